@@ -6,18 +6,100 @@
 */
 
 #include "Env.hpp"
+#include "Val.hpp"
+#include <stdexcept>
+
+#if USE_GC_POINTERS
+static EmptyEnv empty_env;///< never collected, shared by every thread's heap
 
+/**
+* \brief static empty environment object
+*/
+PTR(Env) Env::empty = &empty_env;
+#else
 /**
 * \brief static empty environment object
 */
 PTR(Env) Env::empty = NEW(EmptyEnv)();
+#endif
+
+/**
+* \brief drops env, and if that frees it, frees what it holds with a loop instead of nested destructors.
+    Environments and closures call this for the environments they hold, a release inside the loop only queues
+    the environment, so a long let chain or closures over closures cost heap, not native stack
+* \param env environment to drop
+*/
+void Env::release_chain(PTR(Env) &env) {
+#if !USE_PLAIN_POINTERS && !USE_GC_POINTERS
+    static thread_local std::vector<PTR(Env)> *orphans = nullptr;
+    if ( env == nullptr || env.use_count() > 1 ) {
+        env = nullptr;
+        return;
+    }
+    if ( orphans != nullptr ) {
+        orphans->push_back(std::move(env));
+        return;
+    }
+    std::vector<PTR(Env)> pending;
+    orphans = &pending;
+    pending.push_back(std::move(env));
+    while ( !pending.empty() ) {
+        PTR(Env) e = std::move(pending.back());
+        pending.pop_back();
+        e = nullptr;
+    }
+    orphans = nullptr;
+#endif
+}
+
+/**
+* \brief returns the value associated with the string find_name
+* \param find_name varible to find associated Val
+* \throws std::runtime_error and prints out inteded lookup string if no dictionary binds find_name
+* \return val associated with find_name
+*/
+Value Env::lookup(Symbol find_name) {
+  Value val = find(find_name);
+  if ( val.is_none() ) {
+    throw std::runtime_error("free variable: " + find_name.str());
+  }
+  return val;
+}
+
+/**
+* \brief returns the value at a lexical address, only frames hold addressed values
+* \param depth frames to walk out before reading
+* \param slot index within that frame
+* \throws std::runtime_error always, the expression was not resolved for this environment
+*/
+Value Env::lookup_at(int depth, int slot) {
+  throw std::runtime_error("environment has no frames");
+}
+
+/**
+* \brief stores val at slot of this frame, only frames hold addressed values
+* \param slot index within the frame
+* \param val value to store
+* \throws std::runtime_error always, the expression was not resolved for this environment
+*/
+void Env::bind_at(int slot, const Value &val) {
+  throw std::runtime_error("environment has no frames");
+}
+
+/**
+* \brief marks the objects 'this' points to, the empty environment holds none
+* \param heap heap collecting
+*/
+void Env::trace(GcHeap &heap) const {
+}
 
 /**
 * \brief empty env(dictionary) contain no variable so no lookup can be performed
-* \throws std::runtime_error and prints out inteded lookup string
+* \param find_name unused
+* \return the absent value
 */
-PTR(Val) EmptyEnv::lookup(std::string find_name) {
-  throw std::runtime_error("free variable: " + find_name);
+Value EmptyEnv::find(Symbol find_name) {
+  return Value();
 }
 
 /**
@@ -26,22 +108,157 @@ PTR(Val) EmptyEnv::lookup(std::string find_name) {
 * \param val is the val to be substituted for the variable
 * \param rest is the old environment
 */
-ExtendedEnv::ExtendedEnv(std::string name, PTR(Val) val, PTR(Env) rest) {
+ExtendedEnv::ExtendedEnv(Symbol name, Value val, PTR(Env) rest) {
     this->name = name;
-    this->val = val;
-    this->rest = rest; 
+    this->val = std::move(val);
+    this->rest = std::move(rest);
+}
+
+/**
+* \brief hands rest to Env::release_chain so a long chain is freed without recursion
+*/
+ExtendedEnv::~ExtendedEnv() {
+    Env::release_chain(this->rest);
 }
 
 /**
 * \brief returns the value associated with the string find_name
 * \param find_name varible to find associated Val
-* \return val associated with find_name if in current dictionary if not performs lookup on old environment 'rest'
+* \return val associated with find_name if in current dictionary if not performs find on old environment 'rest',
+    walking a chain of ExtendedEnvs with a loop so a long let chain costs no native stack
 */
-PTR(Val) ExtendedEnv::lookup(std::string find_name) {
-  if ( find_name == name) {
-    return val;
+Value ExtendedEnv::find(Symbol find_name) {
+  ExtendedEnv *env = this;
+  while ( find_name != env->name ) {
+    ExtendedEnv *rest = dynamic_cast<ExtendedEnv*>(RAW(env->rest));
+    if ( rest == nullptr ) {
+      return env->rest->find(find_name);
+    }
+    env = rest;
   }
-  else {
-    return rest->lookup(find_name);
+  return env->val;
+}
+
+/**
+* \brief marks the bound value and the old environment
+* \param heap heap collecting
+*/
+void ExtendedEnv::trace(GcHeap &heap) const {
+    val.trace(heap);
+    heap.mark(RAW(rest));
+}
+
+/**
+* \brief constructor to lay the names out in a table of at least twice as many buckets
+* \param names captured variables in the order their values are kept
+*/
+CaptureSlots::CaptureSlots(std::vector<Symbol> names) : names(std::move(names)) {
+    uint32_t buckets = 1;
+    while ( buckets < 2 * this->names.size() ) {
+        buckets *= 2;
+    }
+    this->mask = buckets - 1;
+    this->table.assign(buckets, 0);
+    for ( size_t i = 0; i < this->names.size(); i++ ) {
+        uint32_t at = bucket(this->names[i]);
+        while ( this->table[at] != 0 ) {
+            at = (at + 1) & this->mask;
+        }
+        this->table[at] = (int)i + 1;
+    }
+}
+
+/**
+* \brief constructor to make a flat dictionary of the values a closure captured
+* \param slots where each captured variable is in vals, shared with the other closures of the function
+* \param vals value of each captured variable in slot order, absent where it was unbound
+*/
+ClosureEnv::ClosureEnv(std::shared_ptr<const CaptureSlots> slots, std::vector<Value> vals) {
+    this->slots = std::move(slots);
+    this->vals = std::move(vals);
+}
+
+/**
+* \brief returns the captured value of find_name from the slot its function's table gives it, no chain to walk
+* \param find_name varible to find associated Val
+* \return val associated with find_name, absent if it was not captured or was unbound
+*/
+Value ClosureEnv::find(Symbol find_name) {
+  int slot = slots->slot_of(find_name);
+  if ( slot < 0 ) {
+    return Value();
+  }
+  return vals[slot];
+}
+
+/**
+* \brief marks the captured values
+* \param heap heap collecting
+*/
+void ClosureEnv::trace(GcHeap &heap) const {
+    for (size_t i = 0; i < vals.size(); i++) {
+        vals[i].trace(heap);
+    }
+}
+
+/**
+* \brief constructor to create a FrameEnv with num_slots unset slots
+* \param num_slots size of the frame
+* \param parent frame one lexical level out, nullptr at the top level
+*/
+FrameEnv::FrameEnv(int num_slots, PTR(Env) parent) : slots(num_slots) {
+    this->parent = std::move(parent);
+}
+
+/**
+* \brief constructor to create a FrameEnv holding slots
+* \param slots values of the frame
+* \param parent frame one lexical level out, nullptr at the top level
+*/
+FrameEnv::FrameEnv(std::vector<Value> slots, PTR(Env) parent) {
+    this->slots = std::move(slots);
+    this->parent = std::move(parent);
+}
+
+/**
+* \brief frames do not keep names, resolved expressions read them by address instead
+* \param find_name unused
+* \return the absent value
+*/
+Value FrameEnv::find(Symbol find_name) {
+  return Value();
+}
+
+/**
+* \brief returns the value at a lexical address
+* \param depth 0 for this frame, 1 for the parent
+* \param slot index within that frame
+* \return val stored at the address
+*/
+Value FrameEnv::lookup_at(int depth, int slot) {
+  if ( depth == 0 ) {
+    return slots[slot];
   }
+  return parent->lookup_at(depth - 1, slot);
+}
+
+/**
+* \brief stores val at slot of this frame
+* \param slot index within the frame
+* \param val value to store
+*/
+void FrameEnv::bind_at(int slot, const Value &val) {
+  slots[slot] = val;
+  GcHeap::written(this, val.raw_boxed());
+}
+
+/**
+* \brief marks the slots and the parent frame
+* \param heap heap collecting
+*/
+void FrameEnv::trace(GcHeap &heap) const {
+    for (size_t i = 0; i < slots.size(); i++) {
+        slots[i].trace(heap);
+    }
+    heap.mark(RAW(parent));
 }
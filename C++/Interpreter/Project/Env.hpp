@@ -6,15 +6,25 @@
 #ifndef Env_hpp
 #define Env_hpp
 #include "pointer.hpp"
+#include "symbol.hpp"
+#include "value.hpp"
 #include <stdio.h>
 #include "string"
+#include <vector>
+#include <memory>
 class Val;
+class GcHeap;
 
-CLASS(Env) {
+HEAP_CLASS(Env) {
     
 public:
     
-virtual PTR(Val) lookup(std::string find_name) = 0;
+Value lookup(Symbol find_name);
+virtual Value find(Symbol find_name) = 0;
+virtual Value lookup_at(int depth, int slot);
+virtual void bind_at(int slot, const Value &val);
+virtual void trace(GcHeap &heap) const;
+static void release_chain(PTR(Env) &env);
 static PTR(Env) empty;///< static environment object
 };//End of Base class
 
@@ -22,7 +32,7 @@ class EmptyEnv : public Env {
     
 public:
     EmptyEnv() = default ;
-    PTR(Val) lookup(std::string find_name);
+    Value find(Symbol find_name);
 }; //End of EmptyEnv class
 
 
@@ -31,14 +41,80 @@ class ExtendedEnv : public Env {
     
 private:
     
-    std::string name;///< name of variable
-    PTR(Val) val;///< value to be substituted
+    Symbol name;///< name of variable
+    Value val;///< value to be substituted
     PTR(Env) rest;///< old environment
     
 public:
-    ExtendedEnv(std::string name, PTR(Val) val, PTR(Env) rest);
-    PTR(Val) lookup(std::string find_name);
+    ExtendedEnv(Symbol name, Value val, PTR(Env) rest);
+    ~ExtendedEnv();
+    Value find(Symbol find_name);
+    void trace(GcHeap &heap) const;
 };//End of ExtendedEnv class
 
 
+/*! \brief slot of each variable a function captures in the values of its closures
+* an open addressed table keyed by symbol id, built once per function and shared by all of its closures,
+* so finding a captured variable is one hash and a compare or two instead of a search
+*/
+class CaptureSlots {
+public:
+    const std::vector<Symbol> names;///< captured variables, slot i holds the value of names[i]
+
+    CaptureSlots(std::vector<Symbol> names);
+
+    /**
+    * \brief slot holding name, -1 if it is not captured
+    */
+    int slot_of(Symbol name) const {
+        for ( uint32_t at = bucket(name); this->table[at] != 0; at = (at + 1) & this->mask ) {
+            int slot = this->table[at] - 1;
+            if ( this->names[slot] == name ) {
+                return slot;
+            }
+        }
+        return -1;
+    }
+
+private:
+    std::vector<int> table;///< slot + 1 of a name hashing to each bucket or one before it, 0 for an empty bucket
+    uint32_t mask;///< buckets - 1, the bucket count is a power of two
+
+    /**
+    * \brief first bucket probed for name
+    */
+    uint32_t bucket(Symbol name) const { return (name.id() * 2654435761u >> 7) & this->mask; }
+};
+
+class ClosureEnv : public Env {
+    
+private:
+    
+    std::shared_ptr<const CaptureSlots> slots;///< where each captured variable is in vals
+    std::vector<Value> vals;///< value of each captured variable, absent where it was unbound
+    
+public:
+    ClosureEnv(std::shared_ptr<const CaptureSlots> slots, std::vector<Value> vals);
+    Value find(Symbol find_name);
+    void trace(GcHeap &heap) const;
+};//End of ClosureEnv class
+
+
+class FrameEnv : public Env {
+    
+private:
+    
+    std::vector<Value> slots;///< values indexed by the slots a Resolver gave out
+    PTR(Env) parent;///< frame one lexical level out, the captured values of a function
+    
+public:
+    FrameEnv(int num_slots, PTR(Env) parent);
+    FrameEnv(std::vector<Value> slots, PTR(Env) parent);
+    Value find(Symbol find_name);
+    Value lookup_at(int depth, int slot);
+    void bind_at(int slot, const Value &val);
+    void trace(GcHeap &heap) const;
+};//End of FrameEnv class
+
+
 #endif /* Env_hpp */
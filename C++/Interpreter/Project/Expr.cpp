@@ -10,11 +10,196 @@
 #include "Expr.hpp"
 #include "Val.hpp"
 #include "Env.hpp"
+#include "vm.hpp"
+#include "cek.hpp"
+#include "resolve.hpp"
+#include "flat.hpp"
+#include "hashcons.hpp"
+#include "traverse.hpp"
+#include "parse.hpp"
+#include <algorithm>
+#include <iterator>
 
 
 
 //**********************EXP CLASS IMPLEMENTATIONS *************************************
 
+/**
+* \brief hash of a node from its kind and up to three fields, children contribute their own hash
+* \param kind kind of the node
+* \param a first field
+* \param b second field
+* \param c third field
+* \return the mixed hash
+*/
+size_t Expr::hash_of(expr_kind_t kind, size_t a, size_t b, size_t c) {
+    uint64_t h = (uint64_t)kind + 0x9e3779b97f4a7c15ull;
+    uint64_t fields[3] = { a, b, c };
+    for (int i = 0; i < 3; i++) {
+        h ^= fields[i] + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        h *= 0xbf58476d1ce4e5b9ull;
+        h ^= h >> 31;
+    }
+    return (size_t)h;
+}
+
+/**
+* \brief hash a child adds to its parent's
+* \param e the child, may be nullptr
+* \return e's hash, 0 for nullptr
+*/
+static size_t child_hash(PTR(Expr) const &e) {
+    return e == nullptr ? 0 : e->hash;
+}
+
+/**
+* \brief set of free variables without the one a binding expression binds
+* \param vars free variables of the binding expression's body
+* \param name variable bound
+* \return vars without name, vars itself when name is not in it
+*/
+FreeVars free_without(FreeVars const &vars, Symbol name) {
+    std::vector<Symbol>::const_iterator at = std::lower_bound(vars->begin(), vars->end(), name);
+    if ( at == vars->end() || *at != name ) {
+        return vars;
+    }
+    std::vector<Symbol> names(vars->begin(), at);
+    names.insert(names.end(), at + 1, vars->end());
+    return std::make_shared<const std::vector<Symbol> >(std::move(names));
+}
+
+//**********************BINDING SCOPES CLASS IMPLEMENTATIONS ***************************
+
+/**
+* \brief constructor to make the scopes of a whole expression, no binder open yet
+*/
+BindingScopes::BindingScopes() : funs(1) {
+    this->funs[0].outer_binders = 0;
+}
+
+/**
+* \brief records a use of name, marking the binder it refers to used and the innermost function free in it
+* \param name variable used
+*/
+void BindingScopes::use(Symbol name) {
+    uint32_t at = name.id() < this->bound_at.size() ? this->bound_at[name.id()] : 0;
+    if ( at != 0 ) {
+        this->binders[at - 1].used = true;
+    }
+    if ( at == 0 || at - 1 < this->funs.back().outer_binders ) {
+        this->funs.back().names.push_back(name);
+    }
+}
+
+/**
+* \brief opens the scope of name, the uses after it refer to it until unbind()
+* \param name variable bound
+*/
+void BindingScopes::bind(Symbol name) {
+    if ( name.id() >= this->bound_at.size() ) {
+        this->bound_at.resize(name.id() + 1, 0);
+    }
+    Binder binder = { name, this->bound_at[name.id()], false };
+    this->binders.push_back(binder);
+    this->bound_at[name.id()] = (uint32_t)this->binders.size();
+}
+
+/**
+* \brief closes the innermost scope bind() opened
+* \return true if a use referred to its variable
+*/
+bool BindingScopes::unbind() {
+    Binder binder = this->binders.back();
+    this->binders.pop_back();
+    this->bound_at[binder.name.id()] = binder.shadowed;
+    return binder.used;
+}
+
+/**
+* \brief opens the scope of a function body, with formal_arg bound in it
+* \param formal_arg variable bound by a call
+*/
+void BindingScopes::open_fun(Symbol formal_arg) {
+    FunScope scope;
+    scope.outer_binders = this->binders.size();
+    this->funs.push_back(std::move(scope));
+    bind(formal_arg);
+}
+
+/**
+* \brief closes the function open_fun() opened, what it takes from outside is used where it is
+* \return variables free in the function
+*/
+FreeVars BindingScopes::close_fun() {
+    unbind();
+    FreeVars names = distinct(this->funs.back().names);
+    this->funs.pop_back();
+    for ( size_t i = 0; i < names->size(); i++ ) {
+        use((*names)[i]);
+    }
+    return names;
+}
+
+/**
+* \brief variables free in the whole expression so far
+*/
+FreeVars BindingScopes::free_names() {
+    FreeVars names = distinct(this->funs[0].names);
+    this->funs[0].names = *names;
+    return names;
+}
+
+/**
+* \brief sorts names by id without the repeats
+* \param names variables, left in no particular order
+* \return the set of them
+*/
+FreeVars BindingScopes::distinct(std::vector<Symbol> &names) {
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    return std::make_shared<const std::vector<Symbol> >(names);
+}
+
+/*! \brief works out the free variables of an expression with BindingScopes, keeping the set of every function
+* in it that had none yet, so a function asked again later or nested in the next one asked is not walked again
+*/
+class FreeVarsVisitor : public ExprVisitor {
+public:
+    BindingScopes scopes;///< binders around the node being walked
+
+    bool enter(Expr *e) {
+        if ( e->kind == expr_var ) {
+            scopes.use(static_cast<VarExpr*>(e)->value);
+            return false;
+        }
+        if ( e->kind == expr_fun ) {
+            FunExpr *fun = static_cast<FunExpr*>(e);
+            if ( fun->free != nullptr ) {
+                FreeVars const &names = fun->free;
+                for ( size_t i = 0; i < names->size(); i++ ) {
+                    scopes.use((*names)[i]);
+                }
+                return false;
+            }
+            scopes.open_fun(fun->formal_arg);
+        }
+        return e->arity() > 0;
+    }
+    void between(Expr *e, int i) {
+        if ( e->kind == expr_let ) {
+            scopes.bind(static_cast<LetExpr*>(e)->lhs);
+        }
+    }
+    void leave(Expr *e) {
+        if ( e->kind == expr_let ) {
+            scopes.unbind();
+        }
+        else if ( e->kind == expr_fun ) {
+            static_cast<FunExpr*>(e)->free = scopes.close_fun();
+        }
+    }
+};
+
 /**
 * \brief prints out string results of print method
 * \returns string result of print method
@@ -34,78 +219,148 @@ std::string Expr:: to_stringPP(){
     this->pretty_print(st);
     return st.str();
 }
-//**********************NUM CLASS IMPLEMENTATIONS **************************************
 
 /**
-* \brief constructor to make a number expression
-* \param val  number value to represented within number expression
+* \brief evaluates 'this' and boxes the result as a Val
+* \param env environment to evaluate in, nullptr for the empty one
+* \return Val object result of the expression
 */
-NumExpr::NumExpr( int val ) {
-    this->val = val;
+PTR(Val) Expr::interp(PTR(Env) const &env) {
+    return evaluate(env).to_val();
 }
 
 /**
-* \brief compares number expression with this
-* \param comp expression to compare against this
-* \return true if param expression is equal to this
+* \brief evaluates 'this' by running interp_step() in a loop, expressions in tail position are handed
+    back through tail and run by the same loop, so calls in tail position do not grow the native stack.
+    Every pass is a safe point, env is rooted and the interp_step() calls below keep their operands rooted
+* \param env environment to evaluate in, nullptr for the empty one
+* \return value of the expression, numbers and booleans unboxed
 */
-bool NumExpr::equals(PTR(Expr) comp) {
+Value Expr::evaluate(PTR(Env) env) {
 
-    PTR(NumExpr) numPtr = CAST(NumExpr)(comp);
-    if ( numPtr == nullptr ) {
-        return false;
+    if(env == nullptr){
+        env = Env::empty;
     }
-    else {
-        return numPtr->val == this->val;
+    GcLocalRoot env_root(env);
+    PTR(Expr) expr = THIS;
+    while (1) {
+        GcHeap::safe_point();
+        PTR(Expr) tail = nullptr;
+        Value result = expr->interp_step(env, tail);
+        if ( tail == nullptr ) {
+            return result;
+        }
+        expr = tail;
     }
 }
 
 /**
-* \brief returns integer value of number expression
-* \param env environment object unused
-* \return Val  object with integer this->val  of number expression
+* \brief collects the variables 'this' uses without binding them
+* \return set of free variable names
+*/
+std::set<Symbol> Expr::free_vars() {
+    FreeVarsVisitor visitor;
+    walk(this, visitor);
+    FreeVars names = visitor.scopes.free_names();
+    return std::set<Symbol>(names->begin(), names->end());
+}
+
+/**
+* \brief whether 'this' uses name without binding it
+* \param name variable to look for
+* \return true if name is free in 'this'
 */
-PTR(Val) NumExpr::interp(PTR(Env) env) {
-    return NEW(NumVal)(this->val);
+bool Expr::has_free(Symbol name) {
+    return free_vars().count(name) > 0;
 }
 
 /**
-* \brief returns this expression
-* \param valToSub unused
-* \param expr unused
-* \return this
+* \brief default continuation of the CEK machine, only reached by expressions that never push one
+* \param cek unused
+* \param kont unused
+* \param val unused
 */
-PTR(Expr) NumExpr::subst(std::string valToSub, PTR(Expr) expr) {
-    return THIS;
+void Expr::resume(Cek &cek, Kont &kont, const Value &val) {
+    throw std::runtime_error("expression has no continuation");
 }
 
+//**********************NUM CLASS IMPLEMENTATIONS **************************************
+
 /**
-* \brief converts num expression to string
-* \param ostream used to convert integer to string
+* \brief constructor to make a number expression
+* \param val  number value to represented within number expression
 */
-void NumExpr::print( std::ostream &ostream){
-    ostream<<std::to_string(val);
+NumExpr::NumExpr( int val ) : Expr(expr_num) {
+    this->val = val;
+    this->hash = hash_of(expr_num, (size_t)(unsigned)val);
 }
 
 /**
-* \brief converts num expression to string
-* \param ostream used to convert integer to string
+* \brief compares the field of comp with this, kind and hash were already found equal
+* \param comp number expression to compare against this
+* \return true if both hold the same number
 */
-void NumExpr::pretty_print( std::ostream  &ostream){
-    ostream<<std::to_string(val);
+bool NumExpr::shallow_equals(Expr *comp) {
+    return static_cast<NumExpr*>(comp)->val == this->val;
 }
 
 /**
-* \brief converts num expression to string
-* \param ostream used to convert integer to string
-* \param  precedence unused
-* \param parentHasParen unused
+* \brief prints 'this'
+* \param ostream output stream
+* \param phase always 0, there are no subexpressions
+*/
+void NumExpr::print_part(std::ostream &ostream, int phase) {
+    ostream << std::to_string(val);
+}
+
+/**
+* \brief pretty prints 'this', the same as print
+* \param ostream output stream
+* \param phase always 0, there are no subexpressions
+* \param frame unused
 * \param caller_pos unused
 */
-void NumExpr::pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos) {
-    ostream<<std::to_string(val);
+void NumExpr::pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos) {
+    ostream << std::to_string(val);
+}
+
+/**
+* \brief returns integer value of number expression
+* \param env environment object unused
+* \param tail unused
+* \return Val  object with integer this->val  of number expression
+*/
+Value NumExpr::interp_step(PTR(Env) &env, PTR(Expr) &tail) {
+    return Value::num(this->val);
+}
+
+/**
+* \brief emits an instruction pushing the number
+* \param compiler compiler of the chunk being built
+* \param phase number of subexpressions compiled so far
+*/
+void NumExpr::compile_part(Compiler &compiler, int phase) {
+    compiler.emit(op_num, this->val);
+}
+
+/**
+* \brief returns the number as a NumVal to the CEK machine
+* \param cek machine evaluating 'this'
+* \param env unused
+*/
+void NumExpr::step(Cek &cek, PTR(Env) const &env) {
+    cek.ret(Value::num(this->val));
 }
 
+/**
+* \brief adds the number to ast
+* \param ast table being built
+* \param children nodes already added for child(0) onwards
+* \return node of 'this'
+*/
+uint32_t NumExpr::flatten(FlatAst &ast, const uint32_t *children) {
+    return ast.num(this->val);
+}
 
 //**********************ADD CLASS IMPLEMENTATIONS **************************************
 
@@ -114,97 +369,152 @@ void NumExpr::pretty_print_at(std::ostream  &ostream, precedence_t precedence, b
 * \param lhs expression of add expression
 * \param rhs expression of add expression
 */
-AddExpr::AddExpr(PTR(Expr) lhs, PTR(Expr) rhs) {
-    this->lhs = lhs;
-    this->rhs = rhs;
+AddExpr::AddExpr(PTR(Expr) lhs, PTR(Expr) rhs) : Expr(expr_add) {
+    this->lhs = std::move(lhs);
+    this->rhs = std::move(rhs);
+    this->hash = hash_of(expr_add, child_hash(this->lhs), child_hash(this->rhs));
 }
 
 /**
-* \brief compares both sides of an add expression to this using recursion
-* \param comp expression to compare against this
-* \return recursive call comparing lhs and rhs. True if expressions are equal false if not.
+* \brief add expressions have no fields besides lhs and rhs
+* \param comp add expression to compare against this
+* \return true, the subexpressions are compared by Expr::equals
 */
-bool AddExpr::equals ( PTR(Expr) comp ) {
+bool AddExpr::shallow_equals(Expr *comp) {
+    return true;
+}
 
-    PTR(AddExpr) addPtr = CAST(AddExpr)(comp);
-    if ( addPtr == nullptr ) {
-        return false;
-    }
-    else {
-        return addPtr->lhs->equals(this->lhs) && addPtr->rhs->equals(this->rhs);
-    }
+/**
+* \brief subexpression i, in the order they are printed
+* \param i index below arity()
+* \return the subexpression
+*/
+PTR(Expr) const &AddExpr::child(int i) const {
+    return i == 0 ? this->lhs : this->rhs;
 }
 
 /**
-* \brief gives add operation result of add expression
-* \param env check if environment is null, if so create an empty environment object 
-* \return Val object by recursive call on lhs and rhs to navigate down to a num expression and adding those two values together
+* \brief builds the same kind of expression over new subexpressions, used by subst
+* \param children replacements for child(0) onwards
+* \return expression from the current ExprFactory
 */
-PTR(Val) AddExpr::interp(PTR(Env) env) {
-    
-    if(env == nullptr){
-        env = Env::empty;
-    }
-    return lhs->interp(env)->add_to(rhs->interp(env));
+PTR(Expr) AddExpr::rebuild(PTR(Expr) const *children) {
+    return ExprFactory::add(children[0], children[1]);
 }
 
 /**
-* \brief function returns new version of this with an expression in place of targeted variable using recursion
-* \param valToSub variable value to substitute expression for
-* \param expr expression to place in this expression valToSub
-* \return recursive call to lhs and rhs to navigate to position of valToSub
+* \brief prints the text before subexpression phase, or after the last one when phase is arity()
+* \param ostream output stream
+* \param phase number of subexpressions printed so far
 */
-PTR(Expr) AddExpr::subst(std::string valToSub, PTR(Expr) expr) {
+void AddExpr::print_part(std::ostream &ostream, int phase) {
+    switch (phase) {
+        case 0:
+            ostream << "(";
+            break;
+        case 1:
+            ostream << "+";
+            break;
+        default:
+            ostream << ")";
+    }
+}
 
-    return NEW(AddExpr)(this->lhs->subst(valToSub,expr), this->rhs->subst(valToSub,expr)) ;
+/**
+* \brief pretty prints the text before subexpression phase and picks the precedence it is printed at,
+    or closes 'this' when phase is arity()
+* \param ostream output stream
+* \param phase number of subexpressions printed so far
+* \param frame precedence and indentation of 'this'
+* \param caller_pos position the indentation of keywords is measured from
+*/
+void AddExpr::pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos) {
+    switch (phase) {
+        case 0:
+            if ( frame.precedence > prec_add ) {
+                ostream << "(";
+            }
+            frame.child_precedence = static_cast<precedence_t>(prec_add + 1);
+            break;
+        case 1:
+            ostream << " + ";
+            frame.child_precedence = prec_none;
+            break;
+        default:
+            if ( frame.precedence > prec_add ) {
+                ostream << ")";
+            }
+    }
 }
 
 /**
-* \brief converts both sides of an add expression to string using recursion to narrow down until var or num encountered
- * surrounds whole expression in parenthesis, no space between expressions and prefix
-* \param ostream used to convert add expression to string
+* \brief hands lhs and rhs to release_child so a long chain is freed without recursion
 */
-void AddExpr::print( std::ostream &ostream){
-
-    ostream << "(";
-    this->lhs->print(ostream);
-    ostream<< "+";
-    this->rhs->print(ostream);
-    ostream<< ")";
+AddExpr::~AddExpr() {
+    release_child(this->lhs);
+    release_child(this->rhs);
 }
 
 /**
-* \brief driver function for recursion call that takes in ostream
-* \param ostream used to convert add expression  to string
+* \brief gives add operation result of add expression
+* \param env environment to evaluate lhs and rhs in
+* \param tail unused
+* \return Val object by recursive call on lhs and rhs to navigate down to a num expression and adding those two values together
 */
-void AddExpr::pretty_print( std::ostream  &ostream){
-    std::streampos pos = 0;
+Value AddExpr::interp_step(PTR(Env) &env, PTR(Expr) &tail) {
+    
+    Value lhs_val = lhs->evaluate(env);
+    GcLocalRoot lhs_root(lhs_val);
+    return lhs_val.add_to(rhs->evaluate(env));
+}
 
-    pretty_print_at(ostream, prec_add, false, pos);
+/**
+* \brief emits the add instruction once lhs and rhs are compiled, the same order interp evaluates them
+* \param compiler compiler of the chunk being built
+* \param phase number of subexpressions compiled so far
+*/
+void AddExpr::compile_part(Compiler &compiler, int phase) {
+    if ( phase == 2 ) {
+        compiler.emit(op_add);
+    }
 }
 
 /**
-* \brief converts both sides of an add expression to string using recursion to narrow down until var or num encountered
- * places parenthesis to adhere to association to the right and our precedence scale
-* \param ostream used to convert add expression  to string
-* \param precedence precedence of the caller, will be prec_add
-* \param parentHasParen boolean signifying if parent caller is surrounded by parenthesis
-* \param caller_pos streampos reference to position of caller
+* \brief evaluates lhs on the CEK machine, resume() takes it from there
+* \param cek machine evaluating 'this'
+* \param env environment to evaluate 'this' in
 */
-void AddExpr::pretty_print_at(std::ostream &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos) {
+void AddExpr::step(Cek &cek, PTR(Env) const &env) {
+    cek.push(THIS, 0, env);
+    cek.eval(this->lhs, env);
+}
 
-    if(precedence > prec_add){
-        ostream << "(";
+/**
+* \brief evaluates rhs once lhs is ready, then adds the two values
+* \param cek machine evaluating 'this'
+* \param kont continuation pushed by step
+* \param val value of the part named by kont.phase
+*/
+void AddExpr::resume(Cek &cek, Kont &kont, const Value &val) {
+    if ( kont.phase == 0 ) {
+        cek.push(THIS, 1, kont.env, val);
+        cek.eval(this->rhs, kont.env);
     }
-    this->lhs->pretty_print_at(ostream, static_cast<precedence_t>(prec_add + 1), parentHasParen, caller_pos);
-    ostream<< " + ";
-    this->rhs->pretty_print_at(ostream, prec_none, parentHasParen, caller_pos);
-
-    if(precedence > prec_add){
-        ostream << ")";
+    else {
+        cek.ret(kont.val.add_to(val));
     }
 }
 
+/**
+* \brief adds the add over its sides to ast
+* \param ast table being built
+* \param children nodes already added for child(0) onwards
+* \return node of 'this'
+*/
+uint32_t AddExpr::flatten(FlatAst &ast, const uint32_t *children) {
+    return ast.add(children[0], children[1]);
+}
+
 //**********************MULT CLASS IMPLEMENTATIONS *************************************
 
 /**
@@ -212,297 +522,403 @@ void AddExpr::pretty_print_at(std::ostream &ostream, precedence_t precedence, bo
 * \param lhs expression of multiplication expression
 * \param rhs expression of multiplication expression
 */
-MultExpr::MultExpr( PTR(Expr) lhs, PTR(Expr) rhs ) {
-    this->lhs = lhs;
-    this->rhs = rhs;
+MultExpr::MultExpr( PTR(Expr) lhs, PTR(Expr) rhs ) : Expr(expr_mult) {
+    this->lhs = std::move(lhs);
+    this->rhs = std::move(rhs);
+    this->hash = hash_of(expr_mult, child_hash(this->lhs), child_hash(this->rhs));
 }
 
 /**
-* \brief compares both sides of an multiplication expression to this using recursion
-* \param comp expression to compare against this
-* \return recursive call comparing lhs and rhs. True if expressions are equal false if not.
+* \brief multiplication expressions have no fields besides lhs and rhs
+* \param comp multiplication expression to compare against this
+* \return true, the subexpressions are compared by Expr::equals
 */
-bool MultExpr::equals(PTR(Expr) comp) {
-    PTR(MultExpr) multPtr = CAST(MultExpr)(comp);
-    if ( multPtr == nullptr ) {
-        return false;
-    }
-    else {
-        return multPtr->lhs->equals(this->lhs) && multPtr->rhs->equals(this->rhs);
-    }
+bool MultExpr::shallow_equals(Expr *comp) {
+    return true;
 }
 
 /**
-* \brief gives multiplication operation result of multiplication expression
-* \param env check if environment is null, if so create an empty environment object
-* \return Val object by recursive call on lhs and rhs to navigate down to a num expression and mutliplying those two values together
+* \brief subexpression i, in the order they are printed
+* \param i index below arity()
+* \return the subexpression
 */
-PTR(Val) MultExpr::interp(PTR(Env) env) {
-    
-    if(env == nullptr){
-        env = Env::empty;
-    }
-    return lhs->interp(env)->mult_with(rhs->interp(env));
+PTR(Expr) const &MultExpr::child(int i) const {
+    return i == 0 ? this->lhs : this->rhs;
 }
 
 /**
-* \brief function returns new version of this with an expression in place of targeted variable using recursion
-* \param valToSub variable value to substitute expression for
-* \param expr expression to place in this expression valToSub
-* \return recursive call to lhs and rhs to navigate to position of valToSub
+* \brief builds the same kind of expression over new subexpressions, used by subst
+* \param children replacements for child(0) onwards
+* \return expression from the current ExprFactory
 */
-PTR(Expr) MultExpr::subst(std::string valToSub, PTR(Expr) expr) {
-
-    return NEW(MultExpr)(this->lhs->subst(valToSub,expr), this->rhs->subst(valToSub,expr)) ;
+PTR(Expr) MultExpr::rebuild(PTR(Expr) const *children) {
+    return ExprFactory::mult(children[0], children[1]);
 }
 
 /**
-* \brief converts both sides of an multiplication expression to string using recursion to narrow down until var or num encountered
- * surrounds whole expression in parenthesis, no space between expressions and prefix
-* \param ostream used to convert multiplication expression to string
+* \brief prints the text before subexpression phase, or after the last one when phase is arity()
+* \param ostream output stream
+* \param phase number of subexpressions printed so far
 */
-void MultExpr::print( std::ostream &ostream){
-    ostream << "(";
-    this->lhs->print(ostream);
-    ostream<< "*";
-    this->rhs->print(ostream);
-    ostream<< ")";
+void MultExpr::print_part(std::ostream &ostream, int phase) {
+    switch (phase) {
+        case 0:
+            ostream << "(";
+            break;
+        case 1:
+            ostream << "*";
+            break;
+        default:
+            ostream << ")";
+    }
 }
 
 /**
-* \brief driver function for recursion call that takes in ostream
-* \param ostream used to convert mult expression  to string
-*/
-void MultExpr::pretty_print( std::ostream  &ostream){
-    std::streampos pos = 0;
-
-    pretty_print_at(ostream, prec_mult, false, pos );
+* \brief pretty prints the text before subexpression phase and picks the precedence it is printed at,
+    or closes 'this' when phase is arity()
+* \param ostream output stream
+* \param phase number of subexpressions printed so far
+* \param frame precedence and indentation of 'this'
+* \param caller_pos position the indentation of keywords is measured from
+*/
+void MultExpr::pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos) {
+    switch (phase) {
+        case 0:
+            if ( frame.precedence > prec_mult ) {
+                frame.parentHasParen = true;
+                frame.child_paren = true;
+                ostream << "(";
+            }
+            frame.child_precedence = static_cast<precedence_t>(prec_mult + 1);
+            break;
+        case 1:
+            ostream << " * ";
+            frame.child_precedence = prec_mult;
+            break;
+        default:
+            if ( frame.precedence > prec_mult ) {
+                ostream << ")";
+            }
+    }
 }
 
 /**
-* \brief converts both sides of an multiplication expression to string using recursion to narrow down until var or num encountered
- * places parenthesis to adhere to association to the right and our precedence scale
-* \param ostream used to convert multiplication expression  to string
-* \param precedence precedence of the caller, will be prec_mult
-* \param parentHasParen boolean signifying if parent caller is surrounded by parenthesis
-* \param caller_pos streampos reference to position of caller
+* \brief hands lhs and rhs to release_child so a long chain is freed without recursion
 */
-void MultExpr::pretty_print_at(std::ostream &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos) {
+MultExpr::~MultExpr() {
+    release_child(this->lhs);
+    release_child(this->rhs);
+}
 
+/**
+* \brief gives multiplication operation result of multiplication expression
+* \param env environment to evaluate lhs and rhs in
+* \param tail unused
+* \return Val object by recursive call on lhs and rhs to navigate down to a num expression and mutliplying those two values together
+*/
+Value MultExpr::interp_step(PTR(Env) &env, PTR(Expr) &tail) {
+    
+    Value lhs_val = lhs->evaluate(env);
+    GcLocalRoot lhs_root(lhs_val);
+    return lhs_val.mult_with(rhs->evaluate(env));
+}
 
-    if(precedence > prec_mult){
-        parentHasParen = true;
-        ostream << "(";
+/**
+* \brief emits the multiplication instruction once lhs and rhs are compiled
+* \param compiler compiler of the chunk being built
+* \param phase number of subexpressions compiled so far
+*/
+void MultExpr::compile_part(Compiler &compiler, int phase) {
+    if ( phase == 2 ) {
+        compiler.emit(op_mult);
     }
-    this->lhs->pretty_print_at(ostream, static_cast<precedence_t>(prec_mult + 1), parentHasParen, caller_pos);
-    ostream<< " * ";
+}
 
-    this->rhs->pretty_print_at(ostream, prec_mult, parentHasParen, caller_pos);
+/**
+* \brief evaluates lhs on the CEK machine, resume() takes it from there
+* \param cek machine evaluating 'this'
+* \param env environment to evaluate 'this' in
+*/
+void MultExpr::step(Cek &cek, PTR(Env) const &env) {
+    cek.push(THIS, 0, env);
+    cek.eval(this->lhs, env);
+}
 
-    if(precedence > prec_mult){
-        ostream << ")";
+/**
+* \brief evaluates rhs once lhs is ready, then multiplies the two values
+* \param cek machine evaluating 'this'
+* \param kont continuation pushed by step
+* \param val value of the part named by kont.phase
+*/
+void MultExpr::resume(Cek &cek, Kont &kont, const Value &val) {
+    if ( kont.phase == 0 ) {
+        cek.push(THIS, 1, kont.env, val);
+        cek.eval(this->rhs, kont.env);
+    }
+    else {
+        cek.ret(kont.val.mult_with(val));
     }
 }
 
+/**
+* \brief adds the multiplication over its sides to ast
+* \param ast table being built
+* \param children nodes already added for child(0) onwards
+* \return node of 'this'
+*/
+uint32_t MultExpr::flatten(FlatAst &ast, const uint32_t *children) {
+    return ast.mult(children[0], children[1]);
+}
 
 //**********************VARIABLE CLASS IMPLEMENTATIONS *******************************
 
 /**
 * \brief constructor to make a variable expression
-* \param value  string value to represented within variable expression
+* \param value  interned name represented within variable expression
 */
-VarExpr::VarExpr(std::string value) {
+VarExpr::VarExpr(Symbol value) : Expr(expr_var) {
     this->value = value;
+    this->hash = hash_of(expr_var, value.id());
 }
 
 /**
-* \brief compares variable's values for equality
-* \param comp expression to compare against this.
-* \return recursive call comparing lhs and rhs. True if variable's value are equal false if not.
+* \brief compares the field of comp with this, kind and hash were already found equal
+* \param comp variable expression to compare against this
+* \return true if both name the same variable
 */
-bool VarExpr::equals(PTR(Expr) comp) {
-    PTR(VarExpr) varPtr = CAST(VarExpr)(comp);
-    if ( varPtr == nullptr ) {
-        return false;
-    }
-
-    return varPtr->value == this->value;
+bool VarExpr::shallow_equals(Expr *comp) {
+    return static_cast<VarExpr*>(comp)->value == this->value;
 }
 
 /**
-* \brief Val object resutl from lookup 
-* \param env check if environment is null, if so create an empty environment object
-* \return result of looking up variable from 'env' dictionary
+* \brief prints 'this'
+* \param ostream output stream
+* \param phase always 0, there are no subexpressions
 */
-PTR(Val) VarExpr::interp(PTR(Env) env) {
-    
-    if(env == nullptr){
-        env = Env::empty;
-    }
-    return env->lookup(this->value);
+void VarExpr::print_part(std::ostream &ostream, int phase) {
+    ostream << this->value;
 }
 
 /**
-* \brief function returns expression parameter substituted in place of parameter valToSub
-* \param valToSub variable value to substitute expression for
-* \param expr expression to place in this expression valToSub
-* \return this if valToSub is not value withing expression, if it is return new expression with expr in place of valToSub
+* \brief pretty prints 'this', the same as print
+* \param ostream output stream
+* \param phase always 0, there are no subexpressions
+* \param frame unused
+* \param caller_pos unused
 */
-PTR(Expr) VarExpr::subst(std::string valToSub, PTR(Expr) expr) {
-
-    if ( this->value == valToSub ){
-        return expr;
-    }
-    return THIS;
+void VarExpr::pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos) {
+    ostream << this->value;
 }
 
 /**
-* \brief variable expression to string
-* \param ostream used to send out value which is already a string
+* \brief Val object resutl from lookup 
+* \param env dictionary to look the variable up in
+* \param tail unused
+* \return result of looking up variable from 'env' dictionary
 */
-void VarExpr::print( std::ostream &ostream){
-
-    ostream<< this->value;
+Value VarExpr::interp_step(PTR(Env) &env, PTR(Expr) &tail) {
+    
+    return env->lookup(this->value);
+}
 
+/**
+* \brief emits a load of the variable's slot, captured value or free variable error
+* \param compiler compiler of the chunk being built
+* \param phase number of subexpressions compiled so far
+*/
+void VarExpr::compile_part(Compiler &compiler, int phase) {
+    compiler.var(this->value);
 }
 
 /**
-* \brief variable expression to string
-* \param ostream used to send out value which is already a string
+* \brief returns the value bound to the variable to the CEK machine
+* \param cek machine evaluating 'this'
+* \param env environment to evaluate 'this' in
 */
-void VarExpr::pretty_print( std::ostream  &ostream){
-    ostream<< this->value;
+void VarExpr::step(Cek &cek, PTR(Env) const &env) {
+    cek.ret(env->lookup(this->value));
 }
 
 /**
-* \brief variable expression to string
-* \param ostream used to send out value which is already a string
-* \param  precedence unused
-* \param parentHasParen unused
-* \param caller_pos unused
+* \brief adds the variable to ast
+* \param ast table being built
+* \param children nodes already added for child(0) onwards
+* \return node of 'this'
 */
-void VarExpr::pretty_print_at(std::ostream &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos) {
-    ostream<< this->value;
+uint32_t VarExpr::flatten(FlatAst &ast, const uint32_t *children) {
+    return ast.var(this->value);
 }
 
 //**********************LET CLASS IMPLEMENTATIONS ***********************************
 
 /**
 * \brief constructor to make a let expression
-* \param var string variable to be replaced in the body
+* \param var interned variable to be replaced in the body
 * \param replacement expression to be swapped for var in the exprToSub
 * \param exprToSub expression containing var to be substituted by replacement
 */
-LetExpr::LetExpr(std::string var, PTR(Expr) replacement, PTR(Expr) exprToSub) {
+LetExpr::LetExpr(Symbol var, PTR(Expr) replacement, PTR(Expr) exprToSub) : Expr(expr_let) {
 
     this->lhs = var;
-    this->rhs = replacement;
-    this->body = exprToSub;
+    this->rhs = std::move(replacement);
+    this->body = std::move(exprToSub);
+    this->hash = hash_of(expr_let, var.id(), child_hash(this->rhs), child_hash(this->body));
 }
 
 /**
-* \brief compares all fields of a let expression to this using recursion
-* \param comp expression to compare against this
-* \return recursive call comparing rhs and body. True if expressions are equal false if not.
+* \brief compares the variables bound
+* \param comp let expression to compare against this
+* \return true if the fields other than the subexpressions match
 */
-bool LetExpr::equals(PTR(Expr) comp) {
-    PTR(LetExpr) letPtr = CAST(LetExpr)(comp);
-    if ( letPtr == nullptr ) {
-        return false;
-    }
-    else {
-        return letPtr->lhs == this->lhs  && letPtr->rhs->equals(this->rhs) && letPtr->body->equals(this->body);
-    }
+bool LetExpr::shallow_equals(Expr *comp) {
+    return static_cast<LetExpr*>(comp)->lhs == this->lhs;
+}
 
+/**
+* \brief subexpression i, in the order they are printed
+* \param i index below arity()
+* \return the subexpression
+*/
+PTR(Expr) const &LetExpr::child(int i) const {
+    return i == 0 ? this->rhs : this->body;
 }
 
 /**
-* \brief gives let expression result of body expression after substitution of rhs
-* \param env check if environment is null, if so create an empty environment object
-* \return Val object result of let expression by recursive call on  rhs and body to navigate down to a num expression
- *Checks env dictionary for binded lhs and substitutes that variable in the body *
+* \brief the body is left alone when the let binds valToSub itself
+* \param i 0 for rhs, 1 for body
+* \param valToSub variable being substituted
+* \return true if child(i) is substituted
 */
-PTR(Val) LetExpr::interp(PTR(Env) env) {
-    
-    if(env == nullptr){
-        env = Env::empty;
-    }
+bool LetExpr::substitutes(int i, Symbol valToSub) {
+    return i == 0 || this->lhs != valToSub;
+}
 
-        PTR(Val) rhs_val = rhs->interp(env);
-        PTR(Env) new_env = NEW(ExtendedEnv)(lhs, rhs_val, env);
-        return body->interp(new_env);
+/**
+* \brief builds the same kind of expression over new subexpressions, used by subst
+* \param children replacements for child(0) onwards
+* \return expression from the current ExprFactory
+*/
+PTR(Expr) LetExpr::rebuild(PTR(Expr) const *children) {
+    return ExprFactory::let(this->lhs, children[0], children[1]);
 }
 
 /**
-* \brief function returns new version of this with an expression in place of targeted variable using recursion
-* \param valToSub variable value to substitute expression for
-* \param expr expression to place in this expression valToSub
-* \return new expression from body after substitution.  If lhs equals valToSub recursion call only on rhs, else call on rhs and body
+* \brief prints the text before subexpression phase, or after the last one when phase is arity()
+* \param ostream output stream
+* \param phase number of subexpressions printed so far
 */
-PTR(Expr) LetExpr::subst(std::string valToSub, PTR(Expr) expr) {
+void LetExpr::print_part(std::ostream &ostream, int phase) {
+    switch (phase) {
+        case 0:
+            ostream << "(_let " << this->lhs << "=";
+            break;
+        case 1:
+            ostream << " _in ";
+            break;
+        default:
+            ostream << ")";
+    }
+}
 
-    if ( valToSub == this->lhs ){
-        return NEW(LetExpr)(this->lhs, this->rhs->subst(valToSub, expr), this->body);
+/**
+* \brief pretty prints the text before subexpression phase and picks the precedence it is printed at,
+    or closes 'this' when phase is arity()
+* \param ostream output stream
+* \param phase number of subexpressions printed so far
+* \param frame precedence and indentation of 'this'
+* \param caller_pos position the indentation of keywords is measured from
+*/
+void LetExpr::pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos) {
+    switch (phase) {
+        case 0:
+            if ( !frame.parentHasParen && frame.precedence != prec_none ) {
+                ostream << "(";
+            }
+            frame.kw_pos = std::string( ostream.tellp() - caller_pos, ' ' );
+            ostream << "_let " << this->lhs << " = ";
+            frame.child_precedence = prec_none;
+            break;
+        case 1:
+            ostream << "\n";
+            caller_pos = ostream.tellp();
+            ostream << frame.kw_pos << "_in  ";
+            break;
+        default:
+            if ( !frame.parentHasParen && frame.precedence != prec_none ) {
+                ostream << ")";
+            }
     }
-    return NEW(LetExpr)(this->lhs, this->rhs->subst(valToSub, expr), this->body->subst(valToSub, expr));
 }
 
 /**
-* \brief converts let expression to string using recursion to narrow down until var or num encountered
- * surrounds whole expression in parenthesis, no space between expressions and prefixes
-* \param ostream used to convert let expression to string
+* \brief hands rhs and body to release_child so a long chain is freed without recursion
 */
-void LetExpr::print( std::ostream &ostream){
-
-    ostream << "(_let ";
-    ostream << this->lhs;
-    ostream << "=";
-    this->rhs->print(ostream);
-    ostream<< " _in ";
-    this->body->print(ostream);
-    ostream<< ")";
+LetExpr::~LetExpr() {
+    release_child(this->rhs);
+    release_child(this->body);
 }
 
 /**
-* \brief driver function for recursion call that takes in ostream
-* \param ostream used to convert let expression  to string
+* \brief binds lhs to the value of rhs and hands body back as the tail expression
+* \param env environment rhs is evaluated in, replaced by the one body runs in
+* \param tail set to body, run next by Expr::evaluate
+* \return the absent value, the result comes from the tail expression
+ *Checks env dictionary for binded lhs and substitutes that variable in the body *
 */
-void LetExpr::pretty_print( std::ostream  &ostream){
+Value LetExpr::interp_step(PTR(Env) &env, PTR(Expr) &tail) {
 
-    std::streampos pos = 0;
-    pretty_print_at(ostream, prec_none, false, pos);
+        Value rhs_val = rhs->evaluate(env);
+        env = NEW(ExtendedEnv)(lhs, rhs_val, env);
+        tail = body;
+        return Value();
 }
 
 /**
-* \brief converts let expression to string using recursion to narrow down until var or num encountered
- * places parenthesis to adhere to association to the right and our precedence scale
-* \param ostream used to convert let expression  to string
-* \param precedence precedence of the caller, will be prec_none
-* \param parentHasParen boolean signifying if parent caller is surrounded by parenthesis
-* \param caller_pos streampos reference to position of caller
+* \brief stores rhs in a fresh slot for lhs before body, so lhs is visible in body only, and ends the
+    binding after body
+* \param compiler compiler of the chunk being built
+* \param phase number of subexpressions compiled so far
 */
-void LetExpr::pretty_print_at(std::ostream & ostream, precedence_t precedence, bool parentHasParen, std::streampos & caller_pos ) {
-
-    if(!parentHasParen && precedence != prec_none){
-        ostream << "(";
+void LetExpr::compile_part(Compiler &compiler, int phase) {
+    switch (phase) {
+        case 1:
+            compiler.emit(op_store, compiler.bind(this->lhs));
+            break;
+        case 2:
+            compiler.unbind();
+            break;
     }
+}
 
-    std::streampos initial_pos = ostream.tellp();
-    std::string kw_pos = std::string( initial_pos - caller_pos, ' ' );
-
-    ostream << "_let "<< this->lhs<< " = ";
-    this->rhs->pretty_print_at(ostream, prec_none, parentHasParen, caller_pos);
-    ostream<< "\n";
-    caller_pos = ostream.tellp();
-
-    ostream << kw_pos << "_in  ";
+/**
+* \brief evaluates rhs on the CEK machine, resume() takes it from there
+* \param cek machine evaluating 'this'
+* \param env environment to evaluate 'this' in
+*/
+void LetExpr::step(Cek &cek, PTR(Env) const &env) {
+    cek.push(THIS, 0, env);
+    cek.eval(this->rhs, env);
+}
 
-    this->body->pretty_print_at(ostream, prec_none, parentHasParen, caller_pos);
-    if(!parentHasParen && precedence != prec_none){
-        ostream << ")";
-    }
+/**
+* \brief binds lhs to the value of rhs and makes body the next step
+* \param cek machine evaluating 'this'
+* \param kont continuation pushed by step
+* \param val value of the part named by kont.phase
+*/
+void LetExpr::resume(Cek &cek, Kont &kont, const Value &val) {
+    cek.eval(this->body, NEW(ExtendedEnv)(this->lhs, val, kont.env));
 }
 
+/**
+* \brief adds the let over its rhs and body to ast
+* \param ast table being built
+* \param children nodes already added for child(0) onwards
+* \return node of 'this'
+*/
+uint32_t LetExpr::flatten(FlatAst &ast, const uint32_t *children) {
+    return ast.let(this->lhs, children[0], children[1]);
+}
 
 //********************** IFEXPR CLASS IMPLEMENTATIONS ***********************************
 
@@ -512,204 +928,274 @@ void LetExpr::pretty_print_at(std::ostream & ostream, precedence_t precedence, b
 * \param then_part if test_part condition is true use this expression
 * \param else_part if test_part condition is false use this expression
 */
-IfExpr::IfExpr( PTR(Expr) test_part, PTR(Expr) then_part, PTR(Expr) else_part ){
+IfExpr::IfExpr( PTR(Expr) test_part, PTR(Expr) then_part, PTR(Expr) else_part ) : Expr(expr_if) {
 
-    this->test_part = test_part;
-    this->then_part = then_part;
-    this->else_part = else_part;
+    this->test_part = std::move(test_part);
+    this->then_part = std::move(then_part);
+    this->else_part = std::move(else_part);
+    this->hash = hash_of(expr_if, child_hash(this->test_part), child_hash(this->then_part), child_hash(this->else_part));
 }
 
 /**
-* \brief compares all fields of an if expression to 'this' using recursion
-* \param comp expression to compare against this
-* \return recursive call comparing each field of if expression. True if expressions are equal false if not.
+* \brief if expressions have no fields besides their three parts
+* \param comp if expression to compare against this
+* \return true, the subexpressions are compared by Expr::equals
 */
-bool IfExpr::equals(PTR(Expr)comp){
-
-    PTR(IfExpr) ifPtr = CAST(IfExpr)(comp);
-    if ( ifPtr == nullptr ) {
-        return false;
-    }
-
-    return ifPtr->test_part->equals(this->test_part) && ifPtr->then_part->equals(this->then_part) && ifPtr-> else_part->equals(this->else_part);
+bool IfExpr::shallow_equals(Expr *comp) {
+    return true;
 }
 
 /**
-* \brief gives result of expression determined by test_part conditional expression
-* \param env check if environment is null, if so create an empty environment object
-* \return Val object result of expression by recursive call interping expression until navigating to VarExpr or NumExpr
+* \brief subexpression i, in the order they are printed
+* \param i index below arity()
+* \return the subexpression
 */
-PTR(Val) IfExpr::interp(PTR(Env) env) {
-
-    if (test_part->interp(env)->is_true())
-        return then_part->interp(env);
-
-    else
-    {
-        return else_part->interp(env);
+PTR(Expr) const &IfExpr::child(int i) const {
+    switch (i) {
+        case 0:
+            return this->test_part;
+        case 1:
+            return this->then_part;
+        default:
+            return this->else_part;
     }
 }
 
 /**
-* \brief function returns expression parameter substituted in place of parameter valToSub
-* \param valToSub variable value to substitute expression for
-* \param expr expression to place in this expression valToSub
-* \return this if valToSub is not value withing expression, if it is return new expression with expr in place of valToSub
+* \brief builds the same kind of expression over new subexpressions, used by subst
+* \param children replacements for child(0) onwards
+* \return expression from the current ExprFactory
 */
-PTR(Expr) IfExpr::subst( std::string valToSub, PTR(Expr) expr ) {
-
-    return NEW(IfExpr)(this->test_part->subst(valToSub, expr), this->then_part->subst(valToSub,expr), this->else_part->subst(valToSub, expr)) ;
+PTR(Expr) IfExpr::rebuild(PTR(Expr) const *children) {
+    return ExprFactory::cond(children[0], children[1], children[2]);
 }
 
 /**
-* \brief converts if expression to string using recursion to narrow down until var or num encountered
- * surrounds whole expression in parenthesis, no space between expressions and prefixes
-* \param ostream used to convert if expression to string
+* \brief prints the text before subexpression phase, or after the last one when phase is arity()
+* \param ostream output stream
+* \param phase number of subexpressions printed so far
 */
-void IfExpr::print( std::ostream &ostream) {
+void IfExpr::print_part(std::ostream &ostream, int phase) {
+    switch (phase) {
+        case 0:
+            ostream << "(_if ";
+            break;
+        case 1:
+            ostream << " _then ";
+            break;
+        case 2:
+            ostream << " _else ";
+            break;
+        default:
+            ostream << ")";
+    }
+}
 
-    ostream << "(_if ";
-    this->test_part->print(ostream);
-    ostream << " _then ";
-    this->then_part->print(ostream);
-    ostream << " _else ";
-    this->else_part->print(ostream);
-    ostream << ")";
+/**
+* \brief pretty prints the text before subexpression phase and picks the precedence it is printed at,
+    or closes 'this' when phase is arity()
+* \param ostream output stream
+* \param phase number of subexpressions printed so far
+* \param frame precedence and indentation of 'this'
+* \param caller_pos position the indentation of keywords is measured from
+*/
+void IfExpr::pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos) {
+    switch (phase) {
+        case 0:
+            if ( frame.precedence > prec_none ) {
+                ostream << "(";
+            }
+            frame.kw_pos = std::string( ostream.tellp() - caller_pos, ' ' );
+            ostream << "_if   ";
+            frame.child_precedence = prec_none;
+            break;
+        case 1:
+            ostream << "\n";
+            caller_pos = ostream.tellp();
+            ostream << frame.kw_pos << "_then ";
+            break;
+        case 2:
+            ostream << "\n";
+            caller_pos = ostream.tellp();
+            ostream << frame.kw_pos << "_else ";
+            break;
+        default:
+            if ( frame.precedence > prec_none ) {
+                ostream << ")";
+            }
+    }
 }
 
 /**
-* \brief driver function for recursion call that takes in ostream
-* \param ostream used to convert if expression  to string
+* \brief hands the three parts to release_child so a long chain is freed without recursion
 */
-void IfExpr::pretty_print( std::ostream  &ostream) {
-    std::streampos pos = 0;
-    pretty_print_at(ostream, prec_none, false, pos);
+IfExpr::~IfExpr() {
+    release_child(this->test_part);
+    release_child(this->then_part);
+    release_child(this->else_part);
 }
 
 /**
-* \brief converts let expression to string using recursion to narrow down until var or num encountered
- * places parenthesis to adhere to association to the right and our precedence scale
-* \param ostream used to convert let expression  to string
-* \param precedence precedence of the caller, will be prec_none
-* \param parentHasParen boolean signifying if parent caller is surrounded by parenthesis
-* \param caller_pos streampos reference to position of caller
+* \brief picks then_part or else_part with test_part and hands it back as the tail expression
+* \param env environment to evaluate in
+* \param tail set to the chosen branch, run next by Expr::evaluate
+* \return the absent value, the result comes from the tail expression
 */
-void IfExpr::pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos) {
-
-    if(precedence > prec_none) {
-        ostream << "(";
-    }
-
-    std::streampos initial_pos = ostream.tellp();
-    std::string kw_pos = std::string( initial_pos - caller_pos, ' ' );
-
-    ostream << "_if   ";
-    this->test_part->pretty_print_at(ostream, prec_none, parentHasParen, caller_pos);
-    ostream << "\n";
-
-    caller_pos = ostream.tellp();
-
-    ostream << kw_pos << "_then ";
-    this->then_part->pretty_print_at(ostream, prec_none, parentHasParen, caller_pos);
-    ostream << "\n";
+Value IfExpr::interp_step(PTR(Env) &env, PTR(Expr) &tail) {
 
-    caller_pos = ostream.tellp();
+    if (test_part->evaluate(env).is_true())
+        tail = then_part;
 
-    ostream << kw_pos << "_else ";
-    this->else_part->pretty_print_at(ostream, prec_none, parentHasParen, caller_pos);
-
-    if(precedence > prec_none){
-        ostream << ")";
+    else
+    {
+        tail = else_part;
+    }
+    return Value();
+}
+
+/**
+* \brief emits the jumps around then_part and else_part, each is patched once the code it skips is compiled
+* \param compiler compiler of the chunk being built
+* \param phase number of subexpressions compiled so far
+*/
+void IfExpr::compile_part(Compiler &compiler, int phase) {
+    switch (phase) {
+        case 1:
+            compiler.push_jump(compiler.emit(op_jump_if_false));
+            break;
+        case 2: {
+            int to_else = compiler.pop_jump();
+            compiler.push_jump(compiler.emit(op_jump));
+            compiler.patch(to_else);
+            break;
+        }
+        case 3:
+            compiler.patch(compiler.pop_jump());
+            break;
     }
 }
 
-//********************** BOOLEXPR CLASS IMPLEMENTATIONS *********************************
-
 /**
-* \brief constructor to make an if expression
-* \param boolean bool variable to determine type of bool expression
+* \brief evaluates test_part on the CEK machine, resume() takes it from there
+* \param cek machine evaluating 'this'
+* \param env environment to evaluate 'this' in
 */
-BoolExpr::BoolExpr(bool boolean) {
-    this->boolean = boolean;
+void IfExpr::step(Cek &cek, PTR(Env) const &env) {
+    cek.push(THIS, 0, env);
+    cek.eval(this->test_part, env);
 }
 
 /**
-* \brief compares all fields of an if expression to 'this' using recursion
-* \param comp expression to compare against this
-* \return true if boolean values equate to same condition on both expression objects
+* \brief makes then_part or else_part the next step depending on the value of test_part
+* \param cek machine evaluating 'this'
+* \param kont continuation pushed by step
+* \param val value of the part named by kont.phase
 */
-bool BoolExpr::equals(PTR(Expr)comp) {
-    PTR(BoolExpr) boolPtr = CAST(BoolExpr)(comp);
-    if ( boolPtr == nullptr ) {
-        return false;
+void IfExpr::resume(Cek &cek, Kont &kont, const Value &val) {
+    if ( val.is_true() ) {
+        cek.eval(this->then_part, kont.env);
+    }
+    else {
+        cek.eval(this->else_part, kont.env);
     }
-    return boolPtr->boolean == this->boolean;
-
 }
 
 /**
-* \brief gives back a BoolVal object with member bool
-* \param env check if environment is null, if so create an empty environment object
-* \return BoolVal object result of expression
+* \brief adds the if over its three parts to ast
+* \param ast table being built
+* \param children nodes already added for child(0) onwards
+* \return node of 'this'
 */
-PTR(Val) BoolExpr::interp(PTR(Env) env) {
-    return NEW(BoolVal)(this->boolean);
+uint32_t IfExpr::flatten(FlatAst &ast, const uint32_t *children) {
+    return ast.cond(children[0], children[1], children[2]);
 }
 
+//********************** BOOLEXPR CLASS IMPLEMENTATIONS *********************************
+
 /**
-* \brief function returns expression parameter substituted in place of parameter valToSub
-* \param valToSub variable value to substitute expression for
-* \param expr expression to place in this expression valToSub
-* \return this if valToSub is not value withing expression, if it is return new expression with expr in place of valToSub
+* \brief constructor to make an if expression
+* \param boolean bool variable to determine type of bool expression
 */
-PTR(Expr) BoolExpr::subst( std::string valToSub, PTR(Expr) expr ) {
-    return THIS;
+BoolExpr::BoolExpr(bool boolean) : Expr(expr_bool) {
+    this->boolean = boolean;
+    this->hash = hash_of(expr_bool, boolean ? 1 : 0);
 }
 
 /**
-* \brief converts bool expression to string, prints out '_true' or 'false' depending upon boolean condition
-* \param ostream used to convert bool expression to string
+* \brief compares the field of comp with this, kind and hash were already found equal
+* \param comp boolean expression to compare against this
+* \return true if both hold the same boolean
 */
-void BoolExpr::print( std::ostream &ostream) {
+bool BoolExpr::shallow_equals(Expr *comp) {
+    return static_cast<BoolExpr*>(comp)->boolean == this->boolean;
+}
 
+/**
+* \brief prints 'this'
+* \param ostream output stream
+* \param phase always 0, there are no subexpressions
+*/
+void BoolExpr::print_part(std::ostream &ostream, int phase) {
     if (boolean) {
-        ostream<< "_true";
+        ostream << "_true";
     }
     else {
-        ostream<< "_false";
+        ostream << "_false";
     }
 }
 
 /**
-* \brief same as print function above
-* \param ostream used to convert bool expression  to string
+* \brief pretty prints 'this', the same as print
+* \param ostream output stream
+* \param phase always 0, there are no subexpressions
+* \param frame unused
+* \param caller_pos unused
 */
-void BoolExpr::pretty_print( std::ostream  &ostream) {
-
-
+void BoolExpr::pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos) {
     if (boolean) {
-        ostream<< "_true"; //turnary operator
+        ostream << "_true";
     }
     else {
-        ostream<< "_false";
+        ostream << "_false";
     }
 }
 
 /**
-* \brief same as print function above
-* \param ostream unused
-* \param precedence unused
-* \param parentHasParen unused
-* \param caller_pos unused
+* \brief gives back a BoolVal object with member bool
+* \param env unused
+* \param tail unused
+* \return BoolVal object result of expression
 */
-void BoolExpr::pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos) {
+Value BoolExpr::interp_step(PTR(Env) &env, PTR(Expr) &tail) {
+    return Value::boolean(this->boolean);
+}
 
-    if (boolean) {
-        ostream<< "_true";
-    }
-    else {
-        ostream<< "_false";
-    }
+/**
+* \brief emits an instruction pushing the boolean
+* \param compiler compiler of the chunk being built
+* \param phase number of subexpressions compiled so far
+*/
+void BoolExpr::compile_part(Compiler &compiler, int phase) {
+    compiler.emit(op_bool, this->boolean);
+}
+
+/**
+* \brief returns the boolean as a BoolVal to the CEK machine
+* \param cek machine evaluating 'this'
+* \param env unused
+*/
+void BoolExpr::step(Cek &cek, PTR(Env) const &env) {
+    cek.ret(Value::boolean(this->boolean));
+}
+
+/**
+* \brief adds the boolean to ast
+* \param ast table being built
+* \param children nodes already added for child(0) onwards
+* \return node of 'this'
+*/
+uint32_t BoolExpr::flatten(FlatAst &ast, const uint32_t *children) {
+    return ast.boolean(this->boolean);
 }
 
 //********************** EQEXPR CLASS IMPLEMENTATIONS ***********************************
@@ -719,197 +1205,389 @@ void BoolExpr::pretty_print_at(std::ostream  &ostream, precedence_t precedence,
 * \param lhs left hand side of equality expression
 * \param rhs right hand side of equality expression
 */
-EqExpr::EqExpr( PTR(Expr) lhs, PTR(Expr) rhs ) {
-    this->lhs = lhs;
-    this->rhs = rhs;
+EqExpr::EqExpr( PTR(Expr) lhs, PTR(Expr) rhs ) : Expr(expr_eq) {
+    this->lhs = std::move(lhs);
+    this->rhs = std::move(rhs);
+    this->hash = hash_of(expr_eq, child_hash(this->lhs), child_hash(this->rhs));
 }
 
 /**
-* \brief compares all fields of an equality expression to 'this' using recursion
-* \param comp expression to compare against this
-* \return recursive call comparing each field of equality expression. True if expressions are equal false if not.
+* \brief equality expressions have no fields besides lhs and rhs
+* \param comp equality expression to compare against this
+* \return true, the subexpressions are compared by Expr::equals
 */
-bool EqExpr::equals(PTR(Expr) comp) {
-
-    PTR(EqExpr) eqPtr = CAST(EqExpr)(comp);
-    if ( eqPtr == nullptr ) {
-        return false;
-    }
-    return eqPtr->lhs->equals(this->lhs) && eqPtr->rhs->equals(this->rhs);
+bool EqExpr::shallow_equals(Expr *comp) {
+    return true;
 }
 
 /**
-* \brief gives result of expression determined by test_part conditional expression
-* \param env check if environment is null, if so create an empty environment object
-* \return Val object result of expression by recursive call interping expression until navigating to VarExpr or NumExpr
+* \brief subexpression i, in the order they are printed
+* \param i index below arity()
+* \return the subexpression
 */
-PTR(Val) EqExpr::interp(PTR(Env) env) {
-    return NEW(BoolVal)(this->lhs->interp(env)->equals(this->rhs->interp(env)));
+PTR(Expr) const &EqExpr::child(int i) const {
+    return i == 0 ? this->lhs : this->rhs;
 }
 
-
 /**
-* \brief function returns expression parameter substituted in place of parameter valToSub
-* \param valToSub variable value to substitute expression for
-* \param expr expression to place in this expression valToSub
-* \return this if valToSub is not value withing expression, if it is return new expression with expr in place of valToSub
+* \brief builds the same kind of expression over new subexpressions, used by subst
+* \param children replacements for child(0) onwards
+* \return expression from the current ExprFactory
 */
-PTR(Expr) EqExpr::subst( std::string valToSub, PTR(Expr) expr ) {
-    return NEW(EqExpr)(this->lhs->subst(valToSub, expr), this->rhs->subst(valToSub, expr));
+PTR(Expr) EqExpr::rebuild(PTR(Expr) const *children) {
+    return ExprFactory::eq(children[0], children[1]);
 }
 
 /**
-* \brief converts equality expression to string using recursion to narrow down until var or num encountered
- * surrounds whole expression in parenthesis, no space between expressions and prefixes
-* \param ostream used to convert equality expression to string
+* \brief prints the text before subexpression phase, or after the last one when phase is arity()
+* \param ostream output stream
+* \param phase number of subexpressions printed so far
 */
-void EqExpr::print( std::ostream &ostream) {
-    ostream << "(";
-    this->lhs->print(ostream);
-    ostream << "==";
-    this->rhs->print(ostream);
-    ostream << ")";
+void EqExpr::print_part(std::ostream &ostream, int phase) {
+    switch (phase) {
+        case 0:
+            ostream << "(";
+            break;
+        case 1:
+            ostream << "==";
+            break;
+        default:
+            ostream << ")";
+    }
+}
 
+/**
+* \brief pretty prints the text before subexpression phase and picks the precedence it is printed at,
+    or closes 'this' when phase is arity()
+* \param ostream output stream
+* \param phase number of subexpressions printed so far
+* \param frame precedence and indentation of 'this'
+* \param caller_pos position the indentation of keywords is measured from
+*/
+void EqExpr::pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos) {
+    switch (phase) {
+        case 0:
+            if ( frame.precedence > prec_none ) {
+                ostream << "(";
+            }
+            frame.child_precedence = static_cast<precedence_t>(prec_none + 1);
+            break;
+        case 1:
+            ostream << " == ";
+            frame.child_precedence = prec_none;
+            break;
+        default:
+            if ( frame.precedence > prec_none ) {
+                ostream << ")";
+            }
+    }
 }
 
 /**
-* \brief driver function for recursion call that takes in ostream
-* \param ostream used to convert equality expression  to string
+* \brief hands lhs and rhs to release_child so a long chain is freed without recursion
 */
-void EqExpr::pretty_print( std::ostream  &ostream) {
-
-    std::streampos pos = 0;
-    pretty_print_at(ostream, prec_none, false, pos);
-
+EqExpr::~EqExpr() {
+    release_child(this->lhs);
+    release_child(this->rhs);
 }
 
 /**
-* \brief converts equality expression to string using recursion to narrow down until var or num encountered
- * places parenthesis to adhere to association to the right and our precedence scale
-* \param ostream used to convert function expression  to string
-* \param precedence precedence of the caller, will be prec_none
-* \param parentHasParen boolean signifying if parent caller is surrounded by parenthesis
-* \param caller_pos streampos reference to position of caller
+* \brief gives result of comparing the values of lhs and rhs
+* \param env environment to evaluate lhs and rhs in
+* \param tail unused
+* \return Val object result of expression by recursive call interping expression until navigating to VarExpr or NumExpr
 */
-void EqExpr::pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos) {
+Value EqExpr::interp_step(PTR(Env) &env, PTR(Expr) &tail) {
+    Value lhs_val = this->lhs->evaluate(env);
+    GcLocalRoot lhs_root(lhs_val);
+    return Value::boolean(lhs_val.equals(this->rhs->evaluate(env)));
+}
 
-    if(precedence > prec_none){
-        ostream << "(";
+
+/**
+* \brief emits the equality instruction once lhs and rhs are compiled
+* \param compiler compiler of the chunk being built
+* \param phase number of subexpressions compiled so far
+*/
+void EqExpr::compile_part(Compiler &compiler, int phase) {
+    if ( phase == 2 ) {
+        compiler.emit(op_eq);
     }
+}
 
-    this->lhs->pretty_print_at(ostream, static_cast<precedence_t >(prec_none + 1), parentHasParen, caller_pos);
-    ostream << " == ";
-    this->rhs->pretty_print_at(ostream, prec_none, parentHasParen, caller_pos);
+/**
+* \brief evaluates lhs on the CEK machine, resume() takes it from there
+* \param cek machine evaluating 'this'
+* \param env environment to evaluate 'this' in
+*/
+void EqExpr::step(Cek &cek, PTR(Env) const &env) {
+    cek.push(THIS, 0, env);
+    cek.eval(this->lhs, env);
+}
 
-    if(precedence > prec_none){
-        ostream << ")";
+/**
+* \brief evaluates rhs once lhs is ready, then compares the two values
+* \param cek machine evaluating 'this'
+* \param kont continuation pushed by step
+* \param val value of the part named by kont.phase
+*/
+void EqExpr::resume(Cek &cek, Kont &kont, const Value &val) {
+    if ( kont.phase == 0 ) {
+        cek.push(THIS, 1, kont.env, val);
+        cek.eval(this->rhs, kont.env);
+    }
+    else {
+        cek.ret(Value::boolean(kont.val.equals(val)));
     }
 }
 
+/**
+* \brief adds the comparison over its sides to ast
+* \param ast table being built
+* \param children nodes already added for child(0) onwards
+* \return node of 'this'
+*/
+uint32_t EqExpr::flatten(FlatAst &ast, const uint32_t *children) {
+    return ast.eq(children[0], children[1]);
+}
+
 //********************** FUNEXPR CLASS IMPLEMENTATIONS ***********************************
 
 /**
 * \brief constructor to make an Function expression
 * \param formal_arg varible in body to be substituted
 * \param body exprssion containing formal_arg
+* \param free_names variables free in the function when the caller already knows them, else worked out when
+    first needed
 */
-FunExpr::FunExpr( std::string formal_arg, PTR(Expr) body ){
+FunExpr::FunExpr( Symbol formal_arg, PTR(Expr) body, FreeVars free_names ) : Expr(expr_fun) {
     this->formal_arg = std::move(formal_arg); //todo may need to change
-    this->body = body;
+    this->body = std::move(body);
+    this->hash = hash_of(expr_fun, this->formal_arg.id(), child_hash(this->body));
+    this->free = std::move(free_names);
+    if ( this->free != nullptr ) {
+        make_slots();
+    }
 }
 
 /**
-* \brief compares all fields of an function expression to 'this' using recursion
-* \param comp expression to compare against this
-* \return recursive call comparing each field of function expression. True if expressions are equal false if not.
+* \brief constructor to make a function whose body was only pre-parsed, it is parsed from its span the first
+    time anything needs it
+* \param formal_arg varible in body to be substituted
+* \param lazy where the body is in the source
+* \param body_hash hash the body will have, worked out by the pre-parse
+* \param body_free free variables of the body, worked out by the pre-parse
 */
-bool FunExpr::equals(PTR(Expr)comp){
+FunExpr::FunExpr( Symbol formal_arg, std::shared_ptr<const LazyBody> lazy, size_t body_hash, FreeVars body_free )
+    : Expr(expr_fun) {
+    this->formal_arg = std::move(formal_arg);
+    this->body = nullptr;
+    this->lazy = std::move(lazy);
+    this->hash = hash_of(expr_fun, this->formal_arg.id(), body_hash);
+    this->free = free_without(body_free, this->formal_arg);
+    make_slots();
+}
 
-    PTR(FunExpr) funPtr = CAST(FunExpr)(comp);
-    if ( funPtr == nullptr ) {
-        return false;
+/**
+* \brief the body, built by build_body() the first time it is asked for
+* \return body of the function
+*/
+PTR(Expr) const &FunExpr::body_expr() const {
+    if ( this->body == nullptr ) {
+        this->body = build_body();
     }
-    else {
-        return funPtr->formal_arg == this->formal_arg  && funPtr->body->equals(this->body);
+    return this->body;
+}
+
+/**
+* \brief variables free in the function, worked out by walking the body the first time they are asked for
+* \return the set, sorted by id
+*/
+FreeVars const &FunExpr::free_names() const {
+    if ( this->free == nullptr ) {
+        FreeVarsVisitor visitor;
+        walk(const_cast<FunExpr*>(this), visitor);
     }
+    return this->free;
 }
 
 /**
-* \brief converts to a FunVal expresion with same fields including passed through environment
-* \param env dictionary
-* \return FunVal object
+* \brief parses the span of a pre-parsed body, with functions in it pre-parsed in turn
+* \return the body, nullptr if 'this' has neither body nor span
 */
-PTR(Val) FunExpr::interp(PTR(Env) env){
-    
-    return NEW(FunVal)(formal_arg, body, env);
+PTR(Expr) FunExpr::build_body() const {
+    return this->lazy == nullptr ? nullptr : parse_lazy_body(*this->lazy);
+}
+
+/**
+* \brief compares the formal arguments
+* \param comp function expression to compare against this
+* \return true if the fields other than the subexpressions match
+*/
+bool FunExpr::shallow_equals(Expr *comp) {
+    return static_cast<FunExpr*>(comp)->formal_arg == this->formal_arg;
 }
 
+/**
+* \brief subexpression i, in the order they are printed
+* \param i index below arity()
+* \return the subexpression
+*/
+PTR(Expr) const &FunExpr::child(int i) const {
+    return body_expr();
+}
 
 /**
-* \brief function returns expression parameter substituted in place of parameter valToSub
-* \param valToSub variable value to substitute expression for
-* \param expr expression to place in this expression valToSub
-* \return this if valToSub is not value withing expression, if it is return new expression with expr in place of valToSub
+* \brief the body is left alone when formal_arg is valToSub
+* \param i always 0, the body
+* \param valToSub variable being substituted
+* \return true if the body is substituted
 */
-PTR(Expr) FunExpr::subst( std::string valToSub, PTR(Expr) expr ){
+bool FunExpr::substitutes(int i, Symbol valToSub) {
+    return this->formal_arg != valToSub;
+}
 
-    if ( valToSub == this->formal_arg) {
-        return THIS;
-    }
-    return NEW(FunExpr)(this->formal_arg, this->body->subst(valToSub, expr));
+/**
+* \brief builds the same kind of expression over new subexpressions, used by subst
+* \param children replacements for child(0) onwards
+* \return expression from the current ExprFactory
+*/
+PTR(Expr) FunExpr::rebuild(PTR(Expr) const *children) {
+    return ExprFactory::fun(this->formal_arg, children[0]);
 }
 
 /**
-* \brief converts function expression to string using recursion to narrow down until var or num encountered
- * surrounds whole expression in parenthesis, no space between expressions and prefixes
-* \param ostream used to convert function expression to string
+* \brief prints the text before subexpression phase, or after the last one when phase is arity()
+* \param ostream output stream
+* \param phase number of subexpressions printed so far
 */
-void FunExpr::print( std::ostream &ostream){
+void FunExpr::print_part(std::ostream &ostream, int phase) {
+    switch (phase) {
+        case 0:
+            ostream << "(_fun (" << this->formal_arg << ") ";
+            break;
+        default:
+            ostream << ")";
+    }
+}
 
-    ostream << "(_fun (" << this->formal_arg << ") ";
-    this->body->print(ostream);
-    ostream << ")";
+/**
+* \brief pretty prints the text before subexpression phase and picks the precedence it is printed at,
+    or closes 'this' when phase is arity()
+* \param ostream output stream
+* \param phase number of subexpressions printed so far
+* \param frame precedence and indentation of 'this'
+* \param caller_pos position the indentation of keywords is measured from
+*/
+void FunExpr::pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos) {
+    switch (phase) {
+        case 0:
+            if ( frame.precedence > prec_none ) {
+                ostream << "(";
+            }
+            frame.kw_pos = std::string( ostream.tellp() - caller_pos, ' ' );
+            ostream << "_fun (" << this->formal_arg << ")";
+            ostream << "\n";
+            caller_pos = ostream.tellp();
+            ostream << frame.kw_pos << "  ";
+            frame.child_precedence = prec_none;
+            break;
+        default:
+            if ( frame.precedence > prec_none ) {
+                ostream << ")";
+            }
+    }
 }
 
 /**
-* \brief driver function for recursion call that takes in ostream
-* \param ostream used to convert function expression  to string
+* \brief hands the body to release_child so a long chain is freed without recursion
 */
-void FunExpr::pretty_print( std::ostream  &ostream){
-    std::streampos initialPos = 0;
-    pretty_print_at(ostream, prec_none, false, initialPos);
+FunExpr::~FunExpr() {
+    release_child(this->body);
 }
 
 /**
-* \brief converts function expression to string using recursion to narrow down until var or num encountered
- * places parenthesis to adhere to association to the right and our precedence scale
-* \param ostream used to convert function expression  to string
-* \param precedence precedence of the caller, will be prec_none
-* \param parentHasParen boolean signifying if parent caller is surrounded by parenthesis
-* \param caller_pos streampos reference to position of caller
+* \brief converts to a FunVal expresion with same fields and the values it captures from the environment
+* \param env dictionary
+* \param tail unused
+* \return FunVal object
 */
-void FunExpr::pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos){
-    
+Value FunExpr::interp_step(PTR(Env) &env, PTR(Expr) &tail){
     
-    if ( precedence > prec_none ) {
-        ostream << "(";
+    return Value::function(closure(env));
+}
+
+
+/**
+* \brief makes the FunVal of 'this' in env, a pre-parsed body is left for the FunVal to build on its first call
+* \param env environment the function is made in
+* \return FunVal holding the values it captures from env
+*/
+PTR(Val) FunExpr::closure(PTR(Env) const &env) {
+    if ( this->body == nullptr ) {
+        return NEW(FunVal)(this->formal_arg, nullptr, capture(env), THIS);
     }
-    
-    std::streampos initial_pos = ostream.tellp();
-    std::string kw_pos = std::string( initial_pos - caller_pos, ' ' );
-    
-    
-    ostream << "_fun (" << this->formal_arg << ")";
-    ostream << "\n";
-    
-    caller_pos = ostream.tellp();
-    ostream << kw_pos << "  ";
-    
-    this->body->pretty_print_at(ostream, prec_none, parentHasParen, caller_pos );
+    return NEW(FunVal)(this->formal_arg, this->body, capture(env));
+}
 
-    if ( precedence > prec_none ) {
-        ostream << ")";
+/**
+* \brief lays the free variables out in the slot table every closure of 'this' shares. The parser knows them
+    when it makes the node, so parsed functions get their table here and not from the first capture()
+*/
+void FunExpr::make_slots() const {
+    FreeVars const &names = free_names();
+    this->slots = std::make_shared<const CaptureSlots>(std::vector<Symbol>(names->begin(), names->end()));
+}
+
+/**
+* \brief copies the values of the function's free variables out of env into a flat dictionary, so the FunVal keeps only what its body can reach
+* \param env environment the function is made in
+* \return ClosureEnv holding the captured values
+*/
+PTR(Env) FunExpr::capture(PTR(Env) const &env) {
+    if ( this->slots == nullptr ) {
+        make_slots();
     }
+    const std::vector<Symbol> &names = this->slots->names;
+    std::vector<Value> vals;
+    vals.reserve(names.size());
+    for ( size_t i = 0; i < names.size(); i++ ) {
+        vals.push_back(env->find(names[i]));
+    }
+    return NEW(ClosureEnv)(this->slots, std::move(vals));
+}
+
+/**
+* \brief opens a new chunk for the body, then closes it and emits the closure instruction
+* \param compiler compiler of the chunk being built
+* \param phase number of subexpressions compiled so far
+*/
+void FunExpr::compile_part(Compiler &compiler, int phase) {
+    if ( phase == 0 ) {
+        compiler.open_fun(this->formal_arg, body_expr());
+    }
+    else {
+        compiler.close_fun();
+    }
+}
+
+/**
+* \brief returns a FunVal holding the values it captures from env to the CEK machine
+* \param cek machine evaluating 'this'
+* \param env environment to evaluate 'this' in
+*/
+void FunExpr::step(Cek &cek, PTR(Env) const &env) {
+    cek.ret(Value::function(closure(env)));
+}
+
+/**
+* \brief adds the function over its body to ast
+* \param ast table being built
+* \param children nodes already added for child(0) onwards
+* \return node of 'this'
+*/
+uint32_t FunExpr::flatten(FlatAst &ast, const uint32_t *children) {
+    return ast.fun(this->formal_arg, children[0]);
 }
 
 //********************** CALLEXPR CLASS IMPLEMENTATIONS ***********************************
@@ -919,87 +1597,138 @@ void FunExpr::pretty_print_at(std::ostream  &ostream, precedence_t precedence, b
 * \param to_be_called expression to containing value to be subbed will be a function expression
 * \param actual_arg expression to substitute with in to_be_called expression
 */
-CallExpr::CallExpr( PTR(Expr) to_be_called, PTR(Expr) actual_arg ) {
+CallExpr::CallExpr( PTR(Expr) to_be_called, PTR(Expr) actual_arg ) : Expr(expr_call) {
 
-    this->to_be_called = to_be_called;
-    this->actual_arg = actual_arg;
+    this->to_be_called = std::move(to_be_called);
+    this->actual_arg = std::move(actual_arg);
+    this->hash = hash_of(expr_call, child_hash(this->to_be_called), child_hash(this->actual_arg));
 }
 
 /**
-* \brief compares all fields of an call expression to 'this' using recursion
-* \param comp expression to compare against this
-* \return recursive call comparing each field of call expression. True if expressions are equal false if not.
+* \brief call expressions have no fields besides their two parts
+* \param comp call expression to compare against this
+* \return true, the subexpressions are compared by Expr::equals
 */
-bool CallExpr::equals(PTR(Expr) comp) {
+bool CallExpr::shallow_equals(Expr *comp) {
+    return true;
+}
 
-    PTR(CallExpr) callPtr = CAST(CallExpr)(comp);
-    if ( callPtr == nullptr ) {
-        return false;
-    }
-    else {
-        return callPtr->to_be_called->equals(this->to_be_called)  && callPtr->actual_arg->equals(this->actual_arg);
-    }
+/**
+* \brief subexpression i, in the order they are printed
+* \param i index below arity()
+* \return the subexpression
+*/
+PTR(Expr) const &CallExpr::child(int i) const {
+    return i == 0 ? this->to_be_called : this->actual_arg;
 }
 
 /**
-* \brief gives result of expression determined by test_part conditional expression
-* \param env check if environment is null, if so create an empty environment object
-* \return Val object result of to_be_called expression after substitution of actual_arg
+* \brief builds the same kind of expression over new subexpressions, used by subst
+* \param children replacements for child(0) onwards
+* \return expression from the current ExprFactory
 */
-PTR(Val) CallExpr::interp(PTR(Env) env){
+PTR(Expr) CallExpr::rebuild(PTR(Expr) const *children) {
+    return ExprFactory::call(children[0], children[1]);
+}
 
-    return to_be_called->interp(env)->call(actual_arg->interp(env));
+/**
+* \brief prints the text before subexpression phase, or after the last one when phase is arity()
+* \param ostream output stream
+* \param phase number of subexpressions printed so far
+*/
+void CallExpr::print_part(std::ostream &ostream, int phase) {
+    if ( phase == 1 ) {
+        ostream << " ";
+    }
 }
 
+/**
+* \brief pretty prints the text before subexpression phase and picks the precedence it is printed at,
+    or closes 'this' when phase is arity()
+* \param ostream output stream
+* \param phase number of subexpressions printed so far
+* \param frame precedence and indentation of 'this'
+* \param caller_pos position the indentation of keywords is measured from
+*/
+void CallExpr::pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos) {
+    switch (phase) {
+        case 0:
+            frame.child_precedence = prec_none;
+            break;
+        case 1:
+            ostream << "(";
+            break;
+        default:
+            ostream << ")";
+    }
+}
 
 /**
-* \brief function returns expression parameter substituted in place of parameter valToSub
-* \param valToSub variable value to substitute expression for
-* \param expr expression to place in this expression valToSub
-* \return this if valToSub is not value withing expression, if it is return new expression with expr in place of valToSub
+* \brief hands to_be_called and actual_arg to release_child so a long chain is freed without recursion
 */
-PTR(Expr) CallExpr::subst( std::string valToSub, PTR(Expr) expr ){
-
-    return NEW(CallExpr)(this->to_be_called->subst(valToSub,expr), this->actual_arg->subst(valToSub,expr)) ;
+CallExpr::~CallExpr() {
+    release_child(this->to_be_called);
+    release_child(this->actual_arg);
 }
 
 /**
-* \brief converts call expression to string using recursion to narrow down until var or num encountered
- * surrounds whole expression in parenthesis, no space between expressions and prefixes
-* \param ostream used to convert call expression to string
+* \brief evaluates to_be_called and actual_arg, then lets the function hand its body back as the tail
+    expression so a call in tail position reuses the caller's interp loop
+* \param env environment to evaluate in, replaced by the one the body runs in
+* \param tail set to the function body, run next by Expr::evaluate
+* \return the absent value when the body is the tail expression, else the result of the call
 */
-void CallExpr::print( std::ostream &ostream){
+Value CallExpr::interp_step(PTR(Env) &env, PTR(Expr) &tail){
 
-  
-    this->to_be_called->print(ostream);
-    ostream<< " ";
-    this->actual_arg->print(ostream);
+    Value to_call = to_be_called->evaluate(env);
+    GcLocalRoot to_call_root(to_call);
+    return to_call.call_step(actual_arg->evaluate(env), env, tail);
 }
 
+
 /**
-* \brief driver function for recursion call that takes in ostream
-* \param ostream used to convert call expression  to string
+* \brief emits the call instruction once to_be_called and actual_arg are compiled
+* \param compiler compiler of the chunk being built
+* \param phase number of subexpressions compiled so far
 */
-void CallExpr::pretty_print(std::ostream &ostream) {
-    std::streampos initialPos = 0;
-    pretty_print_at(ostream, prec_none, false, initialPos);
+void CallExpr::compile_part(Compiler &compiler, int phase) {
+    if ( phase == 2 ) {
+        compiler.emit(op_call);
+    }
+}
 
+/**
+* \brief evaluates to_be_called on the CEK machine, resume() takes it from there
+* \param cek machine evaluating 'this'
+* \param env environment to evaluate 'this' in
+*/
+void CallExpr::step(Cek &cek, PTR(Env) const &env) {
+    cek.push(THIS, 0, env);
+    cek.eval(this->to_be_called, env);
 }
 
 /**
-* \brief converts call expression to string using recursion to narrow down until var or num encountered
- * places parenthesis to adhere to association to the right and our precedence scale
-* \param ostream used to convert call expression  to string
-* \param precedence precedence of the caller, will be prec_none
-* \param parentHasParen boolean signifying if parent caller is surrounded by parenthesis
-* \param caller_pos streampos reference to position of caller
+* \brief evaluates actual_arg once to_be_called is ready, then applies the function without recursing
+* \param cek machine evaluating 'this'
+* \param kont continuation pushed by step
+* \param val value of the part named by kont.phase
 */
-void CallExpr::pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos){
-    
-       
-    this->to_be_called->pretty_print_at(ostream, prec_none, parentHasParen, caller_pos);
-    ostream<< "(";
-    this->actual_arg->pretty_print_at(ostream, prec_none, parentHasParen, caller_pos);
-    ostream<< ")";
+void CallExpr::resume(Cek &cek, Kont &kont, const Value &val) {
+    if ( kont.phase == 0 ) {
+        cek.push(THIS, 1, kont.env, val);
+        cek.eval(this->actual_arg, kont.env);
+    }
+    else {
+        kont.val.apply(cek, val);
+    }
+}
 
+/**
+* \brief adds the call over its function and argument to ast
+* \param ast table being built
+* \param children nodes already added for child(0) onwards
+* \return node of 'this'
+*/
+uint32_t CallExpr::flatten(FlatAst &ast, const uint32_t *children) {
+    return ast.call(children[0], children[1]);
 }
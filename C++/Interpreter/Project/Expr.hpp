@@ -11,10 +11,22 @@
 #include <iostream>
 #include <stdexcept>
 #include <sstream>
+#include <set>
+#include <vector>
+#include <memory>
 #include "pointer.hpp"
+#include "symbol.hpp"
+#include "value.hpp"
 
 class Val;
 class Env;
+class Compiler;
+class Cek;
+struct Kont;
+class Resolver;
+class FlatAst;
+class CaptureSlots;
+struct PrettyFrame;
 
 
 /*! \brief custom enum to set precendence withing operations
@@ -27,18 +39,125 @@ typedef enum {
     prec_mult = 2
 } precedence_t;
 
+/*! \brief custom enum naming the concrete class of an expression
+* resolved expressions share the kind of the class they extend
+*/
+typedef enum {
+    expr_num,
+    expr_add,
+    expr_mult,
+    expr_var,
+    expr_let,
+    expr_if,
+    expr_bool,
+    expr_eq,
+    expr_fun,
+    expr_call
+} expr_kind_t;
+
+/*! \brief variables free in an expression, sorted by id
+* only functions keep one, for the values their closures capture
+*/
+typedef std::shared_ptr<const std::vector<Symbol> > FreeVars;
+
+FreeVars free_without(FreeVars const &vars, Symbol name);
+
+/*! \brief the binders around the point a parse or a walk has reached, telling which binder each variable
+* refers to without any node holding a set of its free variables. Every open function collects the
+* variables it takes from outside it, the whole expression is the outermost function
+*/
+class BindingScopes {
+public:
+    BindingScopes();
+    void use(Symbol name);
+    void bind(Symbol name);
+    bool unbind();
+    void open_fun(Symbol formal_arg);
+    FreeVars close_fun();
+    FreeVars free_names();
+
+private:
+    /*! \brief a variable bound by an open let body or function */
+    struct Binder {
+        Symbol name;///< the variable
+        uint32_t shadowed;///< bound_at of name before, put back by unbind()
+        bool used;///< whether a use referred to this binder
+    };
+
+    /*! \brief an open function */
+    struct FunScope {
+        size_t outer_binders;///< binders open around the function, a use bound by one of them is free in it
+        std::vector<Symbol> names;///< variables it uses from outside, repeats left for close_fun()
+    };
+
+    std::vector<Binder> binders;///< open binders, innermost last
+    std::vector<uint32_t> bound_at;///< position in binders + 1 of the innermost binder of each symbol id, 0 for none
+    std::vector<FunScope> funs;///< open functions, the whole expression first
+
+    static FreeVars distinct(std::vector<Symbol> &names);
+};
+
+/*! \brief where in the source a function body left unparsed by the parser is */
+struct LazyBody {
+    std::shared_ptr<const std::string> source;///< whole text the function was pre-parsed from
+    size_t begin;///< offset of the first character of the body
+    size_t end;///< offset just past its last character
+};
+
 
 CLASS(Expr) {
 public:
-    virtual bool equals(PTR(Expr) e) = 0;
-    virtual PTR(Val) interp(PTR(Env) env = nullptr) = 0; 
-    virtual PTR(Expr) subst( std::string valToSub, PTR(Expr) expr ) = 0;
-    virtual void print( std::ostream &ostream) = 0;
-    virtual void pretty_print( std::ostream  &ostream) = 0;
+    const expr_kind_t kind;///< concrete class, compared instead of a dynamic cast
+    uint32_t table;///< id of the ExprFactory 'this' is interned in, 0 for none
+    size_t hash;///< structural hash, set by the constructor from the children's
+
+    Expr(expr_kind_t kind) : kind(kind), table(0), hash(0) { }
+    static size_t hash_of(expr_kind_t kind, size_t a, size_t b = 0, size_t c = 0);
+
+    /**
+    * \brief whether comparing the addresses alone settles equals against e,
+        true when e is 'this' or both are interned in the same table
+    * \param e expression of the same kind and hash
+    */
+    bool identity_decides(const Expr *e) const { return e == this || (this->table != 0 && e->table == this->table); }
+    bool equals(PTR(Expr) const &e);
+    PTR(Val) interp(PTR(Env) const &env = nullptr);
+    Value evaluate(PTR(Env) env = nullptr);
+    virtual Value interp_step(PTR(Env) &env, PTR(Expr) &tail) = 0;
+    PTR(Expr) subst( Symbol valToSub, PTR(Expr) const &expr );
+    std::set<Symbol> free_vars();
+    bool has_free(Symbol name);
+    void print( std::ostream &ostream);
+    void pretty_print( std::ostream  &ostream);
     std::string to_string();
     std::string to_stringPP();
-    virtual void pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos) = 0;
+    void pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos);
+    virtual void compile_part(Compiler &compiler, int phase) = 0;
+    virtual void step(Cek &cek, PTR(Env) const &env) = 0;
+    virtual void resume(Cek &cek, Kont &kont, const Value &val);
+    virtual uint32_t flatten(FlatAst &ast, const uint32_t *children) = 0;
+
+    /**
+    * \brief number of subexpressions, the children child() hands out
+    */
+    int arity() const {
+        switch (this->kind) {
+            case expr_num: case expr_var: case expr_bool: return 0;
+            case expr_fun: return 1;
+            case expr_if: return 3;
+            default: return 2;
+        }
+    }
+    virtual PTR(Expr) const &child(int i) const;
+    virtual bool shallow_equals(Expr *comp) = 0;
+    virtual bool substitutes(int i, Symbol valToSub);
+    virtual PTR(Expr) rebuild(PTR(Expr) const *children);
+    virtual void print_part(std::ostream &ostream, int phase) = 0;
+    virtual void pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos) = 0;
     virtual ~Expr() { }
+
+protected:
+    static void release_child(PTR(Expr) &child);
 };
 
 class NumExpr : public Expr {
@@ -46,12 +165,13 @@ public:
     int val;///< integer value of num expression
 
     NumExpr(int val);
-    bool equals( PTR(Expr) comp );
-    PTR(Val) interp(PTR(Env) env = nullptr);
-    PTR(Expr) subst( std::string valToSub, PTR(Expr) expr );
-    void print( std::ostream &ostream);
-    void pretty_print( std::ostream  &ostream);
-    void pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos);
+    Value interp_step(PTR(Env) &env, PTR(Expr) &tail);
+    bool shallow_equals(Expr *comp);
+    void print_part(std::ostream &ostream, int phase);
+    void pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos);
+    void compile_part(Compiler &compiler, int phase);
+    void step(Cek &cek, PTR(Env) const &env);
+    uint32_t flatten(FlatAst &ast, const uint32_t *children);
 
 };
 
@@ -61,12 +181,17 @@ public:
     PTR(Expr) rhs;///< expression right hand side of add expression
 
     AddExpr(PTR(Expr) lhs, PTR(Expr) rhs);
-    bool equals( PTR(Expr) comp );
-    PTR(Val) interp(PTR(Env) env = nullptr);
-    PTR(Expr) subst( std::string valToSub, PTR(Expr) expr );
-    void print( std::ostream &ostream);
-    void pretty_print( std::ostream  &ostream);
-    void pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos);
+    Value interp_step(PTR(Env) &env, PTR(Expr) &tail);
+    bool shallow_equals(Expr *comp);
+    void print_part(std::ostream &ostream, int phase);
+    void pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos);
+    PTR(Expr) const &child(int i) const;
+    PTR(Expr) rebuild(PTR(Expr) const *children);
+    ~AddExpr();
+    void compile_part(Compiler &compiler, int phase);
+    void step(Cek &cek, PTR(Env) const &env);
+    uint32_t flatten(FlatAst &ast, const uint32_t *children);
+    void resume(Cek &cek, Kont &kont, const Value &val);
 
 };
 
@@ -77,60 +202,75 @@ public:
     PTR(Expr) rhs;///< expression left hand side of multiplication expression
 
     MultExpr( PTR(Expr) lhs, PTR(Expr) rhs );
-    bool equals( PTR(Expr) comp );
-    PTR(Val) interp(PTR(Env) env = nullptr);
-    PTR(Expr) subst( std::string valToSub, PTR(Expr) expr );
-    void print( std::ostream &ostream);
-    void pretty_print( std::ostream  &ostream);
-    void pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos);
+    Value interp_step(PTR(Env) &env, PTR(Expr) &tail);
+    bool shallow_equals(Expr *comp);
+    void print_part(std::ostream &ostream, int phase);
+    void pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos);
+    PTR(Expr) const &child(int i) const;
+    PTR(Expr) rebuild(PTR(Expr) const *children);
+    ~MultExpr();
+    void compile_part(Compiler &compiler, int phase);
+    void step(Cek &cek, PTR(Env) const &env);
+    uint32_t flatten(FlatAst &ast, const uint32_t *children);
+    void resume(Cek &cek, Kont &kont, const Value &val);
 
 };
 
 class VarExpr : public Expr {
 public:
-    std::string value;///< String value contained in Variable expression
-
-    VarExpr( std::string value);
-    bool equals(PTR(Expr) comp);
-    PTR(Val) interp(PTR(Env) env = nullptr);
-    PTR(Expr) subst( std::string valToSub, PTR(Expr) expr );
-    void print( std::ostream &ostream);
-    void pretty_print( std::ostream  &ostream);
-    void pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos);
+    Symbol value;///< name of the variable
+
+    VarExpr( Symbol value);
+    Value interp_step(PTR(Env) &env, PTR(Expr) &tail);
+    bool shallow_equals(Expr *comp);
+    void print_part(std::ostream &ostream, int phase);
+    void pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos);
+    void compile_part(Compiler &compiler, int phase);
+    void step(Cek &cek, PTR(Env) const &env);
+    uint32_t flatten(FlatAst &ast, const uint32_t *children);
 };
 
 class LetExpr : public Expr {
 public:
-    std::string lhs;///< String value containing the variable to be replaced
+    Symbol lhs;///< variable to be replaced
     PTR(Expr) rhs;///< replacement expression to swap lhs for in the body
     PTR(Expr) body;///< expression containing variable to be swapped by rhs
-    LetExpr(std::string var, PTR(Expr) replacement, PTR(Expr) exprToSub);
-    bool equals(PTR(Expr) comp);
-    PTR(Val) interp(PTR(Env) env = nullptr);
-    PTR(Expr) subst( std::string valToSub, PTR(Expr) expr );
-    void print( std::ostream &ostream);
-    void pretty_print( std::ostream  &ostream);
-    void pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos);
+    LetExpr(Symbol var, PTR(Expr) replacement, PTR(Expr) exprToSub);
+    Value interp_step(PTR(Env) &env, PTR(Expr) &tail);
+    bool shallow_equals(Expr *comp);
+    void print_part(std::ostream &ostream, int phase);
+    void pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos);
+    PTR(Expr) const &child(int i) const;
+    PTR(Expr) rebuild(PTR(Expr) const *children);
+    bool substitutes(int i, Symbol valToSub);
+    ~LetExpr();
+    void compile_part(Compiler &compiler, int phase);
+    void step(Cek &cek, PTR(Env) const &env);
+    uint32_t flatten(FlatAst &ast, const uint32_t *children);
+    void resume(Cek &cek, Kont &kont, const Value &val);
 };
 
 class BoolExpr : public Expr {
 private:
+    friend class ExprFactory;
 
     bool boolean;///< boolean value of bool expression
 
 public:
 
     BoolExpr(bool boolean);
-    bool equals(PTR(Expr) comp);
-    PTR(Val) interp(PTR(Env) env = nullptr);
-    PTR(Expr) subst( std::string valToSub, PTR(Expr) expr );
-    void print( std::ostream &ostream);
-    void pretty_print( std::ostream  &ostream);
-    void pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos);
+    Value interp_step(PTR(Env) &env, PTR(Expr) &tail);
+    bool shallow_equals(Expr *comp);
+    void print_part(std::ostream &ostream, int phase);
+    void pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos);
+    void compile_part(Compiler &compiler, int phase);
+    void step(Cek &cek, PTR(Env) const &env);
+    uint32_t flatten(FlatAst &ast, const uint32_t *children);
 };
 
 class IfExpr : public Expr {
 private:
+    friend class ExprFactory;
 
     PTR(Expr) test_part;///< conditional expression equating to true or false
     PTR(Expr) then_part;///< resulting expression if test_part is true
@@ -139,16 +279,22 @@ private:
 public:
 
     IfExpr( PTR(Expr) test_part, PTR(Expr) then_part, PTR(Expr) else_part );
-    bool equals(PTR(Expr) comp);
-    PTR(Val) interp(PTR(Env) env = nullptr);
-    PTR(Expr) subst( std::string valToSub, PTR(Expr) expr );
-    void print( std::ostream &ostream);
-    void pretty_print( std::ostream  &ostream);
-    void pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos);
+    Value interp_step(PTR(Env) &env, PTR(Expr) &tail);
+    bool shallow_equals(Expr *comp);
+    void print_part(std::ostream &ostream, int phase);
+    void pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos);
+    PTR(Expr) const &child(int i) const;
+    PTR(Expr) rebuild(PTR(Expr) const *children);
+    ~IfExpr();
+    void compile_part(Compiler &compiler, int phase);
+    void step(Cek &cek, PTR(Env) const &env);
+    uint32_t flatten(FlatAst &ast, const uint32_t *children);
+    void resume(Cek &cek, Kont &kont, const Value &val);
 };
 
 class EqExpr : public Expr {
 private:
+    friend class ExprFactory;
 
     PTR(Expr) lhs;///< left hand side of equality expression
     PTR(Expr) rhs;///< right hand side of equality expression
@@ -156,45 +302,80 @@ private:
 public:
 
     EqExpr( PTR(Expr) lhs, PTR(Expr) rhs );
-    bool equals(PTR(Expr) comp);
-    PTR(Val) interp(PTR(Env) env = nullptr);
-    PTR(Expr) subst( std::string valToSub, PTR(Expr) expr );
-    void print( std::ostream &ostream);
-    void pretty_print( std::ostream  &ostream);
-    void pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos);
+    Value interp_step(PTR(Env) &env, PTR(Expr) &tail);
+    bool shallow_equals(Expr *comp);
+    void print_part(std::ostream &ostream, int phase);
+    void pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos);
+    PTR(Expr) const &child(int i) const;
+    PTR(Expr) rebuild(PTR(Expr) const *children);
+    ~EqExpr();
+    void compile_part(Compiler &compiler, int phase);
+    void step(Cek &cek, PTR(Env) const &env);
+    uint32_t flatten(FlatAst &ast, const uint32_t *children);
+    void resume(Cek &cek, Kont &kont, const Value &val);
 };
 
 class FunExpr : public Expr {
-private:
-    
-    std::string formal_arg;///< variable contained in body to be substituted
-    PTR(Expr) body;///< expression containing formal_arg
+protected:
+    friend class ExprFactory;
+    friend class Resolver;
+    friend class FreeVarsVisitor;
     
+    Symbol formal_arg;///< variable contained in body to be substituted
+    mutable PTR(Expr) body;///< expression containing formal_arg, nullptr until body_expr() builds a lazy one
+    mutable FreeVars free;///< variables free in 'this', nullptr until free_names() works them out
+    std::shared_ptr<const LazyBody> lazy;///< span body is parsed from on first use, nullptr if parsed with 'this'
+    mutable std::shared_ptr<const CaptureSlots> slots;///< where closures keep each free variable, see capture()
+
+    virtual PTR(Expr) build_body() const;
+    void make_slots() const;
+
 public:
     
-    FunExpr( std::string formal_arg, PTR(Expr) body );
-    bool equals(PTR(Expr) comp);
-    PTR(Val) interp(PTR(Env) env = nullptr);
-    PTR(Expr) subst( std::string valToSub, PTR(Expr) expr );
-    void print( std::ostream &ostream);
-    void pretty_print( std::ostream  &ostream);
-    void pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos);
+    FunExpr( Symbol formal_arg, PTR(Expr) body, FreeVars free_names = nullptr );
+    FunExpr( Symbol formal_arg, std::shared_ptr<const LazyBody> lazy, size_t body_hash, FreeVars body_free );
+    PTR(Expr) const &body_expr() const;
+    FreeVars const &free_names() const;
+
+    /**
+    * \brief whether the body exists as nodes yet, false for a pre-parsed function nothing has used
+    */
+    bool has_body() const { return this->body != nullptr; }
+    PTR(Env) capture(PTR(Env) const &env);
+    PTR(Val) closure(PTR(Env) const &env);
+    Value interp_step(PTR(Env) &env, PTR(Expr) &tail);
+    bool shallow_equals(Expr *comp);
+    void print_part(std::ostream &ostream, int phase);
+    void pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos);
+    PTR(Expr) const &child(int i) const;
+    PTR(Expr) rebuild(PTR(Expr) const *children);
+    bool substitutes(int i, Symbol valToSub);
+    ~FunExpr();
+    void compile_part(Compiler &compiler, int phase);
+    void step(Cek &cek, PTR(Env) const &env);
+    uint32_t flatten(FlatAst &ast, const uint32_t *children);
 };
 
 class CallExpr : public Expr {
 private:
+    friend class ExprFactory;
     
     PTR(Expr) to_be_called;///< exprssion containing expression to be subbed out. Will be a function expression
     PTR(Expr) actual_arg;///< expression to substitute with for variable expression in to_be_called
     
 public:
     CallExpr( PTR(Expr) to_be_called, PTR(Expr) actual_arg );
-    bool equals(PTR(Expr) comp);
-    PTR(Val) interp(PTR(Env) env = nullptr);
-    PTR(Expr) subst( std::string valToSub, PTR(Expr) expr );
-    void print( std::ostream &ostream);
-    void pretty_print( std::ostream  &ostream);
-    void pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos);
+    Value interp_step(PTR(Env) &env, PTR(Expr) &tail);
+    bool shallow_equals(Expr *comp);
+    void print_part(std::ostream &ostream, int phase);
+    void pretty_print_part(std::ostream &ostream, int phase, PrettyFrame &frame, std::streampos &caller_pos);
+    PTR(Expr) const &child(int i) const;
+    PTR(Expr) rebuild(PTR(Expr) const *children);
+    ~CallExpr();
+    void compile_part(Compiler &compiler, int phase);
+    void step(Cek &cek, PTR(Env) const &env);
+    uint32_t flatten(FlatAst &ast, const uint32_t *children);
+    void resume(Cek &cek, Kont &kont, const Value &val);
 };
 
 #endif //HOMEWORK1SMSDSCRIPT_EXPR_H
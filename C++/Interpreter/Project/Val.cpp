@@ -9,6 +9,7 @@
 #include <utility>
 #include "Expr.hpp"
 #include "Env.hpp"
+#include "cek.hpp"
 
 /**
 * \brief converts Val objects to string and prints
@@ -20,26 +21,61 @@ std::string Val::to_string() {
     return st.str();
 }
 
+/**
+* \brief calls 'this' from CallExpr::interp_step, values without a body to hand back just call()
+* \param actual_arg value to call with
+* \param env unused
+* \param tail unused
+* \return result of call()
+*/
+Value Val::call_step(const Value &actual_arg, PTR(Env) &env, PTR(Expr) &tail) {
+    return Value(this->call(actual_arg.to_val()));
+}
+
+/**
+* \brief calls 'this' from the CEK machine, hands the result of call() straight back
+* \param cek machine to give the result to
+* \param actual_arg value to call with
+*/
+void Val::apply(Cek &cek, const Value &actual_arg) {
+    cek.ret(Value(this->call(actual_arg.to_val())));
+}
+
+/**
+* \brief marks the objects 'this' points to, numbers and booleans hold none
+* \param heap heap collecting
+*/
+void Val::trace(GcHeap &heap) const {
+}
+
 //*****************************NUMVAL CLASS *********************************
 
 /**
 * \brief constructor to make a number val
 * \param val  number value to represented within number val
 */
-NumVal::NumVal(int val) {
+NumVal::NumVal(int val) : Val(val_num) {
     this->val_ = val;
 }
 
+/**
+* \brief number held by 'this'
+* \return integer value of num val
+*/
+int NumVal::to_int() {
+    return this->val_;
+}
+
 /**
 * \brief compares number val with 'this'
 * \param v val to compare against this
 * \return true if param val is equal to this
 */
-bool NumVal::equals(PTR(Val) v){
-    PTR(NumVal) valPtr = CAST(NumVal)(v);
-    if ( valPtr == nullptr ) {
+bool NumVal::equals(PTR(Val) const &v){
+    if ( v == nullptr || v->kind != val_num ) {
         return false;
     }
+    NumVal *valPtr = static_cast<NumVal*>(RAW(v));
     return valPtr->val_ == this->val_;
 }
 
@@ -49,11 +85,11 @@ bool NumVal::equals(PTR(Val) v){
 * \param v Val object to add to
 * \return new Val object result of adding two NumVals.
 */
-PTR(Val) NumVal::add_to(PTR(Val) v){
-    PTR(NumVal) valPtr = CAST(NumVal)(v);
-    if ( valPtr == nullptr ) {
+PTR(Val) NumVal::add_to(PTR(Val) const &v){
+    if ( v == nullptr || v->kind != val_num ) {
         throw std::runtime_error("Trying to add a non-number!");
     }
+    NumVal *valPtr = static_cast<NumVal*>(RAW(v));
     return NEW(NumVal)((unsigned)this->val_ + (unsigned )valPtr->val_);
 }
 
@@ -63,11 +99,11 @@ PTR(Val) NumVal::add_to(PTR(Val) v){
 * \param v Val object to multiply with
 * \return new Val object result of mulitplying two NumVals.
 */
-PTR(Val) NumVal::mult_with(PTR(Val) v){
-    PTR(NumVal) valPtr = CAST(NumVal)(v);
-    if ( valPtr == nullptr ) {
+PTR(Val) NumVal::mult_with(PTR(Val) const &v){
+    if ( v == nullptr || v->kind != val_num ) {
         throw std::runtime_error("Trying to perform multiplication with a non-number!");
     }
+    NumVal *valPtr = static_cast<NumVal*>(RAW(v));
     return NEW(NumVal)((unsigned)this->val_ * (unsigned)valPtr->val_);
 }
 
@@ -98,7 +134,7 @@ bool NumVal::is_true(){
 /**
 * \brief throws runtime_error because call can only be performed on FunVal object
 */
-PTR(Val) NumVal::call(PTR(Val) actual_arg) {
+PTR(Val) NumVal::call(PTR(Val) const &actual_arg) {
     throw std::runtime_error("NumVal cannot call");
 }
 
@@ -108,7 +144,7 @@ PTR(Val) NumVal::call(PTR(Val) actual_arg) {
 * \brief constructor to make a BoolVal object
 * \param boolean val to represented in BoolVal object
 */
-BoolVal::BoolVal(bool boolean) {
+BoolVal::BoolVal(bool boolean) : Val(val_bool) {
     this->boolean = boolean;
 }
 
@@ -125,12 +161,12 @@ PTR(Expr) BoolVal::to_expr() {
 * \param v Val to compare against this
 * \return true if param Val  is equal to this
 */
-bool BoolVal::equals(PTR(Val) v) {
+bool BoolVal::equals(PTR(Val) const &v) {
 
-    PTR(BoolVal) valPtr = CAST(BoolVal)(v);
-    if ( valPtr == nullptr ) {
+    if ( v == nullptr || v->kind != val_bool ) {
         return false;
     }
+    BoolVal *valPtr = static_cast<BoolVal*>(RAW(v));
     return valPtr->boolean == this->boolean;
 
 }
@@ -138,14 +174,14 @@ bool BoolVal::equals(PTR(Val) v) {
 /**
 * \brief throws runtime_error because add_to can only be performed on a NumVal
 */
-PTR(Val) BoolVal::add_to(PTR(Val) v) {
+PTR(Val) BoolVal::add_to(PTR(Val) const &v) {
     throw std::runtime_error("Cannot perform add operation on BoolVal!");
 }
 
 /**
 * \brief throws runtime_error because mult_with can only be performed on a NumVal
 */
-PTR(Val) BoolVal::mult_with(PTR(Val) v) {
+PTR(Val) BoolVal::mult_with(PTR(Val) const &v) {
     throw std::runtime_error("Cannot perform multiplication operation on BoolVal!");
 }
 
@@ -168,7 +204,7 @@ bool BoolVal::is_true() {
 /**
 * \brief throws runtime_error because call can only be performed on FunVal object
 */
-PTR(Val) BoolVal::call(PTR(Val) actual_arg) {
+PTR(Val) BoolVal::call(PTR(Val) const &actual_arg) {
     throw std::runtime_error("BoolVal cannot call");
 }
 
@@ -176,16 +212,25 @@ PTR(Val) BoolVal::call(PTR(Val) actual_arg) {
 
 /**
 * \brief constructor to make a FunVal object
-* \param formal_arg string value to be substituted in body
+* \param formal_arg interned variable to be substituted in body
 * \param body expression containing formall_arg
 * \param env dictionary containing valid replacement for formal_arg
+* \param fun pre-parsed FunExpr whose body is built on the first call, when body is nullptr
 */
-FunVal::FunVal(std::string formal_arg, PTR(Expr) body, PTR(Env) env){
+FunVal::FunVal(Symbol formal_arg, PTR(Expr) body, PTR(Env) env, PTR(Expr) fun) : Val(val_fun) {
 
     this->formal_arg = std::move(formal_arg);
-    this->body = body;
-    this->env = env;
+    this->body = std::move(body);
+    this->env = env != nullptr ? std::move(env) : Env::empty;
+    this->fun = std::move(fun);
+
+}
 
+/**
+* \brief hands env to Env::release_chain so closures over long chains are freed without recursion
+*/
+FunVal::~FunVal() {
+    Env::release_chain(this->env);
 }
 
 /**
@@ -193,7 +238,18 @@ FunVal::FunVal(std::string formal_arg, PTR(Expr) body, PTR(Env) env){
 * \return new FunExpr with same member field as 'this'
 */
 PTR(Expr) FunVal::to_expr(){
-    return NEW(FunExpr)(this->formal_arg, this->body);
+    return NEW(FunExpr)(this->formal_arg, this->body_expr());
+}
+
+/**
+* \brief body of the function as an expression, built from the pre-parsed function the first time it is asked for
+* \return body
+*/
+PTR(Expr) FunVal::body_expr(){
+    if ( this->body == nullptr ) {
+        this->body = static_cast<FunExpr*>(RAW(this->fun))->body_expr();
+    }
+    return this->body;
 }
 
 /**
@@ -201,27 +257,27 @@ PTR(Expr) FunVal::to_expr(){
 * \param v Val to compare against this
 * \return true if param Val is equal to this
 */
-bool FunVal::equals(PTR(Val) v){
+bool FunVal::equals(PTR(Val) const &v){
 
-    PTR(FunVal) funPtr = CAST(FunVal)(v);
-    if ( funPtr == nullptr ) {
+    if ( v == nullptr || v->kind != val_fun ) {
         return false;
     }
-    return funPtr->formal_arg == this->formal_arg && funPtr->body->equals(this->body);
+    FunVal *funPtr = static_cast<FunVal*>(RAW(v));
+    return funPtr->formal_arg == this->formal_arg && funPtr->body_expr()->equals(this->body_expr());
 
 }
 
 /**
 * \brief throws runtime_error because add_to can only be performed on a NumVal
 */
-PTR(Val) FunVal::add_to(PTR(Val) v){
+PTR(Val) FunVal::add_to(PTR(Val) const &v){
     throw std::runtime_error("Cannot perform add operation on FunVal!");
 }
 
 /**
 * \brief throws runtime_error because mult_with can only be performed on a NumVal
 */
-PTR(Val) FunVal::mult_with(PTR(Val) v){
+PTR(Val) FunVal::mult_with(PTR(Val) const &v){
     throw std::runtime_error("Cannot perform multiplication operation on FunVal!");
 }
 
@@ -232,7 +288,7 @@ PTR(Val) FunVal::mult_with(PTR(Val) v){
 void FunVal::print(std::ostream& ostream){
     
     ostream << "[_fun (" << this->formal_arg << ") ";
-    this->body->print(ostream);
+    this->body_expr()->print(ostream);
     ostream << "]";
 }
 
@@ -249,6 +305,47 @@ bool FunVal::is_true() {
 * \param actual_arg Val to substitute in body of FunVal object
 * \return interp result of the body after substitution of actual_arg
 */
-PTR(Val) FunVal::call(PTR(Val) actual_arg) {
-    return body->interp(NEW(ExtendedEnv)(formal_arg, actual_arg, env));
+PTR(Val) FunVal::call(PTR(Val) const &actual_arg) {
+    GcNoCollection native_caller;
+    if ( body == nullptr ) {
+        body_expr();
+    }
+    return body->evaluate(NEW(ExtendedEnv)(formal_arg, Value(actual_arg), env)).to_val();
+}
+
+/**
+* \brief binds formal_arg to actual_arg and hands the body back as the tail expression instead of
+    interping it, the tail call half of call()
+* \param actual_arg value to substitute in body of FunVal object
+* \param env replaced by the environment the body runs in
+* \param tail set to body, run next by Expr::evaluate
+* \return the absent value, the result comes from the tail expression
+*/
+Value FunVal::call_step(const Value &actual_arg, PTR(Env) &env, PTR(Expr) &tail) {
+    if ( body == nullptr ) {
+        body_expr();
+    }
+    env = NEW(ExtendedEnv)(formal_arg, actual_arg, this->env);
+    tail = body;
+    return Value();
+}
+
+/**
+* \brief calls 'this' from the CEK machine by making the body its next step instead of recursing
+* \param cek machine to evaluate the body on
+* \param actual_arg value to substitute in body of FunVal object
+*/
+void FunVal::apply(Cek &cek, const Value &actual_arg) {
+    if ( body == nullptr ) {
+        body_expr();
+    }
+    cek.eval(body, NEW(ExtendedEnv)(formal_arg, actual_arg, env));
+}
+
+/**
+* \brief marks the environment of the closure, the body is not collected
+* \param heap heap collecting
+*/
+void FunVal::trace(GcHeap &heap) const {
+    heap.mark(RAW(this->env));
 }
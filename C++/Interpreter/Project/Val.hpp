@@ -8,22 +8,42 @@
 
 #include <string>
 #include "pointer.hpp"
+#include "symbol.hpp"
+#include "value.hpp"
 
 
 class Expr;
 class Env ;
+class Cek;
+class GcHeap;
 
 
-CLASS(Val) {
+/*! \brief custom enum naming the concrete class of a value
+* every FunVal subclass is val_fun
+*/
+typedef enum {
+    val_num,
+    val_bool,
+    val_fun
+} val_kind_t;
+
+
+HEAP_CLASS(Val) {
 
 public:
+    const val_kind_t kind;///< concrete class, compared instead of a dynamic cast
+
+    Val(val_kind_t kind) : kind(kind) { }
     virtual PTR(Expr) to_expr() = 0;
-    virtual bool equals(PTR(Val) v) = 0;
-    virtual PTR(Val) add_to(PTR(Val) v) = 0;
-    virtual PTR(Val) mult_with(PTR(Val) v) = 0;
+    virtual bool equals(PTR(Val) const &v) = 0;
+    virtual PTR(Val) add_to(PTR(Val) const &v) = 0;
+    virtual PTR(Val) mult_with(PTR(Val) const &v) = 0;
     virtual void print(std::ostream& ostream) = 0;
     virtual bool is_true() = 0;
-    virtual PTR(Val) call(PTR(Val) actual_arg) = 0;
+    virtual PTR(Val) call(PTR(Val) const &actual_arg) = 0;
+    virtual Value call_step(const Value &actual_arg, PTR(Env) &env, PTR(Expr) &tail);
+    virtual void apply(Cek &cek, const Value &actual_arg);
+    virtual void trace(GcHeap &heap) const;
     std::string to_string();
     virtual ~Val() { }
 
@@ -36,13 +56,14 @@ private:
 
 public:
     NumVal(int val);
+    int to_int();
     PTR(Expr) to_expr();
-    bool equals(PTR(Val) v);
-    PTR(Val) add_to(PTR(Val) v);
-    PTR(Val) mult_with(PTR(Val) v);
+    bool equals(PTR(Val) const &v);
+    PTR(Val) add_to(PTR(Val) const &v);
+    PTR(Val) mult_with(PTR(Val) const &v);
     void print(std::ostream& ostream);
     bool is_true();
-    PTR(Val) call(PTR(Val) actual_arg);
+    PTR(Val) call(PTR(Val) const &actual_arg);
 };
 
 class BoolVal : public Val {
@@ -52,29 +73,35 @@ private:
 public:
     BoolVal(bool boolean);
     PTR(Expr) to_expr();
-    bool equals(PTR(Val) v);
-    PTR(Val) add_to(PTR(Val) v);
-    PTR(Val) mult_with(PTR(Val) v);
+    bool equals(PTR(Val) const &v);
+    PTR(Val) add_to(PTR(Val) const &v);
+    PTR(Val) mult_with(PTR(Val) const &v);
     void print(std::ostream& ostream);
     bool is_true();
-    PTR(Val) call(PTR(Val) actual_arg);
+    PTR(Val) call(PTR(Val) const &actual_arg);
 };
 
 class FunVal : public Val {
-private:
-    std::string formal_arg;///< variable to be substituted in body
-    PTR(Expr) body;///< expression containing formal_arg
+protected:
+    Symbol formal_arg;///< variable to be substituted in body
+    PTR(Expr) body;///< expression containing formal_arg, nullptr until body_expr() takes it from fun
     PTR(Env) env;///< dictionary containing expression to be subtituted for formal_arg 
+    PTR(Expr) fun;///< pre-parsed FunExpr the body is built from on the first call while body is nullptr
 
 public:
-    FunVal(std::string formal_arg, PTR(Expr) body, PTR(Env) env = nullptr);
+    FunVal(Symbol formal_arg, PTR(Expr) body, PTR(Env) env = nullptr, PTR(Expr) fun = nullptr);
+    ~FunVal();
     PTR(Expr) to_expr();
-    bool equals(PTR(Val) v);
-    PTR(Val) add_to(PTR(Val) v);
-    PTR(Val) mult_with(PTR(Val) v);
+    virtual PTR(Expr) body_expr();
+    bool equals(PTR(Val) const &v);
+    PTR(Val) add_to(PTR(Val) const &v);
+    PTR(Val) mult_with(PTR(Val) const &v);
     void print(std::ostream& ostream);
     bool is_true();
-    PTR(Val) call(PTR(Val) actual_arg);
+    PTR(Val) call(PTR(Val) const &actual_arg);
+    Value call_step(const Value &actual_arg, PTR(Env) &env, PTR(Expr) &tail);
+    void apply(Cek &cek, const Value &actual_arg);
+    void trace(GcHeap &heap) const;
 };
 
 
@@ -0,0 +1,285 @@
+/**
+* \file batch.cpp
+* \brief contains the batch and file mode implementations
+        runs one mode over a stream of framed expressions in a single process, each expression parsed into
+        its own Program and released before the next, each result or error written back in order.
+        A source of top level expressions without framing is split by a pre-scan and parsed on several threads
+*/
+
+#include "batch.hpp"
+#include "mapped.hpp"
+#include <ctype.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+/**
+* \brief reads the next expression of a batch. Throws runtime_error when a length prefix is not a
+    number or the input ends inside a record, the stream cannot be split any further after either
+* \param in input stream
+* \param framing how records are delimited, not framing_none
+* \param record set to the text of the expression
+* \return false at the end of the input
+*/
+bool read_record(std::istream &in, framing_t framing, std::string &record) {
+    if ( framing != framing_length ) {
+        //a last record may be left unterminated, nothing after the last delimiter is no record
+        return (bool)std::getline(in, record, framing == framing_nul ? '\0' : '\n');
+    }
+
+    //lines with nothing but spaces may separate length prefixed records
+    std::string header;
+    size_t start;
+    do {
+        if ( !std::getline(in, header) ) {
+            return false;
+        }
+        start = header.find_first_not_of(" \t\r");
+    } while ( start == std::string::npos );
+    size_t end = header.find_last_not_of(" \t\r") + 1;
+    size_t length = 0;
+    for (size_t i = start; i < end; i++) {
+        if ( !isdigit((unsigned char)header[i]) || length > (size_t)-1 / 10 - 10 ) {
+            throw std::runtime_error("invalid record length");
+        }
+        length = length * 10 + (size_t)(header[i] - '0');
+    }
+    record.resize(length);
+    if ( length > 0 && !in.read(&record[0], (std::streamsize)length) ) {
+        throw std::runtime_error("truncated record");
+    }
+    return true;
+}
+
+/**
+* \brief writes one result of a batch framed like the input. A newline framed result is escaped, a backslash
+    doubled and a newline written as \n, so a pretty printed result or a message spanning lines stays one line
+* \param out output stream
+* \param framing how records are delimited, not framing_none
+* \param text the result
+*/
+void write_record(std::ostream &out, framing_t framing, const std::string &text) {
+    if ( framing == framing_length ) {
+        out << text.size() << '\n' << text << '\n';
+    }
+    else if ( framing == framing_nul ) {
+        out << text << '\0';
+    }
+    else {
+        size_t start = 0;
+        for (size_t i = text.find_first_of("\\\n"); i != std::string::npos; i = text.find_first_of("\\\n", start)) {
+            out.write(text.data() + start, (std::streamsize)(i - start));
+            out << (text[i] == '\n' ? "\\n" : "\\\\");
+            start = i + 1;
+        }
+        out.write(text.data() + start, (std::streamsize)(text.size() - start)) << '\n';
+    }
+}
+
+/**
+* \brief runs a mode on a parsed program
+* \param program the program
+* \param mode what to do with it
+* \param engine evaluator used by do_interp
+* \return the result
+*/
+std::string run_program(Program &program, run_mode_t mode, engine_t engine) {
+    switch ( mode ) {
+        case do_interp:
+            return interp_program(program, engine);
+        case do_print:
+            return program.expr->to_string();
+        case do_pretty_print:
+            return program.expr->to_stringPP();
+        default:
+            return "";
+    }
+}
+
+/**
+* \brief runs a mode on one expression of a batch
+* \param record text of the expression
+* \param mode what to do with it
+* \param engine evaluator used by do_interp
+* \return the result, or "error: " and the message when parsing or running it failed
+*/
+std::string run_record(const std::string &record, run_mode_t mode, engine_t engine) {
+    try {
+        Program program(record);
+        return run_program(program, mode, engine);
+    } catch (std::exception &exn) {
+        return std::string("error: ") + exn.what();
+    }
+}
+
+namespace {
+
+/**
+* \brief top level expressions parsed and run at a time by executeExpressions(), enough to keep every thread
+    busy while bounding how many programs and their arenas are alive at once
+*/
+const size_t parse_window = 1024;
+
+/**
+* \brief parses the expressions of spans from first up to last, spread over jobs threads. Every thread takes
+    the next expression left until none are, so a long one does not hold up the rest. Each Program brings its
+    own arena and ExprFactory and the threads share nothing but the intern table, and every thread is joined
+    before returning, so the programs can be used from the calling thread
+* \param begin first character of the source
+* \param spans where each expression of the source is, from split_expressions()
+* \param first index of the first expression to parse
+* \param last index just past the last one
+* \param jobs most threads to parse on, the calling thread included, 0 for one per hardware thread
+* \return the expressions in source order, each parsed or holding why it failed
+*/
+std::vector<ParsedExpr> parse_spans(const char *begin, const std::vector<std::pair<size_t, size_t> > &spans,
+                                    size_t first, size_t last, unsigned jobs) {
+    std::vector<ParsedExpr> parsed(last - first);
+    std::atomic<size_t> next(first);
+    auto work = [&]() {
+        for (size_t i = next++; i < last; i = next++) {
+            try {
+                parsed[i - first].program.reset(new Program(begin + spans[i].first, begin + spans[i].second));
+            } catch (std::exception &exn) {
+                parsed[i - first].error = exn.what();
+            }
+        }
+    };
+
+    if ( jobs == 0 ) {
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+    size_t workers = std::min((size_t)jobs, last - first);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers; i++) {
+        threads.push_back(std::thread(work));
+    }
+    work();
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    return parsed;
+}
+
+}
+
+/**
+* \brief parses each top level expression of a source on its own, spread over jobs threads, after splitting the
+    source with split_expressions()
+* \param begin first character of the source
+* \param end just past its last character
+* \param jobs most threads to parse on, the calling thread included, 0 for one per hardware thread
+* \return the expressions in source order, each parsed or holding why it failed
+*/
+std::vector<ParsedExpr> parse_expressions(const char *begin, const char *end, unsigned jobs) {
+    std::vector<std::pair<size_t, size_t> > spans = split_expressions(begin, end);
+    return parse_spans(begin, spans, 0, spans.size(), jobs);
+}
+
+/**
+* \brief runs a mode on every top level expression of a source and writes each result on a line in source
+    order, an expression that fails gives an error result and the rest still run. Parsing is spread over
+    threads a window of expressions at a time, running stays on the calling thread
+* \param begin first character of the source
+* \param end just past its last character
+* \param out output stream
+* \param mode what to do with each expression
+* \param engine evaluator used by do_interp
+* \param jobs most threads to parse on, 0 for one per hardware thread
+*/
+void executeExpressions(const char *begin, const char *end, std::ostream &out, run_mode_t mode, engine_t engine,
+                        unsigned jobs) {
+    std::vector<std::pair<size_t, size_t> > spans = split_expressions(begin, end);
+    for (size_t first = 0; first < spans.size(); first += parse_window) {
+        std::vector<ParsedExpr> parsed = parse_spans(begin, spans, first,
+                                                     std::min(first + parse_window, spans.size()), jobs);
+        for (size_t i = 0; i < parsed.size(); i++) {
+            std::string result;
+            if ( !parsed[i].program ) {
+                result = "error: " + parsed[i].error;
+            }
+            else {
+                try {
+                    result = run_program(*parsed[i].program, mode, engine);
+                } catch (std::exception &exn) {
+                    result = std::string("error: ") + exn.what();
+                }
+                parsed[i].program.reset();
+            }
+            write_record(out, framing_newline, result);
+        }
+    }
+    out.flush();
+}
+
+/**
+* \brief runs a mode on every expression of in and writes the results to out in the same order, an
+    expression that fails gives an error result and the next one still runs. out is flushed whenever in has
+    nothing more buffered, so a client waiting on its answers before sending more gets them
+* \param in input stream of framed expressions
+* \param out output stream of framed results
+* \param mode what to do with each expression
+* \param engine evaluator used by do_interp
+* \param framing how records are delimited in both streams, framing_expr to split the input at top level
+    expressions itself and parse them in parallel, which reads all of in first
+* \param jobs most threads to parse on with framing_expr, 0 for one per hardware thread
+*/
+void executeBatch(std::istream &in, std::ostream &out, run_mode_t mode, engine_t engine, framing_t framing,
+                  unsigned jobs) {
+    if ( framing == framing_expr ) {
+        std::string source = Lexer::read_all(in);
+        executeExpressions(source.data(), source.data() + source.size(), out, mode, engine, jobs);
+        return;
+    }
+    std::string record;
+    while (1) {
+        try {
+            if ( !read_record(in, framing, record) ) {
+                break;
+            }
+        } catch (std::runtime_error &exn) {
+            write_record(out, framing, std::string("error: ") + exn.what());
+            break;
+        }
+        write_record(out, framing, run_record(record, mode, engine));
+        if ( in.rdbuf()->in_avail() <= 0 ) {
+            out.flush();
+        }
+    }
+    out.flush();
+}
+
+/**
+* \brief runs a mode on files in order, each mapped into memory and lexed in place. Without framing a file
+    holds one expression and its result is written on a line, as for std::cin, and the first failure throws.
+    With framing a file holds a batch, read through the mapping without copying it first
+* \param paths files to run
+* \param out output stream
+* \param mode what to do with each expression
+* \param engine evaluator used by do_interp
+* \param framing how records are delimited in a file, framing_none for one expression per file
+* \param jobs most threads to parse on with framing_expr, 0 for one per hardware thread
+* \param lazy true to leave the function bodies of a file without framing unparsed until they are called
+*/
+void executeFiles(const std::vector<std::string> &paths, std::ostream &out, run_mode_t mode, engine_t engine,
+                  framing_t framing, unsigned jobs, bool lazy) {
+    for (size_t i = 0; i < paths.size(); i++) {
+        MappedFile file(paths[i]);
+        if ( framing == framing_none ) {
+            //lazy bodies are parsed after the mapping is gone, so they need a copy of the text to keep
+            std::unique_ptr<Program> program(lazy ? new Program(std::string(file.begin(), file.end()), true)
+                                                  : new Program(file.begin(), file.end()));
+            out << run_program(*program, mode, engine) << std::endl;
+        }
+        else if ( framing == framing_expr ) {
+            executeExpressions(file.begin(), file.end(), out, mode, engine, jobs);
+        }
+        else {
+            ViewBuf buffer(file.begin(), file.end());
+            std::istream in(&buffer);
+            executeBatch(in, out, mode, engine, framing);
+        }
+    }
+}
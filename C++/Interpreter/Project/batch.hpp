@@ -0,0 +1,35 @@
+/**
+* \file batch.hpp
+* \brief contains the batch and file mode declarations
+*/
+
+#ifndef batch_hpp
+#define batch_hpp
+
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "cmdline.hpp"
+#include "parse.hpp"
+
+/*! \brief one top level expression of a source, parsed on a worker thread */
+struct ParsedExpr {
+    std::unique_ptr<Program> program;///< the parsed expression, empty when parsing failed
+    std::string error;///< message parsing failed with
+};
+
+bool read_record(std::istream &in, framing_t framing, std::string &record);
+void write_record(std::ostream &out, framing_t framing, const std::string &text);
+std::string run_program(Program &program, run_mode_t mode, engine_t engine);
+std::string run_record(const std::string &record, run_mode_t mode, engine_t engine);
+std::vector<ParsedExpr> parse_expressions(const char *begin, const char *end, unsigned jobs);
+void executeExpressions(const char *begin, const char *end, std::ostream &out, run_mode_t mode, engine_t engine,
+                        unsigned jobs);
+void executeBatch(std::istream &in, std::ostream &out, run_mode_t mode, engine_t engine, framing_t framing,
+                  unsigned jobs = 0);
+void executeFiles(const std::vector<std::string> &paths, std::ostream &out, run_mode_t mode, engine_t engine,
+                  framing_t framing, unsigned jobs = 0, bool lazy = false);
+
+#endif /* batch_hpp */
@@ -0,0 +1,73 @@
+/**
+* \file bench_parse.cpp
+* \brief times msdscript on nested lets whose body sums every variable, which per-node free variable sets
+        made quadratic. Kept out of --test, wall-clock times depend on the machine and its load
+* \author Ben Baysinger
+*/
+
+#include <stdio.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "exec.hpp"
+
+/**
+* \brief n nested lets whose body sums every variable
+* \param n number of lets
+* \return the source
+*/
+static std::string nested_lets(int n) {
+    std::string names, source;
+    for (int i = 0; i < n; i++) {
+        std::string name;
+        for (int k = i + 1; k > 0; k /= 26) {
+            name += (char)('a' + k % 26);
+        }
+        source += "_let " + name + " = " + std::to_string(i) + " _in ";
+        names += (i == 0 ? "" : "+") + name;
+    }
+    return source + names;
+}
+
+/**
+* \brief best of three runs of msdscript --print on source
+* \param argv msdscript and its arguments
+* \param source input
+* \return seconds taken
+*/
+static double best_time(const char * const *argv, const std::string &source) {
+    double best = 1e9;
+    for (int run = 0; run < 3; run++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        ExecResult result = exec_program(2, argv, source);
+        double taken = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if ( result.exit_code != 0 ) {
+            std::cerr << "msdscript failed: " << result.err << std::endl;
+            return -1;
+        }
+        if ( taken < best ) {
+            best = taken;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    if ( argc != 2 ) {
+        std::cerr << "usage: bench_parse <msdscript>" << std::endl;
+        return 1;
+    }
+    const char * const print_argv[] = { argv[1], "--print" };
+    double small = best_time(print_argv, nested_lets(4000));
+    double large = best_time(print_argv, nested_lets(16000));
+    if ( small < 0 || large < 0 ) {
+        return 1;
+    }
+    std::cout << "4000 lets: " << small << " s, 16000 lets: " << large << " s, ratio " << large / small << std::endl;
+    //four times the lets should take about four times as long, quadratic work would take sixteen
+    if ( large > 8 * small + 0.01 ) {
+        std::cout << "parsing grows faster than linearly" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+/**
+* \file cek.cpp
+* \brief contains the explicit continuation (CEK) machine implementation
+        evaluates an Expr with the control, environment and continuation kept in heap
+        allocated frames, so the native stack stays the same depth however deep the
+        program recurses
+*/
+
+#include "cek.hpp"
+#include "Expr.hpp"
+#include "Env.hpp"
+#include "Val.hpp"
+
+/**
+* \brief constructor to make an idle machine
+*/
+Cek::Cek() : GcRoots(GcHeap::current()) {
+    this->control = nullptr;
+    this->env = nullptr;
+}
+
+/**
+* \brief makes expr the next thing to evaluate
+* \param expr expression to evaluate
+* \param env environment to evaluate expr in
+*/
+void Cek::eval(PTR(Expr) const &expr, PTR(Env) const &env) {
+    this->control = expr;
+    this->env = env;
+}
+
+/**
+* \brief hands val to the top continuation
+* \param val value produced by the current step
+*/
+void Cek::ret(const Value &val) {
+    this->control = nullptr;
+    this->val = val;
+}
+
+/**
+* \brief saves a continuation to resume once the value of a part of expr is ready
+* \param expr node to resume
+* \param phase which part of expr is being evaluated
+* \param env environment for the rest of expr
+* \param val value from an earlier phase to keep
+*/
+void Cek::push(PTR(Expr) const &expr, int phase, PTR(Env) const &env, const Value &val) {
+    Kont kont;
+    kont.expr = expr;
+    kont.phase = phase;
+    kont.env = env;
+    kont.val = val;
+    konts.push_back(kont);
+}
+
+/**
+* \brief runs the machine until expr has a value
+* \param expr expression to evaluate
+* \param env environment, nullptr for the empty one
+* \return value of expr
+*/
+Value Cek::run(PTR(Expr) expr, PTR(Env) env) {
+
+    if ( env == nullptr ) {
+        env = Env::empty;
+    }
+    konts.clear();
+    eval(expr, env);
+
+    while (1) {
+        GcHeap::safe_point();
+        if ( control != nullptr ) {
+            PTR(Expr) current = control;
+            control = nullptr;
+            current->step(*this, this->env);
+        }
+        else if ( konts.empty() ) {
+            Value result = val;
+            val = Value();
+            return result;
+        }
+        else {
+            Kont kont = konts.back();
+            konts.pop_back();
+            Value arrived = val;
+            val = Value();
+            kont.expr->resume(*this, kont, arrived);
+        }
+    }
+}
+
+/**
+* \brief marks the registers and every continuation
+* \param heap heap collecting
+*/
+void Cek::trace_roots(GcHeap &heap) const {
+    heap.mark(RAW(this->env));
+    this->val.trace(heap);
+    for (size_t i = 0; i < konts.size(); i++) {
+        heap.mark(RAW(konts[i].env));
+        konts[i].val.trace(heap);
+    }
+}
+
+/**
+* \brief evaluates an expression on a fresh machine, the constant stack alternative to Expr::interp
+* \param expr expression to evaluate
+* \return Val object result of the expression
+*/
+PTR(Val) cek_interp(PTR(Expr) const &expr) {
+    Cek cek;
+    return cek.run(expr).to_val();
+}
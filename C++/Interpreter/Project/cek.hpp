@@ -0,0 +1,49 @@
+/**
+* \file cek.hpp
+* \brief contains the explicit continuation (CEK) machine declarations
+*/
+
+#ifndef cek_hpp
+#define cek_hpp
+
+#include <vector>
+#include "pointer.hpp"
+#include "value.hpp"
+
+class Expr;
+class Env;
+class Val;
+
+/*! \brief continuation frame, what to do with the next value produced
+* expr is the node waiting for the value and phase says which of its parts produced it
+*/
+struct Kont {
+    PTR(Expr) expr;///< node waiting for a value
+    int phase;///< which part of expr the value belongs to
+    PTR(Env) env;///< environment for the parts of expr still to evaluate
+    Value val;///< value saved by an earlier phase
+};
+
+/*! \brief explicit continuation machine
+* its registers and continuation stack are all it holds while running, so it is the root set
+* of a collection at the top of each step
+*/
+class Cek : public GcRoots {
+public:
+    Cek();
+    void eval(PTR(Expr) const &expr, PTR(Env) const &env);
+    void ret(const Value &val);
+    void push(PTR(Expr) const &expr, int phase, PTR(Env) const &env, const Value &val = Value());
+    Value run(PTR(Expr) expr, PTR(Env) env = nullptr);
+    void trace_roots(GcHeap &heap) const;
+
+private:
+    PTR(Expr) control;///< expression to evaluate next, nullptr when returning val
+    PTR(Env) env;///< environment of control
+    Value val;///< value being returned to the top continuation
+    std::vector<Kont> konts;///< continuation stack, lives on the heap
+};
+
+PTR(Val) cek_interp(PTR(Expr) const &expr);
+
+#endif /* cek_hpp */
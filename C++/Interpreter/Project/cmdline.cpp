@@ -8,8 +8,20 @@
 
 #define CATCH_CONFIG_RUNNER
 #include "cmdline.hpp"
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
+/**
+* \brief whether text is a thread count --jobs accepts, a positive number of at most four digits
+*/
+static bool valid_jobs(const char *text) {
+    size_t length = std::strlen(text);
+    if ( length == 0 || length > 4 || std::strspn(text, "0123456789") != length ) {
+        return false;
+    }
+    return std::strtoul(text, nullptr, 10) > 0;
+}
 
 
 
@@ -20,14 +32,34 @@
  * --interp returns the operative value of what expression is passed
  * --print returns a string value of what expression is passed
  * --pretty-print returns a string value of what expression is passed
+ * --engine=vm makes --interp run on the bytecode vm, --engine=cek on the CEK machine,
+ * --engine=flat over the flat node table, --engine=tree keeps Expr::interp
+ * --batch runs the mode on every expression of the input, one per line, --batch=nul ends them with a NUL
+ * instead, --batch=length prefixes each with its byte count, --batch=expr finds where each top level expression
+ * ends itself and parses them in parallel
+ * --jobs=N caps the threads --batch=expr parses on
+ * --file <path> reads the input from the memory mapped file instead of std::cin, it can be given more than once
+ * --lazy only pre-parses function bodies of a single expression and parses each when it is first called,
+ * with --engine=tree or cek
 * \param argc numbeer of arguments
 * \param argv array storing arguments ran
+* \param engine set to the evaluator picked by --engine, engine_tree if not given
+* \param framing set to how --batch splits the input, framing_none if not given
+* \param files set to the paths given with --file in order, empty to read std::cin
+* \param jobs set to the thread count given with --jobs, 0 for one per hardware thread if not given
+* \param lazy set to whether --lazy was given
 * \returns enum type of argument passed
 */
-run_mode_t use_arguments( int argc, char **argv) {
+run_mode_t use_arguments( int argc, char **argv, engine_t &engine, framing_t &framing, std::vector<std::string> &files,
+                          unsigned &jobs, bool &lazy) {
     
     bool hasSeen = false;
     run_mode_t mode = do_nothing;
+    engine = engine_tree;
+    framing = framing_none;
+    files.clear();
+    jobs = 0;
+    lazy = false;
 
     for( int i = 1; i < argc; i++ ) {
         if (std::strcmp(argv[i], "--help") ==0) {
@@ -35,7 +67,21 @@ run_mode_t use_arguments( int argc, char **argv) {
             << " --test: checks if test has passed and runs tests \n"
             << " --interp: returns the operative value of what expression is passed\n"
             << " --print: returns a string value of what expression is passed\n"
-            << " --pretty-print: returns a string value of what expression is passed\n";
+            << " --pretty-print: returns a string value of what expression is passed\n"
+            << " --engine=tree|vm|cek|flat: evaluator used by --interp, tree walking interp (default), bytecode vm,\n"
+            << "     CEK machine that never overflows the stack on deep recursion, or flat struct-of-arrays node table\n"
+            << " --batch[=newline|nul|length]: runs the mode on many expressions, one per line (default), each ended\n"
+            << "     by a NUL, or each after a line holding its byte count, results come back framed the same way\n"
+            << "     and a bad expression gives an error: line for its result without stopping the rest, a line\n"
+            << "     result has each newline written as \\n and each backslash doubled\n"
+            << " --batch=expr: runs the mode on every top level expression of the input wherever they end, parsing\n"
+            << "     them in parallel, results come back one per line escaped like --batch=newline\n"
+            << " --jobs=N: most threads --batch=expr parses on, one per hardware thread by default\n"
+            << " --file <path>: reads the input from the file instead of standard input, one expression per file\n"
+            << "     or a batch per file with --batch, repeat it to run several files in order\n"
+            << " --lazy: --interp of one expression only checks function bodies when parsing and parses each the\n"
+            << "     first time it is called, so functions that never run cost next to nothing, on the tree or cek\n"
+            << "     engine, the others need every body before they start\n";
             exit(0);
         }
         else if ( std::strcmp(argv[i], "--test") ==0) {
@@ -60,6 +106,39 @@ run_mode_t use_arguments( int argc, char **argv) {
         else if (std::strcmp(argv[i], "--pretty-print") == 0 ) {
             mode = do_pretty_print;
         }
+        else if (std::strcmp(argv[i], "--engine=tree") == 0 ) {
+            engine = engine_tree;
+        }
+        else if (std::strcmp(argv[i], "--engine=vm") == 0 ) {
+            engine = engine_vm;
+        }
+        else if (std::strcmp(argv[i], "--engine=cek") == 0 ) {
+            engine = engine_cek;
+        }
+        else if (std::strcmp(argv[i], "--engine=flat") == 0 ) {
+            engine = engine_flat;
+        }
+        else if (std::strcmp(argv[i], "--batch") == 0 || std::strcmp(argv[i], "--batch=newline") == 0 ) {
+            framing = framing_newline;
+        }
+        else if (std::strcmp(argv[i], "--batch=nul") == 0 ) {
+            framing = framing_nul;
+        }
+        else if (std::strcmp(argv[i], "--batch=length") == 0 ) {
+            framing = framing_length;
+        }
+        else if (std::strcmp(argv[i], "--batch=expr") == 0 ) {
+            framing = framing_expr;
+        }
+        else if (std::strncmp(argv[i], "--jobs=", 7) == 0 && valid_jobs(argv[i] + 7) ) {
+            jobs = (unsigned)std::strtoul(argv[i] + 7, nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--lazy") == 0 ) {
+            lazy = true;
+        }
+        else if (std::strcmp(argv[i], "--file") == 0 && i + 1 < argc ) {
+            files.push_back(argv[++i]);
+        }
         
     
         else{
@@ -6,7 +6,10 @@
 #ifndef HOMEWORK1SMSDSCRIPT_CMDLINE_H
 #define HOMEWORK1SMSDSCRIPT_CMDLINE_H
 
+#include <string>
+#include <vector>
 #include "catch.hpp"
+#include "parse.hpp"
 
 /*! \brief custom enum to interpret  command line arguments
 * Can be either nothing, interp, print, and pretty print
@@ -20,8 +23,24 @@ typedef enum {
 
 } run_mode_t;
 
+/*! \brief custom enum to pick how --batch splits its input into expressions
+* none runs the one expression of the whole input, newline and nul end each expression with that character,
+* length puts the byte count of each expression on a line of its own before it,
+* expr splits the input where one top level expression ends and the next begins and parses them in parallel
+*/
+typedef enum {
+
+  framing_none,
+  framing_newline,
+  framing_nul,
+  framing_length,
+  framing_expr
+
+} framing_t;
+
 //void use_arguments( int argc, char **argv);
-run_mode_t use_arguments( int argc, char **argv);
+run_mode_t use_arguments( int argc, char **argv, engine_t &engine, framing_t &framing, std::vector<std::string> &files,
+                          unsigned &jobs, bool &lazy);
 
 
 #endif //HOMEWORK1SMSDSCRIPT_CMDLINE_H
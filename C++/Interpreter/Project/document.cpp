@@ -0,0 +1,360 @@
+/**
+* \file document.cpp
+* \brief contains the incrementally reparsed document implementations
+        an edit inside a parenthesis, call argument, let, if or function part of an expression parses that part
+        alone and rebuilds only the nodes above it. Any other edit splits the source again from the top level
+        expression before the first one it reaches, until an expression past the edit comes out with the same
+        text as before, from there on the old expressions are kept and only their spans move. The expressions
+        in between are parsed into the Programs they replace, whose tables hand back the node already made for
+        every subtree the edit left alone
+*/
+
+#include "document.hpp"
+#include "hashcons.hpp"
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <stdexcept>
+
+namespace {
+
+/**
+* \brief nodes a program may intern past twice what its first parse made before a reparse starts a fresh one,
+    every reparse leaves the nodes of the text it replaced in the table until the program goes
+*/
+const size_t garbage_slack = 4096;
+
+}
+
+//**********************DOCUMENT CLASS IMPLEMENTATIONS **********************************
+
+/**
+* \brief constructor to split source into its top level expressions and parse each one
+* \param source text of the expressions
+*/
+Document::Document(const std::string &source) : source(source) {
+    const char *text = this->source.data();
+    std::vector<std::pair<size_t, size_t> > spans = split_expressions(text, text + this->source.size());
+    this->exprs.resize(spans.size());
+    for (size_t i = 0; i < spans.size(); i++) {
+        this->exprs[i].begin = spans[i].first;
+        this->exprs[i].end = spans[i].second;
+        parse_into(this->exprs[i], nullptr);
+    }
+}
+
+/**
+* \brief parses the span of expr into the program of the expression it replaces, or into a fresh program when
+    there is none or that one has piled up too many nodes no tree uses
+* \param expr expression with its span set, its program, error, fresh_nodes and spans are set
+* \param previous expression of the old source expr replaces, nullptr for none
+*/
+void Document::parse_into(DocumentExpr &expr, const DocumentExpr *previous) {
+    bool fresh = previous == nullptr
+                 || previous->program->factory->size() > 2 * previous->fresh_nodes + garbage_slack;
+    expr.program = fresh ? std::make_shared<Program>() : previous->program;
+    expr.fresh_nodes = fresh ? 0 : previous->fresh_nodes;
+    expr.spans = std::make_shared<SpanTable>();
+    const char *text = this->source.data();
+    try {
+        expr.program->reparse(text + expr.begin, text + expr.end, expr.spans.get());
+        expr.error.clear();
+    } catch (std::runtime_error &exn) {
+        expr.error = exn.what();
+        expr.spans = nullptr;
+    }
+    if ( expr.fresh_nodes == 0 ) {
+        expr.fresh_nodes = expr.program->factory->size();
+    }
+}
+
+/**
+* \brief replaces removed characters at offset with inserted and parses again what the edit reaches.
+    Throws runtime_error if the removed characters are not all in the source
+* \param offset where the edit starts in the source before it
+* \param removed how many characters it takes out
+* \param inserted text it puts in their place
+* \return the expressions replaced and the ones whose tree or error changed
+*/
+DocumentChange Document::edit(size_t offset, size_t removed, const std::string &inserted) {
+    if ( offset > this->source.size() || removed > this->source.size() - offset ) {
+        throw std::runtime_error("edit out of range");
+    }
+    size_t edit_end = offset + removed;
+    this->source.replace(offset, removed, inserted);
+    DocumentChange change;
+    change.reparsed = 0;
+    if ( reparse_part(offset, removed, inserted.size(), change) ) {
+        return change;
+    }
+
+    //an operator or an argument typed after an expression continues it, so splitting starts one expression
+    //before the first one reaching the edit, whose start the edit cannot move
+    std::vector<DocumentExpr>::iterator reached =
+        std::lower_bound(this->exprs.begin(), this->exprs.end(), offset,
+                         [](const DocumentExpr &e, size_t at) { return e.end < at; });
+    size_t first = (size_t)(reached - this->exprs.begin());
+    if ( first > 0 ) {
+        first--;
+    }
+    size_t start = first == 0 ? 0 : this->exprs[first].begin;
+
+    change.first = first;
+    std::vector<DocumentExpr> replacing;
+    size_t kept = this->exprs.size();
+    size_t next_old = first;
+    const char *text = this->source.data();
+    Lexer lex(text + start, text + this->source.size());
+    while ( lex.peek().kind != tok_end ) {
+        DocumentExpr expr;
+        expr.begin = start + lex.peek().begin;
+        try {
+            expr.end = start + skip_expr(lex);
+        } catch (std::runtime_error &) {
+            expr.end = start + lex.consumed();
+        }
+
+        //past the edit an old expression whose text comes out the same, only moved, means the rest is too
+        while ( next_old < this->exprs.size() && (this->exprs[next_old].begin < edit_end
+                || this->exprs[next_old].begin - removed + inserted.size() < expr.begin) ) {
+            next_old++;
+        }
+        if ( next_old < this->exprs.size()
+             && this->exprs[next_old].begin - removed + inserted.size() == expr.begin
+             && this->exprs[next_old].end - removed + inserted.size() == expr.end ) {
+            kept = next_old;
+            break;
+        }
+
+        //the old expression at the same place gives up its program, only one the split is already past
+        //so it can never be kept as well
+        size_t position = first + replacing.size();
+        const DocumentExpr *previous = position < next_old ? &this->exprs[position] : nullptr;
+        if ( previous != nullptr && previous->end <= offset && previous->begin == expr.begin
+             && previous->end == expr.end ) {
+            replacing.push_back(*previous);
+        }
+        else {
+            PTR(Expr) before = nullptr;
+            std::string before_error;
+            if ( previous != nullptr ) {
+                before = previous->program->expr;
+                before_error = previous->error;
+            }
+            parse_into(expr, previous);
+            change.reparsed += expr.end - expr.begin;
+            bool same = previous != nullptr && expr.error == before_error
+                        && ( !expr.error.empty() || ( expr.program == previous->program
+                                                      ? expr.program->expr == before
+                                                      : expr.program->expr->equals(before) ) );
+            if ( !same ) {
+                change.changed.push_back(position);
+            }
+            replacing.push_back(expr);
+        }
+    }
+
+    change.removed = kept - first;
+    change.inserted = replacing.size();
+    for (size_t i = kept; i < this->exprs.size(); i++) {
+        this->exprs[i].begin = this->exprs[i].begin - removed + inserted.size();
+        this->exprs[i].end = this->exprs[i].end - removed + inserted.size();
+    }
+    if ( replacing.size() == kept - first ) {
+        //the usual keystroke, no expression comes or goes and nothing after them has to move
+        std::move(replacing.begin(), replacing.end(), this->exprs.begin() + first);
+    }
+    else {
+        this->exprs.erase(this->exprs.begin() + first, this->exprs.begin() + kept);
+        this->exprs.insert(this->exprs.begin() + first, std::make_move_iterator(replacing.begin()),
+                           std::make_move_iterator(replacing.end()));
+    }
+    return change;
+}
+
+/**
+* \brief parses again only the smallest part of an expression holding the edit, see SourcePart, and puts the
+    node it gives in place of the old one, rebuilding the nodes above it through the expression's table. Every
+    subtree beside the path down to the part stays the node it was and is not parsed again
+* \param offset where the edit starts in the source before it
+* \param removed how many characters it took out
+* \param inserted how many characters it put in, the source already has them
+* \param change set to what the edit did when it returns true
+* \return false if no part holds the edit, its text no longer parses to one expression closed by the token that
+    closed it before, the text after an expression it ends follows with no whitespace, or a let above it is
+    left without a use. The expression is then left as it was. A part the edit starts right at the beginning
+    of does not count, the text put there could join the token opening it
+*/
+bool Document::reparse_part(size_t offset, size_t removed, size_t inserted, DocumentChange &change) {
+    std::vector<DocumentExpr>::iterator reached =
+        std::lower_bound(this->exprs.begin(), this->exprs.end(), offset,
+                         [](const DocumentExpr &e, size_t at) { return e.end < at; });
+    if ( reached == this->exprs.end() || reached->spans == nullptr || offset <= reached->begin ) {
+        return false;
+    }
+    DocumentExpr &expr = *reached;
+    Program &program = *expr.program;
+    if ( program.factory->size() > 2 * expr.fresh_nodes + garbage_slack ) {
+        //a split parses it into a fresh program
+        return false;
+    }
+    SpanTable &spans = *expr.spans;
+    size_t at = offset - expr.begin;
+    const SourcePart *part = nullptr;
+    for (size_t i = 0; i < spans.parts.size(); i++) {
+        const SourcePart &p = spans.parts[i];
+        if ( p.begin < at && at + removed <= p.end && (part == nullptr || p.end - p.begin < part->end - part->begin) ) {
+            part = &p;
+        }
+    }
+    if ( part == nullptr ) {
+        return false;
+    }
+    SourcePart old = *part;
+    size_t length = expr.end - expr.begin;
+    size_t end = old.end - removed + inserted;
+    size_t expr_end = expr.end - removed + inserted;
+
+    //the part alone, it has to stop right at the token that closed it before
+    ArenaScope scope(program.arena.get());
+    ExprFactoryScope interning(program.factory.get());
+    const char *text = this->source.data() + expr.begin;
+    SpanTable part_spans;
+    PTR(Expr) node;
+    try {
+        Lexer lex(text + old.begin, text + (expr_end - expr.begin));
+        node = parse_expr(lex, part_spans);
+        if ( lex.peek().begin != end - old.begin ) {
+            return false;
+        }
+        if ( old.end == length ) {
+            //closed by the end of the expression, which is its last token, not the whitespace typed after it
+            end = old.begin + lex.consumed();
+            expr_end = expr.begin + end;
+            //the text after the expression with no whitespace between could run into that token in a fresh
+            //parse, the split path lexes it then
+            Lexer after(text + end, this->source.data() + this->source.size());
+            if ( after.peek().kind != tok_end && !after.peek().spaced ) {
+                return false;
+            }
+        }
+    } catch (std::runtime_error &) {
+        return false;
+    }
+
+    //the nodes from the root down to the old node of the part, with the child taken at each, a child's subtree
+    //ends right before the next child's first node, the last one right before its parent
+    std::vector<std::pair<PTR(Expr), int> > path;
+    PTR(Expr) e = program.expr;
+    uint32_t id = (uint32_t)(spans.first.size() - 1);
+    while ( id != old.node ) {
+        int i = e->arity() - 1;
+        uint32_t child = id - 1;
+        while ( spans.first[child] > old.node ) {
+            child = spans.first[child] - 1;
+            i--;
+        }
+        path.push_back(std::make_pair(e, i));
+        PTR(Expr) next = e->child(i);
+        e = next;
+        id = child;
+    }
+
+    //a variable the old part used and the new one does not may leave a let above it with no use, the lets
+    //it reaches before something binds it again are checked on the way up
+    std::set<Symbol> lost;
+    std::set<Symbol> before = e->free_vars();
+    std::set<Symbol> after = node->free_vars();
+    std::set_difference(before.begin(), before.end(), after.begin(), after.end(), std::inserter(lost, lost.end()));
+    std::vector<bool> check(path.size(), false);
+    for (size_t k = path.size(); k-- > 0 && !lost.empty(); ) {
+        std::set<Symbol>::iterator name = lost.begin();
+        while ( name != lost.end() ) {
+            if ( path[k].first->substitutes(path[k].second, *name) ) {
+                ++name;
+                continue;
+            }
+            check[k] = path[k].first->kind == expr_let;
+            name = lost.erase(name);
+        }
+    }
+    PTR(Expr) rebuilt = node == e ? program.expr : node;
+    if ( node != e ) {
+        std::vector<PTR(Expr)> children;
+        for (size_t k = path.size(); k-- > 0; ) {
+            PTR(Expr) const &parent = path[k].first;
+            if ( check[k] && !rebuilt->has_free(static_cast<LetExpr *>(RAW(parent))->lhs) ) {
+                return false;
+            }
+            children.clear();
+            for (int i = 0; i < parent->arity(); i++) {
+                children.push_back(i == path[k].second ? rebuilt : parent->child(i));
+            }
+            rebuilt = parent->rebuild(children.data());
+        }
+    }
+
+    //the numbers of the new subtree take the place of the old ones, the nodes past it move by the difference
+    uint32_t from = spans.first[old.node];
+    uint32_t old_count = old.node - from + 1;
+    uint32_t count = (uint32_t)part_spans.first.size();
+    for (size_t i = old.node + 1; i < spans.first.size(); i++) {
+        if ( spans.first[i] > old.node ) {
+            spans.first[i] = spans.first[i] - old_count + count;
+        }
+    }
+    if ( count > old_count ) {
+        spans.first.insert(spans.first.begin() + old.node + 1, count - old_count, 0);
+    }
+    else {
+        spans.first.erase(spans.first.begin() + from + count, spans.first.begin() + old.node + 1);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        spans.first[from + i] = part_spans.first[i] + from;
+    }
+
+    //the parts in the old subtree go, the ones around it move along with the text after it
+    size_t kept = 0;
+    for (size_t i = 0; i < spans.parts.size(); i++) {
+        SourcePart p = spans.parts[i];
+        if ( p.node >= from && p.node <= old.node && p.begin >= old.begin && p.end <= old.end ) {
+            continue;
+        }
+        if ( p.node >= old.node ) {
+            p.node = p.node - old_count + count;
+        }
+        if ( p.begin >= old.end ) {
+            p.begin = p.begin - removed + inserted;
+        }
+        if ( p.end >= old.end ) {
+            p.end = old.end == length ? end : p.end - removed + inserted;
+        }
+        spans.parts[kept++] = p;
+    }
+    spans.parts.resize(kept);
+    for (size_t i = 0; i < part_spans.parts.size(); i++) {
+        SourcePart p = part_spans.parts[i];
+        p.node += from;
+        p.begin += old.begin;
+        p.end += old.begin;
+        spans.parts.push_back(p);
+    }
+    SourcePart whole = { from + count - 1, old.begin, end };
+    spans.parts.push_back(whole);
+
+    size_t index = (size_t)(reached - this->exprs.begin());
+    change.first = index;
+    change.removed = 1;
+    change.inserted = 1;
+    change.reparsed = end - old.begin;
+    if ( rebuilt != program.expr ) {
+        change.changed.push_back(index);
+        program.expr = rebuilt;
+    }
+    expr.end = expr_end;
+    for (size_t i = index + 1; i < this->exprs.size(); i++) {
+        this->exprs[i].begin = this->exprs[i].begin - removed + inserted;
+        this->exprs[i].end = this->exprs[i].end - removed + inserted;
+    }
+    return true;
+}
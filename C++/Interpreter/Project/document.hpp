@@ -0,0 +1,74 @@
+/**
+* \file document.hpp
+* \brief contains the incrementally reparsed document declarations
+*/
+
+#ifndef document_hpp
+#define document_hpp
+
+#include <stddef.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "parse.hpp"
+
+/*! \brief one top level expression of a Document and the span of source it was parsed from */
+struct DocumentExpr {
+    size_t begin;///< offset of its first character in the source
+    size_t end;///< offset just past its last character
+    std::shared_ptr<Program> program;///< its nodes, kept through a failed parse so fixing the text reuses them
+    std::string error;///< why the text of the span does not parse, empty when program->expr is its tree
+    size_t fresh_nodes;///< nodes interned by the first parse into program, to tell when it holds mostly garbage
+    std::shared_ptr<SpanTable> spans;///< where the parts of program->expr are, at offsets from begin, nullptr after an error
+};
+
+/*! \brief what one Document::edit() did to the top level expressions
+* the old expressions first up to first + removed were replaced by the new ones first up to first + inserted,
+* the ones before and after kept their nodes
+*/
+struct DocumentChange {
+    size_t first;///< index of the first expression the edit could reach
+    size_t removed;///< how many old expressions from first were replaced
+    size_t inserted;///< how many new expressions from first replaced them
+    std::vector<size_t> changed;///< indexes of new expressions whose tree or error is not the one before
+    size_t reparsed;///< characters of source parsed again
+};
+
+/*! \brief source made of top level expressions one after another, kept parsed while it is edited
+* an edit inside a part of an expression, see SourcePart, parses only the smallest such part again and puts its
+* node in the tree in place of the old one. Any other edit splits and parses again the expressions it reaches,
+* each into the Program of the expression it replaces, so every subtree the edit leaves alone comes back as the
+* node already made
+*/
+class Document {
+public:
+    Document(const std::string &source);
+    DocumentChange edit(size_t offset, size_t removed, const std::string &inserted);
+
+    /**
+    * \brief the current source
+    */
+    const std::string &text() const { return this->source; }
+
+    /**
+    * \brief number of top level expressions
+    */
+    size_t size() const { return this->exprs.size(); }
+
+    /**
+    * \brief top level expression i, in source order
+    */
+    const DocumentExpr &at(size_t i) const { return this->exprs.at(i); }
+
+private:
+    std::string source;///< text of every expression and the whitespace between them
+    std::vector<DocumentExpr> exprs;///< top level expressions in source order
+
+    void parse_into(DocumentExpr &expr, const DocumentExpr *previous);
+    bool reparse_part(size_t offset, size_t removed, size_t inserted, DocumentChange &change);
+
+    Document(const Document &);
+    Document &operator=(const Document &);
+};
+
+#endif /* document_hpp */
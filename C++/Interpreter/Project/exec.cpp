@@ -1,11 +1,14 @@
 #include <string>
 #include <iostream>
 #include <cassert>
+#include <csignal>
+#include <cstring>
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <poll.h>
 #include <errno.h>
+#include <sys/wait.h>
 
 #include "exec.hpp"
 
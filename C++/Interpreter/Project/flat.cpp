@@ -0,0 +1,854 @@
+/**
+* \file flat.cpp
+* \brief contains the flat expression table implementations
+        the same interp, print, equals and subst as the Expr classes, run over node ids
+        instead of pointers
+*/
+
+#include "flat.hpp"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include "Env.hpp"
+#include "cek.hpp"
+#include "traverse.hpp"
+
+namespace {
+
+/*! \brief adds every node of a tree to a FlatAst, children first, keeping the nodes of the finished children
+* on a stack so each node is added over them once its last child is done
+*/
+class FlattenVisitor : public ExprVisitor {
+public:
+    FlatAst &ast;///< table being built
+    std::vector<uint32_t> nodes;///< nodes of the children finished so far, in order, for each open node
+
+    FlattenVisitor(FlatAst &ast) : ast(ast) { }
+
+    bool enter(Expr *e) {
+        if ( e->arity() > 0 ) {
+            return true;
+        }
+        nodes.push_back(e->flatten(ast, nullptr));
+        return false;
+    }
+    void leave(Expr *e) {
+        size_t base = nodes.size() - e->arity();
+        uint32_t node = e->flatten(ast, &nodes[base]);
+        nodes.resize(base);
+        nodes.push_back(node);
+    }
+};
+
+/*! \brief a node of a FlatAst waiting on the value of one of its operands */
+struct FlatFrame {
+    const FlatAddresses *resolved;///< addresses of the table holding node, kept alive by flat_run
+    uint32_t node;///< node waiting
+    bool second;///< true once the first operand of a binary node is in val
+    PTR(Env) env;///< environment of node
+    Value val;///< value of the first operand
+};
+
+/*! \brief root set of a running flat_evaluate(), the frames waiting on operands and the registers */
+struct FlatRoots : public GcRoots {
+    const std::vector<FlatFrame> &stack;///< frames of the run
+    PTR(Env) const &env;///< environment of the node being evaluated
+    const Value &val;///< value being handed to the frames
+
+    FlatRoots(const std::vector<FlatFrame> &stack, PTR(Env) const &env, const Value &val)
+        : GcRoots(GcHeap::current()), stack(stack), env(env), val(val) {}
+
+    void trace_roots(GcHeap &heap) const {
+        heap.mark(RAW(env));
+        val.trace(heap);
+        for (size_t i = 0; i < stack.size(); i++) {
+            heap.mark(RAW(stack[i].env));
+            stack[i].val.trace(heap);
+        }
+    }
+};
+
+/**
+* \brief makes table the one flat_run is in, every table entered stays in held, since frames only keep plain
+    pointers and the closures made in it may be gone by the time it is resumed
+* \param resolved addresses of the table being evaluated, set to table
+* \param table addresses of the table to enter, resolved or one of held
+* \param held tables entered before
+* \return table
+*/
+const FlatAddresses *switch_table(std::shared_ptr<const FlatAddresses> &resolved, const FlatAddresses *table,
+                                  std::vector<std::shared_ptr<const FlatAddresses> > &held) {
+    if ( table == resolved.get() ) {
+        return table;
+    }
+    if ( std::find(held.begin(), held.end(), resolved) == held.end() ) {
+        held.push_back(resolved);
+    }
+    for ( size_t i = 0; i < held.size(); i++ ) {
+        if ( held[i].get() == table ) {
+            resolved = held[i];
+        }
+    }
+    return table;
+}
+
+}
+
+//**********************FLATAST CLASS IMPLEMENTATIONS ***********************************
+
+/**
+* \brief constructor to make an empty table
+*/
+FlatAst::FlatAst() {
+    this->root = 0;
+}
+
+/**
+* \brief builds the table of expr, walking it with an explicit stack
+* \param expr expression to flatten
+* \return table whose root is expr
+*/
+std::shared_ptr<FlatAst> FlatAst::flatten(PTR(Expr) const &expr) {
+    std::shared_ptr<FlatAst> ast = std::make_shared<FlatAst>();
+    FlattenVisitor visitor(*ast);
+    walk(RAW(expr), visitor);
+    ast->root = visitor.nodes.back();
+    return ast;
+}
+
+/**
+* \brief appends a node
+* \param kind kind of the node
+* \param a first operand
+* \param b second operand
+* \param c third operand
+* \return id of the node
+*/
+uint32_t FlatAst::add_node(expr_kind_t kind, uint32_t a, uint32_t b, uint32_t c) {
+    kinds.push_back((uint8_t)kind);
+    op0.push_back(a);
+    op1.push_back(b);
+    op2.push_back(c);
+    return (uint32_t)(kinds.size() - 1);
+}
+
+/**
+* \brief appends a number node
+* \param val the number
+* \return id of the node
+*/
+uint32_t FlatAst::num(int val) {
+    literals.push_back(val);
+    return add_node(expr_num, (uint32_t)(literals.size() - 1));
+}
+
+/**
+* \brief appends a boolean node
+* \param val the boolean
+* \return id of the node
+*/
+uint32_t FlatAst::boolean(bool val) {
+    return add_node(expr_bool, val ? 1 : 0);
+}
+
+/**
+* \brief appends a variable node
+* \param name the variable
+* \return id of the node
+*/
+uint32_t FlatAst::var(Symbol name) {
+    return add_node(expr_var, name.id());
+}
+
+/**
+* \brief appends an add node
+* \param lhs node of the left hand side
+* \param rhs node of the right hand side
+* \return id of the node
+*/
+uint32_t FlatAst::add(uint32_t lhs, uint32_t rhs) {
+    return add_node(expr_add, lhs, rhs);
+}
+
+/**
+* \brief appends a multiplication node
+* \param lhs node of the left hand side
+* \param rhs node of the right hand side
+* \return id of the node
+*/
+uint32_t FlatAst::mult(uint32_t lhs, uint32_t rhs) {
+    return add_node(expr_mult, lhs, rhs);
+}
+
+/**
+* \brief appends an equality node
+* \param lhs node of the left hand side
+* \param rhs node of the right hand side
+* \return id of the node
+*/
+uint32_t FlatAst::eq(uint32_t lhs, uint32_t rhs) {
+    return add_node(expr_eq, lhs, rhs);
+}
+
+/**
+* \brief appends a let node
+* \param lhs variable bound
+* \param rhs node of the bound expression
+* \param body node of the body
+* \return id of the node
+*/
+uint32_t FlatAst::let(Symbol lhs, uint32_t rhs, uint32_t body) {
+    return add_node(expr_let, lhs.id(), rhs, body);
+}
+
+/**
+* \brief appends an if node
+* \param test_part node of the condition
+* \param then_part node used when it is true
+* \param else_part node used when it is false
+* \return id of the node
+*/
+uint32_t FlatAst::cond(uint32_t test_part, uint32_t then_part, uint32_t else_part) {
+    return add_node(expr_if, test_part, then_part, else_part);
+}
+
+/**
+* \brief appends a function node
+* \param formal_arg variable bound by a call
+* \param body node of the body
+* \return id of the node
+*/
+uint32_t FlatAst::fun(Symbol formal_arg, uint32_t body) {
+    return add_node(expr_fun, formal_arg.id(), body);
+}
+
+/**
+* \brief appends a call node
+* \param to_be_called node of the function
+* \param actual_arg node of the argument
+* \return id of the node
+*/
+uint32_t FlatAst::call(uint32_t to_be_called, uint32_t actual_arg) {
+    return add_node(expr_call, to_be_called, actual_arg);
+}
+
+/**
+* \brief memory held by the nodes and literals
+* \return bytes in use by the arrays
+*/
+size_t FlatAst::bytes() const {
+    return kinds.size() * sizeof(uint8_t) + (op0.size() + op1.size() + op2.size()) * sizeof(uint32_t)
+        + literals.size() * sizeof(int);
+}
+
+/**
+* \brief subexpressions of node in the order Expr::child() gives them
+* \param node node of the table
+* \param children filled with the nodes of the subexpressions
+* \return number of subexpressions
+*/
+int FlatAst::children(uint32_t node, uint32_t *children) const {
+    switch (kinds[node]) {
+        case expr_num:
+        case expr_bool:
+        case expr_var:
+            return 0;
+        case expr_fun:
+            children[0] = op1[node];
+            return 1;
+        case expr_let:
+            children[0] = op1[node];
+            children[1] = op2[node];
+            return 2;
+        case expr_if:
+            children[0] = op0[node];
+            children[1] = op1[node];
+            children[2] = op2[node];
+            return 3;
+        default:
+            children[0] = op0[node];
+            children[1] = op1[node];
+            return 2;
+    }
+}
+
+/**
+* \brief rebuilds the Expr tree of node, children first with an explicit stack
+* \param node node to convert
+* \return equal expression
+*/
+PTR(Expr) FlatAst::to_expr(uint32_t node) const {
+    std::vector<std::pair<uint32_t, int> > path(1, std::make_pair(node, 0));
+    std::vector<PTR(Expr)> built;
+    uint32_t kids[3];
+    while ( !path.empty() ) {
+        uint32_t n = path.back().first;
+        int i = path.back().second++;
+        int count = children(n, kids);
+        if ( i < count ) {
+            path.push_back(std::make_pair(kids[i], 0));
+            continue;
+        }
+        path.pop_back();
+        PTR(Expr) *parts = built.data() + built.size() - count;
+        uint32_t a = op0[n];
+        PTR(Expr) e;
+        switch (kinds[n]) {
+            case expr_num:
+                e = NEW(NumExpr)(literals[a]);
+                break;
+            case expr_bool:
+                e = NEW(BoolExpr)(a != 0);
+                break;
+            case expr_var:
+                e = NEW(VarExpr)(Symbol::from_id(a));
+                break;
+            case expr_add:
+                e = NEW(AddExpr)(parts[0], parts[1]);
+                break;
+            case expr_mult:
+                e = NEW(MultExpr)(parts[0], parts[1]);
+                break;
+            case expr_eq:
+                e = NEW(EqExpr)(parts[0], parts[1]);
+                break;
+            case expr_let:
+                e = NEW(LetExpr)(Symbol::from_id(a), parts[0], parts[1]);
+                break;
+            case expr_if:
+                e = NEW(IfExpr)(parts[0], parts[1], parts[2]);
+                break;
+            case expr_fun:
+                e = NEW(FunExpr)(Symbol::from_id(a), parts[0]);
+                break;
+            default:
+                e = NEW(CallExpr)(parts[0], parts[1]);
+        }
+        built.resize(built.size() - count);
+        built.push_back(e);
+    }
+    return built.back();
+}
+
+/**
+* \brief prints the text of node that comes before child i, or after the last child when i is the number
+    of children, as Expr::print_part does
+* \param node node being printed
+* \param i which part
+* \param ostream stream to print to
+*/
+void FlatAst::print_part(uint32_t node, int i, std::ostream &ostream) const {
+    uint32_t a = op0[node];
+    switch (kinds[node]) {
+        case expr_num:
+            ostream << std::to_string(literals[a]);
+            break;
+        case expr_bool:
+            ostream << (a != 0 ? "_true" : "_false");
+            break;
+        case expr_var:
+            ostream << Symbol::from_id(a);
+            break;
+        case expr_add:
+            ostream << (i == 0 ? "(" : i == 1 ? "+" : ")");
+            break;
+        case expr_mult:
+            ostream << (i == 0 ? "(" : i == 1 ? "*" : ")");
+            break;
+        case expr_eq:
+            ostream << (i == 0 ? "(" : i == 1 ? "==" : ")");
+            break;
+        case expr_let:
+            if ( i == 0 ) {
+                ostream << "(_let " << Symbol::from_id(a) << "=";
+            }
+            else {
+                ostream << (i == 1 ? " _in " : ")");
+            }
+            break;
+        case expr_if:
+            ostream << (i == 0 ? "(_if " : i == 1 ? " _then " : i == 2 ? " _else " : ")");
+            break;
+        case expr_fun:
+            if ( i == 0 ) {
+                ostream << "(_fun (" << Symbol::from_id(a) << ") ";
+            }
+            else {
+                ostream << ")";
+            }
+            break;
+        default:
+            if ( i == 1 ) {
+                ostream << " ";
+            }
+    }
+}
+
+/**
+* \brief prints node exactly as Expr::print prints the same expression, keeping the path on a heap
+    allocated stack
+* \param node node to print
+* \param ostream stream to print to
+*/
+void FlatAst::print(uint32_t node, std::ostream &ostream) const {
+    std::vector<std::pair<uint32_t, int> > path(1, std::make_pair(node, 0));
+    uint32_t kids[3];
+    while ( !path.empty() ) {
+        uint32_t n = path.back().first;
+        int i = path.back().second++;
+        int count = children(n, kids);
+        print_part(n, i, ostream);
+        if ( i == count ) {
+            path.pop_back();
+        }
+        else {
+            path.push_back(std::make_pair(kids[i], 0));
+        }
+    }
+}
+
+/**
+* \brief converts node to string
+* \param node node to print
+* \return node as printed by print()
+*/
+std::string FlatAst::to_string(uint32_t node) const {
+    std::stringstream st("");
+    print(node, st);
+    return st.str();
+}
+
+/**
+* \brief compares node with other_node of other, as Expr::equals compares the same expressions
+    walks both with an explicit stack of node pairs
+* \param node node of 'this'
+* \param other table holding other_node, may be 'this'
+* \param other_node node to compare against
+* \return true if both are the same expression
+*/
+bool FlatAst::equals(uint32_t node, const FlatAst &other, uint32_t other_node) const {
+    std::vector<std::pair<uint32_t, uint32_t> > pending(1, std::make_pair(node, other_node));
+    while ( !pending.empty() ) {
+        uint32_t n = pending.back().first;
+        uint32_t m = pending.back().second;
+        pending.pop_back();
+        if ( &other == this && n == m ) {
+            continue;
+        }
+        uint8_t kind = kinds[n];
+        if ( kind != other.kinds[m] ) {
+            return false;
+        }
+        switch (kind) {
+            case expr_num:
+                if ( literals[op0[n]] != other.literals[other.op0[m]] ) {
+                    return false;
+                }
+                break;
+            case expr_bool:
+            case expr_var:
+                if ( op0[n] != other.op0[m] ) {
+                    return false;
+                }
+                break;
+            case expr_let:
+                if ( op0[n] != other.op0[m] ) {
+                    return false;
+                }
+                pending.push_back(std::make_pair(op2[n], other.op2[m]));
+                pending.push_back(std::make_pair(op1[n], other.op1[m]));
+                break;
+            case expr_if:
+                pending.push_back(std::make_pair(op2[n], other.op2[m]));
+                pending.push_back(std::make_pair(op1[n], other.op1[m]));
+                pending.push_back(std::make_pair(op0[n], other.op0[m]));
+                break;
+            case expr_fun:
+                if ( op0[n] != other.op0[m] ) {
+                    return false;
+                }
+                pending.push_back(std::make_pair(op1[n], other.op1[m]));
+                break;
+            default:
+                pending.push_back(std::make_pair(op1[n], other.op1[m]));
+                pending.push_back(std::make_pair(op0[n], other.op0[m]));
+        }
+    }
+    return true;
+}
+
+/**
+* \brief replaces the free occurrences of valToSub in node, as Expr::subst does,
+    appending only the nodes that change and sharing the rest. Children are done first with an explicit stack
+* \param node node to substitute in
+* \param valToSub variable to replace
+* \param replacement node of this table to put in its place
+* \return node of the result, node itself when valToSub does not occur free
+*/
+uint32_t FlatAst::subst(uint32_t node, Symbol valToSub, uint32_t replacement) {
+    std::vector<std::pair<uint32_t, int> > path(1, std::make_pair(node, 0));
+    std::vector<uint32_t> done;
+    uint32_t kids[3];
+    while ( !path.empty() ) {
+        uint32_t n = path.back().first;
+        int i = path.back().second++;
+        expr_kind_t kind = (expr_kind_t)kinds[n];
+        int count = children(n, kids);
+        //a let or function binding valToSub keeps its body, which is its last child
+        bool binds = (kind == expr_let || kind == expr_fun) && op0[n] == valToSub.id();
+        if ( i < count - (binds ? 1 : 0) ) {
+            path.push_back(std::make_pair(kids[i], 0));
+            continue;
+        }
+        path.pop_back();
+        if ( kind == expr_var ) {
+            done.push_back(op0[n] == valToSub.id() ? replacement : n);
+            continue;
+        }
+        if ( binds ) {
+            done.push_back(kids[count - 1]);
+        }
+        size_t base = done.size() - count;
+        bool same = true;
+        for ( int k = 0; k < count; k++ ) {
+            same = same && done[base + k] == kids[k];
+        }
+        uint32_t result = n;
+        if ( !same ) {
+            uint32_t ops[3] = { op0[n], op1[n], op2[n] };
+            int first = kind == expr_let || kind == expr_fun ? 1 : 0;
+            for ( int k = 0; k < count; k++ ) {
+                ops[first + k] = done[base + k];
+            }
+            result = add_node(kind, ops[0], ops[1], ops[2]);
+        }
+        done.resize(base);
+        done.push_back(result);
+    }
+    return done.back();
+}
+
+//**********************FLATADDRESSES CLASS IMPLEMENTATIONS *****************************
+
+/**
+* \brief finds the lexical address of every node under node, as resolve() does for an Expr
+* \param ast table holding node
+* \param node node to resolve, run as the top level of a frame of num_slots
+* \throws std::runtime_error naming the first unbound variable
+* \return addresses of the nodes
+*/
+std::shared_ptr<const FlatAddresses> FlatAddresses::resolve(std::shared_ptr<const FlatAst> ast, uint32_t node) {
+    std::shared_ptr<FlatAddresses> resolved = std::make_shared<FlatAddresses>();
+    resolved->ast = std::move(ast);
+    resolved->root = node;
+    if ( !resolved->resolve_tree() ) {
+        //the copy has a node for each place the tree reaches one
+        std::shared_ptr<FlatAst> copy = FlatAst::flatten(resolved->ast->to_expr(node));
+        resolved->ast = copy;
+        resolved->root = copy->root;
+        resolved->captured_from.clear();
+        resolved->resolve_tree();
+    }
+    return resolved;
+}
+
+/**
+* \brief fills in the addresses of the nodes under root, walking them with an explicit stack
+* \throws std::runtime_error naming the first unbound variable
+* \return false if a variable, let or function node is reached twice
+*/
+bool FlatAddresses::resolve_tree() {
+    const FlatAst &t = *this->ast;
+    this->addresses.assign(t.size(), Address());
+    std::vector<bool> reached(t.size(), false);
+    Resolver resolver;
+    resolver.open_top();
+    std::vector<std::pair<uint32_t, int> > path(1, std::make_pair(this->root, 0));
+    uint32_t kids[3];
+    while ( !path.empty() ) {
+        uint32_t n = path.back().first;
+        int i = path.back().second++;
+        expr_kind_t kind = (expr_kind_t)t.kinds[n];
+        bool binding = kind == expr_var || kind == expr_let || kind == expr_fun;
+        if ( i == 0 && binding ) {
+            if ( reached[n] ) {
+                return false;
+            }
+            reached[n] = true;
+        }
+        if ( i == 0 && kind == expr_var ) {
+            this->addresses[n] = resolver.var(Symbol::from_id(t.op0[n]));
+        }
+        else if ( i == 0 && kind == expr_fun ) {
+            resolver.open_fun(Symbol::from_id(t.op0[n]));
+        }
+        else if ( i == 1 && kind == expr_let ) {
+            //lhs is visible in the body only, so it is bound once rhs is done
+            this->addresses[n].slot = resolver.bind(Symbol::from_id(t.op0[n]));
+        }
+        int count = t.children(n, kids);
+        if ( i < count ) {
+            path.push_back(std::make_pair(kids[i], 0));
+            continue;
+        }
+        path.pop_back();
+        if ( kind == expr_let ) {
+            resolver.unbind();
+        }
+        else if ( kind == expr_fun ) {
+            this->addresses[n].slot = (int)this->captured_from.size();
+            this->captured_from.push_back(std::vector<Address>());
+            this->addresses[n].depth = resolver.close_scope(this->captured_from.back());
+        }
+    }
+    std::vector<Address> captured;
+    this->num_slots = resolver.close_scope(captured);
+    return true;
+}
+
+//**********************FLATFUNVAL CLASS IMPLEMENTATIONS ********************************
+
+/**
+* \brief constructor to make a closure over a fun node
+* \param resolved addresses of the table holding the node
+* \param node the fun node
+* \param captured frame of the values the function captures, depth 1 inside the body
+*/
+FlatFunVal::FlatFunVal(std::shared_ptr<const FlatAddresses> resolved, uint32_t node, PTR(Env) captured)
+    : FunVal(Symbol::from_id(resolved->ast->op0[node]), nullptr, std::move(captured)) {
+    this->ast = resolved->ast.get();
+    this->resolved = std::move(resolved);
+    this->node = node;
+}
+
+/**
+* \brief body as an Expr, built from the table the first time it is asked for
+* \return body of the function
+*/
+PTR(Expr) FlatFunVal::body_expr() {
+    if ( this->body == nullptr ) {
+        this->body = ast->to_expr(ast->op1[node]);
+    }
+    return this->body;
+}
+
+/**
+* \brief compares v with 'this', over the tables when both are flat
+* \param v Val to compare against this
+* \return true if v is a function with the same formal_arg and body
+*/
+bool FlatFunVal::equals(PTR(Val) const &v) {
+    FlatFunVal *other = dynamic_cast<FlatFunVal*>(RAW(v));
+    if ( other == nullptr ) {
+        return FunVal::equals(v);
+    }
+    return other->formal_arg == this->formal_arg && ast->equals(ast->op1[node], *other->ast, other->ast->op1[other->node]);
+}
+
+/**
+* \brief prints 'this' the way FunVal prints
+* \param ostream used to print out
+*/
+void FlatFunVal::print(std::ostream &ostream) {
+    ostream << "[_fun (" << this->formal_arg << ") ";
+    ast->print(ast->op1[node], ostream);
+    ostream << "]";
+}
+
+/**
+* \brief makes the frame a call runs in, with actual_arg in slot 0
+* \param actual_arg value bound to formal_arg
+* \return new frame whose parent holds the captured values
+*/
+PTR(Env) FlatFunVal::frame(const Value &actual_arg) const {
+    PTR(Env) frame = NEW(FrameEnv)(resolved->addresses[node].depth, env);
+    frame->bind_at(0, actual_arg);
+    return frame;
+}
+
+/**
+* \brief runs the body with formal_arg bound to actual_arg
+* \param actual_arg Val to bind
+* \return result of the body
+*/
+PTR(Val) FlatFunVal::call(PTR(Val) const &actual_arg) {
+    GcNoCollection native_caller;
+    return flat_run(resolved, ast->op1[node], frame(Value(actual_arg))).to_val();
+}
+
+/**
+* \brief calls 'this' from CallExpr::interp_step, the body has no Expr to hand back so it runs here
+* \param actual_arg value to bind
+* \param env unused
+* \param tail unused
+* \return result of the body
+*/
+Value FlatFunVal::call_step(const Value &actual_arg, PTR(Env) &env, PTR(Expr) &tail) {
+    GcNoCollection native_caller;
+    return flat_run(resolved, ast->op1[node], frame(actual_arg));
+}
+
+/**
+* \brief calls 'this' from the CEK machine, the body runs on the table
+* \param cek machine to give the result to
+* \param actual_arg value to bind
+*/
+void FlatFunVal::apply(Cek &cek, const Value &actual_arg) {
+    GcNoCollection native_caller;
+    cek.ret(flat_run(resolved, ast->op1[node], frame(actual_arg)));
+}
+
+//**********************FLAT INTERP IMPLEMENTATION **************************************
+
+/**
+* \brief evaluates node the way Expr::evaluate does for a resolved expression, without recursing. A node
+    waiting on an operand goes on a stack of FlatFrames, let bodies, if branches and calls of flat closures
+    replace the node being evaluated, so they take no frame at all. Variables are read from the slots their
+    addresses give, lets store into the running frame and calls make a frame over the closure's captured
+    values. Each time a node is resumed is a safe point
+* \param resolved addresses of the table holding node
+* \param node node to evaluate
+* \param env frame node runs in
+* \throws std::runtime_error with the same messages as Expr::interp
+* \return value of node
+*/
+Value flat_run(std::shared_ptr<const FlatAddresses> resolved, uint32_t node, PTR(Env) env) {
+    std::vector<FlatFrame> stack;
+    std::vector<std::shared_ptr<const FlatAddresses> > held;//tables other than resolved entered so far
+    const FlatAddresses *r = resolved.get();
+    const FlatAst *t = r->ast.get();
+    Value val;
+    FlatRoots roots(stack, env, val);
+    while (1) {
+        //evaluate node, down to a value or the first operand it waits on
+        uint32_t a = t->op0[node];
+        bool operand = true;
+        switch (t->kinds[node]) {
+            case expr_num:
+                val = Value::num(t->literals[a]);
+                operand = false;
+                break;
+            case expr_bool:
+                val = Value::boolean(a != 0);
+                operand = false;
+                break;
+            case expr_var: {
+                const Address &address = r->addresses[node];
+                val = env->lookup_at(address.depth, address.slot);
+                operand = false;
+                break;
+            }
+            case expr_fun: {
+                const std::vector<Address> &from = r->captured_from[r->addresses[node].slot];
+                std::vector<Value> captured;
+                captured.reserve(from.size());
+                for ( size_t i = 0; i < from.size(); i++ ) {
+                    captured.push_back(env->lookup_at(from[i].depth, from[i].slot));
+                }
+                val = Value::function(NEW(FlatFunVal)(resolved, node, NEW(FrameEnv)(captured, nullptr)));
+                operand = false;
+                break;
+            }
+            case expr_let:
+                stack.push_back(FlatFrame{ r, node, false, env, Value() });
+                node = t->op1[node];
+                break;
+            default:
+                stack.push_back(FlatFrame{ r, node, false, env, Value() });
+                node = a;
+        }
+        if ( operand ) {
+            continue;
+        }
+
+        //hand val to the frames waiting on it, until one has another node to evaluate
+        bool resumed = false;
+        while ( !resumed ) {
+            if ( stack.empty() ) {
+                return val;
+            }
+            FlatFrame &frame = stack.back();
+            const FlatAddresses *fr = frame.resolved;
+            const FlatAst *ft = fr->ast.get();
+            uint32_t n = frame.node;
+            expr_kind_t kind = (expr_kind_t)ft->kinds[n];
+            if ( !frame.second && kind != expr_let && kind != expr_if ) {
+                frame.second = true;
+                frame.val = val;
+                env = frame.env;
+                r = switch_table(resolved, fr, held);
+                t = ft;
+                node = ft->op1[n];
+                resumed = true;
+                continue;
+            }
+            Value lhs_val = frame.val;
+            PTR(Env) frame_env = frame.env;
+            stack.pop_back();
+            switch (kind) {
+                case expr_add:
+                    val = lhs_val.add_to(val);
+                    break;
+                case expr_mult:
+                    val = lhs_val.mult_with(val);
+                    break;
+                case expr_eq:
+                    val = Value::boolean(lhs_val.equals(val));
+                    break;
+                case expr_let:
+                    env = frame_env;
+                    env->bind_at(fr->addresses[n].slot, val);
+                    r = switch_table(resolved, fr, held);
+                    t = ft;
+                    node = ft->op2[n];
+                    resumed = true;
+                    break;
+                case expr_if:
+                    env = frame_env;
+                    r = switch_table(resolved, fr, held);
+                    t = ft;
+                    node = val.is_true() ? ft->op1[n] : ft->op2[n];
+                    resumed = true;
+                    break;
+                default: {
+                    FlatFunVal *fun = lhs_val.is_num() || lhs_val.is_bool() ? nullptr : dynamic_cast<FlatFunVal*>(lhs_val.raw_boxed());
+                    if ( fun == nullptr ) {
+                        val = lhs_val.call(val);
+                        break;
+                    }
+                    env = fun->frame(val);
+                    node = fun->ast->op1[fun->node];
+                    if ( fun->resolved != resolved && std::find(held.begin(), held.end(), fun->resolved) == held.end() ) {
+                        held.push_back(fun->resolved);
+                    }
+                    r = switch_table(resolved, fun->resolved.get(), held);
+                    t = r->ast.get();
+                    resumed = true;
+                }
+            }
+        }
+        GcHeap::safe_point();
+    }
+}
+
+/**
+* \brief resolves node and evaluates it in a frame of its own
+* \param ast table holding node
+* \param node node to evaluate
+* \throws std::runtime_error naming the first unbound variable before anything runs, or with the same
+    messages as Expr::interp
+* \return value of node
+*/
+Value flat_evaluate(std::shared_ptr<const FlatAst> ast, uint32_t node) {
+    std::shared_ptr<const FlatAddresses> resolved = FlatAddresses::resolve(std::move(ast), node);
+    return flat_run(resolved, resolved->root, NEW(FrameEnv)(resolved->num_slots, nullptr));
+}
+
+/**
+* \brief evaluates the root of a table
+* \param ast table to run
+* \return Val object result of the expression
+*/
+PTR(Val) flat_interp(const std::shared_ptr<const FlatAst> &ast) {
+    return flat_evaluate(ast, ast->root).to_val();
+}
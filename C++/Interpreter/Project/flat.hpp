@@ -0,0 +1,123 @@
+/**
+* \file flat.hpp
+* \brief contains the flat (struct-of-arrays) expression table declarations
+*/
+
+#ifndef flat_hpp
+#define flat_hpp
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <ostream>
+#include <stdint.h>
+#include "pointer.hpp"
+#include "Expr.hpp"
+#include "Val.hpp"
+#include "resolve.hpp"
+
+/*! \brief a whole expression stored as parallel arrays, one entry per node
+* node ids index every array, children are added before their parents and the root is added last.
+* the operands of each kind are
+*   num: op0 index into literals
+*   bool: op0 0 or 1
+*   var: op0 symbol id
+*   add, mult, eq: op0 lhs, op1 rhs
+*   let: op0 symbol id of lhs, op1 rhs, op2 body
+*   if: op0 test, op1 then, op2 else
+*   fun: op0 symbol id of formal_arg, op1 body
+*   call: op0 function, op1 actual arg
+* so a node costs 13 bytes with no pointers, and subtrees left alone by subst are shared
+*/
+class FlatAst {
+public:
+    std::vector<uint8_t> kinds;///< expr_kind_t of each node
+    std::vector<uint32_t> op0;///< first operand of each node
+    std::vector<uint32_t> op1;///< second operand of each node, 0 when unused
+    std::vector<uint32_t> op2;///< third operand of each node, 0 when unused
+    std::vector<int> literals;///< values of the number nodes
+    uint32_t root;///< node of the whole expression
+
+    FlatAst();
+    static std::shared_ptr<FlatAst> flatten(PTR(Expr) const &expr);
+
+    uint32_t num(int val);
+    uint32_t boolean(bool val);
+    uint32_t var(Symbol name);
+    uint32_t add(uint32_t lhs, uint32_t rhs);
+    uint32_t mult(uint32_t lhs, uint32_t rhs);
+    uint32_t eq(uint32_t lhs, uint32_t rhs);
+    uint32_t let(Symbol lhs, uint32_t rhs, uint32_t body);
+    uint32_t cond(uint32_t test_part, uint32_t then_part, uint32_t else_part);
+    uint32_t fun(Symbol formal_arg, uint32_t body);
+    uint32_t call(uint32_t to_be_called, uint32_t actual_arg);
+
+    /**
+    * \brief number of nodes
+    */
+    size_t size() const { return this->kinds.size(); }
+    size_t bytes() const;
+
+    PTR(Expr) to_expr(uint32_t node) const;
+    void print(uint32_t node, std::ostream &ostream) const;
+    std::string to_string(uint32_t node) const;
+    bool equals(uint32_t node, const FlatAst &other, uint32_t other_node) const;
+    uint32_t subst(uint32_t node, Symbol valToSub, uint32_t replacement);
+
+private:
+    friend class FlatAddresses;
+    int children(uint32_t node, uint32_t *children) const;
+    void print_part(uint32_t node, int i, std::ostream &ostream) const;
+    uint32_t add_node(expr_kind_t kind, uint32_t a, uint32_t b = 0, uint32_t c = 0);
+};
+
+/*! \brief lexical addresses of the nodes under one node of a FlatAst, found with the scopes of a Resolver
+* indexed by node id like the table, the address of each kind is
+*   var: frame and slot holding the variable
+*   let: slot of the running frame bound to lhs
+*   fun: depth is the frame size of a call, slot indexes captured_from
+* and left 0 for the other nodes. A variable, let or function node the tree reaches twice, which only
+* subst makes, could need two addresses, so such a tree is resolved from a copy laid out as a tree
+*/
+class FlatAddresses {
+public:
+    std::shared_ptr<const FlatAst> ast;///< table resolved, a copy if the one given shared nodes
+    uint32_t root;///< node resolved
+    int num_slots;///< frame size of root
+    std::vector<Address> addresses;///< address of each node
+    std::vector<std::vector<Address> > captured_from;///< addresses in the enclosing frame a closure copies
+
+    static std::shared_ptr<const FlatAddresses> resolve(std::shared_ptr<const FlatAst> ast, uint32_t node);
+
+private:
+    bool resolve_tree();
+};
+
+/*! \brief closure over a function node of a FlatAst, holding only the values the function captures
+* the body is only turned back into an Expr if something asks for it through body_expr()
+*/
+class FlatFunVal : public FunVal {
+public:
+    std::shared_ptr<const FlatAddresses> resolved;///< addresses of the table holding the function
+    const FlatAst *ast;///< table holding the function, kept alive by resolved
+    uint32_t node;///< the fun node
+
+    FlatFunVal(std::shared_ptr<const FlatAddresses> resolved, uint32_t node, PTR(Env) captured);
+    PTR(Expr) body_expr();
+    bool equals(PTR(Val) const &v);
+    void print(std::ostream &ostream);
+    PTR(Val) call(PTR(Val) const &actual_arg);
+    Value call_step(const Value &actual_arg, PTR(Env) &env, PTR(Expr) &tail);
+    void apply(Cek &cek, const Value &actual_arg);
+
+private:
+    PTR(Env) frame(const Value &actual_arg) const;
+
+    friend Value flat_run(std::shared_ptr<const FlatAddresses> resolved, uint32_t node, PTR(Env) env);
+};
+
+Value flat_run(std::shared_ptr<const FlatAddresses> resolved, uint32_t node, PTR(Env) env);
+Value flat_evaluate(std::shared_ptr<const FlatAst> ast, uint32_t node);
+PTR(Val) flat_interp(const std::shared_ptr<const FlatAst> &ast);
+
+#endif /* flat_hpp */
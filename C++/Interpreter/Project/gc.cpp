@@ -0,0 +1,188 @@
+/**
+* \file gc.cpp
+* \brief contains the generational mark-sweep heap implementations
+*/
+
+#include "pointer.hpp"
+
+//**********************GCROOTS CLASS IMPLEMENTATIONS ***********************************
+
+/**
+* \brief constructor to register roots with heap until destroyed
+* \param heap heap whose collections mark from 'this'
+*/
+GcRoots::GcRoots(GcHeap &heap) : heap(heap) {
+    this->next = heap.roots;
+    heap.roots = this;
+}
+
+/**
+* \brief unregisters 'this', roots are destroyed in the reverse order they were made
+*/
+GcRoots::~GcRoots() {
+    heap.roots = this->next;
+}
+
+//**********************GCHEAP CLASS IMPLEMENTATIONS ************************************
+
+/**
+* \brief constructor to make an empty heap
+*/
+GcHeap::GcHeap() {
+    this->roots = nullptr;
+    this->full = false;
+    this->nursery_limit = 8192;
+    this->old_limit = 8192;
+    this->minors = 0;
+    this->majors = 0;
+    this->allowed = 0;
+    this->paused = 0;
+}
+
+/**
+* \brief frees every object still tracked
+*/
+GcHeap::~GcHeap() {
+    for (size_t i = 0; i < young.size(); i++) {
+        delete young[i];
+    }
+    for (size_t i = 0; i < old.size(); i++) {
+        delete old[i];
+    }
+}
+
+/**
+* \brief heap of the calling thread, objects never move between threads
+* \return the heap
+*/
+GcHeap &GcHeap::current() {
+    static thread_local GcHeap heap;
+    return heap;
+}
+
+/**
+* \brief hands a new object to the collector as young
+* \param object object made with plain new
+*/
+void GcHeap::track(GcObject *object) {
+    object->gc_flags = 0;
+    young.push_back(object);
+}
+
+/**
+* \brief minor collection, followed by a major one when the old generation has doubled
+*/
+void GcHeap::collect() {
+    collect_minor();
+    if ( old.size() > old_limit ) {
+        collect_major();
+    }
+}
+
+/**
+* \brief frees the unreachable young objects and promotes the rest
+*/
+void GcHeap::collect_minor() {
+    this->full = false;
+    mark_roots();
+    for (size_t i = 0; i < remembered.size(); i++) {
+        remembered[i]->trace(*this);
+    }
+    drain();
+    for (size_t i = 0; i < remembered.size(); i++) {
+        remembered[i]->gc_flags &= ~gc_remembered;
+    }
+    remembered.clear();
+
+    std::vector<GcObject *> nursery;
+    nursery.swap(young);
+    sweep(nursery, old);
+    minors++;
+}
+
+/**
+* \brief frees every unreachable object, young or old
+*/
+void GcHeap::collect_major() {
+    this->full = true;
+    mark_roots();
+    drain();
+    for (size_t i = 0; i < remembered.size(); i++) {
+        remembered[i]->gc_flags &= ~gc_remembered;
+    }
+    remembered.clear();
+
+    std::vector<GcObject *> survivors;
+    sweep(young, survivors);
+    young.clear();
+    sweep(old, survivors);
+    old.swap(survivors);
+    old_limit = old.size() * 2 > 8192 ? old.size() * 2 : 8192;
+    majors++;
+}
+
+/**
+* \brief marks object and queues it to have its children marked
+* \param object object to mark, skipped if nullptr, untracked, already marked,
+    or old during a minor collection
+*/
+void GcHeap::mark_object(const GcObject *object) {
+    if ( object == nullptr ) {
+        return;
+    }
+    unsigned char skip = gc_untracked | gc_marked | (this->full ? 0 : gc_old);
+    if ( object->gc_flags & skip ) {
+        return;
+    }
+    object->gc_flags |= gc_marked;
+    worklist.push_back(object);
+}
+
+/**
+* \brief adds an old holder to the remembered set, so its young children survive minor collections
+* \param holder object a young pointer was written to
+*/
+void GcHeap::remember(const GcObject *holder) {
+    if ( (holder->gc_flags & (gc_old | gc_remembered)) == gc_old ) {
+        holder->gc_flags |= gc_remembered;
+        remembered.push_back(holder);
+    }
+}
+
+/**
+* \brief marks from every registered GcRoots
+*/
+void GcHeap::mark_roots() {
+    for (GcRoots *r = roots; r != nullptr; r = r->next) {
+        r->trace_roots(*this);
+    }
+}
+
+/**
+* \brief marks children until nothing is queued, an explicit stack so deep lists cannot overflow
+*/
+void GcHeap::drain() {
+    while ( !worklist.empty() ) {
+        const GcObject *object = worklist.back();
+        worklist.pop_back();
+        object->trace(*this);
+    }
+}
+
+/**
+* \brief frees the unmarked objects, moves the marked ones to survivors as old
+* \param objects objects to sweep
+* \param survivors where the objects still reachable go
+*/
+void GcHeap::sweep(std::vector<GcObject *> &objects, std::vector<GcObject *> &survivors) {
+    for (size_t i = 0; i < objects.size(); i++) {
+        GcObject *object = objects[i];
+        if ( object->gc_flags & gc_marked ) {
+            object->gc_flags = gc_old;
+            survivors.push_back(object);
+        }
+        else {
+            delete object;
+        }
+    }
+}
@@ -0,0 +1,235 @@
+/**
+* \file gc.hpp
+* \brief contains the generational mark-sweep heap declarations
+*/
+
+#ifndef gc_hpp
+#define gc_hpp
+
+#include <stddef.h>
+#include <vector>
+
+class GcHeap;
+
+/*! \brief custom enum of the collector's bits in a GcObject */
+typedef enum {
+    gc_untracked = 1,   ///< not made by the heap (static, stack or plain new), never marked, traced or freed
+    gc_old = 2,         ///< survived a collection, only a major collection frees it
+    gc_marked = 4,      ///< reached during the current collection
+    gc_remembered = 8   ///< old object in the remembered set
+} gc_flag_t;
+
+/*! \brief base of objects the heap can free
+* objects start untracked, GcHeap::track hands them to the collector as young
+*/
+class GcObject {
+public:
+    GcObject() : gc_flags(gc_untracked) {}
+    GcObject(const GcObject &) : gc_flags(gc_untracked) {}
+    GcObject &operator=(const GcObject &) { return *this; }
+    virtual ~GcObject() {}
+
+    /**
+    * \brief marks every object 'this' points to
+    * \param heap heap collecting
+    */
+    virtual void trace(GcHeap &heap) const {}
+
+private:
+    friend class GcHeap;
+    mutable unsigned char gc_flags;///< gc_flag_t bits
+};
+
+/*! \brief live pointers held by an evaluator while it runs
+* registering with the heap for the life of the object, collections start marking here
+*/
+class GcRoots {
+public:
+    GcRoots(GcHeap &heap);
+    virtual ~GcRoots();
+
+    /**
+    * \brief marks every object the evaluator holds
+    * \param heap heap collecting
+    */
+    virtual void trace_roots(GcHeap &heap) const = 0;
+
+private:
+    friend class GcHeap;
+    GcHeap &heap;///< heap registered with
+    GcRoots *next;///< roots registered before 'this'
+
+    GcRoots(const GcRoots &);
+    GcRoots &operator=(const GcRoots &);
+};
+
+/*! \brief mark-sweep heap with a nursery
+* new objects are young, a minor collection marks only young objects, starting from the roots and
+* from old objects written to since the last collection, and promotes the survivors.
+* once the old generation doubles a major collection marks and sweeps everything.
+* collections only run at safe points, and only inside a GcAllowCollection with no GcNoCollection,
+* since pointers held in native locals elsewhere are not roots
+*/
+class GcHeap {
+public:
+    GcHeap();
+    ~GcHeap();
+
+    static GcHeap &current();
+
+    void track(GcObject *object);
+    void collect();
+    void collect_minor();
+    void collect_major();
+
+    /**
+    * \brief marks object, a no-op unless Val and Env are collected (USE_GC_POINTERS)
+    * \param object object to mark, may be nullptr
+    */
+    template<class T>
+    void mark(T *object) {
+#if USE_GC_POINTERS
+        mark_object(object);
+#else
+        (void)object;
+#endif
+    }
+    void mark_object(const GcObject *object);
+
+    /**
+    * \brief write barrier, call after storing target in holder once holder is built
+    * \param holder object written to
+    * \param target object stored, may be nullptr
+    */
+    template<class T, class U>
+    static void written(T *holder, U *target) {
+#if USE_GC_POINTERS
+        if ( target != nullptr && (static_cast<const GcObject *>(target)->gc_flags & (gc_untracked | gc_old)) == 0 ) {
+            current().remember(holder);
+        }
+#else
+        (void)holder;
+        (void)target;
+#endif
+    }
+    void remember(const GcObject *holder);
+
+    /**
+    * \brief collects if the nursery is full and collecting is allowed, call where an evaluator
+        holds every live pointer in its GcRoots
+    */
+    static void safe_point() {
+#if USE_GC_POINTERS
+        GcHeap &heap = current();
+        if ( heap.young.size() >= heap.nursery_limit && heap.allowed > 0 && heap.paused == 0 ) {
+            heap.collect();
+        }
+#endif
+    }
+
+    /**
+    * \brief collects whatever a finished run left behind if collecting is allowed, call where a driver is
+        between top level programs and holds nothing the last one made
+    */
+    static void end_of_run() {
+#if USE_GC_POINTERS
+        GcHeap &heap = current();
+        if ( heap.allowed > 0 && heap.paused == 0 ) {
+            heap.collect();
+        }
+#endif
+    }
+
+    /**
+    * \brief objects tracked and not yet freed
+    */
+    size_t live_objects() const { return this->young.size() + this->old.size(); }
+    size_t young_objects() const { return this->young.size(); }
+    size_t minor_collections() const { return this->minors; }
+    size_t major_collections() const { return this->majors; }
+
+    /**
+    * \brief number of young objects that makes safe_point collect
+    */
+    void set_nursery_limit(size_t limit) { this->nursery_limit = limit; }
+
+private:
+    friend class GcRoots;
+    friend class GcAllowCollection;
+    friend class GcNoCollection;
+
+    std::vector<GcObject *> young;///< objects made since the last collection
+    std::vector<GcObject *> old;///< objects that survived one
+    std::vector<const GcObject *> remembered;///< old objects that may point to young ones
+    std::vector<const GcObject *> worklist;///< marked objects whose children are not marked yet
+    GcRoots *roots;///< innermost registered roots
+    bool full;///< marking old objects too
+    size_t nursery_limit;///< see set_nursery_limit
+    size_t old_limit;///< old generation size that triggers a major collection
+    size_t minors;///< minor collections run
+    size_t majors;///< major collections run
+    int allowed;///< open GcAllowCollection scopes
+    int paused;///< open GcNoCollection scopes
+
+    void mark_roots();
+    void drain();
+    void sweep(std::vector<GcObject *> &objects, std::vector<GcObject *> &survivors);
+
+    GcHeap(const GcHeap &);
+    GcHeap &operator=(const GcHeap &);
+};
+
+/*! \brief lets safe points on this thread collect, for drivers that keep no pointers of their own across a run */
+class GcAllowCollection {
+public:
+#if USE_GC_POINTERS
+    GcAllowCollection() { GcHeap::current().allowed++; }
+    ~GcAllowCollection() { GcHeap::current().allowed--; }
+#else
+    GcAllowCollection() { }///< nothing to count, user-provided so a guard is not an unused variable
+#endif
+};
+
+/*! \brief stops safe points on this thread collecting, for native code re-entering an evaluator
+    while holding pointers of its own */
+class GcNoCollection {
+public:
+#if USE_GC_POINTERS
+    GcNoCollection() { GcHeap::current().paused++; }
+    ~GcNoCollection() { GcHeap::current().paused--; }
+#else
+    GcNoCollection() { }///< nothing to count, user-provided so a guard is not an unused variable
+#endif
+};
+
+/*! \brief roots one Value or collected pointer held in a native local of a recursive evaluator, for as long as
+    the local is in scope, so safe points reached by deeper calls do not free it */
+class GcLocalRoot
+#if USE_GC_POINTERS
+    : public GcRoots
+#endif
+{
+public:
+#if USE_GC_POINTERS
+    template<class T>
+    GcLocalRoot(const T &local) : GcRoots(GcHeap::current()), local(&local), tracer(&trace_local<T>) { }
+
+    void trace_roots(GcHeap &heap) const { tracer(heap, local); }
+
+private:
+    const void *local;///< the rooted local
+    void (*tracer)(GcHeap &, const void *);///< marks local as the type it was rooted as
+
+    template<class T>
+    static void trace_local(GcHeap &heap, const void *local) { trace_one(heap, *static_cast<const T *>(local)); }
+    template<class T>
+    static void trace_one(GcHeap &heap, T *const &pointer) { heap.mark(pointer); }
+    template<class T>
+    static void trace_one(GcHeap &heap, const T &value) { value.trace(heap); }
+#else
+    template<class T>
+    GcLocalRoot(const T &local) { (void)local; }///< nothing to root, nothing is collected
+#endif
+};
+
+#endif /* gc_hpp */
@@ -0,0 +1,261 @@
+/**
+* \file hashcons.cpp
+* \brief contains the hash-consing expression factory implementations
+        every builder looks its node up by hash and shallow structure before making a new one
+*/
+
+#include "hashcons.hpp"
+#include <atomic>
+
+thread_local ExprFactory *ExprFactory::current_factory = nullptr;
+
+namespace {
+
+/**
+* \brief source of table ids, 0 is left for nodes in no table
+*/
+std::atomic<uint32_t> next_table_id(1);
+
+}
+
+//**********************EXPRFACTORY CLASS IMPLEMENTATIONS *******************************
+
+/**
+* \brief constructor to make an empty table with a fresh id
+*/
+ExprFactory::ExprFactory() {
+    this->id_ = next_table_id++;
+    this->hits = 0;
+}
+
+/**
+* \brief canonical node of hash, made and added if the table has none
+* \param hash hash the node has or will have
+* \param same tells whether an interned node of the same hash has the same kind, fields and children
+* \param make builds the node when none is found
+* \return the canonical node
+*/
+template<class Same, class Make>
+PTR(Expr) ExprFactory::intern(size_t hash, Same same, Make make) {
+    typedef std::unordered_multimap<size_t, PTR(Expr)>::iterator iterator;
+    std::pair<iterator, iterator> range = nodes.equal_range(hash);
+    for (iterator it = range.first; it != range.second; ++it) {
+        if ( same(RAW(it->second)) ) {
+            hits++;
+            return it->second;
+        }
+    }
+    PTR(Expr) e = make();
+    e->table = this->id_;
+    nodes.insert(std::make_pair(hash, e));
+    return e;
+}
+
+/**
+* \brief builds a number expression
+* \param val the number
+* \return canonical NumExpr
+*/
+PTR(Expr) ExprFactory::num(int val) {
+    ExprFactory *f = current_factory;
+    if ( f == nullptr ) {
+        return NEW(NumExpr)(val);
+    }
+    return f->intern(Expr::hash_of(expr_num, (size_t)(unsigned)val),
+                     [&](Expr *e) { return e->kind == expr_num && static_cast<NumExpr*>(e)->val == val; },
+                     [&]() { return NEW(NumExpr)(val); });
+}
+
+/**
+* \brief builds a boolean expression
+* \param val the boolean
+* \return canonical BoolExpr
+*/
+PTR(Expr) ExprFactory::boolean(bool val) {
+    ExprFactory *f = current_factory;
+    if ( f == nullptr ) {
+        return NEW(BoolExpr)(val);
+    }
+    return f->intern(Expr::hash_of(expr_bool, val ? 1 : 0),
+                     [&](Expr *e) { return e->kind == expr_bool && static_cast<BoolExpr*>(e)->boolean == val; },
+                     [&]() { return NEW(BoolExpr)(val); });
+}
+
+/**
+* \brief builds a variable expression
+* \param name the variable
+* \return canonical VarExpr
+*/
+PTR(Expr) ExprFactory::var(Symbol name) {
+    ExprFactory *f = current_factory;
+    if ( f == nullptr ) {
+        return NEW(VarExpr)(name);
+    }
+    return f->intern(Expr::hash_of(expr_var, name.id()),
+                     [&](Expr *e) { return e->kind == expr_var && static_cast<VarExpr*>(e)->value == name; },
+                     [&]() { return NEW(VarExpr)(name); });
+}
+
+/**
+* \brief builds an add expression
+* \param lhs left hand side
+* \param rhs right hand side
+* \return canonical AddExpr, or a new one in no table when a side is not interned in the current table
+*/
+PTR(Expr) ExprFactory::add(PTR(Expr) const &lhs, PTR(Expr) const &rhs) {
+    ExprFactory *f = current_factory;
+    if ( f == nullptr || !f->owns(lhs) || !f->owns(rhs) ) {
+        return NEW(AddExpr)(lhs, rhs);
+    }
+    return f->intern(Expr::hash_of(expr_add, lhs->hash, rhs->hash),
+                     [&](Expr *e) {
+                         return e->kind == expr_add && static_cast<AddExpr*>(e)->lhs == lhs && static_cast<AddExpr*>(e)->rhs == rhs;
+                     },
+                     [&]() { return NEW(AddExpr)(lhs, rhs); });
+}
+
+/**
+* \brief builds a multiplication expression
+* \param lhs left hand side
+* \param rhs right hand side
+* \return canonical MultExpr, or a new one in no table when a side is not interned in the current table
+*/
+PTR(Expr) ExprFactory::mult(PTR(Expr) const &lhs, PTR(Expr) const &rhs) {
+    ExprFactory *f = current_factory;
+    if ( f == nullptr || !f->owns(lhs) || !f->owns(rhs) ) {
+        return NEW(MultExpr)(lhs, rhs);
+    }
+    return f->intern(Expr::hash_of(expr_mult, lhs->hash, rhs->hash),
+                     [&](Expr *e) {
+                         return e->kind == expr_mult && static_cast<MultExpr*>(e)->lhs == lhs && static_cast<MultExpr*>(e)->rhs == rhs;
+                     },
+                     [&]() { return NEW(MultExpr)(lhs, rhs); });
+}
+
+/**
+* \brief builds an equality expression
+* \param lhs left hand side
+* \param rhs right hand side
+* \return canonical EqExpr, or a new one in no table when a side is not interned in the current table
+*/
+PTR(Expr) ExprFactory::eq(PTR(Expr) const &lhs, PTR(Expr) const &rhs) {
+    ExprFactory *f = current_factory;
+    if ( f == nullptr || !f->owns(lhs) || !f->owns(rhs) ) {
+        return NEW(EqExpr)(lhs, rhs);
+    }
+    return f->intern(Expr::hash_of(expr_eq, lhs->hash, rhs->hash),
+                     [&](Expr *e) {
+                         return e->kind == expr_eq && static_cast<EqExpr*>(e)->lhs == lhs && static_cast<EqExpr*>(e)->rhs == rhs;
+                     },
+                     [&]() { return NEW(EqExpr)(lhs, rhs); });
+}
+
+/**
+* \brief builds a let expression
+* \param lhs variable bound
+* \param rhs bound expression
+* \param body expression lhs is bound in
+* \return canonical LetExpr, or a new one in no table when rhs or body is not interned in the current table
+*/
+PTR(Expr) ExprFactory::let(Symbol lhs, PTR(Expr) const &rhs, PTR(Expr) const &body) {
+    ExprFactory *f = current_factory;
+    if ( f == nullptr || !f->owns(rhs) || !f->owns(body) ) {
+        return NEW(LetExpr)(lhs, rhs, body);
+    }
+    return f->intern(Expr::hash_of(expr_let, lhs.id(), rhs->hash, body->hash),
+                     [&](Expr *e) {
+                         if ( e->kind != expr_let ) {
+                             return false;
+                         }
+                         LetExpr *let = static_cast<LetExpr*>(e);
+                         return let->lhs == lhs && let->rhs == rhs && let->body == body;
+                     },
+                     [&]() { return NEW(LetExpr)(lhs, rhs, body); });
+}
+
+/**
+* \brief builds an if expression
+* \param test_part condition
+* \param then_part used when it is true
+* \param else_part used when it is false
+* \return canonical IfExpr, or a new one in no table when a part is not interned in the current table
+*/
+PTR(Expr) ExprFactory::cond(PTR(Expr) const &test_part, PTR(Expr) const &then_part, PTR(Expr) const &else_part) {
+    ExprFactory *f = current_factory;
+    if ( f == nullptr || !f->owns(test_part) || !f->owns(then_part) || !f->owns(else_part) ) {
+        return NEW(IfExpr)(test_part, then_part, else_part);
+    }
+    return f->intern(Expr::hash_of(expr_if, test_part->hash, then_part->hash, else_part->hash),
+                     [&](Expr *e) {
+                         if ( e->kind != expr_if ) {
+                             return false;
+                         }
+                         IfExpr *cond = static_cast<IfExpr*>(e);
+                         return cond->test_part == test_part && cond->then_part == then_part
+                             && cond->else_part == else_part;
+                     },
+                     [&]() { return NEW(IfExpr)(test_part, then_part, else_part); });
+}
+
+/**
+* \brief builds a function expression
+* \param formal_arg variable bound by a call
+* \param body body of the function
+* \param free_names variables free in the function when the caller knows them, nullptr to leave them for later
+* \return canonical FunExpr, or a new one in no table when body is not interned in the current table
+*/
+PTR(Expr) ExprFactory::fun(Symbol formal_arg, PTR(Expr) const &body, FreeVars free_names) {
+    ExprFactory *f = current_factory;
+    if ( f == nullptr || !f->owns(body) ) {
+        return NEW(FunExpr)(formal_arg, body, std::move(free_names));
+    }
+    return f->intern(Expr::hash_of(expr_fun, formal_arg.id(), body->hash),
+                     [&](Expr *e) {
+                         if ( e->kind != expr_fun ) {
+                             return false;
+                         }
+                         FunExpr *fun = static_cast<FunExpr*>(e);
+                         return fun->formal_arg == formal_arg && fun->body == body;
+                     },
+                     [&]() { return NEW(FunExpr)(formal_arg, body, free_names); });
+}
+
+/**
+* \brief builds a call expression
+* \param to_be_called function expression
+* \param actual_arg argument expression
+* \return canonical CallExpr, or a new one in no table when a side is not interned in the current table
+*/
+PTR(Expr) ExprFactory::call(PTR(Expr) const &to_be_called, PTR(Expr) const &actual_arg) {
+    ExprFactory *f = current_factory;
+    if ( f == nullptr || !f->owns(to_be_called) || !f->owns(actual_arg) ) {
+        return NEW(CallExpr)(to_be_called, actual_arg);
+    }
+    return f->intern(Expr::hash_of(expr_call, to_be_called->hash, actual_arg->hash),
+                     [&](Expr *e) {
+                         if ( e->kind != expr_call ) {
+                             return false;
+                         }
+                         CallExpr *call = static_cast<CallExpr*>(e);
+                         return call->to_be_called == to_be_called && call->actual_arg == actual_arg;
+                     },
+                     [&]() { return NEW(CallExpr)(to_be_called, actual_arg); });
+}
+
+//**********************EXPRFACTORYSCOPE CLASS IMPLEMENTATIONS **************************
+
+/**
+* \brief constructor to make factory the current table
+* \param factory table the builders intern into, nullptr for none
+*/
+ExprFactoryScope::ExprFactoryScope(ExprFactory *factory) {
+    this->saved = ExprFactory::current_factory;
+    ExprFactory::current_factory = factory;
+}
+
+/**
+* \brief restores the table that was current before
+*/
+ExprFactoryScope::~ExprFactoryScope() {
+    ExprFactory::current_factory = this->saved;
+}
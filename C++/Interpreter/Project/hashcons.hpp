@@ -0,0 +1,86 @@
+/**
+* \file hashcons.hpp
+* \brief contains the hash-consing expression factory declarations
+*/
+
+#ifndef hashcons_hpp
+#define hashcons_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include "pointer.hpp"
+#include "symbol.hpp"
+#include "Expr.hpp"
+
+/*! \brief table keeping one canonical node per expression structure
+* a node is only interned when its children are interned in the same table, so two nodes of one
+* table are structurally equal exactly when they are the same node and Expr::equals stops at the pointers.
+* the builders go through the table of the innermost ExprFactoryScope on the thread, with none they
+* fall back to NEW and the node belongs to no table
+*/
+class ExprFactory {
+public:
+    ExprFactory();
+
+    /**
+    * \brief id stamped on the nodes of 'this', never reused by a later table
+    */
+    uint32_t id() const { return this->id_; }
+
+    /**
+    * \brief number of distinct nodes interned
+    */
+    size_t size() const { return this->nodes.size(); }
+
+    /**
+    * \brief nodes built through 'this' that were already in the table
+    */
+    size_t shared() const { return this->hits; }
+
+    /**
+    * \brief table the builders use on this thread, nullptr for none
+    */
+    static ExprFactory *current() { return current_factory; }
+
+    static PTR(Expr) num(int val);
+    static PTR(Expr) boolean(bool val);
+    static PTR(Expr) var(Symbol name);
+    static PTR(Expr) add(PTR(Expr) const &lhs, PTR(Expr) const &rhs);
+    static PTR(Expr) mult(PTR(Expr) const &lhs, PTR(Expr) const &rhs);
+    static PTR(Expr) eq(PTR(Expr) const &lhs, PTR(Expr) const &rhs);
+    static PTR(Expr) let(Symbol lhs, PTR(Expr) const &rhs, PTR(Expr) const &body);
+    static PTR(Expr) cond(PTR(Expr) const &test_part, PTR(Expr) const &then_part, PTR(Expr) const &else_part);
+    static PTR(Expr) fun(Symbol formal_arg, PTR(Expr) const &body, FreeVars free_names = nullptr);
+    static PTR(Expr) call(PTR(Expr) const &to_be_called, PTR(Expr) const &actual_arg);
+
+private:
+    friend class ExprFactoryScope;
+    static thread_local ExprFactory *current_factory;///< table of the innermost ExprFactoryScope
+
+    uint32_t id_;///< see id()
+    size_t hits;///< see shared()
+    std::unordered_multimap<size_t, PTR(Expr)> nodes;///< interned nodes by hash, keeping them alive
+
+    bool owns(PTR(Expr) const &e) const { return e != nullptr && e->table == this->id_; }
+    template<class Same, class Make>
+    PTR(Expr) intern(size_t hash, Same same, Make make);
+
+    ExprFactory(const ExprFactory &);
+    ExprFactory &operator=(const ExprFactory &);
+};
+
+/*! \brief makes factory the one the ExprFactory builders intern into until the scope ends */
+class ExprFactoryScope {
+public:
+    ExprFactoryScope(ExprFactory *factory);
+    ~ExprFactoryScope();
+
+private:
+    ExprFactory *saved;///< table to restore
+
+    ExprFactoryScope(const ExprFactoryScope &);
+    ExprFactoryScope &operator=(const ExprFactoryScope &);
+};
+
+#endif /* hashcons_hpp */
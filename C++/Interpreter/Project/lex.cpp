@@ -0,0 +1,201 @@
+/**
+* \file lex.cpp
+* \brief contains the tokenizer implementations
+        tokens are scanned straight out of a char buffer read in large blocks, instead of a peek() and get()
+        through the istream for every character, runs of whitespace, digits and letters are skipped by the
+        vector kernels of scan.hpp
+*/
+
+#include "lex.hpp"
+#include <string.h>
+
+namespace {
+
+/**
+* \brief size of the blocks read_all() pulls from a stream
+*/
+const size_t read_block = 1 << 16;
+
+/**
+* \brief whether c is whitespace in the "C" locale
+*/
+bool is_space(char c) {
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+/**
+* \brief whether c can follow a number or a variable, the end of the buffer can too
+*/
+bool ends_word(char c) {
+    return is_space(c) || c == ')' || c == '(' || c == '*' || c == '+' || c == '=';
+}
+
+/**
+* \brief whether c is a decimal digit
+*/
+bool starts_number(char c) {
+    return (unsigned char)(c - '0') <= 9;
+}
+
+/**
+* \brief whether c is an ASCII letter, which starts a variable
+*/
+bool starts_variable(char c) {
+    return (unsigned char)((c | 0x20) - 'a') <= 'z' - 'a';
+}
+
+/**
+* \brief keyword spelled by the length characters at word, without the leading underscore
+* \return its token kind, tok_error when word is no keyword
+*/
+token_kind_t keyword(const char *word, size_t length) {
+    struct Entry {
+        const char *name;
+        token_kind_t kind;
+    };
+    static const Entry keywords[] = {
+        { "let", tok_let }, { "in", tok_in }, { "if", tok_if }, { "then", tok_then },
+        { "else", tok_else }, { "true", tok_true }, { "false", tok_false }, { "fun", tok_fun }
+    };
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+        if ( strlen(keywords[i].name) == length && memcmp(keywords[i].name, word, length) == 0 ) {
+            return keywords[i].kind;
+        }
+    }
+    return tok_error;
+}
+
+}
+
+//**********************LEXER CLASS IMPLEMENTATIONS *************************************
+
+/**
+* \brief constructor to tokenize the characters from begin up to end
+* \param begin first character
+* \param end just past the last character
+*/
+Lexer::Lexer(const char *begin, const char *end) {
+    this->begin = begin;
+    this->pos = begin;
+    this->end = end;
+    this->has_ahead = false;
+    this->taken = 0;
+    this->kernels = &scan_kernels();
+}
+
+/**
+* \brief constructor to tokenize the characters of buffer, which has to outlive the lexer
+* \param buffer input
+*/
+Lexer::Lexer(const std::string &buffer) {
+    this->begin = buffer.data();
+    this->pos = this->begin;
+    this->end = this->begin + buffer.size();
+    this->has_ahead = false;
+    this->taken = 0;
+    this->kernels = &scan_kernels();
+}
+
+/**
+* \brief reads everything left in a stream in large blocks
+* \param in input stream
+* \return the characters read
+*/
+std::string Lexer::read_all(std::istream &in) {
+    std::string buffer;
+    std::streamsize got;
+    do {
+        size_t size = buffer.size();
+        buffer.resize(size + read_block);
+        got = in.rdbuf()->sgetn(&buffer[size], read_block);
+        buffer.resize(size + (size_t)got);
+    } while ( got == (std::streamsize)read_block );
+    in.setstate(std::ios::eofbit);
+    return buffer;
+}
+
+/**
+* \brief reads the token at pos and moves pos past it
+* \return the token, tok_end at the end of the buffer
+*/
+Token Lexer::scan() {
+    Token tok;
+    tok.val = 0;
+    tok.error = nullptr;
+    const char *start = this->kernels->spaces(this->pos, this->end);
+    tok.spaced = start != this->pos;
+    this->pos = start;
+    tok.begin = (size_t)(start - this->begin);
+    if ( start == this->end ) {
+        tok.kind = tok_end;
+        tok.end = tok.begin;
+        return tok;
+    }
+
+    char c = *start;
+    const char *p = start + 1;
+    switch ( c ) {
+    case '(': tok.kind = tok_lparen; break;
+    case ')': tok.kind = tok_rparen; break;
+    case '+': tok.kind = tok_plus; break;
+    case '*': tok.kind = tok_star; break;
+    case '=':
+        if ( p != this->end && *p == '=' ) {
+            tok.kind = tok_eqeq;
+            p++;
+        }
+        else {
+            tok.kind = tok_assign;
+        }
+        break;
+    case '_':
+        p = this->kernels->letters(p, this->end);
+        tok.kind = keyword(start + 1, (size_t)(p - start - 1));
+        if ( tok.kind == tok_error ) {
+            tok.error = "consume mismatch";
+        }
+        break;
+    default:
+        if ( c == '-' || starts_number(c) ) {
+            bool negative = c == '-';
+            if ( negative ) {
+                p = start + 1;
+                if ( p == this->end || !starts_number(*p) ) {
+                    tok.kind = tok_error;
+                    tok.error = "invalid input";
+                    break;
+                }
+            }
+            else {
+                p = start;
+            }
+            //wraps like int arithmetic would, without overflowing a signed value
+            const char *digits = p;
+            p = this->kernels->digits(digits, this->end);
+            unsigned n = digits_value(digits, p);
+            tok.kind = tok_num;
+            tok.val = (int)(negative ? 0u - n : n);
+        }
+        else if ( starts_variable(c) ) {
+            p = this->kernels->letters(p, this->end);
+            tok.kind = tok_var;
+        }
+        else {
+            tok.kind = tok_error;
+            tok.error = "invalid input";
+            break;
+        }
+        if ( p != this->end && !ends_word(*p) ) {
+            //a number or variable running into something else is one bad word
+            while ( p != this->end && !ends_word(*p) ) {
+                p++;
+            }
+            tok.kind = tok_error;
+            tok.error = "invalid input";
+        }
+        break;
+    }
+    this->pos = p;
+    tok.end = (size_t)(p - this->begin);
+    return tok;
+}
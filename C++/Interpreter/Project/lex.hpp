@@ -0,0 +1,112 @@
+/**
+* \file lex.hpp
+* \brief contains the tokenizer declarations
+*/
+
+#ifndef lex_hpp
+#define lex_hpp
+
+#include <stddef.h>
+#include <istream>
+#include <string>
+#include "symbol.hpp"
+#include "scan.hpp"
+
+/*! \brief custom enum naming what a token is
+* tok_error stands for input no token starts with, its message is what parsing it throws
+*/
+typedef enum {
+    tok_num,
+    tok_var,
+    tok_let,
+    tok_in,
+    tok_if,
+    tok_then,
+    tok_else,
+    tok_true,
+    tok_false,
+    tok_fun,
+    tok_lparen,
+    tok_rparen,
+    tok_plus,
+    tok_star,
+    tok_eqeq,
+    tok_assign,
+    tok_end,
+    tok_error
+} token_kind_t;
+
+/*! \brief one token and the span of input it was read from */
+struct Token {
+    token_kind_t kind;///< what the token is
+    size_t begin;///< offset of its first character in the buffer
+    size_t end;///< offset just past its last character
+    bool spaced;///< whether whitespace comes right before it
+    int val;///< value of a tok_num
+    const char *error;///< message of a tok_error
+};
+
+/*! \brief splits a contiguous buffer into tokens, one token of lookahead
+* the buffer is not copied and has to outlive the lexer
+*/
+class Lexer {
+public:
+    Lexer(const char *begin, const char *end);
+    Lexer(const std::string &buffer);
+
+    /**
+    * \brief token next() returns, read once and kept
+    */
+    const Token &peek() {
+        if ( !this->has_ahead ) {
+            this->ahead = scan();
+            this->has_ahead = true;
+        }
+        return this->ahead;
+    }
+
+    /**
+    * \brief reads the next token
+    */
+    Token next() {
+        peek();
+        this->has_ahead = false;
+        this->taken = this->ahead.end;
+        return this->ahead;
+    }
+
+    /**
+    * \brief offset just past the last token next() returned, 0 before the first
+    */
+    size_t consumed() const { return this->taken; }
+
+    /**
+    * \brief first character of the span of tok
+    */
+    const char *at(const Token &tok) const { return this->begin + tok.begin; }
+
+    /**
+    * \brief characters of the span of tok
+    */
+    std::string text(const Token &tok) const { return std::string(at(tok), tok.end - tok.begin); }
+
+    /**
+    * \brief characters of the span of tok, viewed in the buffer without copying
+    */
+    StrView view(const Token &tok) const { return StrView(at(tok), tok.end - tok.begin); }
+
+    static std::string read_all(std::istream &in);
+
+private:
+    const char *begin;///< start of the buffer, spans count from here
+    const char *pos;///< first character not scanned yet
+    const char *end;///< end of the buffer
+    Token ahead;///< token peek() read
+    bool has_ahead;///< whether ahead is waiting to be taken by next()
+    size_t taken;///< see consumed()
+    const ScanKernels *kernels;///< scan_kernels(), looked up once per lexer
+
+    Token scan();
+};
+
+#endif /* lex_hpp */
@@ -7,18 +7,35 @@
 
 #include "cmdline.hpp"
 #include "parse.hpp"
+#include "batch.hpp"
 
 
 int main( int argc, char **argv ) {
     
     try {
         
-        run_mode_t mode = use_arguments(argc,argv);
+        engine_t engine;
+        framing_t framing;
+        std::vector<std::string> files;
+        unsigned jobs;
+        bool lazy;
+        run_mode_t mode = use_arguments(argc,argv, engine, framing, files, jobs, lazy);
+        //the vm and the flat table translate every function before running, so pre-parsing would only add a pass
+        lazy = lazy && ( engine == engine_tree || engine == engine_cek );
+        if ( !files.empty() && mode != do_nothing ) {
+            executeFiles(files, std::cout, mode, engine, framing, jobs, lazy);
+            return 0;
+        }
+        if ( framing != framing_none && mode != do_nothing ) {
+            std::ios::sync_with_stdio(false);
+            executeBatch(std::cin, std::cout, mode, engine, framing, jobs);
+            return 0;
+        }
         switch (mode){
             case do_nothing:
                 break;
             case do_interp:
-                executeInterp();
+                executeInterp(engine, lazy);
                 break;
             case do_print:
                 executePrint();
@@ -0,0 +1,52 @@
+/**
+* \file mapped.cpp
+* \brief contains the memory mapped input file implementations
+*/
+
+#include "mapped.hpp"
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//**********************MAPPEDFILE CLASS IMPLEMENTATIONS ********************************
+
+/**
+* \brief constructor to map the file at path. Throws runtime_error if it cannot be opened or mapped
+* \param path file to map
+*/
+MappedFile::MappedFile(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if ( fd < 0 ) {
+        throw std::runtime_error("cannot open file: " + path);
+    }
+    struct stat info;
+    if ( fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) ) {
+        close(fd);
+        throw std::runtime_error("cannot open file: " + path);
+    }
+    this->length = (size_t)info.st_size;
+    this->data = "";
+    if ( this->length > 0 ) {
+        void *mapping = mmap(nullptr, this->length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if ( mapping == MAP_FAILED ) {
+            close(fd);
+            throw std::runtime_error("cannot map file: " + path);
+        }
+        //the lexer reads front to back once
+        madvise(mapping, this->length, MADV_SEQUENTIAL);
+        this->data = static_cast<const char *>(mapping);
+    }
+    //the mapping stays valid without the descriptor
+    close(fd);
+}
+
+/**
+* \brief unmaps the file
+*/
+MappedFile::~MappedFile() {
+    if ( this->length > 0 ) {
+        munmap(const_cast<char *>(this->data), this->length);
+    }
+}
@@ -0,0 +1,58 @@
+/**
+* \file mapped.hpp
+* \brief contains the memory mapped input file declarations
+*/
+
+#ifndef mapped_hpp
+#define mapped_hpp
+
+#include <stddef.h>
+#include <streambuf>
+#include <string>
+
+/*! \brief a file mapped read only into memory for as long as 'this' lives
+* the parser lexes the mapping in place, nothing of the file is copied through a stream
+*/
+class MappedFile {
+public:
+    MappedFile(const std::string &path);
+    ~MappedFile();
+
+    /**
+    * \brief first character of the file
+    */
+    const char *begin() const { return this->data; }
+
+    /**
+    * \brief just past the last character of the file
+    */
+    const char *end() const { return this->data + this->length; }
+
+    /**
+    * \brief size of the file in bytes
+    */
+    size_t size() const { return this->length; }
+
+private:
+    const char *data;///< start of the mapping, an empty string for an empty file
+    size_t length;///< bytes mapped
+
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+};
+
+/*! \brief read only stream buffer over characters owned elsewhere, so a mapping can be read through an
+* istream without copying it first
+*/
+class ViewBuf : public std::streambuf {
+public:
+    /**
+    * \brief constructor to read the characters from begin up to end
+    */
+    ViewBuf(const char *begin, const char *end) {
+        char *first = const_cast<char *>(begin);
+        this->setg(first, first, first + (end - begin));
+    }
+};
+
+#endif /* mapped_hpp */
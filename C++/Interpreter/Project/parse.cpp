@@ -5,486 +5,829 @@
 * \author Ben Baysinger
 */
 #include "parse.hpp"
+#include "vm.hpp"
+#include "cek.hpp"
+#include "resolve.hpp"
+#include "flat.hpp"
+#include "hashcons.hpp"
+#include <algorithm>
 
 
+namespace {
+
+/*! \brief custom enum naming what an entry of the parse stack waits for
+* the operators wait for their right hand side, the rest for the parts of a construct that closes with a token
+*/
+typedef enum {
+    pending_eq,
+    pending_add,
+    pending_mult,
+    pending_paren,
+    pending_arg,
+    pending_let_rhs,
+    pending_let_body,
+    pending_if_test,
+    pending_if_then,
+    pending_if_else,
+    pending_fun_body
+} pending_t;
+
+/*! \brief a construct opened and not finished, the parts it already has wait on the value stack */
+struct Pending {
+    pending_t kind;///< what is being parsed
+    Symbol name;///< variable a let or function binds
+    size_t begin;///< offset just past the token opening the part being parsed
+    bool spanned;///< false if the part is not recorded, the text right before it could still join it
+};
+
 /**
-* \brief fifth and most dynamic level of chain. Handles number, variable, let, if, bool, and function expresssions. As well      as well as parenthesis surrounding expressions by starting chain over again. Throws runtime_error if invalid input          is encountered
-* \param inn input stream
-* \return expression object
+* \brief moves past the next token. Throws runtime_error if mismatch is encoutered
+* \param lex tokens of the input
+* \param expect expected kind of the next token
 */
-PTR(Expr) parse_inner (std::istream & inn) {
+void consume(Lexer &lex, token_kind_t expect) {
+    if (lex.next().kind != expect) {
+        throw std::runtime_error("consume mismatch");
+    }
+}
 
-    skip_whitespace (inn);
-    int c = inn.peek();
-    if ((c == '-') || isdigit(c)){
-        return parse_num(inn);
+/**
+* \brief how tightly a pending operator holds its operands, 0 for the constructs that close with a token
+*/
+int precedence_of(pending_t kind) {
+    switch ( kind ) {
+    case pending_eq: return 1;
+    case pending_add: return 2;
+    case pending_mult: return 3;
+    default: return 0;
     }
-    else if (c == '(') {
-        consume(inn, '(' );
-        PTR(Expr) e = parse_expr(inn);
-        skip_whitespace(inn);
-        c = inn.get();
-        if (c != ')'){
-            throw std::runtime_error("missing close parenthesis");
+}
+
+/*! \brief builds the nodes of a parse through the current ExprFactory
+* with source set every function body is only pre-parsed, the FunExpr keeps its span and parses it when first used
+*/
+struct NodeBuilder {
+    typedef PTR(Expr) Node;
+    std::shared_ptr<const std::string> source;///< text being parsed when bodies are left for later, else nullptr
+
+    Node num(int val) { return ExprFactory::num(val); }
+    Node var(Symbol name) { return ExprFactory::var(name); }
+    Node boolean(bool val) { return ExprFactory::boolean(val); }
+    Node add(Node const &lhs, Node const &rhs) { return ExprFactory::add(lhs, rhs); }
+    Node mult(Node const &lhs, Node const &rhs) { return ExprFactory::mult(lhs, rhs); }
+    Node eq(Node const &lhs, Node const &rhs) { return ExprFactory::eq(lhs, rhs); }
+    Node let(Symbol lhs, Node const &rhs, Node const &body) { return ExprFactory::let(lhs, rhs, body); }
+    Node cond(Node const &test_part, Node const &then_part, Node const &else_part) {
+        return ExprFactory::cond(test_part, then_part, else_part);
+    }
+    Node fun(Symbol formal_arg, Node const &body, FreeVars const &free_names) {
+        return ExprFactory::fun(formal_arg, body, free_names);
+    }
+    Node call(Node const &to_be_called, Node const &actual_arg) { return ExprFactory::call(to_be_called, actual_arg); }
+    void part(Node const &node, size_t begin, size_t end) { }
+    bool pre_parse(Lexer &lex, Symbol formal_arg, std::vector<Node> &values, BindingScopes &scopes);
+};
+
+/*! \brief works out the hash the nodes of a parse would have without making any
+* the free variables come from the BindingScopes of the parse, as for a parse that makes them
+*/
+struct SummaryBuilder {
+    typedef size_t Node;
+
+    Node num(int val) { return Expr::hash_of(expr_num, (size_t)(unsigned)val); }
+    Node var(Symbol name) { return Expr::hash_of(expr_var, name.id()); }
+    Node boolean(bool val) { return Expr::hash_of(expr_bool, val ? 1 : 0); }
+    Node add(Node lhs, Node rhs) { return Expr::hash_of(expr_add, lhs, rhs); }
+    Node mult(Node lhs, Node rhs) { return Expr::hash_of(expr_mult, lhs, rhs); }
+    Node eq(Node lhs, Node rhs) { return Expr::hash_of(expr_eq, lhs, rhs); }
+    Node let(Symbol lhs, Node rhs, Node body) { return Expr::hash_of(expr_let, lhs.id(), rhs, body); }
+    Node cond(Node test_part, Node then_part, Node else_part) {
+        return Expr::hash_of(expr_if, test_part, then_part, else_part);
+    }
+    Node fun(Symbol formal_arg, Node body, FreeVars const &free_names) {
+        return Expr::hash_of(expr_fun, formal_arg.id(), body);
+    }
+    Node call(Node to_be_called, Node actual_arg) { return Expr::hash_of(expr_call, to_be_called, actual_arg); }
+    void part(Node node, size_t begin, size_t end) { }
+    bool pre_parse(Lexer &lex, Symbol formal_arg, std::vector<Node> &values, BindingScopes &scopes) { return false; }
+};
+
+/*! \brief adds the nodes of a parse straight to a FlatAst, so the flat engine never needs an Expr tree
+* function bodies are always parsed in full, the table has nowhere to keep a span
+*/
+struct FlatBuilder {
+    typedef uint32_t Node;
+    FlatAst &ast;///< table the nodes are added to
+
+    Node num(int val) { return ast.num(val); }
+    Node var(Symbol name) { return ast.var(name); }
+    Node boolean(bool val) { return ast.boolean(val); }
+    Node add(Node lhs, Node rhs) { return ast.add(lhs, rhs); }
+    Node mult(Node lhs, Node rhs) { return ast.mult(lhs, rhs); }
+    Node eq(Node lhs, Node rhs) { return ast.eq(lhs, rhs); }
+    Node let(Symbol lhs, Node rhs, Node body) { return ast.let(lhs, rhs, body); }
+    Node cond(Node test_part, Node then_part, Node else_part) { return ast.cond(test_part, then_part, else_part); }
+    Node fun(Symbol formal_arg, Node body, FreeVars const &free_names) { return ast.fun(formal_arg, body); }
+    Node call(Node to_be_called, Node actual_arg) { return ast.call(to_be_called, actual_arg); }
+    void part(Node node, size_t begin, size_t end) { }
+    bool pre_parse(Lexer &lex, Symbol formal_arg, std::vector<Node> &values, BindingScopes &scopes) { return false; }
+};
+
+/*! \brief builds the nodes of a parse through the current ExprFactory like NodeBuilder, numbering them as they
+* are made and keeping where each part between two tokens is in a SpanTable
+*/
+struct SpanBuilder {
+    /*! \brief a node and its number */
+    struct Node {
+        PTR(Expr) expr;///< the node
+        uint32_t id;///< its number in the table
+    };
+    SpanTable &spans;///< table the numbers and parts go to
+
+    /**
+    * \brief numbers expr, whose subtree starts at the subtree of first_child or at expr itself
+    */
+    Node made(PTR(Expr) const &expr, const Node *first_child) {
+        Node node = { expr, (uint32_t)spans.first.size() };
+        spans.first.push_back(first_child == nullptr ? node.id : spans.first[first_child->id]);
+        return node;
+    }
+    Node num(int val) { return made(ExprFactory::num(val), nullptr); }
+    Node var(Symbol name) { return made(ExprFactory::var(name), nullptr); }
+    Node boolean(bool val) { return made(ExprFactory::boolean(val), nullptr); }
+    Node add(Node const &lhs, Node const &rhs) { return made(ExprFactory::add(lhs.expr, rhs.expr), &lhs); }
+    Node mult(Node const &lhs, Node const &rhs) { return made(ExprFactory::mult(lhs.expr, rhs.expr), &lhs); }
+    Node eq(Node const &lhs, Node const &rhs) { return made(ExprFactory::eq(lhs.expr, rhs.expr), &lhs); }
+    Node let(Symbol lhs, Node const &rhs, Node const &body) { return made(ExprFactory::let(lhs, rhs.expr, body.expr), &rhs); }
+    Node cond(Node const &test_part, Node const &then_part, Node const &else_part) {
+        return made(ExprFactory::cond(test_part.expr, then_part.expr, else_part.expr), &test_part);
+    }
+    Node fun(Symbol formal_arg, Node const &body, FreeVars const &free_names) {
+        return made(ExprFactory::fun(formal_arg, body.expr, free_names), &body);
+    }
+    Node call(Node const &to_be_called, Node const &actual_arg) {
+        return made(ExprFactory::call(to_be_called.expr, actual_arg.expr), &to_be_called);
+    }
+    void part(Node const &node, size_t begin, size_t end) {
+        SourcePart part = { node.id, begin, end };
+        spans.parts.push_back(part);
+    }
+    bool pre_parse(Lexer &lex, Symbol formal_arg, std::vector<Node> &values, BindingScopes &scopes) { return false; }
+};
+
+/**
+* \brief takes the top of the value stack
+*/
+template<class Node>
+Node pop_value(std::vector<Node> &values) {
+    Node e = std::move(values.back());
+    values.pop_back();
+    return e;
+}
+
+/**
+* \brief builds the pending operators holding tighter than precedence, innermost first, all of them are
+    right associative so an operator of the same precedence is left waiting
+* \param builder makes the nodes
+* \param stack pending constructs
+* \param values operands
+* \param precedence precedence of the operator coming next, 0 to build every operator down to the innermost bracket
+*/
+template<class Builder>
+void reduce_operators(Builder &builder, std::vector<Pending> &stack, std::vector<typename Builder::Node> &values,
+                      int precedence) {
+    while ( !stack.empty() && precedence_of(stack.back().kind) > precedence ) {
+        typename Builder::Node rhs = pop_value(values);
+        typename Builder::Node lhs = pop_value(values);
+        switch ( stack.back().kind ) {
+        case pending_eq: values.push_back(builder.eq(lhs, rhs)); break;
+        case pending_add: values.push_back(builder.add(lhs, rhs)); break;
+        default: values.push_back(builder.mult(lhs, rhs)); break;
         }
-        return e;
+        stack.pop_back();
     }
-    else if ( isalpha(c)) {
-        return parse_var(inn);
+}
 
-    }
-    else if ( c == '_' ) {
-        consume(inn, '_');
-        if ( inn.peek() == 'l') {
-            return parse_let(inn);
-        }
-        else if (inn.peek() == 'i') {
-            return parse_if(inn);
-        }
-        else if (inn.peek() == 't') {
-            parse_keyword(inn);
-            return NEW(BoolExpr)(true);
+/**
+* \brief reads tokens up to an operand, opening each let, if, function and parenthesis in front of it.
+    Throws runtime_error if invalid input is encountered
+* \param lex tokens of the input
+* \param builder makes the nodes
+* \param stack pending constructs, the ones opened are pushed
+* \param values operands, the operand is pushed
+* \param scopes binders around the operand, a variable is used and a function opened
+*/
+template<class Builder>
+void parse_operand(Lexer &lex, Builder &builder, std::vector<Pending> &stack,
+                   std::vector<typename Builder::Node> &values, BindingScopes &scopes) {
+    while (1) {
+        Token tok = lex.next();
+        Pending opened = { pending_paren, Symbol(), 0, true };
+        switch ( tok.kind ) {
+        case tok_num:
+            values.push_back(builder.num(tok.val));
+            return;
+        case tok_var: {
+            Symbol name(lex.view(tok));
+            scopes.use(name);
+            values.push_back(builder.var(name));
+            return;
         }
-        else { //BoolExpr(false) or FunExpr
-            consume(inn, 'f');
-            if ( inn.peek() == 'a') {
-                parse_keyword(inn);
-                return NEW(BoolExpr)(false);
+        case tok_true:
+            values.push_back(builder.boolean(true));
+            return;
+        case tok_false:
+            values.push_back(builder.boolean(false));
+            return;
+        case tok_lparen:
+            break;
+        case tok_let:
+            //_let x = rhs _in body
+            opened.kind = pending_let_rhs;
+            if ( lex.peek().kind == tok_var ) {
+                opened.name = Symbol(lex.view(lex.next()));
             }
-            else {
-                return parse_fun(inn);
+            if ( lex.next().kind != tok_assign ) {
+                throw std::runtime_error("consume mismatch for = \n");
             }
-
+            break;
+        case tok_if:
+            opened.kind = pending_if_test;
+            break;
+        case tok_fun:
+            //_fun (x) body, the parentheses are optional. The body of a header missing any of them is not
+            //recorded as a part, its first token could join the header once the text changes
+            opened.kind = pending_fun_body;
+            opened.spanned = lex.peek().kind == tok_lparen;
+            if ( lex.peek().kind == tok_lparen ) {
+                consume(lex, tok_lparen);
+            }
+            opened.spanned = opened.spanned && lex.peek().kind == tok_var;
+            if ( lex.peek().kind == tok_var ) {
+                opened.name = Symbol(lex.view(lex.next()));
+            }
+            opened.spanned = opened.spanned && lex.peek().kind == tok_rparen;
+            if ( lex.peek().kind == tok_rparen ) {
+                consume(lex, tok_rparen);
+            }
+            if ( builder.pre_parse(lex, opened.name, values, scopes) ) {
+                return;
+            }
+            scopes.open_fun(opened.name);
+            break;
+        case tok_error:
+            throw std::runtime_error(tok.error);
+        default:
+            throw std::runtime_error("invalid input");
         }
-    }
-    else{
-        consume(inn, c);
-        throw std::runtime_error("invalid input");
+        opened.begin = lex.consumed();
+        stack.push_back(opened);
     }
 }
 
 /**
-* \brief fourth level of chain will handle call expressions if not passes on to next level
-* \param in input stream
-* \return expression object
+* \brief finishes the innermost pending construct once its current part is parsed, the operators in it
+    already built. Throws runtime_error if the token closing the part is missing
+* \param lex tokens of the input
+* \param builder makes the nodes
+* \param stack pending constructs, the innermost is not an operator
+* \param values operands
+* \param scopes binders around the construct, the ones it opens are opened and closed along with it
+* \return true if the construct goes on with another part, false if it was built and pushed as an operand
 */
-PTR(Expr) parse_multicand(std::istream &in) {
-
-    PTR(Expr) expr = parse_inner(in);
-    PTR(Expr) actual_arg;
-    while ( in.peek() == '(') {
-        consume (in, '(');
-        actual_arg = parse_expr(in);
-        consume(in, ')');
-        expr = NEW(CallExpr)(expr, actual_arg);
-    }
-    return expr;
+template<class Builder>
+bool close_pending(Lexer &lex, Builder &builder, std::vector<Pending> &stack,
+                   std::vector<typename Builder::Node> &values, BindingScopes &scopes) {
+    typedef typename Builder::Node Node;
+    Pending &top = stack.back();
+    if ( top.spanned ) {
+        builder.part(values.back(), top.begin, lex.peek().begin);
+    }
+    switch ( top.kind ) {
+    case pending_paren:
+        if ( lex.next().kind != tok_rparen ) {
+            throw std::runtime_error("missing close parenthesis");
+        }
+        break;
+    case pending_arg: {
+        consume(lex, tok_rparen);
+        Node actual_arg = pop_value(values);
+        Node to_be_called = pop_value(values);
+        values.push_back(builder.call(to_be_called, actual_arg));
+        break;
+    }
+    case pending_let_rhs:
+        consume(lex, tok_in);
+        top.kind = pending_let_body;
+        top.begin = lex.consumed();
+        scopes.bind(top.name);
+        return true;
+    case pending_let_body: {
+        Node body = pop_value(values);
+        Node rhs = pop_value(values);
+        //Make sure valid let expression, the body has to use lhs
+        if ( !scopes.unbind() ) {
+            throw std::runtime_error("invalid let expression");
+        }
+        values.push_back(builder.let(top.name, rhs, body));
+        break;
+    }
+    case pending_if_test:
+        consume(lex, tok_then);
+        top.kind = pending_if_then;
+        top.begin = lex.consumed();
+        return true;
+    case pending_if_then:
+        consume(lex, tok_else);
+        top.kind = pending_if_else;
+        top.begin = lex.consumed();
+        return true;
+    case pending_if_else: {
+        Node else_part = pop_value(values);
+        Node then_part = pop_value(values);
+        Node test_part = pop_value(values);
+        values.push_back(builder.cond(test_part, then_part, else_part));
+        break;
+    }
+    default: {
+        Node body = pop_value(values);
+        values.push_back(builder.fun(top.name, body, scopes.close_fun()));
+        break;
+    }
+    }
+    stack.pop_back();
+    return false;
 }
 
 /**
-* \brief parses number expressions. Throws runtime_error if invalid input is encountered
-* \param inn input stream
-* \return NumExpr object
+* \brief parses an expression with an explicit stack of pending constructs instead of recursion, so no nesting
+    of input can overflow the native stack. == binds loosest, then +, then *, all right associative, a call
+    argument has to open right after what is called, and let, if and function bodies reach as far as they can.
+    Throws runtime_error if invalid input encountered
+* \param lex tokens of the input, the token after the expression is left unread
+* \param builder makes the nodes
+* \param scopes binders around the expression, its free variables are used in them
+* \return the expression builder made
 */
-PTR(Expr) parse_num(std::istream &inn) {
-    int n = 0;
-    bool negative = false;
-
-
-    if (inn.peek() == '-' && !inn.eof()) {
-        negative = true;
-        consume (inn, '-');
-        if(!isdigit(inn.peek())){
-            throw std::runtime_error("invalid input") ;
-        }
-    }
-
+template<class Builder>
+typename Builder::Node build_expr(Lexer &lex, Builder &builder, BindingScopes &scopes) {
+    std::vector<Pending> stack;
+    std::vector<typename Builder::Node> values;
     while (1) {
-        int c = inn.peek();
-
-        if (isdigit(c))
-        {
-            consume(inn, c);
-            n = n*10 + (c - '0');
+        parse_operand(lex, builder, stack, values, scopes);
+
+        //what follows an operand: a call, an operator, or the end of every construct it closes
+        while (1) {
+            const Token &tok = lex.peek();
+            Pending opened = { pending_arg, Symbol(), 0, true };
+            if ( tok.kind == tok_lparen && !tok.spaced ) {
+                lex.next();
+                opened.begin = lex.consumed();
+                stack.push_back(opened);
+                break;
+            }
+            if ( tok.kind == tok_star || tok.kind == tok_plus || tok.kind == tok_eqeq ) {
+                opened.kind = tok.kind == tok_star ? pending_mult : tok.kind == tok_plus ? pending_add : pending_eq;
+                reduce_operators(builder, stack, values, precedence_of(opened.kind));
+                lex.next();
+                stack.push_back(opened);
+                break;
+            }
+            if ( tok.kind == tok_assign ) {
+                throw std::runtime_error("invalid input");
+            }
+            reduce_operators(builder, stack, values, 0);
+            if ( stack.empty() ) {
+                return pop_value(values);
+            }
+            if ( close_pending(lex, builder, stack, values, scopes) ) {
+                break;
+            }
         }
-        else
-            break;
     }
-    if (negative)
-        n = n * -1;
-    if (isInvalidInput(inn)) {
-        throw std::runtime_error("invalid input");
-    }
-    return NEW(NumExpr)(n);
 }
 
 /**
-* \brief second level of recursive chain. Will handle add expressions.  Passes everything else to next level
-* \param in input stream
-* \return expression object
+* \brief with a source to keep, pre-parses the body of the function being opened and pushes a FunExpr that
+    parses it on first use. The pre-parse checks the body the way parsing it would and works out the hash and
+    free variables its nodes will have, so the function hashes, compares and resolves like a parsed one
+* \param lex tokens of the input, at the first token of the body
+* \param formal_arg variable the function binds
+* \param values operands, the function is pushed
+* \param scopes binders around the function, each of its free variables is used
+* \return true if the function was pushed, false to parse the body now
 */
-PTR(Expr) parse_comparg(std::istream &in) {
-
-    PTR(Expr) e;
-    e = parse_addend(in);
-
-    skip_whitespace(in);
-
-    int c = in.peek();
-    if (c == '+') {
-        consume(in, '+');
-        skip_whitespace(in);
-        PTR(Expr) rhs = parse_comparg(in);
-        return NEW(AddExpr)(e, rhs);
-    }
-    else{
-        return  e;
-    }
+bool NodeBuilder::pre_parse(Lexer &lex, Symbol formal_arg, std::vector<Node> &values, BindingScopes &scopes) {
+    if ( this->source == nullptr ) {
+        return false;
+    }
+    const char *text = this->source->data();
+    size_t begin = (size_t)(lex.at(lex.peek()) - text);
+    SummaryBuilder summary;
+    BindingScopes body_scopes;
+    size_t body_hash = build_expr(lex, summary, body_scopes);
+    //the body is all the text up to the token after it, the whitespace before that token parses to nothing
+    std::shared_ptr<LazyBody> lazy = std::make_shared<LazyBody>();
+    lazy->source = this->source;
+    lazy->begin = begin;
+    lazy->end = (size_t)(lex.at(lex.peek()) - text);
+    PTR(Expr) fun = NEW(FunExpr)(formal_arg, std::move(lazy), body_hash, body_scopes.free_names());
+    FreeVars const &names = static_cast<FunExpr*>(RAW(fun))->free_names();
+    for ( size_t i = 0; i < names->size(); i++ ) {
+        scopes.use((*names)[i]);
+    }
+    values.push_back(fun);
+    return true;
 }
 
 /**
-* \brief third level of recursive chain will handle multiplication expressions
-    if not passes on to next level
-* \param in input stream
+* \brief parses an expression and checks all the input was used, nodes are interned in the current
+    ExprFactory, or in a table of their own if there is none, so repeated subtrees are shared
+* \param lex tokens of the input
+* \param builder makes the nodes
 * \return expression object
 */
-PTR(Expr) parse_addend(std::istream &in) {
-
-    PTR(Expr) e;
-    e = parse_multicand(in);
-
-    skip_whitespace(in);
-
-    int c = in.peek();
-    if (c == '*') {
-        consume(in, '*');
-        skip_whitespace(in) ;
-        PTR(Expr) rhs = parse_addend(in);
-        return NEW(MultExpr)(e, rhs);
-    }
-    else{
-        return e ;
+template<class Builder>
+typename Builder::Node parse_all(Lexer &lex, Builder &builder) {
+    ExprFactory local;
+    ExprFactoryScope scope(ExprFactory::current() != nullptr ? ExprFactory::current() : &local);
+    BindingScopes scopes;
+    typename Builder::Node e = build_expr(lex, builder, scopes);
+    if ( lex.peek().kind != tok_end ) {
+        throw std::runtime_error("Invalid input");
     }
+
+    return e;
 }
 
+}
 
 /**
-* \brief top of recursive chain will handle equality expressions  but passes everything else to
-    next recursive function. Throws runtime_error if invalid input encountered
-* \param in input stream
+* \brief parses an expression, see build_expr(). Throws runtime_error if invalid input encountered
+* \param lex tokens of the input, the token after the expression is left unread
 * \return expression object
 */
-PTR(Expr) parse_expr(std::istream &in) {
-
-    PTR(Expr) e;
-
-    e = parse_comparg(in);
-
-    skip_whitespace(in);
-    int firstEquals = in.peek();
-    if (firstEquals == '=') {
-        consume(in, '=');
-        int secondEquals = in.peek();
-        if ( secondEquals == '=') {
-            consume(in, '=');
-            return NEW(EqExpr)(e, parse_expr(in));
-        }
-        else {
-            throw std::runtime_error("invalid input");
-        }
-    }
-    return  e;
-
+PTR(Expr) parse_expr(Lexer &lex) {
+    NodeBuilder builder;
+    BindingScopes scopes;
+    return build_expr(lex, builder, scopes);
 }
 
 /**
-* \brief driver to take in input stream and go into recursive chain
-* \param in input stream std::cin
+* \brief parses an expression like parse_expr(), keeping in spans where each of its parts is
+* \param lex tokens of the input, the token after the expression is left unread
+* \param spans emptied, then filled with the numbers of the nodes and the parts, at offsets of lex
 * \return expression object
 */
-PTR(Expr) parse(std::istream &in) {
-    PTR(Expr) e;
-    e = parse_expr(in);
-    skip_whitespace(in);
-    if ( !in.eof() ) {
-        throw std::runtime_error("Invalid input");
-    }
-
-    return e;
+PTR(Expr) parse_expr(Lexer &lex, SpanTable &spans) {
+    spans.first.clear();
+    spans.parts.clear();
+    SpanBuilder builder = { spans };
+    BindingScopes scopes;
+    return build_expr(lex, builder, scopes).expr;
 }
 
 /**
-* \brief parses variable expressions. Throws runtime_error if invalid input is encountered
-* \param in input stream
-* \return VarExpr object
+* \brief driver to parse an expression and check all the input was used, nodes are interned in the
+    current ExprFactory, or in a table of their own if there is none, so repeated subtrees are shared
+* \param lex tokens of the input
+* \return expression object
 */
-PTR(Expr) parse_var(std::istream &in) {
-
+PTR(Expr) parse(Lexer &lex) {
+    NodeBuilder builder;
+    return parse_all(lex, builder);
+}
 
-    std::string var = "";
-    char c = in.peek();
-    while ( isalpha(c)) {
-        var += c;
-        consume(in, c);
-        c = in.peek();
-    }
-    if (isInvalidInput(in)){
-        throw std::runtime_error("invalid input");
+/**
+* \brief parses an expression straight into a flat table and checks all the input was used, no Expr is made.
+    Throws runtime_error where parse() would
+* \param lex tokens of the input
+* \return table whose root is the expression
+*/
+std::shared_ptr<FlatAst> parse_flat(Lexer &lex) {
+    std::shared_ptr<FlatAst> ast = std::make_shared<FlatAst>();
+    FlatBuilder builder = { *ast };
+    BindingScopes scopes;
+    ast->root = build_expr(lex, builder, scopes);
+    if ( lex.peek().kind != tok_end ) {
+        throw std::runtime_error("Invalid input");
     }
-
-    return NEW(VarExpr)(var);
+    return ast;
 }
 
 /**
-* \brief boolean to check for input stream for valid characters
-* \param in input stream
-* \return true invalid input is encountered
-*/
-bool isInvalidInput (std::istream &in){
-    int k = in.peek();
-    return !isspace(k) 
-           && k != ')'
-           && k != '('
-           && k != '*' && k != '+'
-           && k != '=' && !in.eof();
+* \brief parses the body of a pre-parsed function, with the functions in it pre-parsed in turn. The nodes go
+    to the current arena and a table of their own, whatever program is running
+* \param lazy where the body is in its source
+* \return the body
+*/
+PTR(Expr) parse_lazy_body(const LazyBody &lazy) {
+    ExprFactory local;
+    ExprFactoryScope scope(&local);
+    const char *text = lazy.source->data();
+    Lexer lex(text + lazy.begin, text + lazy.end);
+    NodeBuilder builder;
+    builder.source = lazy.source;
+    return parse_all(lex, builder);
 }
 
 /**
-* \brief parses function expressions.
-* \param inn input stream
-* \return FunExpr object
+* \brief moves past one expression the way parse_expr reads it, without building any node or interning any
+    name. Operators need no entry since they never decide which token closes a construct.
+    Throws runtime_error where parse_expr would find the structure wrong, with the token found wrong taken
+* \param lex tokens of the input
+* \return offset just past the last token of the expression
 */
-PTR(Expr) parse_fun (std::istream &inn) {
-
-    //_fun(x) body
-    std::string formal_arg = "";
-    PTR(Expr) body;
-    parse_keyword(inn); //consumes fun
+size_t skip_expr(Lexer &lex) {
+    std::vector<pending_t> stack;
+    size_t last = 0;
+    while (1) {
+        //an operand, with the constructs opened in front of it
+        bool operand = false;
+        while ( !operand ) {
+            Token tok = lex.next();
+            last = tok.end;
+            switch ( tok.kind ) {
+            case tok_num:
+            case tok_var:
+            case tok_true:
+            case tok_false:
+                operand = true;
+                break;
+            case tok_lparen:
+                stack.push_back(pending_paren);
+                break;
+            case tok_let:
+                if ( lex.peek().kind == tok_var ) {
+                    lex.next();
+                }
+                if ( lex.next().kind != tok_assign ) {
+                    throw std::runtime_error("consume mismatch for = \n");
+                }
+                stack.push_back(pending_let_rhs);
+                break;
+            case tok_if:
+                stack.push_back(pending_if_test);
+                break;
+            case tok_fun:
+                if ( lex.peek().kind == tok_lparen ) {
+                    lex.next();
+                }
+                if ( lex.peek().kind == tok_var ) {
+                    lex.next();
+                }
+                if ( lex.peek().kind == tok_rparen ) {
+                    lex.next();
+                }
+                stack.push_back(pending_fun_body);
+                break;
+            case tok_error:
+                throw std::runtime_error(tok.error);
+            default:
+                throw std::runtime_error("invalid input");
+            }
+        }
 
-    int c = inn.peek();
-    //Consume parenthesis
-    if ( c == '(') {
-        consume(inn, '(');
+        //what follows it: a call, an operator, or the tokens closing the constructs it ends
+        while (1) {
+            const Token &tok = lex.peek();
+            if ( (tok.kind == tok_lparen && !tok.spaced) || tok.kind == tok_star || tok.kind == tok_plus
+                 || tok.kind == tok_eqeq ) {
+                if ( tok.kind == tok_lparen ) {
+                    stack.push_back(pending_arg);
+                }
+                lex.next();
+                break;
+            }
+            if ( tok.kind == tok_assign ) {
+                lex.next(); //taken with the error, so a caller skipping past it does not stop at it again
+                throw std::runtime_error("invalid input");
+            }
+            if ( stack.empty() ) {
+                return last;
+            }
+            pending_t &top = stack.back();
+            if ( top == pending_let_body || top == pending_if_else || top == pending_fun_body ) {
+                //ends with its last part
+                stack.pop_back();
+                continue;
+            }
+            token_kind_t closing = top == pending_let_rhs ? tok_in : top == pending_if_test ? tok_then
+                                 : top == pending_if_then ? tok_else : tok_rparen;
+            Token closed = lex.next();
+            if ( closed.kind != closing ) {
+                throw std::runtime_error(top == pending_paren ? "missing close parenthesis" : "consume mismatch");
+            }
+            last = closed.end;
+            if ( closing == tok_rparen ) {
+                stack.pop_back();
+                continue;
+            }
+            top = top == pending_let_rhs ? pending_let_body : top == pending_if_test ? pending_if_then : pending_if_else;
+            break;
+        }
     }
+}
 
-    //Extract formal_arg
-    while ( isalpha(inn.peek())) {
-        formal_arg += inn.peek();
-        consume(inn, inn.peek());
-    }
-    skip_whitespace(inn);
-    
-    //Consume ')'
-    c = inn.peek();
-    if ( c == ')') {
-        consume(inn, ')');
+/**
+* \brief splits a source holding many expressions one after another at the boundaries between them, in one
+    quick pass over the tokens that checks only parentheses and keyword structure, so the pieces can be
+    parsed independently. An expression ends where nothing open is left and the next token neither continues
+    it with an operator nor calls it with an argument right after it. Where the pass finds the structure wrong
+    the piece ends with the token found wrong, so its parse reports the error, and splitting resumes after it
+* \param begin first character of the source
+* \param end just past its last character
+* \return offset of the first character and just past the last one of each expression, in source order
+*/
+std::vector<std::pair<size_t, size_t> > split_expressions(const char *begin, const char *end) {
+    std::vector<std::pair<size_t, size_t> > spans;
+    Lexer lex(begin, end);
+    while ( lex.peek().kind != tok_end ) {
+        size_t start = lex.peek().begin;
+        try {
+            spans.push_back(std::make_pair(start, skip_expr(lex)));
+        } catch (std::runtime_error &) {
+            spans.push_back(std::make_pair(start, lex.consumed()));
+        }
     }
-    
-    body = parse_expr(inn);
-
-    return NEW(FunExpr)(formal_arg, body);
+    return spans;
 }
 
-
 /**
-* \brief parses if expressions.
-* \param in input stream
-* \return IfExpr object
+* \brief driver to read all of an input stream into one buffer and parse it
+* \param in input stream std::cin
+* \return expression object
 */
-PTR(Expr) parse_if(std::istream &in) {
-
-    PTR(Expr) test_part;
-    PTR(Expr) then_part;
-    PTR(Expr) else_part;
-
-    parse_keyword(in);//consumes _if
-
-    //Extract test_part
-    test_part = parse_expr(in);
-    skip_whitespace(in);
-
-    //Extract then_part
-    consume(in, '_');
-    parse_keyword(in);//consumes _then
-    then_part = parse_expr(in);
-    skip_whitespace(in);
-
-    //Extract else_part
-    consume(in, '_');
-    parse_keyword(in);//consumes _else
-    else_part = parse_expr(in);
-
-    return NEW(IfExpr)(test_part, then_part, else_part);
+PTR(Expr) parse(std::istream &in) {
+    std::string buffer = Lexer::read_all(in);
+    Lexer lex(buffer);
+    return parse(lex);
 }
 
 /**
-* \brief parses let expressions. Throws runtime_error if invalid input is encountered
-* \param in input stream
-* \return LetExpr object
+* \brief constructor to parse in with every node allocated in a fresh arena and interned in a fresh table
+* \param in input stream, read to the end
+* \param lazy true to only pre-parse function bodies, see reparse_lazily()
 */
-PTR(Expr) parse_let(std::istream &in) {
-    PTR(Expr) rhs;
-    PTR(Expr) body;
-
-    parse_keyword(in);//consumes _let
+Program::Program(std::istream &in, bool lazy) : Program(Lexer::read_all(in), lazy) {
+}
 
-    int c = in.peek();
-    //Extract lhs
-    std::string lhs = "";
-    while ( isalpha(c) ) {
-        lhs += c;
-        consume(in, c);
-        c = in.peek();
-    }
-    skip_whitespace(in);
-    c = in.peek();
-    if ( c == '=' ) {
-        consume(in, '=');
+/**
+* \brief constructor to parse source with every node allocated in a fresh arena and interned in a fresh table
+* \param source text of the whole expression
+* \param lazy true to only pre-parse function bodies, see reparse_lazily()
+*/
+Program::Program(const std::string &source, bool lazy) : Program() {
+    if ( lazy ) {
+        reparse_lazily(std::make_shared<const std::string>(source));
     }
     else {
-        throw std::runtime_error("consume mismatch for = \n");
-    }
-    skip_whitespace(in);
-
-    //Extract rhs
-    rhs = parse_expr(in);
-    skip_whitespace(in);
-
-    //consume underscore
-    if ( in.peek() == '_') {
-        consume(in, '_');
-    }
-    parse_keyword(in);//Consume _in
-    //Extract body
-    body = parse_expr(in);
-
-    //Make sure valid let expression
-    std::string bodyString = body->to_string();
-    if (bodyString.find(lhs) == std::string::npos) {
-        throw std::runtime_error("invalid let expression");
+        reparse(source.data(), source.data() + source.size());
     }
-
-    return NEW(LetExpr)(lhs, rhs, body);
 }
 
 /**
-* \brief performs interp() method on what expression is returned from recursive chain and prints result as string
+* \brief constructor to parse the characters from begin up to end in place, identifiers are looked up
+    through views of them, so the buffer is only needed while parsing
+* \param begin first character of the expression
+* \param end just past its last character
 */
-void executeInterp() {
-    PTR(Expr) e = parse(std::cin);
-    std::cout<< e->interp()->to_string() << std::endl;
+Program::Program(const char *begin, const char *end) : Program() {
+    reparse(begin, end);
 }
 
 /**
-* \brief performs print() method on what expression is returned from recursive chain
+* \brief constructor to make an empty program with a fresh arena and table, expr is nullptr until reparse()
 */
-void executePrint() {
-    PTR(Expr) e = parse(std::cin);
-    std::cout<< e->to_string()<< std::endl;
+Program::Program() {
+    this->arena = Arena::make();
+    this->factory = std::make_shared<ExprFactory>();
 }
 
 /**
-* \brief performs pretty_print() method on what expression is returned from recursive chain and prints result as string
+* \brief parses the characters from begin up to end into expr again, in the same arena and table, so every
+    subtree the text shares with anything parsed into the program before is the node already made, and text
+    that parses to the same tree gives back the same expr. Throws runtime_error if invalid input is encountered,
+    expr is left as it was then
+* \param begin first character of the expression
+* \param end just past its last character
+* \param spans if not nullptr, set to where the parts of expr are, at offsets from begin
 */
-void executePrettyPrint() {
-    PTR(Expr) e = parse(std::cin);
-    std::cout<< e->to_stringPP()<< std::endl;
+void Program::reparse(const char *begin, const char *end, SpanTable *spans) {
+    ArenaScope scope(this->arena.get());
+    ExprFactoryScope interning(this->factory.get());
+    Lexer lex(begin, end);
+    if ( spans == nullptr ) {
+        this->expr = parse(lex);
+        return;
+    }
+    spans->first.clear();
+    spans->parts.clear();
+    SpanBuilder builder = { *spans };
+    this->expr = parse_all(lex, builder).expr;
 }
 
 /**
-* \brief moves forward input stream by consuming current location. Throws runtime_error if mismatch is encoutered
-* \param in input stream
-* \param expect expected value of current position of input stream
+* \brief parses all of source into expr like reparse(), except that every function body is only checked,
+    hashed and scanned for free variables. Its nodes are made from the span kept in the FunExpr the first time
+    the body is used, so code that never runs costs no nodes. Throws runtime_error if invalid input is
+    encountered, the errors are the ones parsing all of it would give
+* \param source text of the whole expression, kept for as long as any function of it is left unparsed
 */
-static void consume(std::istream &in, int expect) {
-    int c = in.get();
-    if (c!=expect) {
-        throw std::runtime_error("consume mismatch");
-    }
+void Program::reparse_lazily(std::shared_ptr<const std::string> source) {
+    ArenaScope scope(this->arena.get());
+    ExprFactoryScope interning(this->factory.get());
+    Lexer lex(*source);
+    NodeBuilder builder;
+    builder.source = std::move(source);
+    this->expr = parse_all(lex, builder);
 }
 
 /**
-* \brief skips unused space of input stream
-* \param in input stream
+* \brief evaluates a parsed program
+* \param program the program
+* \param engine evaluator to use, the tree walking interp(), the bytecode vm, the CEK machine or the flat table
+* \return the value as a string
 */
-static void skip_whitespace(std::istream &in) {
-    while (1) {
-        int c = in.peek();
-        if (!isspace(c))
-            break;
-        consume(in, c);
+std::string interp_program(Program &program, engine_t engine) {
+#if USE_PLAIN_POINTERS || USE_GC_POINTERS
+    //nothing is freed without reference counts, so nodes made while running go to the program's arena too,
+    //with the collector Vals and Envs go to its heap, which may collect since only the engine holds them,
+    //and whatever the run left is swept once its result is printed
+    ArenaScope scope(program.arena.get());
+    GcAllowCollection collecting;
+#endif
+    PTR(Expr) e = program.expr;
+    PTR(Val) result;
+    if ( engine == engine_vm ) {
+        result = vm_interp(e);
+    }
+    else if ( engine == engine_cek ) {
+        result = resolved_cek_interp(e);
+    }
+    else if ( engine == engine_flat ) {
+        result = flat_interp(FlatAst::flatten(e));
+    }
+    else {
+        result = resolved_interp(e);
     }
+    std::string text = result->to_string();
+    result = nullptr;
+    GcHeap::end_of_run();
+    return text;
 }
 
 /**
-* \brief Another driver to start recursive chain. Converts string to expression object
-* \param input string value to be parsed into an expression object
-* \return expression object corresponding with passed through string parameter
+* \brief performs interp() method on what expression is parsed and prints result as string
+* \param engine evaluator to use, the tree walking interp(), the bytecode vm, the CEK machine or the flat table,
+    which is parsed into straight from the input
+* \param lazy true to leave function bodies unparsed until they are called
 */
-PTR(Expr) parse_str(std::string input){
-    std::stringstream ss(input);
-    return parse_expr(ss);
+void executeInterp(engine_t engine, bool lazy) {
+    if ( engine == engine_flat ) {
+        //the table is all the flat engine runs, so the source goes straight into it
+        std::string source = Lexer::read_all(std::cin);
+        Lexer lex(source);
+        std::shared_ptr<FlatAst> ast = parse_flat(lex);
+#if USE_PLAIN_POINTERS || USE_GC_POINTERS
+        std::shared_ptr<Arena> arena = Arena::make();
+        ArenaScope scope(arena.get());
+        GcAllowCollection collecting;
+#endif
+        std::string text = flat_interp(ast)->to_string();
+        GcHeap::end_of_run();
+        std::cout<< text << std::endl;
+        return;
+    }
+    Program program(std::cin, lazy);
+    std::cout<< interp_program(program, engine) << std::endl;
 }
 
 /**
-* \brief parses and consumes key words from input stream for let, if, bool, and function expression
-    throws runtime_error if invalid input is encountered
-* \param in input stream
+* \brief performs print() method on what expression is parsed
 */
-void parse_keyword(std::istream &in) {
-
-    if (in.peek() == 'l' ) {
-        consume(in, 'l');
-        consume(in, 'e');
-        consume(in, 't');
-    }
-    else if (in.peek() == 'i'){
-        consume(in, 'i');
-        if (in.peek() == 'f') {
-            consume(in, 'f');
-        }
-        else {
-            consume(in, 'n');
-        }
-    }
-    else if (in.peek() == 't'){
-        consume(in, 't');
-        if (in.peek() == 'r') {
-            consume(in, 'r');
-            consume(in, 'u');
-            consume(in, 'e');
-        }
-        else {
-            consume(in, 'h');
-            consume(in, 'e');
-            consume(in, 'n');
-        }
-
-    }
-    else if ( in.peek() == 'a') {
-        consume(in, 'a');
-        consume(in, 'l');
-        consume(in, 's');
-        consume(in, 'e');
-
-    }
-    else if ( in.peek() == 'u') {
-        consume(in, 'u');
-        consume(in, 'n');
-
-    }
-    else if ( in.peek() == 'e') {
-        consume(in, 'e');
-        consume(in, 'l');
-        consume(in, 's');
-        consume(in, 'e');
-    }
-    else{
-        throw std::runtime_error("consume mismatch");
-    }
-    skip_whitespace(in);
+void executePrint() {
+    Program program(std::cin);
+    PTR(Expr) e = program.expr;
+    std::cout<< e->to_string()<< std::endl;
 }
 
+/**
+* \brief performs pretty_print() method on what expression is parsed and prints result as string
+*/
+void executePrettyPrint() {
+    Program program(std::cin);
+    PTR(Expr) e = program.expr;
+    std::cout<< e->to_stringPP()<< std::endl;
+}
 
 
-
+/**
+* \brief Another driver to start parsing. Converts string to expression object
+* \param input string value to be parsed into an expression object
+* \return expression object corresponding with passed through string parameter
+*/
+PTR(Expr) parse_str(std::string input){
+    Lexer lex(input);
+    return parse_expr(lex);
+}
@@ -7,30 +7,78 @@
 #define parse_hpp
 
 #include <stdio.h>
+#include <utility>
+#include <vector>
 #include "Expr.hpp"
 #include "pointer.hpp"
 #include "Val.hpp"
+#include "lex.hpp"
 
-static void consume(std::istream &in, int expect);
-static void skip_whitespace(std::istream &in);
-PTR(Expr) parse_num(std::istream &inn);
-PTR(Expr) parse_expr(std::istream &in);
-PTR(Expr) parse_multicand(std::istream &in);
-PTR(Expr) parse_addend(std::istream &inn);
+/*! \brief custom enum to pick what evaluates --interp
+* tree walks Expr::interp, vm compiles to bytecode and runs it on the stack vm,
+* cek runs the explicit continuation machine in constant native stack,
+* flat runs over the struct-of-arrays FlatAst table
+*/
+typedef enum {
+    engine_tree,
+    engine_vm,
+    engine_cek,
+    engine_flat
+} engine_t;
+
+class ExprFactory;
+class FlatAst;
+
+/*! \brief a part of a parsed expression between the token opening it and the one closing it: a parenthesis,
+* a call argument, a let rhs or body, an if test, then or else part, or a function body.
+* its text parsed on its own gives its node
+*/
+struct SourcePart {
+    uint32_t node;///< number of the node the part parsed to
+    size_t begin;///< offset just past the token opening it
+    size_t end;///< offset of the token closing it
+};
+
+/*! \brief where the parts of a parsed expression are in its source
+* nodes are numbered in the order the parser makes them, children before their parent, so a subtree is
+* the run of numbers from its first node up to its root, and the root of the whole expression is last
+*/
+struct SpanTable {
+    std::vector<uint32_t> first;///< for each node, the number of the first node of its subtree
+    std::vector<SourcePart> parts;///< every part of the expression
+};
+
+/*! \brief a parsed program and the arena holding its nodes
+* every node of one parse is bump allocated together and released in one shot,
+* with plain pointers the arena is also the only owner of the nodes
+*/
+class Program {
+public:
+    std::shared_ptr<Arena> arena;///< memory of every node of expr
+    std::shared_ptr<ExprFactory> factory;///< table interning the nodes of expr, destroyed before arena
+    PTR(Expr) expr;///< the parsed expression
+
+    Program(std::istream &in, bool lazy = false);
+    Program(const std::string &source, bool lazy = false);
+    Program(const char *begin, const char *end);
+    Program();
+    void reparse(const char *begin, const char *end, SpanTable *spans = nullptr);
+    void reparse_lazily(std::shared_ptr<const std::string> source);
+};
+
+PTR(Expr) parse_expr(Lexer &lex);
+PTR(Expr) parse_expr(Lexer &lex, SpanTable &spans);
+PTR(Expr) parse(Lexer &lex);
+std::shared_ptr<FlatAst> parse_flat(Lexer &lex);
+PTR(Expr) parse_lazy_body(const LazyBody &lazy);
+size_t skip_expr(Lexer &lex);
+std::vector<std::pair<size_t, size_t> > split_expressions(const char *begin, const char *end);
 PTR(Expr) parse(std::istream &in);
-void executeInterp();
+std::string interp_program(Program &program, engine_t engine = engine_tree);
+void executeInterp(engine_t engine = engine_tree, bool lazy = false);
 void executePrint();
 void executePrettyPrint();
-PTR(Expr) parse_let(std::istream &in);
-PTR(Expr) parse_var(std::istream &in);
-PTR(Expr) parse_if(std::istream &in);
 PTR(Expr) parse_str(std::string input);
-bool isInvalidInput (std::istream &in);
-void parse_keyword(std::istream &in);
-PTR(Expr) parse_comparg(std::istream &in);
-PTR(Expr) parse_inner (std::istream &inn);
-PTR(Expr) parse_fun (std::istream &inn);
-
 
 
 
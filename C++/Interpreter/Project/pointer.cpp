@@ -6,3 +6,109 @@
 //
 
 #include "pointer.hpp"
+#include <stdint.h>
+
+thread_local Arena *Arena::current_arena = nullptr;
+
+/**
+* \brief makes an empty arena, blocks are allocated on first use
+* \param block_size size of each block
+* \return the arena, freed once its shared_ptrs and the objects made in it are gone
+*/
+std::shared_ptr<Arena> Arena::make(size_t block_size) {
+    Arena *arena = new Arena(block_size);
+    arena->retain();
+    return std::shared_ptr<Arena>(arena, &Arena::release);
+}
+
+/**
+* \brief drops a reference taken with retain(), freeing the arena with the last one
+* \param arena arena to release
+*/
+void Arena::release(Arena *arena) {
+    if ( --arena->refs == 0 ) {
+        delete arena;
+    }
+}
+
+/**
+* \brief constructor to make an empty arena, see make()
+* \param block_size size of each block
+*/
+Arena::Arena(size_t block_size) : refs(0) {
+    this->next = nullptr;
+    this->end = nullptr;
+    this->block_size = block_size;
+    this->used = 0;
+}
+
+/**
+* \brief runs the registered destructors, newest first, then frees every block
+*/
+Arena::~Arena() {
+    for (size_t i = finalizers.size(); i > 0; i--) {
+        finalizers[i - 1].first(finalizers[i - 1].second);
+    }
+    for (size_t i = 0; i < blocks.size(); i++) {
+        delete[] blocks[i];
+    }
+}
+
+/**
+* \brief bumps the free pointer of the last block, starting a new block when it is full
+* \param size bytes needed
+* \param align alignment needed, a power of two
+* \return memory valid until the arena is destroyed
+*/
+void *Arena::allocate(size_t size, size_t align) {
+    uintptr_t start = ((uintptr_t)this->next + align - 1) & ~(uintptr_t)(align - 1);
+    if ( this->next == nullptr || start + size > (uintptr_t)this->end ) {
+        size_t length = size + align > this->block_size ? size + align : this->block_size;
+        char *block = new char[length];
+        this->blocks.push_back(block);
+        this->end = block + length;
+        start = ((uintptr_t)block + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    this->next = (char *)(start + size);
+    this->used += size;
+    return (void *)start;
+}
+
+/**
+* \brief registers a destructor to run when the arena is destroyed
+* \param destroy destructor of object
+* \param object arena object to destroy
+*/
+void Arena::on_release(void (*destroy)(void *), void *object) {
+    this->finalizers.push_back(std::make_pair(destroy, object));
+}
+
+/**
+* \brief constructor to make arena current on this thread
+* \param arena arena NEW allocates from, nullptr for the heap
+*/
+ArenaScope::ArenaScope(Arena *arena) {
+    this->saved = Arena::current_arena;
+    Arena::current_arena = arena;
+}
+
+/**
+* \brief restores the arena that was current before
+*/
+ArenaScope::~ArenaScope() {
+    Arena::current_arena = this->saved;
+}
+
+/**
+* \brief frees an object whose count dropped to zero, objects made in an arena
+    only run their destructor and let go of the arena
+*/
+void RefCounted::destroy() const {
+    Arena *arena = this->arena;
+    if ( arena == nullptr ) {
+        delete this;
+        return;
+    }
+    this->~RefCounted();
+    Arena::release(arena);
+}
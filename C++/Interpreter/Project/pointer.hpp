@@ -6,24 +6,369 @@
 #ifndef __msdscript_pointer__
 #define __msdscript_pointer__
 
+#include <atomic>
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <stddef.h>
 
+#ifndef USE_PLAIN_POINTERS
 #define USE_PLAIN_POINTERS 0
-#if USE_PLAIN_POINTERS
+#endif
+#ifndef USE_STD_SHARED_POINTERS
+#define USE_STD_SHARED_POINTERS 0
+#endif
+#ifndef USE_ATOMIC_REFCOUNT
+#define USE_ATOMIC_REFCOUNT 0
+#endif
+#ifndef USE_GC_POINTERS
+#define USE_GC_POINTERS 0
+#endif
+
+#include "gc.hpp"
+#include "pool.hpp"
+
+/*! \brief reference count of RefCounted objects and arenas
+* plain integer unless USE_ATOMIC_REFCOUNT, which is needed once objects are shared between threads
+*/
+#if USE_ATOMIC_REFCOUNT
+typedef std::atomic<long> refcount_t;
+#else
+typedef long refcount_t;
+#endif
+
+/*! \brief bump allocator for the nodes of one parse
+* objects are carved out of large blocks and never freed one by one,
+* every block goes back in one shot when the arena is destroyed
+*/
+class Arena : public std::enable_shared_from_this<Arena> {
+public:
+    static std::shared_ptr<Arena> make(size_t block_size = 64 * 1024);
+    void *allocate(size_t size, size_t align);
+    void on_release(void (*destroy)(void *), void *object);
+
+    /**
+    * \brief keeps the arena alive, every shared_ptr to it together holds one reference,
+        every live RefCounted object in it holds one more
+    */
+    void retain() { ++this->refs; }
+    static void release(Arena *arena);
+
+    /**
+    * \brief bytes handed out so far
+    */
+    size_t bytes_used() const { return this->used; }
+
+    /**
+    * \brief arena NEW allocates from on this thread, nullptr for the heap
+    */
+    static Arena *current() { return current_arena; }
+
+private:
+    friend class ArenaScope;
+    static thread_local Arena *current_arena;///< arena of the innermost ArenaScope
+
+    std::vector<char *> blocks;///< every block allocated, freed together
+    char *next;///< first free byte of the last block
+    char *end;///< one past the last block
+    size_t block_size;///< size of a regular block, bigger requests get a block of their own
+    size_t used;///< bytes handed out
+    std::vector<std::pair<void (*)(void *), void *> > finalizers;///< destructors run on release, in reverse
+    refcount_t refs;///< see retain()
+
+    Arena(size_t block_size);
+    ~Arena();
+    Arena(const Arena &);
+    Arena &operator=(const Arena &);
+};
+
+/*! \brief makes arena the one NEW allocates from until the scope ends */
+class ArenaScope {
+public:
+    ArenaScope(Arena *arena);
+    ~ArenaScope();
+
+private:
+    Arena *saved;///< arena to restore
+
+    ArenaScope(const ArenaScope &);
+    ArenaScope &operator=(const ArenaScope &);
+};
+
+/*! \brief allocator for std::allocate_shared placing the object and its control block in an arena
+* holds the arena alive so a node outliving its Program stays valid
+*/
+template<class T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    std::shared_ptr<Arena> arena;///< where memory comes from
+
+    ArenaAllocator(std::shared_ptr<Arena> arena) : arena(arena) {}
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *, size_t) {}
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T> &lhs, const ArenaAllocator<U> &rhs) { return lhs.arena == rhs.arena; }
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T> &lhs, const ArenaAllocator<U> &rhs) { return lhs.arena != rhs.arena; }
+
+/**
+* \brief runs the destructor of an arena object without freeing its memory
+*/
+template<class T>
+void arena_destroy(void *object) {
+    static_cast<T *>(object)->~T();
+}
+
+/**
+* \brief make_shared for arena_make_shared, from the pool for Pooled classes
+*/
+template<class T, class... Args>
+std::shared_ptr<T> heap_make_shared(std::true_type, Args &&... args) {
+    return std::allocate_shared<T>(PoolAllocator<T>(), std::forward<Args>(args)...);
+}
+
+/**
+* \brief make_shared for arena_make_shared of any other class
+*/
+template<class T, class... Args>
+std::shared_ptr<T> heap_make_shared(std::false_type, Args &&... args) {
+    return std::make_shared<T>(std::forward<Args>(args)...);
+}
+
+/**
+* \brief NEW for smart pointers, make_shared unless an arena is current
+*/
+template<class T, class... Args>
+std::shared_ptr<T> arena_make_shared(Args &&... args) {
+    Arena *arena = Arena::current();
+    if ( arena == nullptr ) {
+        return heap_make_shared<T>(typename std::is_base_of<Pooled, T>::type(), std::forward<Args>(args)...);
+    }
+    return std::allocate_shared<T>(ArenaAllocator<T>(arena->shared_from_this()), std::forward<Args>(args)...);
+}
+
+/**
+* \brief NEW for plain pointers, plain new unless an arena is current,
+    in which case the object is destroyed when the arena is
+*/
+template<class T, class... Args>
+T *arena_new(Args &&... args) {
+    Arena *arena = Arena::current();
+    if ( arena == nullptr ) {
+        return new T(std::forward<Args>(args)...);
+    }
+    T *object = ::new (arena->allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    if ( !std::is_trivially_destructible<T>::value ) {
+        arena->on_release(&arena_destroy<T>, object);
+    }
+    return object;
+}
+
+/*! \brief base of classes counted by Ref, the count lives in the object itself
+* so there is no separate control block, copies of a Ref only touch this count
+*/
+class RefCounted {
+public:
+    RefCounted() : refs(0), arena(nullptr) {}
+    RefCounted(const RefCounted &) : refs(0), arena(nullptr) {}
+    RefCounted &operator=(const RefCounted &) { return *this; }
+    virtual ~RefCounted() {}
 
-# define NEW(T)    new T
+    void retain() const { ++this->refs; }
+    void release() const {
+        if ( --this->refs == 0 ) {
+            destroy();
+        }
+    }
+
+    /**
+    * \brief number of Refs to the object
+    */
+    long use_count() const { return this->refs; }
+
+private:
+    template<class T, class... Args> friend class RefMaker;
+
+    mutable refcount_t refs;///< number of Refs to the object
+    Arena *arena;///< arena the object was made in, nullptr for the heap
+
+    void destroy() const;
+};
+
+/*! \brief smart pointer to a RefCounted object, same interface as the std::shared_ptr parts we use */
+template<class T>
+class Ref {
+public:
+    Ref() : ptr(nullptr) {}
+    Ref(std::nullptr_t) : ptr(nullptr) {}
+    explicit Ref(T *ptr) : ptr(ptr) { acquire(); }
+    Ref(const Ref &other) : ptr(other.ptr) { acquire(); }
+    Ref(Ref &&other) : ptr(other.ptr) { other.ptr = nullptr; }
+    template<class U>
+    Ref(const Ref<U> &other) : ptr(other.get()) { acquire(); }
+    template<class U>
+    Ref(Ref<U> &&other) : ptr(other.detach()) {}
+    ~Ref() { if ( this->ptr != nullptr ) { this->ptr->release(); } }
+
+    Ref &operator=(Ref other) {
+        std::swap(this->ptr, other.ptr);
+        return *this;
+    }
+
+    T *get() const { return this->ptr; }
+    T *operator->() const { return this->ptr; }
+    T &operator*() const { return *this->ptr; }
+    explicit operator bool() const { return this->ptr != nullptr; }
+    void reset() { Ref().swap(*this); }
+    void swap(Ref &other) { std::swap(this->ptr, other.ptr); }
+    long use_count() const { return this->ptr != nullptr ? this->ptr->use_count() : 0; }
+
+    /**
+    * \brief gives up the pointer without releasing it
+    */
+    T *detach() {
+        T *p = this->ptr;
+        this->ptr = nullptr;
+        return p;
+    }
+
+private:
+    T *ptr;///< object pointed to, nullptr for none
+
+    void acquire() { if ( this->ptr != nullptr ) { this->ptr->retain(); } }
+};
+
+template<class T, class U>
+bool operator==(const Ref<T> &lhs, const Ref<U> &rhs) { return lhs.get() == rhs.get(); }
+template<class T, class U>
+bool operator!=(const Ref<T> &lhs, const Ref<U> &rhs) { return lhs.get() != rhs.get(); }
+template<class T, class U>
+bool operator<(const Ref<T> &lhs, const Ref<U> &rhs) { return lhs.get() < rhs.get(); }
+template<class T>
+bool operator==(const Ref<T> &lhs, std::nullptr_t) { return lhs.get() == nullptr; }
+template<class T>
+bool operator==(std::nullptr_t, const Ref<T> &rhs) { return rhs.get() == nullptr; }
+template<class T>
+bool operator!=(const Ref<T> &lhs, std::nullptr_t) { return lhs.get() != nullptr; }
+template<class T>
+bool operator!=(std::nullptr_t, const Ref<T> &rhs) { return rhs.get() != nullptr; }
+
+/**
+* \brief THIS for intrusive pointers, the count is in the object so any raw pointer can be wrapped
+*/
+template<class T>
+Ref<T> ref_this(T *self) {
+    return Ref<T>(self);
+}
+
+/**
+* \brief CAST for intrusive pointers
+*/
+template<class T, class U>
+Ref<T> ref_dynamic_cast(const Ref<U> &p) {
+    return Ref<T>(dynamic_cast<T *>(p.get()));
+}
+
+/*! \brief builds RefCounted objects for make_ref, the only place allowed to set their arena */
+template<class T, class... Args>
+class RefMaker {
+public:
+    static Ref<T> make(Args &&... args) {
+        Arena *arena = Arena::current();
+        if ( arena == nullptr ) {
+            return Ref<T>(new T(std::forward<Args>(args)...));
+        }
+        T *object = ::new (arena->allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        static_cast<RefCounted *>(object)->arena = arena;
+        arena->retain();
+        return Ref<T>(object);
+    }
+};
+
+/**
+* \brief NEW for intrusive pointers, the heap unless an arena is current,
+    in which case the object keeps the arena alive until its count drops to zero
+*/
+template<class T, class... Args>
+Ref<T> make_ref(Args &&... args) {
+    return RefMaker<T, Args...>::make(std::forward<Args>(args)...);
+}
+
+/**
+* \brief gc_new of a class the heap collects
+*/
+template<class T, class... Args>
+T *gc_make(std::true_type, Args &&... args) {
+    T *object = new T(std::forward<Args>(args)...);
+    GcHeap::current().track(object);
+    return object;
+}
+
+/**
+* \brief gc_new of any other class, made like a plain pointer
+*/
+template<class T, class... Args>
+T *gc_make(std::false_type, Args &&... args) {
+    return arena_new<T>(std::forward<Args>(args)...);
+}
+
+/**
+* \brief NEW for collected pointers, Val and Env go to the collected heap of the thread,
+    anything else is made like a plain pointer
+*/
+template<class T, class... Args>
+T *gc_new(Args &&... args) {
+    return gc_make<T>(typename std::is_base_of<GcObject, T>::type(), std::forward<Args>(args)...);
+}
+
+#if USE_GC_POINTERS
+
+# define NEW(T)    gc_new<T>
 # define PTR(T)    T*
 # define CAST(T)   dynamic_cast<T*>
 # define CLASS(T)  class T
+# define HEAP_CLASS(T) class T : public GcObject, public Pooled
 # define THIS      this
+# define RAW(p)    (p)
 
-#else
+#elif USE_PLAIN_POINTERS
+
+# define NEW(T)    arena_new<T>
+# define PTR(T)    T*
+# define CAST(T)   dynamic_cast<T*>
+# define CLASS(T)  class T
+# define HEAP_CLASS(T) class T : public Pooled
+# define THIS      this
+# define RAW(p)    (p)
+
+#elif USE_STD_SHARED_POINTERS
 
-# define NEW(T)    std::make_shared<T>
+# define NEW(T)    arena_make_shared<T>
 # define PTR(T)    std::shared_ptr<T>
 # define CAST(T)   std::dynamic_pointer_cast<T>
 # define CLASS(T)  class T : public std::enable_shared_from_this<T>
+# define HEAP_CLASS(T) class T : public std::enable_shared_from_this<T>, public Pooled
 # define THIS      shared_from_this()
+# define RAW(p)    (p).get()
+
+#else
+
+# define NEW(T)    make_ref<T>
+# define PTR(T)    Ref<T>
+# define CAST(T)   ref_dynamic_cast<T>
+# define CLASS(T)  class T : public RefCounted
+# define HEAP_CLASS(T) class T : public RefCounted, public Pooled
+# define THIS      ref_this(this)
+# define RAW(p)    (p).get()
 
 #endif
 
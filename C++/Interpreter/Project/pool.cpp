@@ -0,0 +1,83 @@
+/**
+* \file pool.cpp
+* \brief contains the thread-local size-class pool implementations
+*/
+
+#include "pool.hpp"
+#include <new>
+#include <stdint.h>
+
+/**
+* \brief constructor to make a pool with empty free lists, the first allocation gets a slab
+*/
+ObjectPool::ObjectPool() {
+    for (int i = 0; i < num_classes; i++) {
+        free_lists[i] = nullptr;
+    }
+    slab_next = nullptr;
+    slab_end = nullptr;
+    counters.live = 0;
+    counters.high_water = 0;
+    counters.hits = 0;
+    counters.misses = 0;
+    counters.large = 0;
+}
+
+/**
+* \brief pool of the calling thread, trivially destroyed so objects released during
+    static destruction still find it
+* \return the pool
+*/
+ObjectPool &ObjectPool::local() {
+    static thread_local ObjectPool pool;
+    return pool;
+}
+
+/**
+* \brief hands out an object of size bytes, from the free list of its class if it has one
+* \param size bytes needed
+* \return memory aligned to 16 bytes
+*/
+void *ObjectPool::allocate(size_t size) {
+    if ( ++counters.live > counters.high_water ) {
+        counters.high_water = counters.live;
+    }
+    if ( size > max_size ) {
+        counters.large++;
+        return ::operator new(size);
+    }
+    int size_class = size == 0 ? 0 : (int)((size - 1) / granularity);
+    FreeNode *node = free_lists[size_class];
+    if ( node != nullptr ) {
+        free_lists[size_class] = node->next;
+        counters.hits++;
+        return node;
+    }
+    counters.misses++;
+    size_t bytes = (size_t)(size_class + 1) * granularity;
+    if ( slab_next == nullptr || (size_t)(slab_end - slab_next) < bytes ) {
+        //what is left of the old slab is dropped, at most one object's worth
+        slab_next = static_cast<char *>(::operator new(slab_size));
+        slab_end = slab_next + slab_size;
+    }
+    void *object = slab_next;
+    slab_next += bytes;
+    return object;
+}
+
+/**
+* \brief puts an object back on the free list of its class
+* \param object memory from allocate(), on this thread or another
+* \param size the size passed to allocate()
+*/
+void ObjectPool::release(void *object, size_t size) {
+    counters.live--;
+    if ( size > max_size ) {
+        ::operator delete(object);
+        return;
+    }
+    int size_class = size == 0 ? 0 : (int)((size - 1) / granularity);
+    FreeNode *node = static_cast<FreeNode *>(object);
+    node->next = free_lists[size_class];
+    free_lists[size_class] = node;
+}
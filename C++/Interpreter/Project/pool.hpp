@@ -0,0 +1,84 @@
+/**
+* \file pool.hpp
+* \brief contains the thread-local size-class pool declarations
+*/
+
+#ifndef pool_hpp
+#define pool_hpp
+
+#include <stddef.h>
+
+/*! \brief counters of one thread's pool */
+struct PoolStats {
+    long live;///< objects handed out and not yet released, may go negative on a thread releasing another's objects
+    long high_water;///< most objects live at once
+    size_t hits;///< allocations served from a free list
+    size_t misses;///< allocations carved from a fresh slab
+    size_t large;///< allocations too big for a size class, passed to operator new
+};
+
+/*! \brief free lists of small fixed-size objects, one per 16-byte size class
+* memory is carved out of slabs that are never given back, a released object goes on the free
+* list of its class and is handed out again by the next allocation of that class on the thread
+*/
+class ObjectPool {
+public:
+    static ObjectPool &local();
+    void *allocate(size_t size);
+    void release(void *object, size_t size);
+
+    /**
+    * \brief counters since the thread started
+    */
+    const PoolStats &stats() const { return this->counters; }
+
+private:
+    enum {
+        granularity = 16,       ///< bytes between size classes
+        max_size = 256,         ///< biggest pooled size
+        num_classes = max_size / granularity,
+        slab_size = 64 * 1024   ///< bytes carved into objects at a time
+    };
+
+    /*! \brief released object, its first word links the free list */
+    struct FreeNode {
+        FreeNode *next;///< next free object of the same class
+    };
+
+    FreeNode *free_lists[num_classes];///< released objects of each class
+    char *slab_next;///< next unused byte of the current slab
+    char *slab_end;///< one past the current slab
+    PoolStats counters;///< see stats()
+
+    ObjectPool();
+};
+
+/*! \brief base routing new and delete of a class and its subclasses through the thread's ObjectPool
+* sized delete gets the size of the most derived class through the virtual destructor
+*/
+class Pooled {
+public:
+    static void *operator new(size_t size) { return ObjectPool::local().allocate(size); }
+    static void operator delete(void *object, size_t size) { ObjectPool::local().release(object, size); }
+};
+
+/*! \brief allocator for std::allocate_shared drawing the object and its control block from the pool */
+template<class T>
+class PoolAllocator {
+public:
+    typedef T value_type;
+
+    PoolAllocator() {}
+    template<class U>
+    PoolAllocator(const PoolAllocator<U> &) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(ObjectPool::local().allocate(n * sizeof(T))); }
+    void deallocate(T *object, size_t n) { ObjectPool::local().release(object, n * sizeof(T)); }
+};
+
+template<class T, class U>
+bool operator==(const PoolAllocator<T> &, const PoolAllocator<U> &) { return true; }
+template<class T, class U>
+bool operator!=(const PoolAllocator<T> &, const PoolAllocator<U> &) { return false; }
+
+#endif /* pool_hpp */
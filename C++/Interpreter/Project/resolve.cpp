@@ -0,0 +1,589 @@
+/**
+* \file resolve.cpp
+* \brief contains the lexical addressing pass and the resolved expression implementations
+        resolve() rewrites every variable into the frame and slot it lives in, so the
+        interpreters index arrays instead of comparing names down an environment chain,
+        and reports unbound variables before anything runs
+*/
+
+#include "resolve.hpp"
+#include <algorithm>
+#include "Env.hpp"
+#include "cek.hpp"
+#include "traverse.hpp"
+
+//**********************RESOLVER CLASS IMPLEMENTATIONS ********************************
+
+/**
+* \brief constructor to make a scope nested in enclosing
+* \param enclosing scope of the surrounding function, nullptr at top level
+*/
+Resolver::Scope::Scope(Scope *enclosing) {
+    this->max_locals = 0;
+    this->enclosing = enclosing;
+}
+
+/**
+* \brief constructor to make a resolver with no scope open
+*/
+Resolver::Resolver() {
+    this->scope = nullptr;
+}
+
+/*! \brief resolves the nodes walk() goes through, results wait on a value stack until their parent is left */
+class Resolver::Visitor : public ExprVisitor {
+public:
+    /*! \brief a node whose children are being resolved */
+    struct Frame {
+        Expr *node;///< the node
+        int next;///< index of the child being walked
+        size_t base;///< size of results before its children
+        int slot;///< slot a let binds its lhs to, set once its rhs is resolved
+    };
+
+    Resolver &resolver;///< scopes the variables are looked up in
+    PTR(Expr) root;///< expression resolved
+    std::vector<Frame> frames;///< nodes entered and not yet left
+    std::vector<PTR(Expr)> results;///< resolved children of the open nodes, then the result
+
+    Visitor(Resolver &resolver, PTR(Expr) const &root) : resolver(resolver), root(root) { }
+
+    /**
+    * \brief the node being entered or left, as the reference its parent holds
+    */
+    PTR(Expr) const &self() const {
+        return frames.empty() ? root : frames.back().node->child(frames.back().next);
+    }
+
+    bool enter(Expr *e) {
+        switch (e->kind) {
+            case expr_num: case expr_bool:
+                results.push_back(self());
+                return false;
+            case expr_var: {
+                Symbol name = static_cast<VarExpr*>(e)->value;
+                results.push_back(NEW(ResolvedVarExpr)(name, resolver.var(name)));
+                return false;
+            }
+            case expr_fun: {
+                FunExpr *fun = static_cast<FunExpr*>(e);
+                if ( !fun->has_body() ) {
+                    results.push_back(resolver.lazy_fun(self(), fun->formal_arg, fun->free_names()));
+                    return false;
+                }
+                resolver.open_fun(fun->formal_arg);
+                break;
+            }
+            default:
+                break;
+        }
+        Frame frame = { e, 0, results.size(), -1 };
+        frames.push_back(frame);
+        return true;
+    }
+    void between(Expr *e, int i) {
+        frames.back().next = i;
+        if ( e->kind == expr_let ) {
+            //lhs is visible in the body only, so it is bound once rhs is done
+            frames.back().slot = resolver.bind(static_cast<LetExpr*>(e)->lhs);
+        }
+    }
+    void leave(Expr *e) {
+        Frame frame = frames.back();
+        frames.pop_back();
+        PTR(Expr) const *children = &results[frame.base];
+        PTR(Expr) result;
+        if ( e->kind == expr_let ) {
+            resolver.unbind();
+            result = NEW(ResolvedLetExpr)(static_cast<LetExpr*>(e)->lhs, children[0], children[1], frame.slot);
+        }
+        else if ( e->kind == expr_fun ) {
+            result = resolver.close_fun(static_cast<FunExpr*>(e)->formal_arg, children[0]);
+        }
+        else {
+            bool changed = false;
+            for (int i = 0; i < e->arity(); i++) {
+                changed = changed || children[i] != e->child(i);
+            }
+            result = changed ? e->rebuild(children) : self();
+        }
+        results.resize(frame.base);
+        results.push_back(result);
+    }
+};
+
+/**
+* \brief resolves expr against the open scopes
+* \param expr expression to resolve
+* \throws std::runtime_error naming the first unbound variable
+* \return resolved copy of expr
+*/
+PTR(Expr) Resolver::resolve(PTR(Expr) const &expr) {
+    Visitor visitor(*this, expr);
+    walk(RAW(expr), visitor);
+    return visitor.results.back();
+}
+
+/**
+* \brief resolves expr as the top level, where only _let can bind variables
+* \param expr expression to resolve
+* \param num_slots set to the frame size expr needs
+* \throws std::runtime_error naming the first unbound variable
+* \return resolved copy of expr
+*/
+PTR(Expr) Resolver::top_level(PTR(Expr) const &expr, int &num_slots) {
+    open_top();
+    PTR(Expr) resolved = resolve(expr);
+    std::vector<Address> captured_from;
+    num_slots = close_scope(captured_from);
+    return resolved;
+}
+
+/**
+* \brief opens the scope of the top level, where only _let can bind variables
+*/
+void Resolver::open_top() {
+    scopes.emplace_back(nullptr);
+    scope = &scopes.back();
+}
+
+/**
+* \brief closes the innermost scope, opened by open_top() or open_fun()
+* \param captured_from set to where each value a closure of the scope captures comes from in the enclosing frame
+* \return frame size the scope needs
+*/
+int Resolver::close_scope(std::vector<Address> &captured_from) {
+    int num_slots = scope->max_locals;
+    captured_from = scope->captures;
+    scope = scope->enclosing;
+    scopes.pop_back();
+    return num_slots;
+}
+
+/**
+* \brief finds the address of variable name from the innermost scope
+* \param name variable to find
+* \throws std::runtime_error if no scope binds name
+* \return local slot at depth 0 or captured value at depth 1
+*/
+Address Resolver::var(Symbol name) {
+    Address address;
+    address.depth = 0;
+    address.slot = resolve_local(scope, name);
+    if ( address.slot >= 0 ) {
+        return address;
+    }
+    address.depth = 1;
+    address.slot = resolve_capture(scope, name);
+    if ( address.slot >= 0 ) {
+        return address;
+    }
+    throw std::runtime_error("free variable: " + name.str());
+}
+
+/**
+* \brief makes name visible to the expressions resolved next
+* \param name variable being bound
+* \return frame slot holding the variable
+*/
+int Resolver::bind(Symbol name) {
+    scope->locals.push_back(name);
+    int slot = (int)scope->locals.size() - 1;
+    if ( slot + 1 > scope->max_locals ) {
+        scope->max_locals = slot + 1;
+    }
+    return slot;
+}
+
+/**
+* \brief ends the innermost binding, its slot is reused by the next bind
+*/
+void Resolver::unbind() {
+    scope->locals.pop_back();
+}
+
+/**
+* \brief opens the scope of a function body, with formal_arg in slot 0
+* \param formal_arg variable bound to the actual arg
+*/
+void Resolver::open_fun(Symbol formal_arg) {
+    scopes.emplace_back(scope);
+    scope = &scopes.back();
+    bind(formal_arg);
+}
+
+/**
+* \brief closes the scope open_fun() opened and records what the closure captures
+* \param formal_arg variable bound to the actual arg, lives in slot 0
+* \param body resolved expression run by calls of the closure
+* \return ResolvedFunExpr for the function
+*/
+PTR(Expr) Resolver::close_fun(Symbol formal_arg, PTR(Expr) const &body) {
+    std::vector<Address> captured_from;
+    int num_slots = close_scope(captured_from);
+    return NEW(ResolvedFunExpr)(formal_arg, body, num_slots, std::move(captured_from));
+}
+
+/**
+* \brief looks up what a pre-parsed function captures without resolving its body, the body is resolved by
+    lazy_body() on the first call
+* \param fun the pre-parsed FunExpr
+* \param formal_arg variable bound to the actual arg
+* \param free_names variables free in fun, each captured from the enclosing scope
+* \throws std::runtime_error naming the first unbound variable
+* \return ResolvedFunExpr for the function, with no body yet
+*/
+PTR(Expr) Resolver::lazy_fun(PTR(Expr) const &fun, Symbol formal_arg, FreeVars const &free_names) {
+    std::vector<Address> captured_from;
+    captured_from.reserve(free_names->size());
+    for ( size_t i = 0; i < free_names->size(); i++ ) {
+        captured_from.push_back(var((*free_names)[i]));
+    }
+    std::vector<Symbol> capture_names(free_names->begin(), free_names->end());
+    return NEW(ResolvedFunExpr)(formal_arg, fun, std::move(captured_from), std::move(capture_names));
+}
+
+/**
+* \brief resolves the body of a function lazy_fun() left unresolved, its captured values are fixed already
+* \param formal_arg variable bound to the actual arg, lives in slot 0
+* \param body expression run by calls of the closure
+* \param capture_names names of the captured values in the order the closure holds them
+* \param num_slots set to the frame size a call needs
+* \return resolved copy of body
+*/
+PTR(Expr) Resolver::lazy_body(Symbol formal_arg, PTR(Expr) const &body, const std::vector<Symbol> &capture_names,
+                              int &num_slots) {
+    //the enclosing scope only has to exist, every name body reaches out for is one of capture_names
+    scopes.emplace_back(nullptr);
+    scope = &scopes.back();
+    open_fun(formal_arg);
+    scope->capture_names = capture_names;
+    PTR(Expr) resolved = resolve(body);
+    num_slots = scope->max_locals;
+    scopes.clear();
+    scope = nullptr;
+    return resolved;
+}
+
+/**
+* \brief finds the innermost slot bound to name in scope s
+* \return slot or -1 if name is not a local of s
+*/
+int Resolver::resolve_local(Scope *s, Symbol name) {
+    for ( int i = (int)s->locals.size() - 1; i >= 0; i-- ) {
+        if ( s->locals[i] == name ) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+* \brief finds or adds a captured value for name in scope s, and in every scope between s and the one binding name
+* \return capture index or -1 if no enclosing scope binds name
+*/
+int Resolver::resolve_capture(Scope *s, Symbol name) {
+    std::vector<Scope*> missing; //scopes from s outwards that do not capture name yet
+    Address from;
+    for ( Scope *at = s; ; at = at->enclosing ) {
+        if ( at->enclosing == nullptr ) {
+            return -1;
+        }
+        std::vector<Symbol>::iterator found = std::find(at->capture_names.begin(), at->capture_names.end(), name);
+        if ( found != at->capture_names.end() ) {
+            from.depth = 1;
+            from.slot = (int)(found - at->capture_names.begin());
+            break;
+        }
+        missing.push_back(at);
+        from.depth = 0;
+        from.slot = resolve_local(at->enclosing, name);
+        if ( from.slot >= 0 ) {
+            break;
+        }
+    }
+
+    //each scope captures name from where the scope around it holds it, outermost first
+    for ( size_t i = missing.size(); i-- > 0; ) {
+        missing[i]->captures.push_back(from);
+        missing[i]->capture_names.push_back(name);
+        from.depth = 1;
+        from.slot = (int)missing[i]->capture_names.size() - 1;
+    }
+    return from.slot;
+}
+
+//**********************RESOLVED VARIABLE CLASS IMPLEMENTATIONS ***********************
+
+/**
+* \brief constructor to make a variable read by address
+* \param value name of the variable, kept for printing and equality
+* \param address frame and slot holding the variable
+*/
+ResolvedVarExpr::ResolvedVarExpr(Symbol value, Address address) : VarExpr(value) {
+    this->address = address;
+}
+
+/**
+* \brief reads the variable out of its frame slot
+* \param env frame 'this' was resolved against
+* \param tail unused, a variable has no tail expression
+* \return value stored at the address
+*/
+Value ResolvedVarExpr::interp_step(PTR(Env) &env, PTR(Expr) &tail) {
+    return env->lookup_at(address.depth, address.slot);
+}
+
+/**
+* \brief returns the value in the variable's frame slot to the CEK machine
+* \param cek machine evaluating 'this'
+* \param env frame 'this' was resolved against
+*/
+void ResolvedVarExpr::step(Cek &cek, PTR(Env) const &env) {
+    cek.ret(env->lookup_at(address.depth, address.slot));
+}
+
+//**********************RESOLVED LET CLASS IMPLEMENTATIONS ****************************
+
+/**
+* \brief constructor to make a let expression that binds into a frame slot
+* \param var string variable bound in the body
+* \param replacement expression whose value var takes
+* \param exprToSub expression var is visible in
+* \param slot slot of the running frame bound to var
+*/
+ResolvedLetExpr::ResolvedLetExpr(Symbol var, PTR(Expr) replacement, PTR(Expr) exprToSub, int slot)
+    : LetExpr(var, std::move(replacement), std::move(exprToSub)) {
+    this->slot = slot;
+}
+
+/**
+* \brief stores the value of rhs in lhs's slot and hands body back as the tail expression
+* \param env frame 'this' was resolved against, body runs in the same frame
+* \param tail set to body, run next by Expr::evaluate
+* \return the absent value, the result comes from the tail expression
+*/
+Value ResolvedLetExpr::interp_step(PTR(Env) &env, PTR(Expr) &tail) {
+    env->bind_at(slot, rhs->evaluate(env));
+    tail = body;
+    return Value();
+}
+
+/**
+* \brief stores the value of rhs in lhs's slot and makes body the next step
+* \param cek machine evaluating 'this'
+* \param kont continuation pushed by LetExpr::step
+* \param val value of rhs
+*/
+void ResolvedLetExpr::resume(Cek &cek, Kont &kont, const Value &val) {
+    kont.env->bind_at(slot, val);
+    cek.eval(this->body, kont.env);
+}
+
+//**********************RESOLVED FUNEXPR CLASS IMPLEMENTATIONS ************************
+
+/**
+* \brief constructor to make a function expression whose calls run in array frames
+* \param formal_arg variable bound to the actual arg, slot 0 of the frame
+* \param body resolved expression run by calls
+* \param num_slots frame size of a call
+* \param captured_from addresses in the enclosing frame copied into the closure
+*/
+ResolvedFunExpr::ResolvedFunExpr(Symbol formal_arg, PTR(Expr) body, int num_slots, std::vector<Address> captured_from)
+    : FunExpr(formal_arg, std::move(body)) {
+    this->num_slots = num_slots;
+    this->captured_from = std::move(captured_from);
+    this->unresolved = nullptr;
+}
+
+/**
+* \brief constructor to make a function expression whose body is resolved from a pre-parsed one on the first
+    call
+* \param formal_arg variable bound to the actual arg, slot 0 of the frame
+* \param unresolved the pre-parsed FunExpr
+* \param captured_from addresses in the enclosing frame copied into the closure
+* \param capture_names names of the captured values, in captured_from order
+*/
+ResolvedFunExpr::ResolvedFunExpr(Symbol formal_arg, PTR(Expr) unresolved, std::vector<Address> captured_from,
+                                 std::vector<Symbol> capture_names)
+    : FunExpr(formal_arg, nullptr, std::make_shared<const std::vector<Symbol> >(capture_names)) {
+    this->num_slots = 0;
+    this->captured_from = std::move(captured_from);
+    this->unresolved = std::move(unresolved);
+    this->capture_names = std::move(capture_names);
+}
+
+/**
+* \brief resolves the body of the pre-parsed function, which is parsed first if nothing has used it yet
+* \return resolved body, num_slots is set to the frame size it needs
+*/
+PTR(Expr) ResolvedFunExpr::build_body() const {
+    if ( this->unresolved == nullptr ) {
+        return nullptr;
+    }
+    Resolver resolver;
+    int slots = 0;
+    PTR(Expr) body = resolver.lazy_body(this->formal_arg, static_cast<FunExpr*>(RAW(this->unresolved))->body_expr(),
+                                        this->capture_names, slots);
+    this->num_slots = slots;
+    return body;
+}
+
+/**
+* \brief copies the captured values out of env into the closure's own frame
+* \param env frame 'this' was resolved against
+* \return FrameFunVal for 'this'
+*/
+Value ResolvedFunExpr::make_closure(PTR(Env) const &env) {
+    std::vector<Value> captured;
+    captured.reserve(captured_from.size());
+    for ( size_t i = 0; i < captured_from.size(); i++ ) {
+        captured.push_back(env->lookup_at(captured_from[i].depth, captured_from[i].slot));
+    }
+    if ( body == nullptr ) {
+        return Value::function(NEW(FrameFunVal)(formal_arg, THIS, NEW(FrameEnv)(captured, nullptr)));
+    }
+    return Value::function(NEW(FrameFunVal)(formal_arg, body, NEW(FrameEnv)(captured, nullptr), num_slots));
+}
+
+/**
+* \brief converts to a FrameFunVal holding the values it captures from env
+* \param env frame 'this' was resolved against
+* \param tail unused, a function has no tail expression
+* \return FrameFunVal for 'this'
+*/
+Value ResolvedFunExpr::interp_step(PTR(Env) &env, PTR(Expr) &tail) {
+    return make_closure(env);
+}
+
+/**
+* \brief returns a FrameFunVal holding the values it captures from env to the CEK machine
+* \param cek machine evaluating 'this'
+* \param env frame 'this' was resolved against
+*/
+void ResolvedFunExpr::step(Cek &cek, PTR(Env) const &env) {
+    cek.ret(make_closure(env));
+}
+
+//**********************FRAMEFUNVAL CLASS IMPLEMENTATIONS *****************************
+
+/**
+* \brief constructor to make a closure over a frame of captured values
+* \param formal_arg variable bound to the actual arg
+* \param body resolved expression run by calls
+* \param captured frame of captured values, depth 1 inside body
+* \param num_slots frame size of a call
+*/
+FrameFunVal::FrameFunVal(Symbol formal_arg, PTR(Expr) body, PTR(Env) captured, int num_slots)
+    : FunVal(formal_arg, std::move(body), std::move(captured)) {
+    this->num_slots = num_slots;
+}
+
+/**
+* \brief constructor to make a closure of a function whose body is resolved on the first call
+* \param formal_arg variable bound to the actual arg
+* \param fun ResolvedFunExpr made by Resolver::lazy_fun()
+* \param captured frame of captured values, depth 1 inside body
+*/
+FrameFunVal::FrameFunVal(Symbol formal_arg, PTR(Expr) fun, PTR(Env) captured)
+    : FunVal(formal_arg, nullptr, std::move(captured), std::move(fun)) {
+    this->num_slots = 0;
+}
+
+/**
+* \brief resolved body, taken from the function expression the first time it is asked for
+* \return body of the closure
+*/
+PTR(Expr) FrameFunVal::body_expr() {
+    if ( this->body == nullptr ) {
+        ResolvedFunExpr *resolved = static_cast<ResolvedFunExpr*>(RAW(this->fun));
+        this->body = resolved->body_expr();
+        this->num_slots = resolved->num_slots;
+    }
+    return this->body;
+}
+
+/**
+* \brief makes the frame a call runs in, with actual_arg in slot 0
+* \param actual_arg value bound to formal_arg
+* \return new frame whose parent holds the captured values
+*/
+PTR(Env) FrameFunVal::frame(const Value &actual_arg) {
+    if ( body == nullptr ) {
+        body_expr(); //resolving the body sets num_slots
+    }
+    PTR(Env) frame = NEW(FrameEnv)(num_slots, env);
+    frame->bind_at(0, actual_arg);
+    return frame;
+}
+
+/**
+* \brief runs body in a new frame holding actual_arg
+* \param actual_arg value bound to formal_arg
+* \return Val result of body
+*/
+PTR(Val) FrameFunVal::call(PTR(Val) const &actual_arg) {
+    GcNoCollection native_caller;
+    PTR(Env) call_frame = frame(Value(actual_arg));
+    return body->evaluate(call_frame).to_val();
+}
+
+/**
+* \brief hands body back as the tail expression to run in a new frame holding actual_arg
+* \param actual_arg value bound to formal_arg
+* \param env replaced by the frame the body runs in
+* \param tail set to body, run next by Expr::evaluate
+* \return the absent value, the result comes from the tail expression
+*/
+Value FrameFunVal::call_step(const Value &actual_arg, PTR(Env) &env, PTR(Expr) &tail) {
+    env = frame(actual_arg);
+    tail = body;
+    return Value();
+}
+
+/**
+* \brief makes body the next step of the CEK machine, in a new frame holding actual_arg
+* \param cek machine evaluating the call
+* \param actual_arg value bound to formal_arg
+*/
+void FrameFunVal::apply(Cek &cek, const Value &actual_arg) {
+    PTR(Env) call_frame = frame(actual_arg);
+    cek.eval(body, call_frame);
+}
+
+//**********************DRIVER FUNCTIONS ***********************************************
+
+/**
+* \brief rewrites every variable in expr into its lexical address
+* \param expr expression to resolve
+* \param num_slots set to the size of the top level frame
+* \throws std::runtime_error naming the first unbound variable
+* \return resolved copy of expr, to be run in a FrameEnv of num_slots
+*/
+PTR(Expr) resolve(PTR(Expr) const &expr, int &num_slots) {
+    Resolver resolver;
+    return resolver.top_level(expr, num_slots);
+}
+
+/**
+* \brief resolves expr and interprets it with Expr::evaluate
+* \param expr expression to evaluate
+* \return Val object result of the expression
+*/
+PTR(Val) resolved_interp(PTR(Expr) const &expr) {
+    int num_slots = 0;
+    PTR(Expr) resolved = resolve(expr, num_slots);
+    return resolved->evaluate(NEW(FrameEnv)(num_slots, nullptr)).to_val();
+}
+
+/**
+* \brief resolves expr and evaluates it on the CEK machine
+* \param expr expression to evaluate
+* \return Val object result of the expression
+*/
+PTR(Val) resolved_cek_interp(PTR(Expr) const &expr) {
+    int num_slots = 0;
+    PTR(Expr) resolved = resolve(expr, num_slots);
+    Cek cek;
+    return cek.run(resolved, NEW(FrameEnv)(num_slots, nullptr)).to_val();
+}
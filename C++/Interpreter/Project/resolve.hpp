@@ -0,0 +1,120 @@
+/**
+* \file resolve.hpp
+* \brief contains the lexical addressing pass and the resolved expression declarations
+*/
+
+#ifndef resolve_hpp
+#define resolve_hpp
+
+#include <deque>
+#include <string>
+#include <vector>
+#include "pointer.hpp"
+#include "Expr.hpp"
+#include "Val.hpp"
+
+/*! \brief where a variable lives at run time
+* depth 0 is the frame of the running function, depth 1 the values its closure captured
+*/
+struct Address {
+    int depth;///< frames to walk out
+    int slot;///< index within that frame
+};
+
+/*! \brief keeps the scopes of the lexical addressing pass, resolve() walks the expression with an explicit
+* stack and calls into here as it enters and leaves binders, so nesting depth costs heap, not native stack
+*/
+class Resolver {
+public:
+    Resolver();
+    PTR(Expr) top_level(PTR(Expr) const &expr, int &num_slots);
+    void open_top();
+    int close_scope(std::vector<Address> &captured_from);
+    Address var(Symbol name);
+    int bind(Symbol name);
+    void unbind();
+    void open_fun(Symbol formal_arg);
+    PTR(Expr) close_fun(Symbol formal_arg, PTR(Expr) const &body);
+    PTR(Expr) lazy_fun(PTR(Expr) const &fun, Symbol formal_arg, FreeVars const &free_names);
+    PTR(Expr) lazy_body(Symbol formal_arg, PTR(Expr) const &body, const std::vector<Symbol> &capture_names,
+                        int &num_slots);
+
+private:
+    /*! \brief resolve time view of the function body being resolved */
+    struct Scope {
+        std::vector<Symbol> locals;///< visible bindings, innermost last, position is the slot
+        std::vector<Symbol> capture_names;///< names of the values the closure captures
+        std::vector<Address> captures;///< where each captured value comes from in the enclosing frame
+        int max_locals;///< high water mark of live slots
+        Scope *enclosing;///< scope of the surrounding function, nullptr at top level
+
+        Scope(Scope *enclosing);
+    };
+    class Visitor;
+
+    std::deque<Scope> scopes;///< open scopes, outermost first, a deque so enclosing pointers stay valid
+    Scope *scope;///< innermost scope
+
+    PTR(Expr) resolve(PTR(Expr) const &expr);
+    int resolve_local(Scope *s, Symbol name);
+    int resolve_capture(Scope *s, Symbol name);
+};
+
+class ResolvedVarExpr : public VarExpr {
+public:
+    Address address;///< frame and slot holding the variable
+
+    ResolvedVarExpr(Symbol value, Address address);
+    Value interp_step(PTR(Env) &env, PTR(Expr) &tail);
+    void step(Cek &cek, PTR(Env) const &env);
+};
+
+class ResolvedLetExpr : public LetExpr {
+public:
+    int slot;///< slot of the running frame bound to lhs
+
+    ResolvedLetExpr(Symbol var, PTR(Expr) replacement, PTR(Expr) exprToSub, int slot);
+    Value interp_step(PTR(Env) &env, PTR(Expr) &tail);
+    void resume(Cek &cek, Kont &kont, const Value &val);
+};
+
+class ResolvedFunExpr : public FunExpr {
+public:
+    mutable int num_slots;///< frame size of a call, slot 0 is formal_arg, set when a lazy body is resolved
+    std::vector<Address> captured_from;///< addresses in the enclosing frame copied into the closure
+    PTR(Expr) unresolved;///< pre-parsed function the body is resolved from on the first call, nullptr if none
+    std::vector<Symbol> capture_names;///< names of the captured values of a lazy body, in captured_from order
+
+    ResolvedFunExpr(Symbol formal_arg, PTR(Expr) body, int num_slots, std::vector<Address> captured_from);
+    ResolvedFunExpr(Symbol formal_arg, PTR(Expr) unresolved, std::vector<Address> captured_from,
+                    std::vector<Symbol> capture_names);
+    Value interp_step(PTR(Env) &env, PTR(Expr) &tail);
+    void step(Cek &cek, PTR(Env) const &env);
+
+protected:
+    PTR(Expr) build_body() const;
+
+private:
+    Value make_closure(PTR(Env) const &env);
+};
+
+class FrameFunVal : public FunVal {
+public:
+    int num_slots;///< frame size of a call, set with the body when fun is a ResolvedFunExpr resolved on the first call
+
+    FrameFunVal(Symbol formal_arg, PTR(Expr) body, PTR(Env) captured, int num_slots);
+    FrameFunVal(Symbol formal_arg, PTR(Expr) fun, PTR(Env) captured);
+    PTR(Expr) body_expr();
+    PTR(Val) call(PTR(Val) const &actual_arg);
+    Value call_step(const Value &actual_arg, PTR(Env) &env, PTR(Expr) &tail);
+    void apply(Cek &cek, const Value &actual_arg);
+
+private:
+    PTR(Env) frame(const Value &actual_arg);
+};
+
+PTR(Expr) resolve(PTR(Expr) const &expr, int &num_slots);
+PTR(Val) resolved_interp(PTR(Expr) const &expr);
+PTR(Val) resolved_cek_interp(PTR(Expr) const &expr);
+
+#endif /* resolve_hpp */
@@ -0,0 +1,266 @@
+/**
+* \file scan.cpp
+* \brief contains the character scanning kernel implementations
+        the lexer skips whitespace, digits and letters 16 bytes at a time with SSE2 or 32 with AVX2 where the CPU
+        has them, picked once at run time, and a byte at a time otherwise. Each kernel compares a whole block
+        against the bounds of the class and finds the first byte outside it from the movemask of the result
+*/
+
+#include "scan.hpp"
+
+#if USE_SIMD_SCAN && defined(__SSE2__)
+#define SCAN_SSE2 1
+#include <emmintrin.h>
+#else
+#define SCAN_SSE2 0
+#endif
+
+#if SCAN_SSE2 && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_AVX2 1
+#include <immintrin.h>
+#else
+#define SCAN_AVX2 0
+#endif
+
+namespace {
+
+/**
+* \brief whether c is whitespace in the "C" locale
+*/
+inline bool is_space(char c) {
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+/**
+* \brief whether c is a decimal digit
+*/
+inline bool is_digit(char c) {
+    return (unsigned char)(c - '0') <= 9;
+}
+
+/**
+* \brief whether c is an ASCII letter of either case
+*/
+inline bool is_letter(char c) {
+    return (unsigned char)((c | 0x20) - 'a') <= 'z' - 'a';
+}
+
+const char *scalar_spaces(const char *p, const char *end) {
+    while ( p != end && is_space(*p) ) {
+        p++;
+    }
+    return p;
+}
+
+const char *scalar_digits(const char *p, const char *end) {
+    while ( p != end && is_digit(*p) ) {
+        p++;
+    }
+    return p;
+}
+
+const char *scalar_letters(const char *p, const char *end) {
+    while ( p != end && is_letter(*p) ) {
+        p++;
+    }
+    return p;
+}
+
+const ScanKernels scalar_kernels = { "scalar", scalar_spaces, scalar_digits, scalar_letters };
+
+#if SCAN_SSE2
+
+//the byte compares are signed, bytes from 0x80 up are negative and fall outside every class
+
+/**
+* \brief bytes of v that are whitespace, all ones in each
+*/
+inline __m128i sse2_space_bytes(__m128i v) {
+    __m128i controls = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)),
+                                     _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1)));
+    return _mm_or_si128(controls, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+}
+
+/**
+* \brief bytes of v that are digits, all ones in each
+*/
+inline __m128i sse2_digit_bytes(__m128i v) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+}
+
+/**
+* \brief bytes of v that are letters, all ones in each, setting bit 5 folds upper case onto lower case
+*/
+inline __m128i sse2_letter_bytes(__m128i v) {
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    return _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+}
+
+/**
+* \brief runs a class over whole 16 byte blocks, the bytes left over are skipped by scalar. Runs are mostly
+    empty or one character long, those return from the first two bytes before any block is loaded
+*/
+template<bool (*Is)(char), __m128i (*Match)(__m128i), const char *(*Scalar)(const char *, const char *)>
+const char *sse2_run(const char *p, const char *end) {
+    if ( p == end || !Is(*p) ) {
+        return p;
+    }
+    if ( p + 1 == end || !Is(p[1]) ) {
+        return p + 1;
+    }
+    while ( end - p >= 16 ) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        unsigned outside = ~(unsigned)_mm_movemask_epi8(Match(v)) & 0xFFFFu;
+        if ( outside != 0 ) {
+            return p + __builtin_ctz(outside);
+        }
+        p += 16;
+    }
+    return Scalar(p, end);
+}
+
+const ScanKernels sse2_kernels = {
+    "sse2",
+    sse2_run<is_space, sse2_space_bytes, scalar_spaces>,
+    sse2_run<is_digit, sse2_digit_bytes, scalar_digits>,
+    sse2_run<is_letter, sse2_letter_bytes, scalar_letters>
+};
+
+/**
+* \brief value of the 8 digits at p, pairs of digits are combined by one multiply add and pairs of pairs by
+    another, so the 8 digits take two instead of eight dependent steps
+*/
+inline unsigned sse2_eight_digits(const char *p) {
+    __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p));
+    v = _mm_unpacklo_epi8(_mm_sub_epi8(v, _mm_set1_epi8('0')), _mm_setzero_si128());
+    v = _mm_madd_epi16(v, _mm_setr_epi16(10, 1, 10, 1, 10, 1, 10, 1));
+    v = _mm_packs_epi32(v, v);
+    v = _mm_madd_epi16(v, _mm_setr_epi16(100, 1, 100, 1, 0, 0, 0, 0));
+    unsigned high = (unsigned)_mm_cvtsi128_si32(v);
+    unsigned low = (unsigned)_mm_cvtsi128_si32(_mm_srli_si128(v, 4));
+    return high * 10000u + low;
+}
+
+#endif
+
+#if SCAN_AVX2
+
+//same compares as the SSE2 kernels over 32 byte blocks, only called when the CPU reports AVX2. Most tokens are
+//short, so the first 16 bytes are checked on their own and a run only goes on 32 bytes at a time past them
+
+/**
+* \brief bytes of v that are whitespace, all ones in each
+*/
+__attribute__((target("avx2"))) inline __m256i avx2_space_bytes(__m256i v) {
+    __m256i controls = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)),
+                                        _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v));
+    return _mm256_or_si256(controls, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+}
+
+/**
+* \brief bytes of v that are digits, all ones in each
+*/
+__attribute__((target("avx2"))) inline __m256i avx2_digit_bytes(__m256i v) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+}
+
+/**
+* \brief bytes of v that are letters, all ones in each
+*/
+__attribute__((target("avx2"))) inline __m256i avx2_letter_bytes(__m256i v) {
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    return _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+}
+
+/**
+* \brief runs a class over a first 16 byte block and then whole 32 byte blocks, the bytes left over are
+    skipped by scalar
+*/
+template<bool (*Is)(char), __m128i (*Narrow)(__m128i), __m256i (*Wide)(__m256i),
+         const char *(*Rest)(const char *, const char *)>
+__attribute__((target("avx2"))) const char *avx2_run(const char *p, const char *end) {
+    if ( p == end || !Is(*p) ) {
+        return p;
+    }
+    if ( p + 1 == end || !Is(p[1]) ) {
+        return p + 1;
+    }
+    if ( end - p >= 16 ) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        unsigned outside = ~(unsigned)_mm_movemask_epi8(Narrow(v)) & 0xFFFFu;
+        if ( outside != 0 ) {
+            return p + __builtin_ctz(outside);
+        }
+        p += 16;
+    }
+    while ( end - p >= 32 ) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        unsigned outside = ~(unsigned)_mm256_movemask_epi8(Wide(v));
+        if ( outside != 0 ) {
+            return p + __builtin_ctz(outside);
+        }
+        p += 32;
+    }
+    return Rest(p, end);
+}
+
+const ScanKernels avx2_kernels = {
+    "avx2",
+    avx2_run<is_space, sse2_space_bytes, avx2_space_bytes, scalar_spaces>,
+    avx2_run<is_digit, sse2_digit_bytes, avx2_digit_bytes, scalar_digits>,
+    avx2_run<is_letter, sse2_letter_bytes, avx2_letter_bytes, scalar_letters>
+};
+
+#endif
+
+}
+
+/**
+* \brief kernels this build has that the CPU can run, the scalar ones first and the widest last
+* \return the kernel sets
+*/
+std::vector<const ScanKernels *> available_scan_kernels() {
+    std::vector<const ScanKernels *> kernels(1, &scalar_kernels);
+#if SCAN_SSE2
+    kernels.push_back(&sse2_kernels);
+#endif
+#if SCAN_AVX2
+    if ( __builtin_cpu_supports("avx2") ) {
+        kernels.push_back(&avx2_kernels);
+    }
+#endif
+    return kernels;
+}
+
+/**
+* \brief widest kernels the CPU can run, checked on the first call only
+* \return the kernel set
+*/
+const ScanKernels &scan_kernels() {
+    static const ScanKernels *best = available_scan_kernels().back();
+    return *best;
+}
+
+/**
+* \brief value of a run of digits, wrapping like unsigned arithmetic. Whole groups of 8 digits are converted
+    with SSE2 where it is available and folded in with one multiply each
+* \param p first digit
+* \param end just past the last digit, everything in between has to be a digit
+* \return the value modulo 2^32
+*/
+unsigned digits_value(const char *p, const char *end) {
+    unsigned n = 0;
+#if SCAN_SSE2
+    while ( end - p >= 8 ) {
+        n = n * 100000000u + sse2_eight_digits(p);
+        p += 8;
+    }
+#endif
+    while ( p != end ) {
+        n = n * 10u + (unsigned)(*p - '0');
+        p++;
+    }
+    return n;
+}
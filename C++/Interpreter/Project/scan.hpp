@@ -0,0 +1,32 @@
+/**
+* \file scan.hpp
+* \brief contains the character scanning kernel declarations
+*/
+
+#ifndef scan_hpp
+#define scan_hpp
+
+#include <stddef.h>
+#include <vector>
+
+/*! \brief USE_SIMD_SCAN 0 keeps the lexer on the scalar kernels even where the CPU has vector instructions */
+#ifndef USE_SIMD_SCAN
+#define USE_SIMD_SCAN 1
+#endif
+
+/*! \brief kernels of one instruction set finding where a run of characters of a class ends
+* each takes the run from p, never reads at or past end, and returns the first character not in the class,
+* end if the run reaches it. The classes are the ones of the "C" locale whatever the current locale is
+*/
+struct ScanKernels {
+    const char *name;///< instruction set, "scalar", "sse2" or "avx2"
+    const char *(*spaces)(const char *p, const char *end);///< skips ' ', '\\t', '\\n', '\\v', '\\f' and '\\r'
+    const char *(*digits)(const char *p, const char *end);///< skips '0' to '9'
+    const char *(*letters)(const char *p, const char *end);///< skips 'a' to 'z' and 'A' to 'Z'
+};
+
+const ScanKernels &scan_kernels();
+std::vector<const ScanKernels *> available_scan_kernels();
+unsigned digits_value(const char *p, const char *end);
+
+#endif /* scan_hpp */
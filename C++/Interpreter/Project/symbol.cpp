@@ -0,0 +1,159 @@
+/**
+* \file symbol.cpp
+* \brief contains the intern table and Symbol implementations
+        every identifier is stored once, a Symbol only holds its index
+*/
+
+#include "symbol.hpp"
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+/*! \brief hash of the characters of a view */
+struct StrViewHash {
+    size_t operator()(StrView name) const {
+        //FNV-1a
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < name.size; i++) {
+            h = (h ^ (unsigned char)name.data[i]) * 0x100000001b3ull;
+        }
+        return (size_t)h;
+    }
+};
+
+/*! \brief names and ids of every interned identifier
+* names is a deque so a name never moves once interned, str() can hand out references and the keys of ids
+* can point into it, so looking a name up never copies it
+*/
+struct InternTable {
+    std::mutex lock;///< guards both containers
+    std::unordered_map<StrView, uint32_t, StrViewHash> ids;///< id of each interned name, viewing names
+    std::deque<std::string> names;///< name of each id
+
+    InternTable() {
+        names.push_back("");
+        ids[StrView(names.back())] = 0;
+    }
+
+    uint32_t intern(StrView name) {
+        std::lock_guard<std::mutex> guard(lock);
+        std::unordered_map<StrView, uint32_t, StrViewHash>::iterator it = ids.find(name);
+        if ( it != ids.end() ) {
+            return it->second;
+        }
+        uint32_t id = (uint32_t)names.size();
+        names.push_back(name.str());
+        ids[StrView(names.back())] = id;
+        return id;
+    }
+
+    const std::string &name(uint32_t id) {
+        std::lock_guard<std::mutex> guard(lock);
+        return names[id];
+    }
+
+    /**
+    * \brief appends to known the address of every name from known.size() on, the names never move so the
+        addresses stay valid after the lock is released
+    */
+    void addresses(std::vector<const std::string *> &known) {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t id = known.size(); id < names.size(); id++) {
+            known.push_back(&names[id]);
+        }
+    }
+};
+
+/**
+* \brief the table, built on first use so symbols made by static initializers are safe
+*/
+InternTable &table() {
+    static InternTable table;
+    return table;
+}
+
+/**
+* \brief interns name through a cache of the ids the calling thread already got, keyed by views of the names
+    in the table, which never move, so threads parsing at once only take the lock the first time each of them
+    meets a name
+* \param name identifier text
+* \return its id
+*/
+uint32_t intern(StrView name) {
+    static thread_local std::unordered_map<StrView, uint32_t, StrViewHash> seen;
+    std::unordered_map<StrView, uint32_t, StrViewHash>::iterator it = seen.find(name);
+    if ( it != seen.end() ) {
+        return it->second;
+    }
+    uint32_t id = table().intern(name);
+    seen[StrView(table().name(id))] = id;
+    return id;
+}
+
+/**
+* \brief name of id through the addresses of the names the calling thread has already seen, so printing
+    only takes the lock when a name was interned since the thread last looked
+* \param id id of an interned name
+* \return the name
+*/
+const std::string &name_of(uint32_t id) {
+    static thread_local std::vector<const std::string *> known;
+    if ( id >= known.size() ) {
+        table().addresses(known);
+    }
+    return *known[id];
+}
+
+}
+
+/**
+* \brief constructor to make the empty symbol
+*/
+Symbol::Symbol() {
+    this->id_ = 0;
+}
+
+/**
+* \brief constructor to intern name
+* \param name identifier text
+*/
+Symbol::Symbol(const char *name) {
+    this->id_ = intern(StrView(name, strlen(name)));
+}
+
+/**
+* \brief constructor to intern name
+* \param name identifier text
+*/
+Symbol::Symbol(const std::string &name) {
+    this->id_ = intern(StrView(name));
+}
+
+/**
+* \brief constructor to intern the characters name views, copied only the first time they are interned
+* \param name identifier text
+*/
+Symbol::Symbol(StrView name) {
+    this->id_ = intern(name);
+}
+
+/**
+* \brief text of the symbol, valid for the life of the program
+* \return interned name
+*/
+const std::string &Symbol::str() const {
+    return name_of(this->id_);
+}
+
+/**
+* \brief writes the text of symbol to ostream
+* \param ostream stream to write to
+* \param symbol identifier to write
+* \return ostream
+*/
+std::ostream &operator<<(std::ostream &ostream, Symbol symbol) {
+    return ostream << symbol.str();
+}
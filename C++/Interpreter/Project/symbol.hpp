@@ -0,0 +1,74 @@
+/**
+* \file symbol.hpp
+* \brief contains the interned identifier declarations
+*/
+
+#ifndef symbol_hpp
+#define symbol_hpp
+
+#include <string>
+#include <ostream>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*! \brief characters owned by something else, an identifier lexed in place is looked up through one
+* without being copied into a std::string
+*/
+struct StrView {
+    const char *data;///< first character
+    size_t size;///< number of characters
+
+    StrView() : data(""), size(0) { }
+    StrView(const char *data, size_t size) : data(data), size(size) { }
+    StrView(const std::string &str) : data(str.data()), size(str.size()) { }
+
+    std::string str() const { return std::string(this->data, this->size); }
+};
+
+/**
+* \brief two views are equal when they hold the same characters
+*/
+inline bool operator==(StrView lhs, StrView rhs) {
+    return lhs.size == rhs.size && memcmp(lhs.data, rhs.data, lhs.size) == 0;
+}
+
+/*! \brief identifier interned in a table shared by all threads
+* equal names share one 32-bit id, so comparing or copying a Symbol never touches the characters
+*/
+class Symbol {
+public:
+    Symbol();
+    Symbol(const char *name);
+    Symbol(const std::string &name);
+    explicit Symbol(StrView name);
+    const std::string &str() const;
+
+    /**
+    * \brief id of the name in the intern table, 0 is the empty name
+    */
+    uint32_t id() const { return this->id_; }
+
+    /**
+    * \brief symbol whose id() is id, id must have come from id() of an existing symbol
+    */
+    static Symbol from_id(uint32_t id) { Symbol symbol; symbol.id_ = id; return symbol; }
+
+private:
+    uint32_t id_;///< index of the name in the intern table
+};
+
+/**
+* \brief two symbols are equal when they were interned from the same name
+*/
+inline bool operator==(Symbol lhs, Symbol rhs) { return lhs.id() == rhs.id(); }
+inline bool operator!=(Symbol lhs, Symbol rhs) { return lhs.id() != rhs.id(); }
+
+/**
+* \brief orders symbols by id, which is the order they were first interned, not alphabetical
+*/
+inline bool operator<(Symbol lhs, Symbol rhs) { return lhs.id() < rhs.id(); }
+
+std::ostream &operator<<(std::ostream &ostream, Symbol symbol);
+
+#endif /* symbol_hpp */
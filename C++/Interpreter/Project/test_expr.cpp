@@ -10,6 +10,24 @@
 #include "Val.hpp"
 #include "parse.hpp"
 #include "Env.hpp"
+#include "vm.hpp"
+#include "cek.hpp"
+#include "resolve.hpp"
+#include "symbol.hpp"
+#include "value.hpp"
+#include "flat.hpp"
+#include "hashcons.hpp"
+#include "traverse.hpp"
+#include "lex.hpp"
+#include "batch.hpp"
+#include "mapped.hpp"
+#include "scan.hpp"
+#include "document.hpp"
+#include <climits>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <thread>
 
 
 
@@ -1315,6 +1333,29 @@ TEST_CASE("Parse")
         CHECK_THROWS_WITH( parse_str( "_let 3 = 5 _in y + " ), "consume mismatch for = \n" );
         CHECK_THROWS_WITH( parse_str( "_let x = 5 _in y + 3" ), "invalid let expression" );
         CHECK_THROWS_WITH( parse_str( "_let x = 5 _in 3" ), "invalid let expression" );
+        CHECK_THROWS_WITH( parse_str( "_let x = 5 _in xy" ), "invalid let expression" );
+        CHECK_THROWS_WITH( parse_str( "_let x = 5 _in _fun (x) x" ), "invalid let expression" );
+        CHECK( parse_str( "_let x = 5 _in _let y = x _in y" )->interp()->equals( NEW(NumVal) ( 5 ) ) );
+
+        //every let uses the one before, checked without printing any body
+        std::string nest = "_let a = 1 _in ";
+        std::string name = "a";
+        for (int i = 1; i < 3000; i++) {
+            std::string next = name;
+            int at = (int)next.size() - 1;
+            while ( at >= 0 && next[at] == 'z' ) {
+                next[at--] = 'a';
+            }
+            if ( at < 0 ) {
+                next = "a" + next;
+            }
+            else {
+                next[at]++;
+            }
+            nest += "_let " + next + " = " + name + " + 1 _in ";
+            name = next;
+        }
+        CHECK( parse_str( nest + name )->interp()->equals( NEW(NumVal) ( 3000 ) ) );
 
     }
 
@@ -1630,4 +1671,1594 @@ TEST_CASE( "Comprehensive tests" )
     }
 }
 
+/**
+* \brief parses input and checks the vm gives the same printed result as interp()
+* \param input expression to evaluate with both engines
+* \return true if both engines agree
+*/
+static bool vm_matches_interp(std::string input) {
+    PTR(Expr) e = parse_str(input);
+    return vm_interp(e)->to_string() == e->interp()->to_string();
+}
+
+TEST_CASE( "VM" )
+{
+    SECTION( "vm_interp" )
+    {
+        CHECK( vm_interp(NEW(NumExpr) (4))->equals(NEW(NumVal) (4)) );
+        CHECK( vm_interp(NEW(BoolExpr) (false))->equals(NEW(BoolVal) (false)) );
+        CHECK( vm_interp(NEW(AddExpr) (NEW(MultExpr) (NEW(NumExpr) (2), NEW(NumExpr) (4)), NEW(AddExpr) (NEW(NumExpr) (5), NEW(NumExpr) (10))))->equals(NEW(NumVal) (23)) );
+        CHECK( vm_interp(NEW(FunExpr) ("x", NEW(NumExpr) (5)))->equals(NEW(FunVal) ("x", NEW(NumExpr) (5))) );
+        CHECK( vm_interp(NEW(CallExpr) (NEW(FunExpr) ("x", NEW(MultExpr) (NEW(VarExpr) ("x"), NEW(NumExpr) (6))), NEW(LetExpr) ("y", NEW(NumExpr) (4), NEW(AddExpr) (NEW(VarExpr) ("y"), NEW(NumExpr) (8)))))->equals(NEW(NumVal) (72)) );
+        CHECK( parse_str("_let factrl = _fun (factrl) _fun (x) _if x == 1 _then 1 _else x * factrl(factrl)(x + -1) _in  factrl(factrl)(10)")->interp()->equals(vm_interp(parse_str("_let factrl = _fun (factrl) _fun (x) _if x == 1 _then 1 _else x * factrl(factrl)(x + -1) _in  factrl(factrl)(10)"))) );
+    }
+
+    SECTION( "Same results as interp" )
+    {
+        CHECK( vm_matches_interp("(3 + 5) * 6 * 1") );
+        CHECK( vm_matches_interp("_let x = 5 _in (_let y = 3 _in y + _let z = 6 _in z + 8) + x") );
+        CHECK( vm_matches_interp("_let x = 5 _in ((_let x = 6 _in x + 1) + x)") );
+        CHECK( vm_matches_interp("1==2+3") );
+        CHECK( vm_matches_interp("_if 1 == 1 _then _false _else 4") );
+        CHECK( vm_matches_interp("_let y = 8 _in _fun (x) x + y") );
+        CHECK( vm_matches_interp("_let add = _fun (x) _fun (y) x + y _in add(3)(4)") );
+        CHECK( vm_matches_interp("_let y = 2 _in _let f = _fun (x) _fun (z) x + y + z _in _let y = 100 _in f(10)(y)") );
+        CHECK( vm_matches_interp("(_fun (x) x) == (_fun (x) x)") );
+        CHECK( vm_matches_interp("_let f = _fun (x) x + 1 _in f == f") );
+        CHECK( vm_matches_interp("_let fib = _fun (fib) _fun (x) _if x == 0 _then 1 _else _if x == 1 _then 1 _else fib(fib)(x + -2) + fib(fib)(x + -1) _in fib(fib)(15)") );
+    }
+
+    SECTION( "Same errors as interp" )
+    {
+        CHECK_THROWS_WITH( vm_interp(parse_str("x + y")), "free variable: x" );
+        CHECK_THROWS_WITH( vm_interp(parse_str("_if _false _then x _else 4")), "free variable: x" );
+        CHECK_THROWS_WITH( vm_interp(parse_str("_fun (x) y")->subst("q", NEW(NumExpr) (1))), "free variable: y" );
+        CHECK_THROWS_WITH( vm_interp(parse_str("(1==2)+3")), "Cannot perform add operation on BoolVal!" );
+        CHECK_THROWS_WITH( vm_interp(parse_str("_true + (1 * _true)")), "Trying to perform multiplication with a non-number!" );
+        CHECK_THROWS_WITH( vm_interp(parse_str("_if 1 _then 2 _else 3")), "NumVal is not of type boolean" );
+        CHECK_THROWS_WITH( vm_interp(NEW(CallExpr) (NEW(NumExpr) (5), NEW(NumExpr) (9))), "NumVal cannot call" );
+        CHECK_THROWS_WITH( vm_interp(NEW(CallExpr) (NEW(BoolExpr) (true), NEW(NumExpr) (9))), "BoolVal cannot call" );
+    }
+
+    SECTION( "VmFunVal::call" )
+    {
+        PTR(Val) add = vm_interp(parse_str("_let y = 7 _in _fun (x) x + y"));
+        CHECK( add->call(NEW(NumVal) (3))->equals(NEW(NumVal) (10)) );
+        CHECK( add->to_string() == "[_fun (x) (x+y)]" );
+    }
+
+    SECTION( "Deep expressions" )
+    {
+        //compiling these one native call per node would overflow the native stack
+        std::string sum = "1";
+        std::string lets = "_let x = 1 _in ";
+        std::string ifs;
+        for (int i = 0; i < 100000; i++) {
+            sum += "+1";
+            ifs += "_if _true _then ";
+        }
+        for (int i = 0; i < 200000; i++) {
+            lets += "_let x = x _in ";
+        }
+        lets += "x + 1";
+        ifs += "3";
+        for (int i = 0; i < 100000; i++) {
+            ifs += " _else 4";
+        }
+        CHECK( vm_interp(parse_str(sum))->equals(NEW(NumVal) (100001)) );
+        CHECK( vm_interp(parse_str(lets))->equals(NEW(NumVal) (2)) );
+        CHECK( vm_interp(parse_str(ifs))->equals(NEW(NumVal) (3)) );
+    }
+}
+
+/**
+* \brief parses input and checks the CEK machine gives the same printed result as interp()
+* \param input expression to evaluate with both engines
+* \return true if both engines agree
+*/
+static bool cek_matches_interp(std::string input) {
+    PTR(Expr) e = parse_str(input);
+    return cek_interp(e)->to_string() == e->interp()->to_string();
+}
+
+TEST_CASE( "CEK" )
+{
+    SECTION( "cek_interp" )
+    {
+        CHECK( cek_interp(NEW(NumExpr) (4))->equals(NEW(NumVal) (4)) );
+        CHECK( cek_interp(NEW(BoolExpr) (true))->equals(NEW(BoolVal) (true)) );
+        CHECK( cek_interp(NEW(AddExpr) (NEW(AddExpr) (NEW(NumExpr) (-5), NEW(NumExpr) (15)), NEW(AddExpr) (NEW(NumExpr) (-15), NEW(NumExpr) (23))))->equals(NEW(NumVal) (18)) );
+        CHECK( cek_interp(NEW(FunExpr) ("y", NEW(AddExpr) (NEW(NumExpr) (2), NEW(NumExpr) (3))))->equals(NEW(FunVal) ("y", NEW(AddExpr) (NEW(NumExpr) (2), NEW(NumExpr) (3)))) );
+        CHECK( cek_interp(NEW(CallExpr) (NEW(FunExpr) ("x", NEW(AddExpr) (NEW(VarExpr) ("x"), NEW(NumExpr) (9))), NEW(AddExpr) (NEW(NumExpr) (3), NEW(NumExpr) (7))))->equals(NEW(NumVal) (19)) );
+    }
+
+    SECTION( "Same results as interp" )
+    {
+        CHECK( cek_matches_interp("(7 * 7) * (9 + 2)") );
+        CHECK( cek_matches_interp("_let x = (_let y = 5 _in y+6) _in x+7") );
+        CHECK( cek_matches_interp("_let x = 5 _in ((_let x = 6 _in x + 1) + x)") );
+        CHECK( cek_matches_interp("1==2+3") );
+        CHECK( cek_matches_interp("_if _false _then x _else 4") );
+        CHECK( cek_matches_interp("_let add = _fun (x) _fun (y) x + y _in add(3)(4)") );
+        CHECK( cek_matches_interp("_let y = 8 _in _fun (x) x + y") );
+        CHECK( cek_matches_interp("_let factrl = _fun (factrl) _fun (x) _if x == 1 _then 1 _else x * factrl(factrl)(x + -1) _in  factrl(factrl)(10)") );
+    }
+
+    SECTION( "Same errors as interp" )
+    {
+        CHECK_THROWS_WITH( cek_interp(parse_str("x + y")), "free variable: x" );
+        CHECK_THROWS_WITH( cek_interp(parse_str("(1==2)+3")), "Cannot perform add operation on BoolVal!" );
+        CHECK_THROWS_WITH( cek_interp(parse_str("_true + (1 * _true)")), "Trying to perform multiplication with a non-number!" );
+        CHECK_THROWS_WITH( cek_interp(parse_str("_if 1 _then 2 _else 3")), "NumVal is not of type boolean" );
+        CHECK_THROWS_WITH( cek_interp(NEW(CallExpr) (NEW(NumExpr) (5), NEW(NumExpr) (9))), "NumVal cannot call" );
+        CHECK_THROWS_WITH( cek_interp(NEW(CallExpr) (NEW(BoolExpr) (true), NEW(NumExpr) (9))), "BoolVal cannot call" );
+    }
+
+    SECTION( "Deep recursion" )
+    {
+        //200000 nested calls would overflow the native stack in interp()
+        CHECK( cek_interp(parse_str("_let sum = _fun (sum) _fun (n) _if n == 0 _then 0 _else n + sum(sum)(n + -1) _in sum(sum)(200000)"))
+              ->equals(NEW(NumVal) ((int)(unsigned)(200000ull * 200001ull / 2))) );
+    }
+}
+
+TEST_CASE( "Tail calls" )
+{
+    std::string loop = "_let loop = _fun (loop) _fun (n) _fun (acc) _if n == 0 _then acc _else loop(loop)(n + -1)(acc + n) _in loop(loop)(100000)(0)";
+
+    SECTION( "Expr::interp" )
+    {
+        //100000 iterations would overflow the native stack without tail calls
+        CHECK( parse_str(loop)->interp()->equals(NEW(NumVal) (705082704)) );
+        //call in tail position of a _let body inside an _if branch
+        CHECK( parse_str("_let f = _fun (f) _fun (x) _let y = x + 1 _in _if y == 100000 _then y _else f(f)(y) _in f(f)(0)")->interp()
+              ->equals(NEW(NumVal) (100000)) );
+    }
+
+    SECTION( "vm_interp" )
+    {
+        CHECK( vm_interp(parse_str(loop))->equals(NEW(NumVal) (705082704)) );
+        CHECK( vm_matches_interp("_let count = _fun (count) _fun (n) _if n == 0 _then _true _else _if n == 1 _then _false _else count(count)(n + -2) _in count(count)(1001)") );
+        CHECK_THROWS_WITH( vm_interp(parse_str("_let f = _fun (x) x(1) _in f(2)")), "NumVal cannot call" );
+    }
+}
+
+TEST_CASE( "Closures" )
+{
+    SECTION( "free_vars" )
+    {
+        CHECK( parse_str("x + y * x")->free_vars() == std::set<Symbol>({"x", "y"}) );
+        CHECK( parse_str("_let x = y _in x + z")->free_vars() == std::set<Symbol>({"y", "z"}) );
+        CHECK( parse_str("_let x = x _in x")->free_vars() == std::set<Symbol>({"x"}) );
+        CHECK( parse_str("_fun (x) x + y")->free_vars() == std::set<Symbol>({"y"}) );
+        CHECK( parse_str("_if a _then 1 == b _else f(c)")->free_vars() == std::set<Symbol>({"a", "b", "c", "f"}) );
+        CHECK( parse_str("_fun (x) _fun (y) x + y")->free_vars().empty() );
+        PTR(Expr) sum = parse_str("x + (y + x)");
+        CHECK( sum->has_free("x") );
+        CHECK( !sum->has_free("z") );
+        //only functions keep their set, worked out once when first asked for
+        PTR(Expr) fun = parse_str("_fun (x) _let y = x _in y + z + (_fun (z) w + x)(1)");
+        FreeVars const &names = CAST(FunExpr)(fun)->free_names();
+        CHECK( std::set<Symbol>(names->begin(), names->end()) == std::set<Symbol>({"z", "w"}) );
+        CHECK( std::is_sorted(names->begin(), names->end()) );
+        CHECK( CAST(FunExpr)(fun)->free_names() == names );
+        CHECK( fun->subst("w", NEW(NumExpr) (2))->free_vars() == std::set<Symbol>({"z"}) );
+        CHECK( NEW(MultExpr) (NEW(NumExpr) (2), NEW(VarExpr) ("y"))->free_vars() == std::set<Symbol>({"y"}) );
+    }
+
+    SECTION( "Nested lets keep no free variable sets" )
+    {
+        //n nested lets whose body sums every variable, a set of free variables per node would make this
+        //quadratic. Only the function around them holds one, handed over by the parser and kept after that.
+        //bench_parse times the same input through msdscript
+        std::string source = "_fun (q) ";
+        std::string names = "q";
+        for (int i = 0; i < 16000; i++) {
+            std::string name = "v";
+            for (int k = i + 1; k > 0; k /= 26) {
+                name += (char)('a' + k % 26);
+            }
+            source += "_let " + name + " = " + std::to_string(i) + " _in ";
+            names += "+" + name;
+        }
+        PTR(Expr) fun = parse_str(source + names + "+w");
+        FreeVars const &free = CAST(FunExpr)(fun)->free_names();
+        CHECK( *free == std::vector<Symbol>({"w"}) );
+        CHECK( CAST(FunExpr)(fun)->free_names() == free );
+        CHECK( CAST(FunExpr)(fun)->body_expr()->free_vars() == std::set<Symbol>({"q", "w"}) );
+    }
 
+    SECTION( "Captured values" )
+    {
+        CHECK( parse_str("_let y = 8 _in _let f = _fun (x) x + y _in _let y = 100 _in f(2) + y")->interp()->equals(NEW(NumVal) (110)) );
+        CHECK( parse_str("_let x = 1 _in _let f = _fun (x) x * 3 _in f(5) + x")->interp()->equals(NEW(NumVal) (16)) );
+        CHECK( parse_str("_let a = 1 _in _let b = 2 _in _let c = 3 _in (_fun (x) _fun (y) a + c + x + y)(b)(20)")->interp()->equals(NEW(NumVal) (26)) );
+        CHECK( cek_matches_interp("_let y = 8 _in _let f = _fun (x) x + y _in _let y = 100 _in f(2) + y") );
+    }
+
+    SECTION( "Capture slots" )
+    {
+        std::vector<Symbol> names;
+        for (int i = 0; i < 40; i++) {
+            names.push_back(Symbol("c" + std::string(1, (char)('a' + i % 26)) + std::string(i / 26 + 1, 'q')));
+        }
+        CaptureSlots slots(names);
+        for (size_t i = 0; i < names.size(); i++) {
+            CHECK( slots.slot_of(names[i]) == (int)i );
+        }
+        CHECK( slots.slot_of(Symbol("uncaptured")) == -1 );
+        CHECK( CaptureSlots(std::vector<Symbol>()).slot_of(Symbol("x")) == -1 );
+        //every closure of the function shares its table
+        PTR(Expr) fun = parse_str("_fun (x) x + a + b");
+        PTR(Env) env = NEW(ExtendedEnv) ("a", Value::num(1), NEW(ExtendedEnv) ("b", Value::num(2), Env::empty));
+        PTR(Env) first = CAST(FunExpr)(fun)->capture(env);
+        CHECK( first->find("b").equals(Value::num(2)) );
+        CHECK( first->find("x").is_none() );
+        CHECK( CAST(FunExpr)(fun)->capture(Env::empty)->find("a").is_none() );
+    }
+
+    SECTION( "Unbound captures fail when used" )
+    {
+        CHECK( parse_str("_let f = _fun (x) x + y _in _if _false _then f(3) _else 3")->interp()->equals(NEW(NumVal) (3)) );
+        CHECK_THROWS_WITH( parse_str("_let f = _fun (x) x + y _in f(3)")->interp(), "free variable: y" );
+        CHECK_THROWS_WITH( cek_interp(parse_str("_let f = _fun (x) x + y _in f(3)")), "free variable: y" );
+    }
+}
+
+/**
+* \brief checks the resolved tree walker and CEK machine agree with Expr::interp on input
+* \param input program text
+* \return true if all three print the same value
+*/
+static bool resolved_matches_interp(std::string input) {
+    PTR(Expr) e = parse_str(input);
+    std::string expected = e->interp()->to_string();
+    return resolved_interp(e)->to_string() == expected && resolved_cek_interp(e)->to_string() == expected;
+}
+
+TEST_CASE( "Lexical addressing" )
+{
+    SECTION( "Addresses" )
+    {
+        int num_slots = 0;
+        PTR(Expr) resolved = resolve(parse_str("_let x = 1 _in _let y = x _in _fun (z) x + z + y"), num_slots);
+        CHECK( num_slots == 2 );
+        CHECK( resolved->equals(parse_str("_let x = 1 _in _let y = x _in _fun (z) x + z + y")) );
+        PTR(ResolvedFunExpr) fun = CAST(ResolvedFunExpr)(CAST(LetExpr)(CAST(LetExpr)(resolved)->body)->body);
+        REQUIRE( fun != nullptr );
+        CHECK( fun->num_slots == 1 );
+        REQUIRE( fun->captured_from.size() == 2 );
+        CHECK( fun->captured_from[0].depth == 0 );
+        CHECK( fun->captured_from[0].slot == 0 );
+        CHECK( fun->captured_from[1].slot == 1 );
+        //sibling _let bodies reuse the same slot
+        resolve(parse_str("(_let a = 1 _in a) + (_let b = 2 _in b)"), num_slots);
+        CHECK( num_slots == 1 );
+    }
+
+    SECTION( "Same results as interp" )
+    {
+        CHECK( resolved_matches_interp("(7 * 7) * (9 + 2)") );
+        CHECK( resolved_matches_interp("_let x = 5 _in ((_let x = 6 _in x + 1) + x)") );
+        CHECK( resolved_matches_interp("_let x = (_let y = 5 _in y+6) _in x+7") );
+        CHECK( resolved_matches_interp("_let add = _fun (x) _fun (y) x + y _in add(3)(4)") );
+        CHECK( resolved_matches_interp("_let a = 1 _in _let b = 2 _in (_fun (x) _fun (y) _fun (z) a + b + x + y + z)(3)(4)(5)") );
+        CHECK( resolved_matches_interp("_let y = 8 _in _let f = _fun (x) x + y _in _let y = 100 _in f(2) + y") );
+        CHECK( resolved_matches_interp("_let factrl = _fun (factrl) _fun (x) _if x == 1 _then 1 _else x * factrl(factrl)(x + -1) _in  factrl(factrl)(10)") );
+        CHECK( resolved_interp(parse_str("_let loop = _fun (loop) _fun (n) _fun (acc) _if n == 0 _then acc _else loop(loop)(n + -1)(acc + n) _in loop(loop)(100000)(0)"))
+              ->equals(NEW(NumVal) (705082704)) );
+    }
+
+    SECTION( "Unbound variables are reported before running" )
+    {
+        CHECK_THROWS_WITH( resolved_interp(parse_str("_if _false _then x _else 4")), "free variable: x" );
+        CHECK_THROWS_WITH( resolved_cek_interp(parse_str("_let f = _fun (x) x + y _in _if _false _then f(3) _else f")), "free variable: y" );
+        CHECK_THROWS_WITH( resolved_interp(parse_str("_let x = x _in x")), "free variable: x" );
+        CHECK_THROWS_WITH( resolved_interp(parse_str("(_fun (x) x)(x)")), "free variable: x" );
+        CHECK_THROWS_WITH( resolved_interp(parse_str("(1==2)+3")), "Cannot perform add operation on BoolVal!" );
+        //every engine accepts and rejects the same programs
+        const char *unbound[][2] = { { "_if _true _then 1 _else y", "free variable: y" },
+                                     { "_fun (x) y", "free variable: y" },
+                                     { "_let f = _fun (x) x _in _if _true _then f(1) _else f(z)", "free variable: z" } };
+        engine_t engines[] = { engine_tree, engine_vm, engine_cek, engine_flat };
+        for (size_t i = 0; i < sizeof(unbound) / sizeof(unbound[0]); i++) {
+            Program program(unbound[i][0]);
+            for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+                CHECK_THROWS_WITH( interp_program(program, engines[e]), unbound[i][1] );
+            }
+        }
+    }
+
+    SECTION( "Deep expressions" )
+    {
+        //resolving has to keep the CEK engine's constant native stack
+        const int depth = 500000;
+        std::string sum;
+        sum.reserve(2 * (size_t)depth + 1);
+        for (int i = 0; i < depth; i++) {
+            sum += "1+";
+        }
+        Program program(sum + "1");
+        CHECK( interp_program(program, engine_cek) == std::to_string(depth + 1) );
+        //x is captured through every function between its _let and its use
+        std::string funs = "_let x = 3 _in ";
+        for (int i = 0; i < depth / 10; i++) {
+            funs += "_fun (y) ";
+        }
+        int num_slots = 0;
+        PTR(Expr) resolved = resolve(parse_str(funs + "x"), num_slots);
+        CHECK( num_slots == 1 );
+        PTR(ResolvedFunExpr) outer = CAST(ResolvedFunExpr)(CAST(LetExpr)(resolved)->body);
+        REQUIRE( outer != nullptr );
+        REQUIRE( outer->captured_from.size() == 1 );
+        CHECK( outer->captured_from[0].depth == 0 );
+    }
+}
+
+TEST_CASE( "Symbol" )
+{
+    Symbol x = "x";
+    Symbol long_name = std::string("a_rather_long_identifier_name");
+    CHECK( x == Symbol("x") );
+    CHECK( x != Symbol("y") );
+    CHECK( x.id() == Symbol(std::string("x")).id() );
+    CHECK( Symbol().id() == 0 );
+    CHECK( Symbol("") == Symbol() );
+    CHECK( long_name.str() == "a_rather_long_identifier_name" );
+    CHECK( &long_name.str() == &Symbol("a_rather_long_identifier_name").str() );
+    std::stringstream st("");
+    st << x << long_name;
+    CHECK( st.str() == "xa_rather_long_identifier_name" );
+    CHECK( NEW(VarExpr) ("x")->value == x );
+    CHECK( parse_str("_let x = 1 _in x")->equals(NEW(LetExpr) (x, NEW(NumExpr) (1), NEW(VarExpr) (x))) );
+    //names interned by another thread after this one last printed are found too
+    Symbol other;
+    std::thread interning([&other]() { other = Symbol("interned_on_another_thread"); });
+    interning.join();
+    CHECK( other.str() == "interned_on_another_thread" );
+}
+
+TEST_CASE( "Value" )
+{
+    SECTION( "Inline numbers and booleans" )
+    {
+        CHECK( Value::num(-7).is_num() );
+        CHECK( Value::num(-7).num_value() == -7 );
+        CHECK( Value::num(INT_MIN).num_value() == INT_MIN );
+        CHECK( Value::boolean(true).bool_value() );
+        CHECK( Value::num(5).boxed() == nullptr );
+        CHECK( Value().is_none() );
+        CHECK( Value::num(2).add_to(Value::num(3)).equals(Value::num(5)) );
+        CHECK( Value::num(INT_MAX).add_to(Value::num(1)).num_value() == INT_MIN );
+        CHECK( Value::num(6).mult_with(Value::num(7)).num_value() == 42 );
+        CHECK( Value::boolean(false).equals(Value::boolean(false)) );
+        CHECK( !Value::num(1).equals(Value::boolean(true)) );
+        CHECK( Value::num(-3).to_string() == "-3" );
+        CHECK( Value::boolean(false).to_string() == "_false" );
+    }
+
+    SECTION( "One word for the whole payload range" )
+    {
+#if !VALUE_KEEPS_BOX
+        CHECK( sizeof(Value) == sizeof(uint64_t) );
+#endif
+        const int nums[] = { INT_MIN, INT_MIN + 1, -1, 0, 1, INT_MAX - 1, INT_MAX };
+        for (size_t i = 0; i < sizeof(nums) / sizeof(nums[0]); i++) {
+            Value v = Value::num(nums[i]);
+            CHECK( v.is_num() );
+            CHECK( v.num_value() == nums[i] );
+            CHECK( v.raw_boxed() == nullptr );
+            CHECK( Value(NEW(NumVal) (nums[i])).equals(v) );
+            CHECK( v.to_string() == std::to_string(nums[i]) );
+        }
+        CHECK( Value::boolean(true).is_bool() );
+        CHECK( Value::boolean(true).bool_value() );
+        CHECK( !Value::boolean(false).bool_value() );
+        CHECK( !Value::boolean(false).equals(Value::num(0)) );
+        CHECK( !Value::num(0).equals(Value()) );
+
+        PTR(Val) fun = NEW(FunVal) ("x", NEW(VarExpr) ("x"));
+        Value boxed = Value::function(fun);
+        CHECK( boxed.tag() == value_boxed );
+        CHECK( boxed.raw_boxed() == RAW(fun) );
+        Value copy = boxed;
+        Value moved = std::move(copy);
+        CHECK( moved.boxed() == fun );
+        CHECK( moved.call(Value::num(3)).num_value() == 3 );
+    }
+
+    SECTION( "Same errors as Val" )
+    {
+        CHECK_THROWS_WITH( Value::num(1).add_to(Value::boolean(true)), "Trying to add a non-number!" );
+        CHECK_THROWS_WITH( Value::boolean(true).add_to(Value::num(1)), "Cannot perform add operation on BoolVal!" );
+        CHECK_THROWS_WITH( Value::num(1).mult_with(Value::boolean(true)), "Trying to perform multiplication with a non-number!" );
+        CHECK_THROWS_WITH( Value::boolean(true).mult_with(Value::num(1)), "Cannot perform multiplication operation on BoolVal!" );
+        CHECK_THROWS_WITH( Value::num(1).is_true(), "NumVal is not of type boolean" );
+        CHECK_THROWS_WITH( Value::num(1).call(Value::num(1)), "NumVal cannot call" );
+        CHECK_THROWS_WITH( Value::boolean(true).call(Value::num(1)), "BoolVal cannot call" );
+        CHECK_THROWS_WITH( parse_str("(_fun (x) x) + 1")->evaluate(), "Cannot perform add operation on FunVal!" );
+    }
+
+    SECTION( "Val compatibility" )
+    {
+        CHECK( Value(NEW(NumVal) (9)).is_num() );
+        CHECK( Value(NEW(BoolVal) (true)).is_bool() );
+        CHECK( Value(nullptr).is_none() );
+        CHECK( Value(NEW(NumVal) (9)).to_val()->equals(NEW(NumVal) (9)) );
+        PTR(Val) fun = NEW(FunVal) ("x", NEW(VarExpr) ("x"));
+        CHECK( Value(fun).boxed() == fun );
+        CHECK( Value(fun).to_val() == fun );
+        CHECK( parse_str("_let x = 4 _in x * x")->evaluate().num_value() == 16 );
+        CHECK( parse_str("_let x = 4 _in x * x")->interp()->equals(NEW(NumVal) (16)) );
+    }
+}
+
+TEST_CASE( "Kind tags" )
+{
+    CHECK( NEW(NumExpr) (1)->kind == expr_num );
+    CHECK( parse_str("_let x = 1 _in x")->kind == expr_let );
+    CHECK( parse_str("f(2)")->kind == expr_call );
+    CHECK( NEW(NumVal) (1)->kind == val_num );
+    CHECK( NEW(BoolVal) (true)->kind == val_bool );
+    CHECK( vm_interp(parse_str("_fun (x) x"))->kind == val_fun );
+
+    //same kind, different contents and different kinds with matching fields
+    CHECK( !NEW(AddExpr) (NEW(NumExpr) (1), NEW(NumExpr) (2))->equals(NEW(MultExpr) (NEW(NumExpr) (1), NEW(NumExpr) (2))) );
+    CHECK( !NEW(NumExpr) (1)->equals(NEW(BoolExpr) (true)) );
+    CHECK( !NEW(NumExpr) (1)->equals(nullptr) );
+    CHECK( !NEW(NumVal) (1)->equals(NEW(BoolVal) (true)) );
+    CHECK( !NEW(BoolVal) (true)->equals(NEW(NumVal) (1)) );
+    CHECK( !NEW(FunVal) ("x", NEW(NumExpr) (1))->equals(NEW(NumVal) (1)) );
+    CHECK( vm_interp(parse_str("_fun (x) x"))->equals(NEW(FunVal) ("x", NEW(VarExpr) ("x"))) );
+
+    //resolved expressions keep the kind of the class they extend
+    int num_slots = 0;
+    PTR(Expr) resolved = resolve(parse_str("_let x = 1 _in _fun (y) x + y"), num_slots);
+    CHECK( resolved->kind == expr_let );
+    CHECK( resolved->equals(parse_str("_let x = 1 _in _fun (y) x + y")) );
+    CHECK( parse_str("_let x = 1 _in _fun (y) x + y")->equals(resolved) );
+
+    CHECK_THROWS_WITH( NEW(NumVal) (1)->add_to(NEW(BoolVal) (true)), "Trying to add a non-number!" );
+    CHECK_THROWS_WITH( NEW(NumVal) (1)->mult_with(NEW(FunVal) ("x", NEW(NumExpr) (1))), "Trying to perform multiplication with a non-number!" );
+}
+
+TEST_CASE( "Arena" )
+{
+    SECTION( "Bump allocation" ) {
+        std::shared_ptr<Arena> arena = Arena::make(64);
+        void *a = arena->allocate(3, 1);
+        void *b = arena->allocate(8, 8);
+        CHECK( (uintptr_t)b % 8 == 0 );
+        CHECK( (char*)b >= (char*)a + 3 );
+        //bigger than a block gets a block of its own
+        void *big = arena->allocate(1000, 16);
+        CHECK( (uintptr_t)big % 16 == 0 );
+        CHECK( arena->bytes_used() == 1011 );
+    }
+    SECTION( "Scopes" ) {
+        std::shared_ptr<Arena> outer = Arena::make();
+        std::shared_ptr<Arena> inner = Arena::make();
+        CHECK( Arena::current() == nullptr );
+        {
+            ArenaScope a(outer.get());
+            {
+                ArenaScope b(inner.get());
+                CHECK( Arena::current() == inner.get() );
+                NEW(NumExpr) (1);
+            }
+            CHECK( Arena::current() == outer.get() );
+        }
+        CHECK( Arena::current() == nullptr );
+        CHECK( inner->bytes_used() > 0 );
+        CHECK( outer->bytes_used() == 0 );
+    }
+    SECTION( "Program" ) {
+        std::stringstream in("_let f = _fun (x) x * 2 _in f(21)");
+        Program program(in);
+        CHECK( program.arena->bytes_used() > 0 );
+        CHECK( program.expr->equals(parse_str("_let f = _fun (x) x * 2 _in f(21)")) );
+        CHECK( resolved_interp(program.expr)->equals(NEW(NumVal) (42)) );
+        CHECK( vm_interp(program.expr)->equals(NEW(NumVal) (42)) );
+        CHECK( resolved_cek_interp(program.expr)->equals(NEW(NumVal) (42)) );
+        CHECK( Arena::current() == nullptr );
+
+        std::stringstream bad("1 +");
+        CHECK_THROWS_WITH( Program(bad), "invalid input" );
+        CHECK( Arena::current() == nullptr );
+    }
+#if !USE_PLAIN_POINTERS && !USE_GC_POINTERS
+    SECTION( "Nodes outlive their Program" ) {
+        PTR(Expr) e;
+        PTR(Val) f;
+        {
+            std::stringstream in("_let y = 5 _in _fun (x) x + y");
+            Program program(in);
+            e = program.expr;
+            f = resolved_interp(program.expr);
+        }
+        CHECK( e->to_string() == "(_let y=5 _in (_fun (x) (x+y)))" );
+        CHECK( f->call(NEW(NumVal) (1))->equals(NEW(NumVal) (6)) );
+    }
+#endif
+}
+
+#if !USE_PLAIN_POINTERS && !USE_GC_POINTERS && !USE_STD_SHARED_POINTERS
+TEST_CASE( "Intrusive reference counts" )
+{
+    //the count lives in the object, a pointer is a single word
+    CHECK( sizeof(PTR(Expr)) == sizeof(Expr*) );
+
+    //a boxed Value holds one reference, copies add one and destroying them gives it back
+    PTR(Val) fun = NEW(FunVal) ("x", NEW(VarExpr) ("x"));
+    {
+        Value boxed = Value::function(fun);
+        CHECK( fun.use_count() == 2 );
+        Value copy = boxed;
+        CHECK( fun.use_count() == 3 );
+        copy = Value::num(1);
+        CHECK( fun.use_count() == 2 );
+    }
+    CHECK( fun.use_count() == 1 );
+
+    PTR(Expr) num = NEW(NumExpr) (1);
+    CHECK( num.use_count() == 1 );
+    {
+        PTR(Expr) copy = num;
+        CHECK( num.use_count() == 2 );
+        PTR(Expr) moved = std::move(copy);
+        CHECK( copy == nullptr );
+        CHECK( num.use_count() == 2 );
+    }
+    CHECK( num.use_count() == 1 );
+
+    //THIS wraps the same object and counts it
+    PTR(Expr) same = num->subst("x", NEW(NumExpr) (2));
+    CHECK( same == num );
+    CHECK( num.use_count() == 2 );
+
+    CHECK( CAST(NumExpr)(num) != nullptr );
+    CHECK( CAST(VarExpr)(num) == nullptr );
+    CHECK( num.use_count() == 2 );
+
+    //objects made in an arena keep it alive past its last shared_ptr
+    std::shared_ptr<Arena> arena = Arena::make();
+    PTR(Expr) node;
+    {
+        ArenaScope scope(arena.get());
+        node = NEW(AddExpr) (NEW(NumExpr) (1), NEW(NumExpr) (2));
+    }
+    arena.reset();
+    CHECK( node->interp()->equals(NEW(NumVal) (3)) );
+}
+#endif
+
+/*! \brief collected test object with one outgoing pointer, counts how many were freed */
+struct GcTestNode : public GcObject {
+    static int freed;///< nodes destroyed so far
+    GcTestNode *next;///< only child
+
+    GcTestNode() : next(nullptr) {}
+    ~GcTestNode() { freed++; }
+    void trace(GcHeap &heap) const { heap.mark_object(next); }
+};
+int GcTestNode::freed = 0;
+
+/*! \brief test roots holding a list of nodes */
+struct GcTestRoots : public GcRoots {
+    std::vector<GcTestNode*> nodes;///< nodes kept alive
+
+    GcTestRoots(GcHeap &heap) : GcRoots(heap) {}
+    void trace_roots(GcHeap &heap) const {
+        for (size_t i = 0; i < nodes.size(); i++) {
+            heap.mark_object(nodes[i]);
+        }
+    }
+};
+
+TEST_CASE( "Garbage collector" )
+{
+    SECTION( "Generations and cycles" ) {
+        GcTestNode::freed = 0;
+        GcHeap heap;
+        GcTestRoots roots(heap);
+        GcTestNode *a = new GcTestNode();
+        GcTestNode *b = new GcTestNode();
+        GcTestNode *c = new GcTestNode();
+        heap.track(a);
+        heap.track(b);
+        heap.track(c);
+        a->next = b;
+        b->next = a;
+        roots.nodes.push_back(a);
+
+        heap.collect_minor();
+        CHECK( GcTestNode::freed == 1 );
+        CHECK( heap.live_objects() == 2 );
+        CHECK( heap.young_objects() == 0 );
+
+        //a young node only reachable from an old one survives through the remembered set
+        GcTestNode *d = new GcTestNode();
+        heap.track(d);
+        b->next = d;
+        heap.remember(b);
+        heap.collect_minor();
+        CHECK( GcTestNode::freed == 1 );
+        CHECK( heap.live_objects() == 3 );
+
+        //minor collections leave old garbage, major ones take it, cycles included
+        d->next = a;
+        roots.nodes.clear();
+        heap.collect_minor();
+        CHECK( heap.live_objects() == 3 );
+        heap.collect_major();
+        CHECK( GcTestNode::freed == 4 );
+        CHECK( heap.live_objects() == 0 );
+        CHECK( heap.minor_collections() == 3 );
+        CHECK( heap.major_collections() == 1 );
+    }
+    SECTION( "Untracked objects are never freed" ) {
+        GcTestNode::freed = 0;
+        GcHeap heap;
+        GcTestRoots roots(heap);
+        GcTestNode fixed;
+        GcTestNode *young = new GcTestNode();
+        heap.track(young);
+        young->next = &fixed;
+        roots.nodes.push_back(young);
+        roots.nodes.push_back(&fixed);
+        heap.collect_major();
+        CHECK( GcTestNode::freed == 0 );
+        CHECK( heap.live_objects() == 1 );
+        roots.nodes.clear();
+        heap.collect_major();
+        CHECK( GcTestNode::freed == 1 );
+        CHECK( heap.live_objects() == 0 );
+    }
+#if USE_GC_POINTERS
+    SECTION( "Engines collect at safe points" ) {
+        std::string loop = "_let loop = _fun (f) _fun (n) _if n == 0 _then 0 _else f(f)(n + -1) _in loop(loop)(20000)";
+        GcHeap &heap = GcHeap::current();
+        heap.set_nursery_limit(256);
+        size_t minors = heap.minor_collections();
+        {
+            GcAllowCollection collecting;
+            CHECK( vm_interp(parse_str(loop))->equals(NEW(NumVal) (0)) );
+            CHECK( resolved_cek_interp(parse_str(loop))->equals(NEW(NumVal) (0)) );
+        }
+        CHECK( heap.minor_collections() > minors );
+        CHECK( heap.young_objects() < 20000 );
+        heap.collect_major();
+        CHECK( heap.live_objects() < 1000 );
+
+        //the tree walkers and the flat table collect too, with operands held across calls kept alive
+        std::string sum = "_let sum = _fun (f) _fun (n) _if n == 0 _then 0 _else n + f(f)(n + -1) _in sum(sum)(2000)";
+        {
+            GcAllowCollection collecting;
+            minors = heap.minor_collections();
+            CHECK( resolved_interp(parse_str(loop))->equals(NEW(NumVal) (0)) );
+            CHECK( resolved_interp(parse_str(sum))->equals(NEW(NumVal) (2001000)) );
+            CHECK( heap.minor_collections() > minors );
+            minors = heap.minor_collections();
+            CHECK( parse_str(loop)->interp()->equals(NEW(NumVal) (0)) );
+            CHECK( parse_str(sum)->interp()->equals(NEW(NumVal) (2001000)) );
+            CHECK( heap.minor_collections() > minors );
+            minors = heap.minor_collections();
+            CHECK( flat_interp(FlatAst::flatten(parse_str(loop)))->equals(NEW(NumVal) (0)) );
+            CHECK( flat_interp(FlatAst::flatten(parse_str(sum)))->equals(NEW(NumVal) (2001000)) );
+            CHECK( heap.minor_collections() > minors );
+        }
+        heap.set_nursery_limit(8192);
+    }
+    SECTION( "Drivers collect between programs" ) {
+        GcHeap &heap = GcHeap::current();
+        heap.collect_major();
+        size_t live = heap.live_objects();
+        for (int i = 0; i < 20; i++) {
+            Program program("_let f = _fun (x) x + 1 _in f(1) + f(2)");
+            CHECK( interp_program(program, engine_tree) == "5" );
+            CHECK( heap.young_objects() == 0 );
+        }
+        CHECK( heap.live_objects() == live );
+    }
+#endif
+}
+
+TEST_CASE( "Object pool" )
+{
+    ObjectPool &pool = ObjectPool::local();
+
+    SECTION( "Size classes" ) {
+        PoolStats before = pool.stats();
+        void *a = pool.allocate(24);
+        CHECK( (uintptr_t)a % 16 == 0 );
+        pool.release(a, 24);
+        //same 32-byte class, served from the free list
+        size_t hits = pool.stats().hits;
+        void *b = pool.allocate(20);
+        CHECK( b == a );
+        CHECK( pool.stats().hits == hits + 1 );
+        void *c = pool.allocate(40);
+        CHECK( c != a );
+        void *big = pool.allocate(1000);
+        CHECK( pool.stats().live == before.live + 3 );
+        CHECK( pool.stats().high_water >= before.live + 3 );
+        CHECK( pool.stats().large == before.large + 1 );
+        pool.release(big, 1000);
+        pool.release(c, 40);
+        pool.release(b, 20);
+        CHECK( pool.stats().live == before.live );
+    }
+#if !USE_PLAIN_POINTERS && !USE_GC_POINTERS
+    SECTION( "NEW reuses released values and environments" ) {
+        Val *first = nullptr;
+        {
+            PTR(Val) a = NEW(NumVal) (1);
+            first = RAW(a);
+        }
+        PTR(Val) b = NEW(NumVal) (2);
+        CHECK( RAW(b) == first );
+
+        size_t hits = pool.stats().hits;
+        long live = pool.stats().live;
+        CHECK( parse_str("_let f = _fun (x) x + 1 _in f(1) + f(2) + f(3)")->interp()->equals(NEW(NumVal) (9)) );
+        CHECK( pool.stats().hits > hits );
+        CHECK( pool.stats().live == live );
+    }
+#endif
+}
+
+/**
+* \brief runs input on the flat table and with interp()
+* \param input expression to evaluate both ways
+* \return true if both agree
+*/
+static bool flat_matches_interp(std::string input) {
+    PTR(Expr) e = parse_str(input);
+    return flat_interp(FlatAst::flatten(e))->to_string() == e->interp()->to_string();
+}
+
+TEST_CASE( "Flat AST" )
+{
+    std::string fact = "_let factrl = _fun (factrl) _fun (x) _if x == 1 _then 1 _else x * factrl(factrl)(x + -1) _in  factrl(factrl)(10)";
+
+    SECTION( "Layout" ) {
+        FlatAst ast;
+        uint32_t x = ast.var("x");
+        uint32_t one = ast.num(1);
+        uint32_t sum = ast.add(x, one);
+        ast.root = ast.let("x", ast.num(4), sum);
+        CHECK( ast.size() == 5 );
+        CHECK( ast.kinds[sum] == expr_add );
+        CHECK( ast.op0[sum] == x );
+        CHECK( ast.op1[sum] == one );
+        CHECK( ast.literals.size() == 2 );
+        CHECK( ast.to_string(ast.root) == "(_let x=4 _in (x+1))" );
+        CHECK( ast.bytes() == 5 * 13 + 2 * sizeof(int) );
+    }
+
+    SECTION( "Round trip, print and equals" ) {
+        const char *inputs[] = { "1 + 2 * 3", "_let x = 5 _in x + x", "_if 1 == 2 _then _true _else _false",
+            "f(3)(4)", fact.c_str() };
+        for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+            PTR(Expr) e = parse_str(inputs[i]);
+            std::shared_ptr<FlatAst> ast = FlatAst::flatten(e);
+            CHECK( ast->to_string(ast->root) == e->to_string() );
+            CHECK( ast->to_expr(ast->root)->equals(e) );
+            CHECK( ast->equals(ast->root, *FlatAst::flatten(parse_str(inputs[i])), ast->root) );
+        }
+        std::shared_ptr<FlatAst> a = FlatAst::flatten(parse_str("_fun (x) x + 1"));
+        CHECK( !a->equals(a->root, *FlatAst::flatten(parse_str("_fun (y) y + 1")), a->root) );
+        CHECK( !a->equals(a->root, *FlatAst::flatten(parse_str("_fun (x) x + 2")), a->root) );
+        CHECK( !a->equals(a->root, *FlatAst::flatten(parse_str("_fun (x) x * 1")), a->root) );
+    }
+
+    SECTION( "subst" ) {
+        const char *inputs[] = { "x + y * x", "_let x = x _in x + 1", "_let y = x _in y + x", "_fun (x) x + y",
+            "_fun (y) x + y", "_if x == 1 _then x _else f(x)" };
+        for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+            PTR(Expr) e = parse_str(inputs[i]);
+            std::shared_ptr<FlatAst> ast = FlatAst::flatten(e);
+            size_t before = ast->size();
+            uint32_t replacement = ast->num(7);
+            uint32_t result = ast->subst(ast->root, "x", replacement);
+            CHECK( ast->to_expr(result)->equals(e->subst("x", NEW(NumExpr) (7))) );
+            //the original is left alone
+            CHECK( ast->to_expr(ast->root)->equals(e) );
+            CHECK( ast->size() - before <= 4 );
+        }
+        std::shared_ptr<FlatAst> ast = FlatAst::flatten(parse_str("_fun (x) x + 1"));
+        CHECK( ast->subst(ast->root, "x", ast->num(2)) == ast->root );
+    }
+
+    SECTION( "Same results as interp" ) {
+        CHECK( flat_matches_interp("(7 * 7) * (9 + 2)") );
+        CHECK( flat_matches_interp("_let x = (_let y = 5 _in y+6) _in x+7") );
+        CHECK( flat_matches_interp("_let x = 5 _in ((_let x = 6 _in x + 1) + x)") );
+        CHECK( flat_matches_interp("1==2+3") );
+        CHECK( flat_matches_interp("_let add = _fun (x) _fun (y) x + y _in add(3)(4)") );
+        CHECK( flat_matches_interp("_let y = 8 _in _fun (x) x + y") );
+        CHECK( flat_matches_interp(fact) );
+        CHECK( flat_interp(FlatAst::flatten(parse_str("_fun (x) x + 1")))->equals(NEW(FunVal) ("x", parse_str("x + 1"))) );
+        CHECK( NEW(FunVal) ("x", parse_str("x + 1"))->equals(flat_interp(FlatAst::flatten(parse_str("_fun (x) x + 1")))) );
+    }
+
+    SECTION( "Same errors as interp" ) {
+        CHECK_THROWS_WITH( flat_interp(FlatAst::flatten(parse_str("x + y"))), "free variable: x" );
+        //variables are resolved before anything runs, as the tree engine does
+        CHECK_THROWS_WITH( flat_interp(FlatAst::flatten(parse_str("_if _false _then x _else 4"))), "free variable: x" );
+        CHECK_THROWS_WITH( flat_interp(FlatAst::flatten(parse_str("_fun (x) y"))), "free variable: y" );
+        CHECK_THROWS_WITH( flat_interp(FlatAst::flatten(parse_str("(1==2)+3"))), "Cannot perform add operation on BoolVal!" );
+        CHECK_THROWS_WITH( flat_interp(FlatAst::flatten(parse_str("_if 1 _then 2 _else 3"))), "NumVal is not of type boolean" );
+        CHECK_THROWS_WITH( flat_interp(FlatAst::flatten(parse_str("5(9)"))), "NumVal cannot call" );
+    }
+
+    SECTION( "Tail calls" ) {
+        CHECK( flat_interp(FlatAst::flatten(parse_str("_let loop = _fun (loop) _fun (n) _fun (acc) _if n == 0 _then acc _else loop(loop)(n + -1)(acc + n) _in loop(loop)(100000)(0)")))
+              ->equals(NEW(NumVal) (705082704)) );
+    }
+
+    SECTION( "Closures run by other engines" ) {
+        PTR(Val) add = flat_interp(FlatAst::flatten(parse_str("_let y = 8 _in _fun (x) x + y")));
+        CHECK( add->call(NEW(NumVal) (2))->equals(NEW(NumVal) (10)) );
+        CHECK( add->to_string() == "[_fun (x) (x+y)]" );
+        CHECK( add->to_expr()->equals(parse_str("_fun (x) x + y")) );
+        //a closure of one table called from another, the caller's table carries on afterwards
+        std::string calls = "_fun (f) f(2) * f(3) + y";
+        Lexer lex(calls);
+        std::shared_ptr<FlatAst> caller = parse_flat(lex);
+        uint32_t y = caller->num(1);
+        PTR(Val) twice = flat_evaluate(caller, caller->subst(caller->root, "y", y)).to_val();
+        CHECK( twice->call(add)->equals(NEW(NumVal) (111)) );
+    }
+
+    SECTION( "Parsed straight into the table" ) {
+        const char *inputs[] = { "1 + 2 * 3", "_let x = 5 _in x + x", "f(3)(4)", fact.c_str() };
+        for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+            std::string input = inputs[i];
+            Lexer lex(input);
+            std::shared_ptr<FlatAst> ast = parse_flat(lex);
+            std::shared_ptr<FlatAst> flattened = FlatAst::flatten(parse_str(inputs[i]));
+            CHECK( ast->size() == flattened->size() );
+            CHECK( ast->equals(ast->root, *flattened, flattened->root) );
+        }
+        std::string extra = "1 2";
+        Lexer unused(extra);
+        CHECK_THROWS_WITH( parse_flat(unused), "Invalid input" );
+    }
+
+    SECTION( "Deep tables" ) {
+        std::string sum;
+        std::string vars;
+        for (int i = 0; i < 50000; i++) {
+            sum += "1+";
+            vars += "x*";
+        }
+        sum += "1";
+        vars += "x";
+        Lexer lex(sum);
+        std::shared_ptr<FlatAst> ast = parse_flat(lex);
+        CHECK( flat_interp(ast)->equals(NEW(NumVal) (50001)) );
+        CHECK( ast->to_string(ast->root).size() == 4 * 50000 + 1 );
+        CHECK( ast->to_expr(ast->root)->equals(parse_str(sum)) );
+        CHECK( ast->equals(ast->root, *FlatAst::flatten(parse_str(sum)), ast->root) );
+        Lexer lex_vars(vars);
+        std::shared_ptr<FlatAst> product = parse_flat(lex_vars);
+        uint32_t one = product->num(1);
+        uint32_t ones = product->subst(product->root, "x", one);
+        CHECK( flat_evaluate(product, ones).to_val()->equals(NEW(NumVal) (1)) );
+        CHECK( flat_evaluate(product, product->subst(ones, "x", one)).is_num() );
+        //a node subst put in several places can be under different binders, they are resolved on a copy
+        std::string shared = "_let x = 1 _in _fun (y) x + (_let z = 2 _in x * z) + (_fun (w) x)(y)";
+        std::shared_ptr<FlatAst> shared_ast = FlatAst::flatten(parse_str(shared));
+        uint32_t y_plus_y = shared_ast->add(shared_ast->var("y"), shared_ast->var("y"));
+        uint32_t doubled = shared_ast->subst(shared_ast->op2[shared_ast->root], "x", y_plus_y);
+        PTR(Val) doubles = flat_evaluate(shared_ast, doubled).to_val();
+        CHECK( doubles->call(NEW(NumVal) (5))->equals(NEW(NumVal) (40)) );
+
+        //every let extends the environment, the chain and a closure holding it are freed with a loop
+        std::string lets = "_let x = 1 _in ";
+        for (int i = 0; i < 200000; i++) {
+            lets += "_let x = x _in ";
+        }
+        std::string closure = lets + "_fun (y) x + y";
+        //a variable bound outside the whole chain is read from its slot, and found by interp() with a loop
+        std::string outer = "_let a = 7 _in " + lets + "a + x";
+        Lexer lex_outer(outer);
+        CHECK( flat_interp(parse_flat(lex_outer))->equals(NEW(NumVal) (8)) );
+        CHECK( parse_str(outer)->interp()->equals(NEW(NumVal) (8)) );
+        CHECK( resolved_interp(parse_str(outer))->equals(NEW(NumVal) (8)) );
+        lets += "x";
+        Lexer lex_lets(lets);
+        CHECK( flat_interp(parse_flat(lex_lets))->equals(NEW(NumVal) (1)) );
+        Lexer lex_closure(closure);
+        CHECK( flat_interp(parse_flat(lex_closure))->call(NEW(NumVal) (2))->equals(NEW(NumVal) (3)) );
+        CHECK( parse_str(closure)->interp()->call(NEW(NumVal) (2))->equals(NEW(NumVal) (3)) );
+    }
+}
+
+TEST_CASE( "Hash consing" )
+{
+    SECTION( "One node per structure" ) {
+        ExprFactory factory;
+        ExprFactoryScope scope(&factory);
+        PTR(Expr) a = ExprFactory::add(ExprFactory::var("x"), ExprFactory::num(1));
+        PTR(Expr) b = ExprFactory::add(ExprFactory::var("x"), ExprFactory::num(1));
+        CHECK( RAW(a) == RAW(b) );
+        CHECK( a->table == factory.id() );
+        CHECK( factory.size() == 3 );
+        CHECK( factory.shared() == 3 );
+        CHECK( RAW(ExprFactory::mult(ExprFactory::var("x"), ExprFactory::num(1))) != RAW(a) );
+        CHECK( RAW(ExprFactory::fun("x", a)) != RAW(ExprFactory::fun("y", a)) );
+        CHECK( RAW(ExprFactory::let("x", a, a)) == RAW(ExprFactory::let("x", b, b)) );
+        CHECK( RAW(ExprFactory::cond(ExprFactory::boolean(true), a, a)) != RAW(ExprFactory::cond(ExprFactory::boolean(false), a, a)) );
+    }
+
+    SECTION( "equals" ) {
+        ExprFactory factory;
+        ExprFactoryScope scope(&factory);
+        PTR(Expr) a = ExprFactory::call(ExprFactory::var("f"), ExprFactory::num(1));
+        PTR(Expr) b = ExprFactory::call(ExprFactory::var("f"), ExprFactory::num(2));
+        CHECK( a->equals(a) );
+        CHECK( !a->equals(b) );
+        CHECK( a->hash == NEW(CallExpr) (NEW(VarExpr) ("f"), NEW(NumExpr) (1))->hash );
+        //nodes in no table are still compared by structure
+        CHECK( a->equals(NEW(CallExpr) (NEW(VarExpr) ("f"), NEW(NumExpr) (1))) );
+        CHECK( NEW(CallExpr) (NEW(VarExpr) ("f"), NEW(NumExpr) (1))->equals(a) );
+        CHECK( !b->equals(NEW(CallExpr) (NEW(VarExpr) ("f"), NEW(NumExpr) (1))) );
+        //a node over a child from no table is not interned
+        PTR(Expr) c = ExprFactory::add(NEW(NumExpr) (1), ExprFactory::num(1));
+        CHECK( c->table == 0 );
+        CHECK( c->equals(ExprFactory::add(ExprFactory::num(1), ExprFactory::num(1))) );
+    }
+
+    SECTION( "Parser and subst build through the table" ) {
+        std::stringstream in("(x+1)*(x+1) + (_fun (y) y + (x+1))(x+1)");
+        Program program(in);
+        CHECK( program.factory->size() == 9 );
+        MultExpr *mult = static_cast<MultExpr*>(RAW(static_cast<AddExpr*>(RAW(program.expr))->lhs));
+        CHECK( RAW(mult->lhs) == RAW(mult->rhs) );
+        CHECK( program.expr->equals(parse_str("(x+1)*(x+1) + (_fun (y) y + (x+1))(x+1)")) );
+
+        ExprFactoryScope scope(program.factory.get());
+        //nothing substituted, every node is found again
+        CHECK( RAW(program.expr->subst("z", ExprFactory::num(5))) == RAW(program.expr) );
+        PTR(Expr) e = program.expr->subst("x", ExprFactory::num(5));
+        CHECK( e->equals(parse_str("(5+1)*(5+1) + (_fun (y) y + (5+1))(5+1)")) );
+        CHECK( e->table == program.factory->id() );
+    }
+
+    SECTION( "Repetitive input" ) {
+        std::string input = "1";
+        for (int i = 0; i < 2000; i++) {
+            input += " + (_let x = 2 _in x * 3)";
+        }
+        std::stringstream in(input);
+        Program program(in);
+        //one node per distinct subtree, the 2000 copies of the let are one node
+        CHECK( program.factory->size() == 2000 + 6 );
+        CHECK( program.factory->shared() == 1999 * 5 );
+        CHECK( program.expr->interp()->equals(NEW(NumVal) (12001)) );
+    }
+}
+
+TEST_CASE( "Deep expressions" )
+{
+    //the shape parsing gives a long sum, nested on the right
+    const int depth = 200000;
+    PTR(Expr) x = NEW(VarExpr) ("x");
+    PTR(Expr) chain = NEW(NumExpr) (0);
+    for (int i = 0; i < depth; i++) {
+        chain = NEW(AddExpr) (x, chain);
+    }
+
+    SECTION( "print and pretty_print" ) {
+        std::string printed = chain->to_string();
+        CHECK( printed.size() == 4 * (size_t)depth + 1 );
+        CHECK( printed.substr(0, 7) == "(x+(x+(" );
+        CHECK( printed.substr(3 * (size_t)depth - 3, 5) == "(x+0)" );
+        std::string pretty = chain->to_stringPP();
+        CHECK( pretty.size() == 4 * (size_t)depth + 1 );
+        CHECK( pretty.substr(pretty.size() - 9) == "x + x + 0" );
+    }
+
+    SECTION( "equals and subst" ) {
+        PTR(Expr) copy = chain->subst("x", NEW(VarExpr) ("x"));
+        CHECK( RAW(copy) != RAW(chain) );
+        CHECK( chain->equals(copy) );
+        CHECK( RAW(chain->subst("y", NEW(NumExpr) (1))) == RAW(chain) );
+        copy = nullptr;
+        PTR(Expr) ones = chain->subst("x", NEW(NumExpr) (1));
+        CHECK( !chain->equals(ones) );
+        CHECK( ones->to_string().substr(0, 7) == "(1+(1+(" );
+    }
+
+    SECTION( "Parsing" ) {
+        std::string sum;
+        sum.reserve(2 * (size_t)depth + 1);
+        for (int i = 0; i < depth; i++) {
+            sum += "x+";
+        }
+        CHECK( parse_str(sum + "0")->equals(chain) );
+        std::string nested = std::string(depth, '(') + "x" + std::string(depth, ')');
+        CHECK( parse_str(nested)->equals(x) );
+        std::string calls = "f";
+        for (int i = 0; i < depth / 4; i++) {
+            calls += "(_fun (y) y * 2 == 1";
+        }
+        calls += std::string(depth / 4, ')');
+        PTR(Expr) call = parse_str(calls);
+        CHECK( call->to_string().substr(0, 49) == "f (_fun (y) ((y*2)==1 (_fun (y) ((y*2)==1 (_fun (" );
+        CHECK_THROWS_WITH( parse_str(nested.substr(0, nested.size() - 1)), "missing close parenthesis" );
+    }
+
+    SECTION( "Destruction" ) {
+        chain = nullptr;
+        CHECK( chain == nullptr );
+    }
+}
+
+TEST_CASE( "Traversal" )
+{
+    /*! \brief records the order walk() makes its callbacks in */
+    class Recorder : public ExprVisitor {
+    public:
+        std::string log;
+        bool enter(Expr *e) { log += "<" + e->to_string(); return e->kind != expr_fun; }
+        void between(Expr *e, int i) { log += "|" + std::to_string(i); }
+        void leave(Expr *e) { log += ">"; }
+    };
+    Recorder recorder;
+    PTR(Expr) e = parse_str("_if a _then b + 1 _else _fun (x) x");
+    walk(RAW(e), recorder);
+    CHECK( recorder.log == "<(_if a _then (b+1) _else (_fun (x) x))<a>|1<(b+1)<b>|1<1>>|2<(_fun (x) x)>" );
+}
+
+TEST_CASE( "Lexer" )
+{
+    SECTION( "Tokens and spans" )
+    {
+        std::string input = "_let xy = -12\n _in xy(3)==4";
+        Lexer lex(input);
+        token_kind_t kinds[] = { tok_let, tok_var, tok_assign, tok_num, tok_in, tok_var, tok_lparen, tok_num,
+                                 tok_rparen, tok_eqeq, tok_num, tok_end };
+        std::string texts[] = { "_let", "xy", "=", "-12", "_in", "xy", "(", "3", ")", "==", "4", "" };
+        bool spaced[] = { false, true, true, true, true, true, false, false, false, false, false, false };
+        for (int i = 0; i < 12; i++) {
+            CHECK( lex.peek().kind == kinds[i] );
+            Token tok = lex.next();
+            CHECK( tok.kind == kinds[i] );
+            CHECK( lex.text(tok) == texts[i] );
+            CHECK( tok.spaced == spaced[i] );
+        }
+        std::string negative = "-12";
+        Lexer num(negative);
+        CHECK( num.next().val == -12 );
+        CHECK( lex.next().kind == tok_end );
+    }
+    SECTION( "Errors" )
+    {
+        std::string input = "x_z _lett - 2x (";
+        Lexer lex(input);
+        Token tok = lex.next();
+        CHECK( tok.kind == tok_error );
+        CHECK( std::string(tok.error) == "invalid input" );
+        CHECK( lex.text(tok) == "x_z" );
+        tok = lex.next();
+        CHECK( tok.kind == tok_error );
+        CHECK( std::string(tok.error) == "consume mismatch" );
+        CHECK( lex.next().kind == tok_error );
+        CHECK( lex.text(lex.next()) == "2x" );
+        CHECK( lex.next().kind == tok_lparen );
+    }
+    SECTION( "Reading a stream" )
+    {
+        std::string big(200000, ' ');
+        big += "1 + 2";
+        std::istringstream in(big);
+        std::string buffer = Lexer::read_all(in);
+        CHECK( buffer == big );
+        std::istringstream program(big);
+        CHECK( parse(program)->equals(parse_str("1+2")) );
+        std::istringstream trailing("1 2");
+        CHECK_THROWS_WITH( parse(trailing), "Invalid input" );
+    }
+}
+
+TEST_CASE( "Batch" )
+{
+    SECTION( "Newline framing" )
+    {
+        std::istringstream in("1 + 2\n_let x = 3 _in y\n(1\n\n(_fun (x) x + 1)(41)\n_if _true _then 4 _else 5");
+        std::ostringstream out;
+        executeBatch(in, out, do_interp, engine_tree, framing_newline);
+        CHECK( out.str() == "3\nerror: invalid let expression\nerror: missing close parenthesis\nerror: invalid input\n"
+                            "42\n4\n" );
+    }
+    SECTION( "One line per record" )
+    {
+        std::istringstream in("_let x = 1 _in x + 2\n_let x 1\n1+2\n");
+        std::ostringstream out;
+        executeBatch(in, out, do_pretty_print, engine_tree, framing_newline);
+        std::string lines = out.str();
+        CHECK( std::count(lines.begin(), lines.end(), '\n') == 3 );
+        CHECK( lines == "_let x = 1\\n_in  x + 2\nerror: consume mismatch for = \\n\n1 + 2\n" );
+        std::ostringstream escaped;
+        write_record(escaped, framing_newline, "a\\b\nc");
+        CHECK( escaped.str() == "a\\\\b\\nc\n" );
+        std::string source = "_let x = 1 _in x\n_fun (y)\ny";
+        std::ostringstream split;
+        executeExpressions(source.data(), source.data() + source.size(), split, do_pretty_print, engine_tree, 1);
+        CHECK( split.str() == "_let x = 1\\n_in  x\n_fun (y)\\n  y\n" );
+    }
+    SECTION( "NUL framing" )
+    {
+        const char records[] = "_let x = 1\n_in x + 2\0" "2 *\0" "_fun (y)\n y";
+        const char results[] = "_let x = 1\n_in  x + 2\0" "error: invalid input\0" "_fun (y)\n  y\0";
+        std::istringstream in(std::string(records, sizeof(records) - 1));
+        std::ostringstream out;
+        executeBatch(in, out, do_pretty_print, engine_vm, framing_nul);
+        CHECK( out.str() == std::string(results, sizeof(results) - 1) );
+    }
+    SECTION( "Length framing" )
+    {
+        std::istringstream in("5\n1+2*3\n 12\n_true == 1\n\n3\n1 2");
+        std::ostringstream out;
+        executeBatch(in, out, do_print, engine_tree, framing_length);
+        CHECK( out.str() == "9\n(1+(2*3))\n10\n(_true==1)\n20\nerror: Invalid input\n" );
+        std::istringstream bad("3\n1+2\nx\n");
+        std::ostringstream bad_out;
+        executeBatch(bad, bad_out, do_interp, engine_tree, framing_length);
+        CHECK( bad_out.str() == "1\n3\n28\nerror: invalid record length\n" );
+        std::istringstream truncated("10\n1+2");
+        std::string record;
+        CHECK_THROWS_WITH( read_record(truncated, framing_length, record), "truncated record" );
+    }
+    SECTION( "Engines" )
+    {
+        std::string program = "_let f = _fun (f) _fun (x) _if x == 0 _then 0 _else x + f(f)(x + -1) _in f(f)(10)";
+        CHECK( run_record(program, do_interp, engine_tree) == "55" );
+        CHECK( run_record(program, do_interp, engine_vm) == "55" );
+        CHECK( run_record(program, do_interp, engine_cek) == "55" );
+        CHECK( run_record(program, do_interp, engine_flat) == "55" );
+        CHECK( run_record("1 + _true", do_interp, engine_tree) == "error: Trying to add a non-number!" );
+    }
+}
+
+TEST_CASE( "Mapped files" )
+{
+    const char *path = "msdscript_mapped_test.txt";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "_let count = 41\n_in count + 1\n";
+    }
+
+    SECTION( "Mapping" ) {
+        MappedFile file(path);
+        CHECK( file.size() == 30 );
+        CHECK( std::string(file.begin(), file.end()) == "_let count = 41\n_in count + 1\n" );
+        Program program(file.begin(), file.end());
+        CHECK( program.expr->interp()->equals(NEW(NumVal) (42)) );
+        CHECK_THROWS_WITH( MappedFile("msdscript_no_such_file.txt"), "cannot open file: msdscript_no_such_file.txt" );
+    }
+
+    SECTION( "Views" ) {
+        std::string text = "abc abcd";
+        CHECK( Symbol(StrView(text.data(), 3)) == Symbol("abc") );
+        CHECK( Symbol(StrView(text.data() + 4, 4)) == Symbol(std::string("abcd")) );
+        CHECK( Symbol(StrView(text.data(), 3)) != Symbol(StrView(text.data() + 4, 4)) );
+        CHECK( Symbol(StrView(text.data(), 0)) == Symbol() );
+        Lexer lex(text);
+        Token tok = lex.next();
+        CHECK( lex.view(tok).data == text.data() );
+        CHECK( Symbol(lex.view(lex.next())).str() == "abcd" );
+    }
+
+    SECTION( "File mode" ) {
+        std::vector<std::string> paths(2, path);
+        std::ostringstream out;
+        executeFiles(paths, out, do_pretty_print, engine_tree, framing_none);
+        CHECK( out.str() == "_let count = 41\n_in  count + 1\n_let count = 41\n_in  count + 1\n" );
+        std::ostringstream lines;
+        executeFiles(std::vector<std::string>(1, path), lines, do_print, engine_tree, framing_newline);
+        CHECK( lines.str() == "error: consume mismatch\nerror: invalid input\n" );
+    }
+
+    std::remove(path);
+}
+
+TEST_CASE( "Parallel parsing" )
+{
+    SECTION( "Splitting" )
+    {
+        std::string source = "1 + 2 3*4\n_let x = 5 _in x + x  f(1) (2)\n_if _true _then 1 _else _fun (y) y  z";
+        std::vector<std::pair<size_t, size_t> > spans = split_expressions(source.data(), source.data() + source.size());
+        std::vector<std::string> pieces;
+        for (size_t i = 0; i < spans.size(); i++) {
+            pieces.push_back(source.substr(spans[i].first, spans[i].second - spans[i].first));
+        }
+        std::vector<std::string> expected = { "1 + 2", "3*4", "_let x = 5 _in x + x", "f(1)", "(2)",
+                                              "_if _true _then 1 _else _fun (y) y", "z" };
+        CHECK( pieces == expected );
+        //a piece ends with the token found wrong and splitting resumes after it
+        std::string bad = "1 (2 3) 4 _let x 5 y";
+        spans = split_expressions(bad.data(), bad.data() + bad.size());
+        pieces.clear();
+        for (size_t i = 0; i < spans.size(); i++) {
+            pieces.push_back(bad.substr(spans[i].first, spans[i].second - spans[i].first));
+        }
+        expected = { "1", "(2 3", ")", "4", "_let x 5", "y" };
+        CHECK( pieces == expected );
+        std::string misplaced = ")1 2";
+        std::ostringstream out;
+        executeExpressions(misplaced.data(), misplaced.data() + misplaced.size(), out, do_print, engine_tree, 2);
+        CHECK( out.str() == "error: invalid input\n1\n2\n" );
+        std::string blank = " \n ";
+        CHECK( split_expressions(blank.data(), blank.data() + blank.size()).empty() );
+    }
+    SECTION( "Same as parsing each alone" )
+    {
+        std::string source;
+        std::vector<std::string> alone;
+        for (int i = 0; i < 500; i++) {
+            std::string text = "_let x = " + std::to_string(i) + " _in _let f = _fun (y) y * x _in f(" +
+                               std::to_string(i) + ") + (x + 1)";
+            alone.push_back(text);
+            source += text + (i % 2 == 0 ? "\n" : "  ");
+        }
+        std::vector<ParsedExpr> parsed = parse_expressions(source.data(), source.data() + source.size(), 4);
+        REQUIRE( parsed.size() == alone.size() );
+        for (size_t i = 0; i < parsed.size(); i++) {
+            REQUIRE( parsed[i].program );
+            CHECK( parsed[i].program->expr->to_string() == parse_str(alone[i])->to_string() );
+        }
+        CHECK( interp_program(*parsed[499].program) == std::to_string(499 * 499 + 500) );
+    }
+    SECTION( "Expression framing" )
+    {
+        std::istringstream in("1 + 2 _let x = 3 _in y (_fun (x) x + 1)(41)\n_if _true _then 4 _else 5 (1 2) 7");
+        std::ostringstream out;
+        executeBatch(in, out, do_interp, engine_vm, framing_expr, 3);
+        CHECK( out.str() == "3\nerror: invalid let expression\n42\n4\nerror: missing close parenthesis\n"
+                            "error: invalid input\n7\n" );
+    }
+}
+
+TEST_CASE( "Scanning kernels" )
+{
+    SECTION( "Every kernel agrees with the scalar one" )
+    {
+        //every byte value, and runs crossing the 16 and 32 byte blocks at every offset
+        std::string text;
+        for (int c = 0; c < 256; c++) {
+            text += (char)c;
+            text += "aZ09 ";
+        }
+        for (int run = 1; run < 70; run += 3) {
+            text += std::string(run, ' ') + "\t\r\n\v\f" + std::string(run, '7') + std::string(run, 'q') + "Q@[`{/:";
+        }
+        std::vector<const ScanKernels *> kernels = available_scan_kernels();
+        REQUIRE( std::string(kernels.front()->name) == "scalar" );
+        CHECK( &scan_kernels() == kernels.back() );
+        const char *begin = text.data();
+        const char *end = begin + text.size();
+        for (size_t k = 1; k < kernels.size(); k++) {
+            for (const char *p = begin; p != end; p++) {
+                REQUIRE( kernels[k]->spaces(p, end) == kernels[0]->spaces(p, end) );
+                REQUIRE( kernels[k]->digits(p, end) == kernels[0]->digits(p, end) );
+                REQUIRE( kernels[k]->letters(p, end) == kernels[0]->letters(p, end) );
+            }
+            std::string spaces(100, ' ');
+            CHECK( kernels[k]->spaces(spaces.data(), spaces.data() + 40) == spaces.data() + 40 );
+        }
+        std::string mixed = " \t x";
+        CHECK( kernels[0]->spaces(mixed.data(), mixed.data() + mixed.size()) == mixed.data() + 3 );
+    }
+    SECTION( "Digit runs" )
+    {
+        std::string digits = "12345678901234567890123";
+        for (size_t length = 0; length <= digits.size(); length++) {
+            unsigned expected = 0;
+            for (size_t i = 0; i < length; i++) {
+                expected = expected * 10 + (unsigned)(digits[i] - '0');
+            }
+            CHECK( digits_value(digits.data(), digits.data() + length) == expected );
+        }
+        CHECK( digits_value(digits.data(), digits.data() + 8) == 12345678u );
+        CHECK( parse_str("99999999 + 2147483647")->interp()->to_string() == "-2047483650" );
+        CHECK( parse_str("-4294967296000000000")->equals(parse_str("0")) );
+    }
+}
+
+/**
+* \brief checks doc against splitting and parsing its whole text again, down to where the parts of each tree are
+* \param doc document after some edits
+*/
+static void check_document(Document &doc) {
+    std::string text = doc.text();
+    std::vector<std::pair<size_t, size_t> > spans = split_expressions(text.data(), text.data() + text.size());
+    REQUIRE( spans.size() == doc.size() );
+    for (size_t i = 0; i < spans.size(); i++) {
+        REQUIRE( doc.at(i).begin == spans[i].first );
+        REQUIRE( doc.at(i).end == spans[i].second );
+        std::string error;
+        std::string printed;
+        SpanTable parsed;
+        try {
+            Program program;
+            program.reparse(text.data() + spans[i].first, text.data() + spans[i].second, &parsed);
+            printed = program.expr->to_string();
+        } catch (std::runtime_error &exn) {
+            error = exn.what();
+        }
+        REQUIRE( doc.at(i).error == error );
+        if ( error.empty() ) {
+            REQUIRE( doc.at(i).program->expr->to_string() == printed );
+            //the parts kept through edits are the ones a parse finds
+            const SpanTable &kept = *doc.at(i).spans;
+            REQUIRE( kept.first == parsed.first );
+            std::set<std::vector<size_t> > kept_parts;
+            std::set<std::vector<size_t> > parsed_parts;
+            for (size_t k = 0; k < kept.parts.size(); k++) {
+                kept_parts.insert({ kept.parts[k].node, kept.parts[k].begin, kept.parts[k].end });
+            }
+            for (size_t k = 0; k < parsed.parts.size(); k++) {
+                parsed_parts.insert({ parsed.parts[k].node, parsed.parts[k].begin, parsed.parts[k].end });
+            }
+            REQUIRE( kept_parts == parsed_parts );
+        }
+    }
+}
+
+TEST_CASE( "Incremental reparsing" )
+{
+    std::string source = "1 + 2  _let f = _fun (x) x * 3 _in f(4) + f(5)\n_if _true _then 6 _else 7";
+    Document doc(source);
+    REQUIRE( doc.size() == 3 );
+    std::shared_ptr<Program> sum = doc.at(0).program;
+    std::shared_ptr<Program> cond = doc.at(2).program;
+    //holds the nodes, with plain pointers they go with their program
+    std::shared_ptr<Program> original = doc.at(1).program;
+    PTR(Expr) let = original->expr;
+    PTR(Expr) fun = CAST(LetExpr)(let)->rhs;
+
+    SECTION( "Editing inside one expression" )
+    {
+        DocumentChange change = doc.edit(source.find("5"), 1, "50");
+        CHECK( change.changed == std::vector<size_t>(1, 1) );
+        CHECK( doc.at(0).program == sum );
+        CHECK( doc.at(2).program == cond );
+        CHECK( doc.at(2).begin == source.find("_if") + 1 );
+        CHECK( interp_program(*doc.at(1).program) == "162" );
+        //the function is not retyped, so it is the node made before
+        CHECK( CAST(LetExpr)(doc.at(1).program->expr)->rhs == fun );
+    }
+    SECTION( "Edits that leave the trees alone" )
+    {
+        DocumentChange change = doc.edit(source.find("x *"), 1, "x  ");
+        CHECK( change.changed.empty() );
+        CHECK( doc.at(1).program->expr == let );
+        change = doc.edit(source.find("  _let"), 2, "\n\n\n");
+        CHECK( change.changed.empty() );
+        CHECK( doc.size() == 3 );
+        CHECK( doc.at(1).begin == source.find("_let") + 1 );
+    }
+    SECTION( "Joining and splitting expressions" )
+    {
+        DocumentChange change = doc.edit(source.find(" _let"), 0, " *");
+        CHECK( doc.size() == 2 );
+        CHECK( change.first == 0 );
+        CHECK( change.removed == 2 );
+        CHECK( change.inserted == 1 );
+        CHECK( change.changed == std::vector<size_t>(1, 0) );
+        CHECK( interp_program(*doc.at(0).program) == "55" );
+        CHECK( doc.at(1).program == cond );
+        doc.edit(source.find(" _let"), 2, "");
+        CHECK( doc.size() == 3 );
+        CHECK( doc.at(1).program->expr->equals(let) );
+    }
+    SECTION( "Errors and fixing them" )
+    {
+        DocumentChange change = doc.edit(source.find("_in"), 3, "_on");
+        //the broken expression ends at _on, the rest splits as before
+        CHECK( change.changed == std::vector<size_t>({ 1, 2 }) );
+        CHECK( doc.size() == 4 );
+        CHECK( doc.at(1).error == "consume mismatch" );
+        CHECK( doc.at(1).end == source.find("_in") + 3 );
+        CHECK( doc.at(2).program->expr->equals(parse_str("f(4) + f(5)")) );
+        CHECK( doc.at(3).program == cond );
+        change = doc.edit(source.find("_in"), 3, "_in");
+        CHECK( doc.size() == 3 );
+        CHECK( doc.at(1).error.empty() );
+        CHECK( doc.at(1).program->expr == let );
+        CHECK_THROWS_WITH( doc.edit(doc.text().size(), 1, ""), "edit out of range" );
+    }
+    SECTION( "Editing inside a part" )
+    {
+        //a large sum beside a deep chain of parentheses with a small sum at the bottom
+        std::string big = "1";
+        std::string deep = "3 + 4";
+        for (int i = 0; i < 20000; i++) {
+            big += " + 2";
+            deep = "1 + (" + deep + ")";
+        }
+        std::string text = "_let a = " + big + " _in _let b = " + deep + " _in a * b";
+        Document deep_doc(text);
+        REQUIRE( deep_doc.size() == 1 );
+        std::shared_ptr<Program> program = deep_doc.at(0).program;
+        PTR(Expr) root = program->expr;
+        PTR(Expr) sum = CAST(LetExpr)(root)->rhs;
+        PTR(Expr) inner = CAST(LetExpr)(CAST(LetExpr)(root)->body)->body;
+
+        DocumentChange change = deep_doc.edit(text.find("3 + 4") + 4, 1, "40");
+        CHECK( change.first == 0 );
+        CHECK( change.removed == 1 );
+        CHECK( change.inserted == 1 );
+        CHECK( change.changed == std::vector<size_t>(1, 0) );
+        //only the innermost parenthesis is parsed again, the nodes beside the path down to it are the old ones
+        CHECK( change.reparsed == std::string("3 + 40").size() );
+        CHECK( deep_doc.at(0).program == program );
+        CHECK( deep_doc.at(0).program->expr != root );
+        CHECK( CAST(LetExpr)(deep_doc.at(0).program->expr)->rhs == sum );
+        CHECK( CAST(LetExpr)(CAST(LetExpr)(deep_doc.at(0).program->expr)->body)->body == inner );
+        CHECK( deep_doc.at(0).end == text.size() + 1 );
+        CHECK( interp_program(*deep_doc.at(0).program, engine_cek) == std::to_string((1 + 20000 * 2) * (20000 + 43)) );
+
+        //a let left without a use and a part that stops before its old end parse the whole text
+        std::string lets = "_let x = 1 _in ( x ) + (_let y = 2 _in y)";
+        Document lets_doc(lets);
+        size_t x = lets.find("( x )") + 2;
+        change = lets_doc.edit(x, 1, "z");
+        CHECK( lets_doc.at(0).error == "invalid let expression" );
+        CHECK( change.reparsed == lets.size() );
+        lets_doc.edit(x, 1, "x");
+        CHECK( lets_doc.at(0).error.empty() );
+        change = lets_doc.edit(x, 1, "x");
+        CHECK( change.reparsed == std::string(" x ").size() );
+        CHECK( change.changed.empty() );
+        change = lets_doc.edit(x, 1, "x ) + ( x");
+        CHECK( change.reparsed == lets_doc.text().size() );
+        CHECK( lets_doc.at(0).program->expr->equals(parse_str("_let x = 1 _in ( x ) + ( x ) + (_let y = 2 _in y)")) );
+
+        //whitespace typed after the last token of an expression is not part of it
+        Document trailing("1 _fun (x) et 2");
+        change = trailing.edit(13, 0, " ");
+        CHECK( change.reparsed == std::string(" et").size() );
+        CHECK( trailing.at(1).end == 13 );
+        check_document(trailing);
+        trailing.edit(16, 0, " ");
+        check_document(trailing);
+
+        //single characters typed and deleted anywhere, an edit that breaks the text is taken back
+        Document keys("_let a = (1 + 2) * (3 + _let b = 4 _in b) _in _if a == 1 _then (_fun (x) x + a)(2) _else f( a + (5) )");
+        const char *typed[] = { "1", "x", "a", "b", " ", "+", "*", "(", ")", "_" };
+        unsigned seed = 777;
+        for (int step = 0; step < 300; step++) {
+            seed = seed * 1103515245u + 12345u;
+            size_t size = keys.text().size();
+            size_t offset = (seed >> 8) % size;
+            std::string removed = (seed >> 20) % 2 == 0 ? keys.text().substr(offset, 1) : "";
+            std::string inserted = removed.empty() ? typed[(seed >> 12) % (sizeof(typed) / sizeof(typed[0]))] : "";
+            keys.edit(offset, removed.size(), inserted);
+            check_document(keys);
+            if ( keys.size() != 1 || !keys.at(0).error.empty() ) {
+                keys.edit(offset, inserted.size(), removed);
+                check_document(keys);
+            }
+        }
+        CHECK( keys.size() == 1 );
+    }
+    SECTION( "Same as parsing the whole text again" )
+    {
+        //where a header missing its parentheses ends depends on the body, an edit to the body can move it
+        Document open_header("_fun _false(x)");
+        open_header.edit(5, 1, "");
+        check_document(open_header);
+        CHECK( open_header.at(0).program->expr->equals(parse_str("_fun (false) x")) );
+        Document closing_header("_fun)x+_false_");
+        closing_header.edit(6, 3, "");
+        check_document(closing_header);
+        CHECK( closing_header.size() == 1 );
+        //a last token edited up against the expression after it runs into it, as it does in a fresh parse
+        Document run_on("_if _true _then 5 _else _true_fun (x) x * x)(7)");
+        run_on.edit(24, 2, "");
+        check_document(run_on);
+        CHECK( run_on.at(0).error == "invalid input" );
+
+        const char *pieces[] = { "1", " ", "+", "(", ")", "_let x = 2 _in x", "f(", "_if _true _then ", " _else 3",
+                                 "\n", "*", "y", "_fun (y) y", "_fun ", "_false", "x", "_true", "_t" };
+        unsigned seed = 12345;
+        for (int step = 0; step < 400; step++) {
+            seed = seed * 1103515245u + 12345u;
+            size_t size = doc.text().size();
+            size_t offset = (seed >> 8) % (size + 1);
+            size_t removed = (seed >> 20) % 3 == 0 ? std::min((size_t)((seed >> 4) % 6), size - offset) : 0;
+            std::string inserted = pieces[(seed >> 12) % (sizeof(pieces) / sizeof(pieces[0]))];
+            doc.edit(offset, removed, inserted);
+
+            check_document(doc);
+            Document fresh(doc.text());
+            REQUIRE( fresh.size() == doc.size() );
+            for (size_t i = 0; i < fresh.size(); i++) {
+                REQUIRE( fresh.at(i).error == doc.at(i).error );
+                if ( fresh.at(i).error.empty() ) {
+                    REQUIRE( fresh.at(i).program->expr->equals(doc.at(i).program->expr) );
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE( "Lazy function bodies" )
+{
+    std::string source = "_let z = 2 _in _let f = _fun (x) _fun (y) x + y * z _in "
+                         "_let g = _fun (g) _fun (n) _if n == 0 _then 1 _else n * g(g)(n + -1) _in "
+                         "_let unused = _fun (a) _let b = a + z _in b * (_fun (c) c)(b) _in "
+                         "_if _false _then unused(1) _else f(2)(3) + g(g)(5)";
+    Program eager(source);
+    Program lazy(source, true);
+    //the functions bound by the lets, from the outside in
+    std::vector<FunExpr *> funs;
+    std::vector<FunExpr *> parsed;
+    for ( PTR(Expr) e = CAST(LetExpr)(lazy.expr)->body; e->kind == expr_let; e = CAST(LetExpr)(e)->body ) {
+        funs.push_back(static_cast<FunExpr *>(RAW(CAST(LetExpr)(e)->rhs)));
+    }
+    for ( PTR(Expr) e = CAST(LetExpr)(eager.expr)->body; e->kind == expr_let; e = CAST(LetExpr)(e)->body ) {
+        parsed.push_back(static_cast<FunExpr *>(RAW(CAST(LetExpr)(e)->rhs)));
+    }
+    REQUIRE( funs.size() == 3 );
+    REQUIRE( parsed.size() == 3 );
+
+    SECTION( "Only the bodies that run are parsed" )
+    {
+        CHECK( lazy.expr->hash == eager.expr->hash );
+        for ( size_t i = 0; i < funs.size(); i++ ) {
+            CHECK( !funs[i]->has_body() );
+            CHECK( funs[i]->hash == parsed[i]->hash );
+            CHECK( *funs[i]->free_names() == *parsed[i]->free_names() );
+        }
+        CHECK( interp_program(lazy) == "128" );
+        CHECK( funs[0]->has_body() );
+        CHECK( funs[1]->has_body() );
+        CHECK( !funs[2]->has_body() );
+        CHECK( interp_program(lazy, engine_cek) == "128" );
+        CHECK( !funs[2]->has_body() );
+    }
+    SECTION( "Lazy trees compare and print like parsed ones" )
+    {
+        CHECK( lazy.expr->equals(eager.expr) );
+        CHECK( funs[2]->has_body() );
+        CHECK( funs[2]->body_expr()->hash == parsed[2]->body_expr()->hash );
+        CHECK( lazy.expr->to_string() == eager.expr->to_string() );
+        CHECK( lazy.expr->to_stringPP() == eager.expr->to_stringPP() );
+    }
+    SECTION( "Every engine runs them" )
+    {
+        CHECK( interp_program(lazy, engine_vm) == "128" );
+        CHECK( interp_program(lazy, engine_flat) == "128" );
+        CHECK( interp_program(lazy, engine_tree) == "128" );
+        CHECK( interp_program(lazy, engine_cek) == "128" );
+        CHECK( Program("_let f = _fun (x) x + 1 _in f", true).expr->interp()->to_string() == "[_fun (x) (x+1)]" );
+    }
+    SECTION( "Closures build the body on their first call" )
+    {
+        CHECK( lazy.expr->interp()->to_string() == "128" );
+        CHECK( !funs[2]->has_body() );
+        CHECK( cek_interp(lazy.expr)->to_string() == "128" );
+        CHECK( !funs[2]->has_body() );
+        Program defined("_let f = _fun (x) x * 2 _in f", true);
+        FunExpr *f = static_cast<FunExpr *>(RAW(CAST(LetExpr)(defined.expr)->rhs));
+        PTR(Val) closure = cek_interp(defined.expr);
+        CHECK( !f->has_body() );
+        CHECK( closure->call(NEW(NumVal) (21))->to_string() == "42" );
+        CHECK( f->has_body() );
+    }
+    SECTION( "Errors are the ones of a full parse" )
+    {
+        CHECK_THROWS_WITH( Program("_fun (x) _let y = 1 _in x", true), "invalid let expression" );
+        CHECK_THROWS_WITH( Program("_fun (x) (x + 1", true), "missing close parenthesis" );
+        CHECK_THROWS_WITH( Program("_fun (x) x 1", true), "Invalid input" );
+        Program unbound("_fun (x) _fun (y) x + w", true);
+        CHECK_THROWS_WITH( interp_program(unbound), "free variable: w" );
+        CHECK_THROWS_WITH( interp_program(unbound, engine_cek), "free variable: w" );
+    }
+}
@@ -0,0 +1,278 @@
+/**
+* \file traverse.cpp
+* \brief contains the explicit-stack expression traversal implementations
+        print, pretty_print, equals, subst and the release of subexpressions go through here, each node
+        only says what it does between its children, so no depth of expression can overflow the native stack
+*/
+
+#include "traverse.hpp"
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+* \brief goes through root depth first keeping the path on a heap allocated stack
+* \param root expression to walk, kept alive by the caller
+* \param visitor callbacks made along the way
+*/
+void walk(Expr *root, ExprVisitor &visitor) {
+    if ( !visitor.enter(root) ) {
+        return;
+    }
+    std::vector<std::pair<Expr *, int> > path(1, std::make_pair(root, 0));
+    while ( !path.empty() ) {
+        Expr *node = path.back().first;
+        int i = path.back().second++;
+        if ( i == node->arity() ) {
+            path.pop_back();
+            visitor.leave(node);
+            continue;
+        }
+        if ( i > 0 ) {
+            visitor.between(node, i);
+        }
+        Expr *child = RAW(node->child(i));
+        if ( visitor.enter(child) ) {
+            path.push_back(std::make_pair(child, 0));
+        }
+    }
+}
+
+namespace {
+
+/*! \brief prints a node's parts around its children */
+class PrintVisitor : public ExprVisitor {
+public:
+    std::ostream &ostream;///< stream printed to
+
+    PrintVisitor(std::ostream &ostream) : ostream(ostream) { }
+
+    bool enter(Expr *e) {
+        e->print_part(ostream, 0);
+        return e->arity() > 0;
+    }
+    void between(Expr *e, int i) { e->print_part(ostream, i); }
+    void leave(Expr *e) { e->print_part(ostream, e->arity()); }
+};
+
+/*! \brief pretty prints a node's parts around its children, each open node keeps a PrettyFrame */
+class PrettyPrintVisitor : public ExprVisitor {
+public:
+    std::ostream &ostream;///< stream printed to
+    std::streampos &caller_pos;///< shared by every node, see Expr::pretty_print_at
+    std::vector<PrettyFrame> frames;///< frame of every node entered and not yet left
+    precedence_t root_precedence;///< precedence the root is printed at
+    bool root_paren;///< parentHasParen of the root
+
+    PrettyPrintVisitor(std::ostream &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos)
+        : ostream(ostream), caller_pos(caller_pos), root_precedence(precedence), root_paren(parentHasParen) { }
+
+    bool enter(Expr *e) {
+        PrettyFrame frame;
+        frame.precedence = frames.empty() ? root_precedence : frames.back().child_precedence;
+        frame.parentHasParen = frames.empty() ? root_paren : frames.back().child_paren;
+        frame.child_precedence = prec_none;
+        frame.child_paren = frame.parentHasParen;
+        if ( e->arity() == 0 ) {
+            e->pretty_print_part(ostream, 0, frame, caller_pos);
+            return false;
+        }
+        frames.push_back(frame);
+        e->pretty_print_part(ostream, 0, frames.back(), caller_pos);
+        return true;
+    }
+    void between(Expr *e, int i) { e->pretty_print_part(ostream, i, frames.back(), caller_pos); }
+    void leave(Expr *e) {
+        e->pretty_print_part(ostream, e->arity(), frames.back(), caller_pos);
+        frames.pop_back();
+    }
+};
+
+/*! \brief rebuilds the nodes whose children changed, bottom up, results wait on a value stack */
+class SubstVisitor : public ExprVisitor {
+public:
+    /*! \brief a node whose children are being substituted */
+    struct Frame {
+        Expr *node;///< the node
+        int next;///< index of the child being walked
+        size_t base;///< size of results before its children
+    };
+
+    Symbol valToSub;///< variable replaced
+    PTR(Expr) replacement;///< what it is replaced with
+    PTR(Expr) root;///< expression substituted in
+    std::vector<Frame> frames;///< nodes entered and not yet left
+    std::vector<PTR(Expr)> results;///< substituted children of the open nodes, then the result
+
+    SubstVisitor(Symbol valToSub, PTR(Expr) const &replacement, PTR(Expr) const &root)
+        : valToSub(valToSub), replacement(replacement), root(root) { }
+
+    bool enter(Expr *e) {
+        PTR(Expr) const &self = frames.empty() ? root : frames.back().node->child(frames.back().next);
+        if ( !frames.empty() && !frames.back().node->substitutes(frames.back().next, valToSub) ) {
+            results.push_back(self);
+            return false;
+        }
+        if ( e->arity() == 0 ) {
+            bool matches = e->kind == expr_var && static_cast<VarExpr*>(e)->value == valToSub;
+            results.push_back(matches ? replacement : self);
+            return false;
+        }
+        Frame frame = { e, 0, results.size() };
+        frames.push_back(frame);
+        return true;
+    }
+    void between(Expr *e, int i) { frames.back().next = i; }
+    void leave(Expr *e) {
+        size_t base = frames.back().base;
+        frames.pop_back();
+        bool changed = false;
+        for (int i = 0; i < e->arity(); i++) {
+            changed = changed || results[base + i] != e->child(i);
+        }
+        PTR(Expr) result = changed ? e->rebuild(&results[base])
+            : (frames.empty() ? root : frames.back().node->child(frames.back().next));
+        results.resize(base);
+        results.push_back(result);
+    }
+};
+
+}
+
+//**********************EXP TRAVERSAL IMPLEMENTATIONS ***********************************
+
+/**
+* \brief compares e with 'this' node by node, with an explicit stack of pairs still to compare
+* \param e expression to compare against this
+* \return true if both are the same expression
+*/
+bool Expr::equals(PTR(Expr) const &e) {
+    if ( this->arity() == 0 ) {
+        return e != nullptr && this->kind == e->kind && this->shallow_equals(RAW(e));
+    }
+    std::vector<std::pair<Expr *, Expr *> > pending(1, std::make_pair(this, RAW(e)));
+    while ( !pending.empty() ) {
+        Expr *a = pending.back().first;
+        Expr *b = pending.back().second;
+        pending.pop_back();
+        if ( a == nullptr || b == nullptr ) {
+            if ( a != b ) {
+                return false;
+            }
+            continue;
+        }
+        if ( a->kind != b->kind || a->hash != b->hash ) {
+            return false;
+        }
+        if ( a->identity_decides(b) ) {
+            if ( a != b ) {
+                return false;
+            }
+            continue;
+        }
+        if ( !a->shallow_equals(b) ) {
+            return false;
+        }
+        for (int i = a->arity() - 1; i >= 0; i--) {
+            pending.push_back(std::make_pair(RAW(a->child(i)), RAW(b->child(i))));
+        }
+    }
+    return true;
+}
+
+/**
+* \brief replaces the free occurrences of valToSub with expr, nodes with nothing replaced below are kept
+* \param valToSub variable to replace
+* \param expr expression to put in its place
+* \return 'this' with valToSub replaced
+*/
+PTR(Expr) Expr::subst( Symbol valToSub, PTR(Expr) const &expr ) {
+    SubstVisitor visitor(valToSub, expr, THIS);
+    walk(this, visitor);
+    return visitor.results.back();
+}
+
+/**
+* \brief prints 'this' in the fully parenthesized form
+* \param ostream output stream
+*/
+void Expr::print( std::ostream &ostream) {
+    PrintVisitor visitor(ostream);
+    walk(this, visitor);
+}
+
+/**
+* \brief prints 'this' with only the parentheses needed and keywords lined up
+* \param ostream output stream
+*/
+void Expr::pretty_print( std::ostream  &ostream) {
+    std::streampos pos = 0;
+    pretty_print_at(ostream, prec_none, false, pos);
+}
+
+/**
+* \brief pretty prints 'this' inside an enclosing expression
+* \param ostream output stream
+* \param precedence precedence of the enclosing operator, parentheses are added when 'this' binds looser
+* \param parentHasParen whether an enclosing expression opened a parenthesis
+* \param caller_pos start of the line being printed, keywords are indented relative to it
+*/
+void Expr::pretty_print_at(std::ostream  &ostream, precedence_t precedence, bool parentHasParen, std::streampos &caller_pos) {
+    PrettyPrintVisitor visitor(ostream, precedence, parentHasParen, caller_pos);
+    walk(this, visitor);
+}
+
+/**
+* \brief expressions without subexpressions have no children to hand out
+* \param i unused
+* \throws std::runtime_error always
+*/
+PTR(Expr) const &Expr::child(int i) const {
+    throw std::runtime_error("expression has no subexpressions");
+}
+
+/**
+* \brief whether subst goes into child(i), only binding expressions say no
+* \param i index of the child
+* \param valToSub variable being substituted
+* \return true
+*/
+bool Expr::substitutes(int i, Symbol valToSub) {
+    return true;
+}
+
+/**
+* \brief expressions without subexpressions are never rebuilt
+* \param children unused
+* \return 'this'
+*/
+PTR(Expr) Expr::rebuild(PTR(Expr) const *children) {
+    return THIS;
+}
+
+/**
+* \brief lets go of a subexpression from a destructor, a subexpression that dies with it is queued
+    and freed by the outermost call in a loop, so a long chain of nodes is not freed by nested destructors
+* \param child member of the node being destroyed, left empty
+*/
+void Expr::release_child(PTR(Expr) &child) {
+#if !USE_PLAIN_POINTERS && !USE_GC_POINTERS
+    static thread_local std::vector<PTR(Expr)> *orphans = nullptr;
+    if ( child == nullptr || child.use_count() > 1 ) {
+        return;
+    }
+    if ( orphans != nullptr ) {
+        orphans->push_back(std::move(child));
+        return;
+    }
+    std::vector<PTR(Expr)> pending;
+    orphans = &pending;
+    pending.push_back(std::move(child));
+    while ( !pending.empty() ) {
+        PTR(Expr) e = std::move(pending.back());
+        pending.pop_back();
+        e = nullptr;
+    }
+    orphans = nullptr;
+#endif
+}
@@ -0,0 +1,52 @@
+/**
+* \file traverse.hpp
+* \brief contains the explicit-stack expression traversal declarations
+*/
+
+#ifndef traverse_hpp
+#define traverse_hpp
+
+#include <string>
+#include "pointer.hpp"
+#include "Expr.hpp"
+
+/*! \brief callbacks walk() makes while it goes through an expression
+* every node is entered, then for a node that was descended into each child is walked in order,
+* with between() called before every child after the first, and left
+*/
+class ExprVisitor {
+public:
+    /**
+    * \brief called first for every node
+    * \param e the node
+    * \return true to walk the children of e and call leave(), false to skip both
+    */
+    virtual bool enter(Expr *e) = 0;
+
+    /**
+    * \brief called before child i of e, for i from 1 to arity() - 1
+    */
+    virtual void between(Expr *e, int i) { }
+
+    /**
+    * \brief called after the last child of e, for nodes enter() returned true for
+    */
+    virtual void leave(Expr *e) { }
+
+    virtual ~ExprVisitor() { }
+};
+
+void walk(Expr *root, ExprVisitor &visitor);
+
+/*! \brief state of one expression being pretty printed, kept on the traversal stack instead of
+* in the locals of a recursive call
+*/
+struct PrettyFrame {
+    precedence_t precedence;///< precedence the enclosing expression prints 'this' at
+    bool parentHasParen;///< whether an enclosing expression opened a parenthesis
+    std::string kw_pos;///< indentation lining the keywords up under the first one
+    precedence_t child_precedence;///< precedence of the next child, set by pretty_print_part
+    bool child_paren;///< parentHasParen of the next child, parentHasParen unless pretty_print_part changes it
+};
+
+#endif /* traverse_hpp */
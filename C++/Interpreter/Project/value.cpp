@@ -0,0 +1,286 @@
+/**
+* \file value.cpp
+* \brief contains the tagged value implementation
+        numbers and booleans are handled inline with the same results and errors as
+        NumVal and BoolVal, boxed values forward to their Val
+*/
+
+#include "value.hpp"
+#include <sstream>
+#include <stdexcept>
+#include "Val.hpp"
+#include "cek.hpp"
+
+static_assert(alignof(Val) >= 4, "the tag of a boxed Value lives in the low bits of its pointer");
+
+/**
+* \brief constructor to make a value from a Val, numbers and booleans are unboxed
+* \param val Val to hold, nullptr for the absent value
+*/
+Value::Value(PTR(Val) val) : word(value_none) {
+    if ( val == nullptr ) {
+        this->word = value_none;
+        return;
+    }
+    switch (val->kind) {
+        case val_num:
+            this->word = ((uint64_t)(uint32_t)static_cast<NumVal*>(RAW(val))->to_int() << 32) | value_num;
+            break;
+        case val_bool:
+            this->word = ((uint64_t)val->is_true() << 32) | value_bool;
+            break;
+        default:
+            hold(std::move(val));
+    }
+}
+
+/**
+* \brief makes an inline number
+* \param n the number
+* \return Value holding n
+*/
+Value Value::num(int n) {
+    Value v;
+    v.word = ((uint64_t)(uint32_t)n << 32) | value_num;
+    return v;
+}
+
+/**
+* \brief makes an inline boolean
+* \param b the boolean
+* \return Value holding b
+*/
+Value Value::boolean(bool b) {
+    Value v;
+    v.word = ((uint64_t)b << 32) | value_bool;
+    return v;
+}
+
+/**
+* \brief boxes a function, skipping the number and boolean checks of Value(PTR(Val))
+* \param fun FunVal to hold
+* \return Value holding fun
+*/
+Value Value::function(PTR(Val) fun) {
+    Value v;
+    v.hold(std::move(fun));
+    return v;
+}
+
+/**
+* \brief makes the absent value 'this' hold val, taking over the reference val had
+* \param val Val to box, not nullptr
+*/
+void Value::hold(PTR(Val) val) {
+    this->word = (uint64_t)(uintptr_t)RAW(val) | value_boxed;
+#if VALUE_KEEPS_BOX
+    this->box = std::move(val);
+#elif !USE_GC_POINTERS && !USE_PLAIN_POINTERS
+    val.detach();
+#endif
+}
+
+#if !USE_GC_POINTERS && !USE_PLAIN_POINTERS
+/**
+* \brief takes one more reference to the boxed Val, 'this' must be boxed
+*/
+void Value::retain() const {
+#if !VALUE_KEEPS_BOX
+    raw_boxed()->retain();
+#endif
+}
+
+/**
+* \brief drops the reference 'this' holds to the boxed Val, 'this' must be boxed
+*/
+void Value::release() const {
+#if !VALUE_KEEPS_BOX
+    raw_boxed()->release();
+#endif
+}
+#endif
+
+/**
+* \brief the boxed Val
+* \return the Val, nullptr unless tag() is value_boxed
+*/
+PTR(Val) Value::boxed() const {
+#if VALUE_KEEPS_BOX
+    return this->box;
+#elif USE_GC_POINTERS || USE_PLAIN_POINTERS
+    return raw_boxed();
+#else
+    return PTR(Val)(raw_boxed());
+#endif
+}
+
+/**
+* \brief boxes 'this' as a Val for code using the Val API
+* \return NumVal, BoolVal or the boxed Val, nullptr for the absent value
+*/
+PTR(Val) Value::to_val() const {
+    switch (tag()) {
+        case value_num:
+            return NEW(NumVal)(num_value());
+        case value_bool:
+            return NEW(BoolVal)(bool_value());
+        case value_boxed:
+            return boxed();
+        default:
+            return nullptr;
+    }
+}
+
+/**
+* \brief adds v to 'this'
+* \param v value to add
+* \throws std::runtime_error if either side is not a number, with the message NumVal, BoolVal or FunVal gives
+* \return the sum, wrapping like NumVal::add_to
+*/
+Value Value::add_to(const Value &v) const {
+    if ( is_num() ) {
+        if ( !v.is_num() ) {
+            throw std::runtime_error("Trying to add a non-number!");
+        }
+        return num((unsigned)num_value() + (unsigned)v.num_value());
+    }
+    if ( is_bool() ) {
+        throw std::runtime_error("Cannot perform add operation on BoolVal!");
+    }
+    return Value(raw_boxed()->add_to(v.to_val()));
+}
+
+/**
+* \brief multiplies 'this' by v
+* \param v value to multiply with
+* \throws std::runtime_error if either side is not a number, with the message NumVal, BoolVal or FunVal gives
+* \return the product, wrapping like NumVal::mult_with
+*/
+Value Value::mult_with(const Value &v) const {
+    if ( is_num() ) {
+        if ( !v.is_num() ) {
+            throw std::runtime_error("Trying to perform multiplication with a non-number!");
+        }
+        return num((unsigned)num_value() * (unsigned)v.num_value());
+    }
+    if ( is_bool() ) {
+        throw std::runtime_error("Cannot perform multiplication operation on BoolVal!");
+    }
+    return Value(raw_boxed()->mult_with(v.to_val()));
+}
+
+/**
+* \brief compares v with 'this'
+* \param v value to compare against
+* \return true if both hold the same number, the same boolean or equal Vals
+*/
+bool Value::equals(const Value &v) const {
+    if ( tag() != v.tag() ) {
+        return false;
+    }
+    if ( tag() == value_boxed ) {
+        return raw_boxed()->equals(v.boxed());
+    }
+    return this->word == v.word;
+}
+
+/**
+* \brief condition of a boolean
+* \throws std::runtime_error if 'this' is not a boolean
+* \return the boolean
+*/
+bool Value::is_true() const {
+    if ( is_bool() ) {
+        return bool_value();
+    }
+    if ( is_num() ) {
+        throw std::runtime_error("NumVal is not of type boolean");
+    }
+    return raw_boxed()->is_true();
+}
+
+/**
+* \brief calls 'this' with actual_arg
+* \param actual_arg value to call with
+* \throws std::runtime_error if 'this' is not a function
+* \return result of the call
+*/
+Value Value::call(const Value &actual_arg) const {
+    if ( is_num() ) {
+        throw std::runtime_error("NumVal cannot call");
+    }
+    if ( is_bool() ) {
+        throw std::runtime_error("BoolVal cannot call");
+    }
+    return Value(raw_boxed()->call(actual_arg.to_val()));
+}
+
+/**
+* \brief calls 'this' from CallExpr::interp_step, see Val::call_step
+* \param actual_arg value to call with
+* \param env replaced by the environment the body runs in
+* \param tail set to the body when the call is handed back
+* \throws std::runtime_error if 'this' is not a function
+* \return result of the call, or the absent value when tail is set
+*/
+Value Value::call_step(const Value &actual_arg, PTR(Env) &env, PTR(Expr) &tail) const {
+    if ( is_num() ) {
+        throw std::runtime_error("NumVal cannot call");
+    }
+    if ( is_bool() ) {
+        throw std::runtime_error("BoolVal cannot call");
+    }
+    return raw_boxed()->call_step(actual_arg, env, tail);
+}
+
+/**
+* \brief calls 'this' from the CEK machine, see Val::apply
+* \param cek machine evaluating the call
+* \param actual_arg value to call with
+* \throws std::runtime_error if 'this' is not a function
+*/
+void Value::apply(Cek &cek, const Value &actual_arg) const {
+    if ( is_num() ) {
+        throw std::runtime_error("NumVal cannot call");
+    }
+    if ( is_bool() ) {
+        throw std::runtime_error("BoolVal cannot call");
+    }
+    raw_boxed()->apply(cek, actual_arg);
+}
+
+/**
+* \brief prints 'this' the way its Val prints
+* \param ostream used to print out
+*/
+void Value::print(std::ostream &ostream) const {
+    if ( is_num() ) {
+        ostream << num_value();
+    }
+    else if ( is_bool() ) {
+        ostream << (bool_value() ? "_true" : "_false");
+    }
+    else {
+        raw_boxed()->print(ostream);
+    }
+}
+
+/**
+* \brief converts 'this' to string
+* \return 'this' as printed by print()
+*/
+std::string Value::to_string() const {
+    std::stringstream st("");
+    this->print(st);
+    return st.str();
+}
+
+/**
+* \brief marks the boxed Val, numbers and booleans are not on the heap
+* \param heap heap collecting
+*/
+void Value::trace(GcHeap &heap) const {
+    if ( tag() == value_boxed ) {
+        heap.mark(raw_boxed());
+    }
+}
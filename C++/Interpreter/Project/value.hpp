@@ -0,0 +1,113 @@
+/**
+* \file value.hpp
+* \brief contains the tagged value declarations used by the evaluators
+*/
+
+#ifndef value_hpp
+#define value_hpp
+
+#include <string>
+#include <ostream>
+#include <utility>
+#include <stdint.h>
+#include "pointer.hpp"
+
+/// a std::shared_ptr cannot be rebuilt from a bare Val*, so with those pointers a Value keeps one beside its word
+#define VALUE_KEEPS_BOX (USE_STD_SHARED_POINTERS && !USE_GC_POINTERS && !USE_PLAIN_POINTERS)
+
+class Val;
+class Env;
+class Expr;
+class Cek;
+class GcHeap;
+
+/*! \brief custom enum of what a Value holds, kept in the low bits of its word */
+typedef enum {
+    value_none = 0,     ///< no value, what Env::find gives for an unbound name
+    value_num = 1,      ///< number held inline
+    value_bool = 2,     ///< boolean held inline
+    value_boxed = 3     ///< any other Val, held by pointer
+} value_tag_t;
+
+/*! \brief result of evaluating an expression
+* a single 64-bit word: numbers and booleans live inline (tag below, payload in the high 32 bits),
+* so arithmetic never allocates, only functions are boxed as a Val whose pointer is the word with the tag
+* in its low bits (a Val is at least 4-byte aligned). Copies of a boxed value hold one reference the way
+* a PTR(Val) would, only the std::shared_ptr build also keeps the owning pointer (VALUE_KEEPS_BOX)
+*/
+class Value {
+public:
+    Value() : word(value_none) {}
+    Value(PTR(Val) val);
+#if !VALUE_KEEPS_BOX
+    Value(const Value &other) : word(other.word) {
+        if ( tag() == value_boxed ) {
+            retain();
+        }
+    }
+    Value(Value &&other) : word(other.word) { other.word = value_none; }
+    ~Value() {
+        if ( tag() == value_boxed ) {
+            release();
+        }
+    }
+    Value &operator=(Value other) {
+        std::swap(this->word, other.word);
+        return *this;
+    }
+#endif
+    static Value num(int n);
+    static Value boolean(bool b);
+    static Value function(PTR(Val) fun);
+
+    /**
+    * \brief what the value holds
+    */
+    value_tag_t tag() const { return (value_tag_t)(this->word & 3); }
+    bool is_none() const { return tag() == value_none; }
+    bool is_num() const { return tag() == value_num; }
+    bool is_bool() const { return tag() == value_bool; }
+
+    /**
+    * \brief payload of a number or boolean
+    */
+    int num_value() const { return (int)(uint32_t)(this->word >> 32); }
+    bool bool_value() const { return (this->word >> 32) != 0; }
+
+    /**
+    * \brief the boxed Val without touching its count, nullptr unless tag() is value_boxed
+    */
+    Val *raw_boxed() const {
+        return tag() == value_boxed ? (Val *)(uintptr_t)(this->word & ~(uint64_t)3) : nullptr;
+    }
+    PTR(Val) boxed() const;
+
+    PTR(Val) to_val() const;
+    Value add_to(const Value &v) const;
+    Value mult_with(const Value &v) const;
+    bool equals(const Value &v) const;
+    bool is_true() const;
+    Value call(const Value &actual_arg) const;
+    Value call_step(const Value &actual_arg, PTR(Env) &env, PTR(Expr) &tail) const;
+    void apply(Cek &cek, const Value &actual_arg) const;
+    void print(std::ostream &ostream) const;
+    std::string to_string() const;
+    void trace(GcHeap &heap) const;
+
+private:
+    uint64_t word;///< tag in the low 2 bits, number or boolean in the high 32, or the pointer of a boxed Val
+#if VALUE_KEEPS_BOX
+    PTR(Val) box;///< owns the Val of a boxed value
+#endif
+
+    void hold(PTR(Val) val);
+#if USE_GC_POINTERS || USE_PLAIN_POINTERS
+    void retain() const {}
+    void release() const {}
+#else
+    void retain() const;
+    void release() const;
+#endif
+};
+
+#endif /* value_hpp */
@@ -0,0 +1,495 @@
+/**
+* \file vm.cpp
+* \brief contains bytecode compiler and stack vm implementations
+        Expr trees are compiled once into chunks of flat instructions with every variable
+        resolved to a frame slot or a captured value, then run by a loop over an explicit
+        value stack instead of recursive interp() calls
+*/
+
+#include "vm.hpp"
+#include "Expr.hpp"
+#include "cek.hpp"
+#include "Env.hpp"
+#include "traverse.hpp"
+#include <stdexcept>
+
+//**********************COMPILER CLASS IMPLEMENTATIONS *********************************
+
+/**
+* \brief constructor to make a scope for one chunk
+* \param chunk index of the chunk being compiled
+* \param enclosing scope of the surrounding function
+*/
+Compiler::Scope::Scope(int chunk, Scope *enclosing) {
+    this->chunk = chunk;
+    this->max_locals = 0;
+    this->enclosing = enclosing;
+}
+
+/**
+* \brief constructor to make a compiler writing into bytecode
+* \param bytecode empty bytecode to fill in
+*/
+Compiler::Compiler(Bytecode &bytecode) : bytecode(bytecode) {
+    this->scope = nullptr;
+}
+
+/*! \brief has each node walk() goes through emit its code around its children */
+class Compiler::Visitor : public ExprVisitor {
+public:
+    Compiler &compiler;///< compiler the nodes emit into
+
+    Visitor(Compiler &compiler) : compiler(compiler) { }
+
+    bool enter(Expr *e) {
+        e->compile_part(compiler, 0);
+        return e->arity() > 0;
+    }
+    void between(Expr *e, int i) { e->compile_part(compiler, i); }
+    void leave(Expr *e) { e->compile_part(compiler, e->arity()); }
+};
+
+/**
+* \brief compiles expr as chunk 0, the code run first by the vm
+* \param expr expression to compile
+*/
+void Compiler::top_level(PTR(Expr) const &expr) {
+    scopes.emplace_back(0, nullptr);
+    scope = &scopes.back();
+    bytecode.chunks.push_back(Chunk());
+    bytecode.chunks[0].body = expr;
+    Visitor visitor(*this);
+    walk(RAW(expr), visitor);
+    emit(op_return);
+    mark_tail_calls();
+    bytecode.chunks[0].num_locals = scope->max_locals;
+    scopes.pop_back();
+    scope = nullptr;
+}
+
+/**
+* \brief appends an instruction to the chunk being compiled
+* \param op instruction to append
+* \param arg operand of op
+* \return position of the instruction, used to patch jumps
+*/
+int Compiler::emit(opcode_t op, int arg) {
+    std::vector<Instr> &code = bytecode.chunks[scope->chunk].code;
+    Instr instr = { op, arg };
+    code.push_back(instr);
+    return (int)code.size() - 1;
+}
+
+/**
+* \brief points the jump at position at to the next instruction emitted
+* \param at position returned by emit for the jump
+*/
+void Compiler::patch(int at) {
+    std::vector<Instr> &code = bytecode.chunks[scope->chunk].code;
+    code[at].arg = (int)code.size();
+}
+
+/**
+* \brief keeps a jump until the code it skips is compiled
+* \param at position returned by emit for the jump
+*/
+void Compiler::push_jump(int at) {
+    jumps.push_back(at);
+}
+
+/**
+* \brief takes back the jump push_jump() kept last
+* \return position of the jump, to patch
+*/
+int Compiler::pop_jump() {
+    int at = jumps.back();
+    jumps.pop_back();
+    return at;
+}
+
+/**
+* \brief emits a load of variable name from a local slot or a captured value
+* \param name variable to load
+* \throws std::runtime_error if no scope binds name, so an unbound variable is reported before anything runs
+*/
+void Compiler::var(Symbol name) {
+    int slot = resolve_local(scope, name);
+    if ( slot >= 0 ) {
+        emit(op_local, slot);
+        return;
+    }
+    int index = resolve_capture(scope, name);
+    if ( index >= 0 ) {
+        emit(op_captured, index);
+        return;
+    }
+    throw std::runtime_error("free variable: " + name.str());
+}
+
+/**
+* \brief makes name visible to the code compiled next
+* \param name variable being bound
+* \return frame slot holding the variable
+*/
+int Compiler::bind(Symbol name) {
+    scope->locals.push_back(name);
+    int slot = (int)scope->locals.size() - 1;
+    if ( slot + 1 > scope->max_locals ) {
+        scope->max_locals = slot + 1;
+    }
+    return slot;
+}
+
+/**
+* \brief ends the innermost binding, its slot is reused by the next bind
+*/
+void Compiler::unbind() {
+    scope->locals.pop_back();
+}
+
+/**
+* \brief opens a new chunk that the body of a function is compiled into next
+* \param formal_arg variable bound to the actual arg, lives in slot 0
+* \param body expression run by calls of the closure
+*/
+void Compiler::open_fun(Symbol formal_arg, PTR(Expr) const &body) {
+    int index = (int)bytecode.chunks.size();
+    bytecode.chunks.push_back(Chunk());
+    bytecode.chunks[index].formal_arg = formal_arg;
+    bytecode.chunks[index].body = body;
+
+    scopes.emplace_back(index, scope);
+    scope = &scopes.back();
+    bind(formal_arg);
+}
+
+/**
+* \brief ends the chunk open_fun() opened and emits code that makes a closure of it in the enclosing chunk
+*/
+void Compiler::close_fun() {
+    emit(op_return);
+    mark_tail_calls();
+    int index = scope->chunk;
+    bytecode.chunks[index].num_locals = scope->max_locals;
+    scope = scope->enclosing;
+    scopes.pop_back();
+
+    emit(op_closure, index);
+}
+
+/**
+* \brief turns calls whose result is returned straight away into tail calls in the chunk being compiled
+    jumps that only lead to a return become returns first, so calls at the end of _then branches count too
+*/
+void Compiler::mark_tail_calls() {
+    std::vector<Instr> &code = bytecode.chunks[scope->chunk].code;
+    for ( size_t i = 0; i < code.size(); i++ ) {
+        if ( code[i].op != op_jump ) {
+            continue;
+        }
+        int target = code[i].arg;
+        while ( code[target].op == op_jump ) {
+            target = code[target].arg;
+        }
+        if ( code[target].op == op_return ) {
+            code[i].op = op_return;
+        }
+    }
+    for ( size_t i = 0; i + 1 < code.size(); i++ ) {
+        if ( code[i].op == op_call && code[i + 1].op == op_return ) {
+            code[i].op = op_tail_call;
+        }
+    }
+}
+
+/**
+* \brief finds the innermost slot bound to name in scope s
+* \return slot or -1 if name is not a local of s
+*/
+int Compiler::resolve_local(Scope *s, Symbol name) {
+    for ( int i = (int)s->locals.size() - 1; i >= 0; i-- ) {
+        if ( s->locals[i] == name ) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+* \brief finds or adds a captured value for name in scope s, recursing through enclosing scopes
+* \return capture index or -1 if no enclosing scope binds name
+*/
+int Compiler::resolve_capture(Scope *s, Symbol name) {
+    if ( s->enclosing == nullptr ) {
+        return -1;
+    }
+    for ( size_t i = 0; i < s->capture_names.size(); i++ ) {
+        if ( s->capture_names[i] == name ) {
+            return (int)i;
+        }
+    }
+
+    Capture capture;
+    capture.index = resolve_local(s->enclosing, name);
+    capture.from_local = capture.index >= 0;
+    if ( !capture.from_local ) {
+        capture.index = resolve_capture(s->enclosing, name);
+        if ( capture.index < 0 ) {
+            return -1;
+        }
+    }
+    bytecode.chunks[s->chunk].captures.push_back(capture);
+    s->capture_names.push_back(name);
+    return (int)s->capture_names.size() - 1;
+}
+
+//**********************BYTECODE CLASS IMPLEMENTATIONS *********************************
+
+/**
+* \brief compiles an expression tree to bytecode
+* \param expr expression to compile
+* \return bytecode ready for vm_run
+*/
+std::shared_ptr<Bytecode> Bytecode::compile(PTR(Expr) const &expr) {
+    std::shared_ptr<Bytecode> bytecode = std::make_shared<Bytecode>();
+    Compiler compiler(*bytecode);
+    compiler.top_level(expr);
+    return bytecode;
+}
+
+//**********************VMFUNVAL CLASS IMPLEMENTATIONS *********************************
+
+/**
+* \brief constructor to make a closure over a compiled chunk
+* \param program bytecode owning the chunk
+* \param chunk index of the compiled body
+* \param captured values of the body's free variables
+*/
+VmFunVal::VmFunVal(std::shared_ptr<const Bytecode> program, int chunk, std::vector<Value> captured)
+    : FunVal(program->chunks[chunk].formal_arg, program->chunks[chunk].body) {
+    this->program = std::move(program);
+    this->chunk = chunk;
+    this->captured = std::move(captured);
+}
+
+//**********************VM IMPLEMENTATION **********************************************
+
+/*! \brief activation record of a running chunk
+* the callee sits in stack[base - 1] and keeps closure alive, locals start at stack[base]
+*/
+struct Frame {
+    const Chunk *chunk;///< code being run
+    size_t pc;///< next instruction
+    size_t base;///< stack index of slot 0
+    VmFunVal *closure;///< running closure, nullptr for chunk 0
+    const std::shared_ptr<const Bytecode> *program;///< bytecode owning chunk
+};
+
+/*! \brief root set of a running execute()
+* every closure, argument and temporary of the running chunks sits on the value stack
+*/
+struct StackRoots : public GcRoots {
+    const std::vector<Value> &stack;///< value stack of the run
+
+    StackRoots(const std::vector<Value> &stack) : GcRoots(GcHeap::current()), stack(stack) {}
+
+    void trace_roots(GcHeap &heap) const {
+        for (size_t i = 0; i < stack.size(); i++) {
+            stack[i].trace(heap);
+        }
+    }
+};
+
+/**
+* \brief runs a chunk until it returns, calls between vm closures push frames instead of recursing
+* \param program bytecode owning the chunk
+* \param chunk index of the chunk to run
+* \param callee closure being called, nullptr for chunk 0
+* \param actual_arg value for slot 0, unused for chunk 0
+* \return value returned by the chunk
+*/
+static Value execute(const std::shared_ptr<const Bytecode> &program, int chunk, const Value &callee, const Value &actual_arg) {
+
+    std::vector<Value> stack;
+    std::vector<Frame> frames;
+    StackRoots roots(stack);
+
+    Frame frame;
+    frame.chunk = &program->chunks[chunk];
+    frame.pc = 0;
+    frame.closure = static_cast<VmFunVal*>(callee.raw_boxed());
+    frame.program = frame.closure != nullptr ? &frame.closure->program : &program;
+    stack.push_back(callee);
+    frame.base = stack.size();
+    if ( frame.closure != nullptr ) {
+        stack.push_back(actual_arg);
+    }
+    stack.resize(frame.base + frame.chunk->num_locals);
+
+    while (1) {
+        const Instr &instr = frame.chunk->code[frame.pc++];
+        switch (instr.op) {
+            case op_num:
+                stack.push_back(Value::num(instr.arg));
+                break;
+            case op_bool:
+                stack.push_back(Value::boolean(instr.arg != 0));
+                break;
+            case op_local:
+                stack.push_back(stack[frame.base + instr.arg]);
+                break;
+            case op_captured:
+                stack.push_back(frame.closure->captured[instr.arg]);
+                break;
+            case op_store:
+                stack[frame.base + instr.arg] = stack.back();
+                stack.pop_back();
+                break;
+            case op_add: {
+                Value rhs = stack.back();
+                stack.pop_back();
+                stack.back() = stack.back().add_to(rhs);
+                break;
+            }
+            case op_mult: {
+                Value rhs = stack.back();
+                stack.pop_back();
+                stack.back() = stack.back().mult_with(rhs);
+                break;
+            }
+            case op_eq: {
+                Value rhs = stack.back();
+                stack.pop_back();
+                stack.back() = Value::boolean(stack.back().equals(rhs));
+                break;
+            }
+            case op_jump:
+                frame.pc = instr.arg;
+                break;
+            case op_jump_if_false: {
+                bool test = stack.back().is_true();
+                stack.pop_back();
+                if ( !test ) {
+                    frame.pc = instr.arg;
+                }
+                break;
+            }
+            case op_closure: {
+                const Chunk &target = (*frame.program)->chunks[instr.arg];
+                std::vector<Value> captured;
+                captured.reserve(target.captures.size());
+                for ( size_t i = 0; i < target.captures.size(); i++ ) {
+                    const Capture &capture = target.captures[i];
+                    if ( capture.from_local ) {
+                        captured.push_back(stack[frame.base + capture.index]);
+                    }
+                    else {
+                        captured.push_back(frame.closure->captured[capture.index]);
+                    }
+                }
+                stack.push_back(Value::function(NEW(VmFunVal)(*frame.program, instr.arg, captured)));
+                break;
+            }
+            case op_call: {
+                GcHeap::safe_point();
+                VmFunVal *fun = dynamic_cast<VmFunVal*>(stack[stack.size() - 2].raw_boxed());
+                if ( fun == nullptr ) {
+                    Value arg = stack.back();
+                    stack.pop_back();
+                    stack.back() = stack.back().call(arg);
+                    break;
+                }
+                frames.push_back(frame);
+                frame.chunk = &fun->program->chunks[fun->chunk];
+                frame.pc = 0;
+                frame.closure = fun;
+                frame.program = &fun->program;
+                frame.base = stack.size() - 1;
+                stack.resize(frame.base + frame.chunk->num_locals);
+                break;
+            }
+            case op_tail_call: {
+                GcHeap::safe_point();
+                VmFunVal *fun = dynamic_cast<VmFunVal*>(stack[stack.size() - 2].raw_boxed());
+                if ( fun == nullptr ) {
+                    Value arg = stack.back();
+                    stack.pop_back();
+                    stack.back() = stack.back().call(arg);
+                    break;
+                }
+                //the op_return after this instruction is skipped, the callee returns for us
+                Value callee = stack[stack.size() - 2];
+                Value arg = stack.back();
+                stack.resize(frame.base - 1);
+                stack.push_back(callee);
+                stack.push_back(arg);
+                frame.chunk = &fun->program->chunks[fun->chunk];
+                frame.pc = 0;
+                frame.closure = fun;
+                frame.program = &fun->program;
+                stack.resize(frame.base + frame.chunk->num_locals);
+                break;
+            }
+            case op_return: {
+                Value result = stack.back();
+                stack.resize(frame.base - 1);
+                if ( frames.empty() ) {
+                    return result;
+                }
+                stack.push_back(result);
+                frame = frames.back();
+                frames.pop_back();
+                break;
+            }
+        }
+    }
+}
+
+/**
+* \brief calls the compiled body with actual_arg in slot 0
+* \param actual_arg Val to bind to formal_arg
+* \return result of running the body
+*/
+PTR(Val) VmFunVal::call(PTR(Val) const &actual_arg) {
+    GcNoCollection native_caller;
+    return execute(program, chunk, Value::function(THIS), Value(actual_arg)).to_val();
+}
+
+/**
+* \brief calls 'this' from the CEK machine, the body only exists as bytecode so it runs on the vm
+* \param cek machine to give the result to
+* \param actual_arg value to bind to formal_arg
+*/
+void VmFunVal::apply(Cek &cek, const Value &actual_arg) {
+    GcNoCollection native_caller;
+    cek.ret(execute(program, chunk, Value::function(THIS), actual_arg));
+}
+
+/**
+* \brief marks the captured values and the environment
+* \param heap heap collecting
+*/
+void VmFunVal::trace(GcHeap &heap) const {
+    FunVal::trace(heap);
+    for (size_t i = 0; i < captured.size(); i++) {
+        captured[i].trace(heap);
+    }
+}
+
+/**
+* \brief runs chunk 0 of compiled bytecode
+* \param program bytecode made by Bytecode::compile
+* \return value of the compiled expression
+*/
+PTR(Val) vm_run(const std::shared_ptr<const Bytecode> &program) {
+    return execute(program, 0, Value(), Value()).to_val();
+}
+
+/**
+* \brief compiles an expression and runs it on the vm, the bytecode alternative to Expr::interp
+* \param expr expression to evaluate
+* \return Val object result of the expression
+*/
+PTR(Val) vm_interp(PTR(Expr) const &expr) {
+    return vm_run(Bytecode::compile(expr));
+}
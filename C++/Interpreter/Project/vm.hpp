@@ -0,0 +1,122 @@
+/**
+* \file vm.hpp
+* \brief contains bytecode, compiler and stack vm declarations
+*/
+
+#ifndef vm_hpp
+#define vm_hpp
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <memory>
+#include "pointer.hpp"
+#include "Val.hpp"
+
+class Expr;
+
+/*! \brief custom enum of bytecode instructions
+* the meaning of each instruction's arg is listed next to it
+*/
+typedef enum {
+    op_num,             ///< push NumVal of arg
+    op_bool,            ///< push BoolVal of arg
+    op_local,           ///< push local slot arg
+    op_captured,        ///< push captured value arg of the running closure
+    op_store,           ///< pop into local slot arg
+    op_add,             ///< pop rhs and lhs, push lhs + rhs
+    op_mult,            ///< pop rhs and lhs, push lhs * rhs
+    op_eq,              ///< pop rhs and lhs, push lhs == rhs
+    op_jump,            ///< jump to arg
+    op_jump_if_false,   ///< pop test, jump to arg if it is false
+    op_closure,         ///< push closure for chunk arg
+    op_call,            ///< pop actual arg and function, push result of call
+    op_tail_call,       ///< pop actual arg and function, replace the running frame with the call
+    op_return           ///< pop result and return it to the caller
+} opcode_t;
+
+/*! \brief single bytecode instruction */
+struct Instr {
+    opcode_t op;///< what to do
+    int arg;///< operand of op, unused by some instructions
+};
+
+/*! \brief where a closure copies one of its captured values from when it is made */
+struct Capture {
+    bool from_local;///< true for a local slot of the enclosing chunk, false for one of its captures
+    int index;///< slot or capture index in the enclosing chunk
+};
+
+/*! \brief compiled code of one function body, chunk 0 is the top level expression */
+struct Chunk {
+    std::vector<Instr> code;///< instructions of the chunk
+    int num_locals;///< frame slots used by the chunk, slot 0 is formal_arg
+    std::vector<Capture> captures;///< values copied into closures of this chunk
+    Symbol formal_arg;///< variable bound to the actual arg
+    PTR(Expr) body;///< source of the chunk, kept for printing and equality
+};
+
+class Bytecode {
+public:
+    std::vector<Chunk> chunks;///< chunk 0 is the top level, the rest are function bodies
+
+    static std::shared_ptr<Bytecode> compile(PTR(Expr) const &expr);
+};
+
+/*! \brief fills in a Bytecode, walk() goes through the expression with an explicit stack and every node
+* calls into here through Expr::compile_part() before, between and after its children, so nesting depth
+* costs heap, not native stack
+*/
+class Compiler {
+public:
+    Compiler(Bytecode &bytecode);
+    void top_level(PTR(Expr) const &expr);
+    int emit(opcode_t op, int arg = 0);
+    void patch(int at);
+    void push_jump(int at);
+    int pop_jump();
+    void var(Symbol name);
+    int bind(Symbol name);
+    void unbind();
+    void open_fun(Symbol formal_arg, PTR(Expr) const &body);
+    void close_fun();
+
+private:
+    /*! \brief compile time view of the function body being compiled */
+    struct Scope {
+        int chunk;///< chunk receiving instructions
+        std::vector<Symbol> locals;///< visible bindings, innermost last, position is the slot
+        std::vector<Symbol> capture_names;///< names matching the chunk's captures
+        int max_locals;///< high water mark of live slots
+        Scope *enclosing;///< scope of the surrounding function, nullptr at top level
+
+        Scope(int chunk, Scope *enclosing);
+    };
+    class Visitor;
+
+    Bytecode &bytecode;///< bytecode being filled in
+    std::deque<Scope> scopes;///< open scopes, outermost first, a deque so enclosing pointers stay valid
+    Scope *scope;///< innermost scope
+    std::vector<int> jumps;///< jumps of the open nodes waiting for the position they land on
+
+    void mark_tail_calls();
+    int resolve_local(Scope *s, Symbol name);
+    int resolve_capture(Scope *s, Symbol name);
+};
+
+class VmFunVal : public FunVal {
+public:
+    std::shared_ptr<const Bytecode> program;///< bytecode owning the chunk
+    int chunk;///< index of the compiled body
+    std::vector<Value> captured;///< values of the body's free variables
+
+    VmFunVal(std::shared_ptr<const Bytecode> program, int chunk, std::vector<Value> captured);
+    PTR(Val) call(PTR(Val) const &actual_arg);
+    void apply(Cek &cek, const Value &actual_arg);
+    void trace(GcHeap &heap) const;
+};
+
+PTR(Val) vm_run(const std::shared_ptr<const Bytecode> &program);
+PTR(Val) vm_interp(PTR(Expr) const &expr);
+
+#endif /* vm_hpp */